@@ -41,19 +41,65 @@
 #include <stdbool.h>
 #include <cart/api.h>
 
+struct iof_bulk_arena;
+
 struct iof_local_bulk {
-	void		*buf;
-	crt_bulk_t	 handle;
-	size_t		 len;
+	void			*buf;
+	crt_bulk_t		 handle;
+	size_t			 len;
+	/* Offset of buf within handle, non-zero for arena buffers which
+	 * share a single registration so must be used as the local or
+	 * remote offset of any transfer.
+	 */
+	size_t			 offset;
+	/* Arena the buffer was allocated from, or NULL */
+	struct iof_bulk_arena	*arena;
 };
 
 bool iof_bulk_alloc(crt_context_t ctx, void *ptr, off_t bulk_offset, size_t len,
 		    bool read_only);
 void iof_bulk_free(void *ptr, off_t bulk_offset);
 
+/* Create an arena of count buffers of slot_size bytes.
+ *
+ * The arena is a single mapping, backed by huge pages where possible, which
+ * is registered once so buffers can be handed out and returned without any
+ * registration.  The mapping is not created until the first buffer is
+ * allocated.  Returns -DER_SUCCESS or a negative error code.
+ */
+int iof_bulk_arena_create(crt_context_t ctx, size_t slot_size, uint32_t count,
+			  bool read_only, struct iof_bulk_arena **arenap);
+
+/* Destroy an arena, all buffers must have been freed */
+void iof_bulk_arena_destroy(struct iof_bulk_arena *arena);
+
+/* Allocate a buffer from an arena, falling back to iof_bulk_alloc() if the
+ * arena is NULL, full or the buffer is too large.  Buffers are released
+ * with iof_bulk_free() as normal.
+ */
+bool iof_bulk_alloc_arena(struct iof_bulk_arena *arena, crt_context_t ctx,
+			  void *ptr, off_t bulk_offset, size_t len,
+			  bool read_only);
+
+/* Return the number of bytes registered for bulk transfers by this process,
+ * and the number of those which are in use by allocated buffers.
+ */
+void iof_bulk_usage(uint64_t *registered, uint64_t *in_use);
+
+/* Set a function to be called for every new bulk mapping before it is
+ * registered, allowing the caller to control NUMA placement of the memory.
+ * Should be set before any buffers are allocated.
+ */
+void iof_bulk_set_placement(void (*place)(void *addr, size_t len, void *arg),
+			    void *arg);
+
 #define IOF_BULK_ALLOC(ctx, ptr, field, len, read_only)			\
 	iof_bulk_alloc((ctx), (ptr), offsetof(__typeof__(*ptr), field),	\
 		       (len), (read_only))
+#define IOF_BULK_ALLOC_ARENA(arena, ctx, ptr, field, len, read_only)	\
+	iof_bulk_alloc_arena((arena), (ctx), (ptr),			\
+			     offsetof(__typeof__(*ptr), field),		\
+			     (len), (read_only))
 #define IOF_BULK_FREE(ptr, field)	\
 	iof_bulk_free((ptr), offsetof(__typeof__(*ptr), field))
 
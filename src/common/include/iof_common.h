@@ -80,6 +80,8 @@
 #define IOF_CNSS_MT			0x080UL
 #define IOF_FUSE_READ_BUF		0x100UL
 #define IOF_FUSE_WRITE_BUF		0x200UL
+#define IOF_READDIR_COMPACT		0x400UL
+#define IOF_IMIGRATE_MULTI		0x800UL
 
 enum iof_projection_mode {
 	/* Private Access Mode */
@@ -136,6 +138,7 @@ struct iof_psr_query {
 	d_iov_t		query_list;
 	uint32_t	count;
 	uint32_t	poll_interval;
+	uint32_t	tag_count;	/* Number of IONSS contexts */
 	bool		progress_callback;
 };
 
@@ -150,6 +153,62 @@ struct iof_imigrate_in {
 	int inode;
 };
 
+/* Batched inode migration.
+ *
+ * If a projection has IOF_IMIGRATE_MULTI set then after failover the client
+ * may migrate its inodes in batches rather than with one imigrate RPC per
+ * inode.  The client bulk buffer holds count packed entries, len bytes in
+ * total, followed at IOF_IMIGRATE_RES_OFFSET(len) by space for count
+ * iof_imigrate_res, which the server fills in and pushes back.  Each
+ * entry is:
+ *
+ *	struct ios_gah	parent GAH, only used if the parent index is -1
+ *	uint64_t	inode number
+ *	int32_t		index of the parent in this batch, or -1
+ *	uint32_t	name length, zero if the name should not be used
+ *	char		name, not NULL terminated
+ *
+ * Parents must appear in the batch before their children.
+ */
+#define IOF_IMIGRATE_BULK_SIZE		(1024 * 1024)
+#define IOF_IMIGRATE_MAX_COUNT		8192
+#define IOF_IMIGRATE_RES_OFFSET(LEN)	(((LEN) + 7) & ~(size_t)7)
+
+struct iof_imigrate_ent {
+	struct ios_gah gah;
+	uint64_t inode;
+	int32_t parent;
+	char name[NAME_MAX + 1];
+};
+
+struct iof_imigrate_res {
+	struct ios_gah gah;
+	int32_t rc;
+	int32_t err;
+};
+
+struct iof_imigrate_multi_in {
+	struct ios_gah gah;
+	crt_bulk_t bulk;
+	uint64_t len;
+	uint32_t count;
+};
+
+/* Return the encoded size of an entry */
+size_t iof_imigrate_ent_size(const struct iof_imigrate_ent *);
+
+/* Encode one entry into buf, returning the number of bytes used or 0 if it
+ * does not fit.
+ */
+size_t iof_imigrate_encode(const struct iof_imigrate_ent *, void *buf,
+			   size_t len);
+
+/* Decode count entries from buf, returns -DER_PROTO if buf is too short or
+ * an entry is malformed.
+ */
+int iof_imigrate_decode(const void *buf, size_t len, int count,
+			struct iof_imigrate_ent *);
+
 struct iof_string_out {
 	d_string_t path;
 	int rc;
@@ -228,6 +287,7 @@ struct iof_readdir_in {
 	struct ios_gah gah;
 	crt_bulk_t bulk;
 	uint64_t offset;
+	uint32_t flags;
 };
 
 /* Each READDIR rpc contains an array of these */
@@ -239,6 +299,43 @@ struct iof_readdir_reply {
 	int stat_rc;
 };
 
+/* Compact readdir encoding.
+ *
+ * If a projection has IOF_READDIR_COMPACT set then the client may also set
+ * it in iof_readdir_in.flags, in which case the replies are sent as a packed
+ * sequence of variable length entries rather than an array of
+ * iof_readdir_reply.  Each entry is:
+ *
+ *	uint64_t	inode number
+ *	uint32_t	mode
+ *	uint16_t	stat_rc, or read_rc if IOF_READDIR_ENT_READ_ERR is set
+ *	uint8_t		flags
+ *	uint8_t		name length
+ *	varint		nextoff, as a zig-zag encoded delta from the previous
+ *			entry, or from the requested offset for the first
+ *	char		name, not NULL terminated
+ *
+ * Only the inode number and mode are sent as that is all that is used to
+ * populate a FUSE readdir reply.  Replies which fit in
+ * IOF_READDIR_INLINE_SIZE are sent inline, otherwise by bulk.
+ */
+#define IOF_READDIR_ENT_READ_ERR	0x1
+#define IOF_READDIR_ENT_MIN		18
+#define IOF_READDIR_INLINE_SIZE		2048
+
+/* Return the encoded size of a reply, given the offset of the previous one */
+size_t iof_readdir_ent_size(const struct iof_readdir_reply *, off_t prev);
+
+/* Encode as many replies as will fit into buf, returning the number of bytes
+ * used.
+ */
+size_t iof_readdir_encode(const struct iof_readdir_reply *, int count,
+			  off_t base, void *buf, size_t len);
+
+/* Decode count replies from buf, returns -DER_PROTO if buf is too short */
+int iof_readdir_decode(const void *buf, size_t len, int count, off_t base,
+		       struct iof_readdir_reply *);
+
 struct iof_readdir_out {
 	d_iov_t replies;
 	int last;
@@ -253,6 +350,14 @@ struct iof_open_out {
 	int err;
 };
 
+/* Maximum number of extents in a vectored read or write.
+ *
+ * For a vectored request xtvec_len is the number of extents in xtvec_bulk,
+ * and xtvec is set to the offset of the first extent and the total length.
+ * The data for all extents is packed, in order, in data_bulk.
+ */
+#define IOF_XTVEC_MAX 1024
+
 struct iof_readx_in {
 	struct ios_gah gah;
 	struct iof_xtvec xtvec;
@@ -260,6 +365,8 @@ struct iof_readx_in {
 	uint64_t bulk_len;
 	crt_bulk_t xtvec_bulk;
 	crt_bulk_t data_bulk;
+	/* Offset of the data within data_bulk */
+	uint64_t data_bulk_off;
 };
 
 struct iof_readx_out {
@@ -293,6 +400,8 @@ struct iof_writex_in {
 	uint64_t bulk_len;
 	crt_bulk_t xtvec_bulk;
 	crt_bulk_t data_bulk;
+	/* Offset of the data within data_bulk */
+	uint64_t data_bulk_off;
 };
 
 struct iof_writex_out {
@@ -310,6 +419,34 @@ struct iof_setattr_in {
 	uint32_t to_set;
 };
 
+/* Allocate, punch or zero a range of an open file, mode takes the
+ * fallocate() FALLOC_FL_* flags.
+ */
+struct iof_fallocate_in {
+	struct ios_gah gah;
+	uint64_t offset;
+	uint64_t len;
+	uint32_t mode;
+};
+
+/* Copy a range between two open files on the IONSS.  The server may copy
+ * less than requested, the number of bytes copied is returned in len.
+ */
+struct iof_copy_range_in {
+	struct ios_gah gah;
+	struct ios_gah dst_gah;
+	uint64_t src_off;
+	uint64_t dst_off;
+	uint64_t len;
+	uint32_t flags;
+};
+
+struct iof_copy_range_out {
+	uint64_t len;
+	int rc;
+	int err;
+};
+
 extern struct crt_req_format QUERY_RPC_FMT;
 
 #define DEF_RPC_TYPE(TYPE) IOF_OPI_##TYPE
@@ -334,16 +471,113 @@ extern struct crt_req_format QUERY_RPC_FMT;
 	X(statfs,	gah_in,		iov_pair)	\
 	X(lookup,	gah_string_in,	entry_out)	\
 	X(setattr,	setattr_in,	attr_out)	\
-	X(imigrate,	imigrate_in,	entry_out)
+	X(imigrate,	imigrate_in,	entry_out)	\
+	X(imigrate_multi, imigrate_multi_in, status_out) \
+	X(copy_range,	copy_range_in,	copy_range_out)	\
+	X(fallocate,	fallocate_in,	status_out)
 
 #define X(a, b, c) DEF_RPC_TYPE(a),
 
 enum {
 	IOF_RPCS_LIST
+	IOF_RPC_COUNT
 };
 
 #undef X
 
+/* IONSS statistics, as returned by the stats RPC.
+ *
+ * The client passes a bulk handle of at least IOF_STATS_SIZE bytes which
+ * the server fills with a struct iof_ionss_stats followed by projection_count
+ * struct iof_projection_stats.  Counters are cumulative since startup so the
+ * client should report the difference between two samples.
+ *
+ * Latencies are split into time spent queued on the IONSS, time spent in the
+ * backend filesystem and time spent in bulk transfers, and are recorded as
+ * histograms with bucket 0 holding samples of less than 1us, and bucket n
+ * holding samples between 2^(n-1) and 2^n us, with the last bucket holding
+ * everything longer.
+ */
+#define IOF_STATS_BUCKETS		24
+#define IOF_STATS_MAX_PROJECTIONS	64
+
+enum iof_stats_phase {
+	IOF_STATS_QUEUE,
+	IOF_STATS_BACKEND,
+	IOF_STATS_BULK,
+	IOF_STATS_PHASES
+};
+
+struct iof_op_stats {
+	uint64_t	count;
+	uint64_t	samples[IOF_STATS_PHASES];
+	uint64_t	total_ns[IOF_STATS_PHASES];
+	uint64_t	hist[IOF_STATS_PHASES][IOF_STATS_BUCKETS];
+};
+
+/* Wait times are from an operation being queued to a lane to it starting,
+ * and yields count the times a worker left an operation queued because the
+ * lane it yields to was busy.
+ */
+struct iof_lane_stats {
+	uint64_t	ops;
+	uint64_t	wait_ns;
+	uint64_t	max_wait_ns;
+	uint64_t	yields;
+	uint32_t	depth;
+	uint32_t	max_depth;
+};
+
+struct iof_projection_stats {
+	uint64_t	read_bytes;
+	uint64_t	write_bytes;
+	/* Requests waiting for a slot, and slots in use */
+	uint32_t	read_queued;
+	uint32_t	read_active;
+	uint32_t	read_limit;
+	uint32_t	write_queued;
+	uint32_t	write_active;
+	uint32_t	write_limit;
+	/* Block cache counters, zero if the cache is disabled */
+	uint64_t	cache_hits;
+	uint64_t	cache_misses;
+	uint64_t	cache_evictions;
+	uint64_t	cache_invalidations;
+	struct iof_lane_stats	data_lane;
+};
+
+struct iof_ionss_stats {
+	/* Time the sample was taken, in ns from an arbitrary epoch */
+	uint64_t			timestamp;
+	uint32_t			op_count;
+	uint32_t			projection_count;
+	uint32_t			fd_open;
+	uint32_t			fd_max;
+	uint64_t			fd_reopens;
+	uint64_t			fd_evictions;
+	/* Bytes registered for bulk transfers, and in use by buffers */
+	uint64_t			bulk_registered;
+	uint64_t			bulk_in_use;
+	struct iof_lane_stats		meta_lane;
+	struct iof_lane_stats		stat_lane;
+	struct iof_op_stats		ops[IOF_RPC_COUNT];
+	struct iof_projection_stats	projections[];
+};
+
+#define IOF_STATS_SIZE (sizeof(struct iof_ionss_stats) +		\
+			sizeof(struct iof_projection_stats) *		\
+			IOF_STATS_MAX_PROJECTIONS)
+
+struct iof_stats_in {
+	crt_bulk_t bulk;
+	uint64_t len;
+};
+
+struct iof_stats_out {
+	uint64_t len;
+	int err;
+};
+
 int
 iof_register(struct crt_proto_format **proto,
 	     crt_rpc_cb_t handlers[]);
@@ -351,6 +585,9 @@ iof_register(struct crt_proto_format **proto,
 int
 iof_signon_register(crt_rpc_cb_t handlers[]);
 
+/* Opcode index of the stats RPC in the signon protocol */
+#define IOF_SIGNON_STATS	2
+
 int
 iof_signon_query(crt_endpoint_t *tgt_ep,
 		 struct crt_proto_format **proto);
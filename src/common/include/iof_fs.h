@@ -50,9 +50,24 @@ struct iof_service_group {
 	crt_endpoint_t		psr_ep;    /* Server PSR endpoint */
 	ATOMIC uint32_t		pri_srv_rank;  /* Primary Service Rank */
 	uint32_t		grp_id;    /* CNSS defined ionss id */
+	uint32_t		tag_count; /* Number of server contexts */
 	bool			enabled;   /* Indicates group is available */
 };
 
+/* Select the endpoint tag to use for RPCs against a GAH.
+ *
+ * The IONSS runs one CaRT context per progress thread so spread requests
+ * across them, keeping all requests for the same handle on the same context.
+ */
+static inline uint32_t iof_gah_tag(struct iof_service_group *grp,
+				   struct ios_gah *gah)
+{
+	if (grp->tag_count <= 1)
+		return 0;
+
+	return gah->fid % grp->tag_count;
+}
+
 /** Projection specific information held on the client.
  *
  * Shared between CNSS and IL.
@@ -140,6 +140,12 @@ void iof_pool_release(struct iof_pool_type *, void *);
  */
 void iof_pool_restock(struct iof_pool_type *);
 
+/* Change the maximum number of descriptors of a type.  If reduced below the
+ * number already created then existing descriptors are kept but no more are
+ * created.
+ */
+void iof_pool_set_max_desc(struct iof_pool_type *, int max_desc);
+
 /* Reclaim any memory possible across all types
  *
  * Returns true of there are any descriptors in use.
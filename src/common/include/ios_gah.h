@@ -50,11 +50,14 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <gurt/list.h>
 #include <gurt/errno.h>
 #include <gurt/common.h>
 
+#include "iof_atomic.h"
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
 /**
@@ -87,35 +90,63 @@ struct ios_gah {
  * Server side datatype for tracking allocation.
  *
  * Server has a number of these, one per fid which it uses to track in-use
- * handles and create new ones.
+ * handles and create new ones.  Entries are never freed while the store
+ * exists so lookups can access them without holding a lock, validating the
+ * state before and after reading the user pointer.
  */
 struct ios_gah_ent {
 	/** User pointer.  If fid is valid then this contains a user pointer */
-	void		*arg;
-	d_list_t	list;
-	uint64_t	revision;	/**< The latest used revision number */
-	uint64_t	fid;		/**< The ID of this entity */
-	bool		in_use;		/**< Is this fid currently in-use */
+	void * ATOMIC	arg;
+	/** The latest used revision number, shifted left by one, with the
+	 * bottom bit set if this fid is currently in-use
+	 */
+	ATOMIC uint64_t	state;
+	/** Index of the next free entry plus one, or zero for end of list */
+	ATOMIC uint32_t	next;
+	uint32_t	fid;		/**< The ID of this entity */
+};
+
+/** Number of entries in each segment of the store */
+#define IOS_GAH_SEGMENT_SIZE (1024 * 8)
+
+/** Maximum number of segments, enough to cover the 24 bit fid space */
+#define IOS_GAH_MAX_SEGMENTS ((1 << 24) / IOS_GAH_SEGMENT_SIZE)
+
+/** Number of free lists, threads pick one based on the CPU they run on */
+#define IOS_GAH_FREE_LISTS 16
+
+/**
+ * Head of a lock-free free list.
+ *
+ * The bottom 32 bits are the index of the first entry plus one, the top 32
+ * bits are a counter which is incremented on every update to prevent ABA
+ * problems.  Padded so that each list is on a separate cache line.
+ */
+struct ios_gah_free_list {
+	ATOMIC uint64_t	head;
+	char		pad[56];
 };
 
 /**
  * Structure with dynamically-sized storage to keep the file metadata.
  *
- * This is used on the server only, and is used for allocating
+ * This is used on the server only, and is used for allocating.  All
+ * functions are thread-safe, allocation and lookup do not take any locks
+ * except when the store needs to grow.
  */
 struct ios_gah_store {
+	/** Free lists, one per group of CPUs */
+	struct ios_gah_free_list free_list[IOS_GAH_FREE_LISTS];
 	/** number of fids currently in used */
-	int size;
+	ATOMIC int size;
 	/** total number of fids, whether used and unused */
-	int capacity;
+	ATOMIC int capacity;
 	/** local rank */
 	d_rank_t rank;
-	/** storage for the actual file entries */
-	struct ios_gah_ent *data;
-	/** array of pointers to file entries */
-	struct ios_gah_ent **ptr_array;
-	/** list of available file entries */
-	d_list_t free_list;
+	/** Serialises adding segments to the store */
+	pthread_mutex_t grow_lock;
+	/** Segments of file entries, allocated as the store grows */
+	struct ios_gah_ent * ATOMIC segments[IOS_GAH_MAX_SEGMENTS];
 };
 
 /**
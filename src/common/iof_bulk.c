@@ -39,9 +39,52 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "iof_atomic.h"
 #include "iof_bulk.h"
 #include "log.h"
 
+/* Size of huge pages used for arenas, arenas are rounded up to this */
+#define IOF_BULK_HUGE_PAGE (2 * 1024 * 1024)
+
+struct iof_bulk_arena {
+	pthread_mutex_t	lock;
+	void		*base;
+	size_t		size;
+	crt_bulk_t	handle;
+	size_t		slot_size;
+	uint32_t	count;
+	/* Stack of free slot numbers */
+	uint32_t	*free_slots;
+	uint32_t	free_count;
+	/* The arena is mapped and registered on first use */
+	crt_context_t	ctx;
+	bool		read_only;
+	bool		failed;
+};
+
+/* Bytes registered, and bytes in use by allocated buffers, in this process */
+static ATOMIC uint64_t bulk_registered;
+static ATOMIC uint64_t bulk_in_use;
+
+/* Placement callback for new mappings */
+static void (*bulk_place)(void *addr, size_t len, void *arg);
+static void *bulk_place_arg;
+
+void iof_bulk_set_placement(void (*place)(void *addr, size_t len, void *arg),
+			    void *arg)
+{
+	bulk_place = place;
+	bulk_place_arg = arg;
+}
+
+void iof_bulk_usage(uint64_t *registered, uint64_t *in_use)
+{
+	*registered = atomic_load_consume(&bulk_registered);
+	*in_use = atomic_load_consume(&bulk_in_use);
+}
+
 bool iof_bulk_alloc(crt_context_t ctx, void *ptr, off_t bulk_offset, size_t len,
 		    bool read_only)
 {
@@ -59,6 +102,9 @@ bool iof_bulk_alloc(crt_context_t ctx, void *ptr, off_t bulk_offset, size_t len,
 		return false;
 	}
 
+	if (bulk_place)
+		bulk_place(bulk->buf, len, bulk_place_arg);
+
 	iov.iov_len = len;
 	iov.iov_buf = bulk->buf;
 	iov.iov_buf_len = len;
@@ -79,6 +125,11 @@ bool iof_bulk_alloc(crt_context_t ctx, void *ptr, off_t bulk_offset, size_t len,
 		return false;
 	}
 	bulk->len = len;
+	bulk->offset = 0;
+	bulk->arena = NULL;
+
+	atomic_fetch_add(&bulk_registered, len);
+	atomic_fetch_add(&bulk_in_use, len);
 
 	IOF_TRACE_DEBUG(ptr, "mapped bulk range: %p-%p", bulk->buf,
 			bulk->buf + len - 1);
@@ -116,14 +167,212 @@ static void bulk_free_helper(void *ptr, struct iof_local_bulk *bulk)
 				strerror(errno));
 }
 
+static void arena_slot_free(void *ptr, struct iof_local_bulk *bulk)
+{
+	struct iof_bulk_arena *arena = bulk->arena;
+
+	IOF_TRACE_DEBUG(ptr, "returning arena slot %p", bulk->buf);
+
+	D_MUTEX_LOCK(&arena->lock);
+	arena->free_slots[arena->free_count++] = bulk->offset /
+		arena->slot_size;
+	D_MUTEX_UNLOCK(&arena->lock);
+
+	atomic_fetch_sub(&bulk_in_use, arena->slot_size);
+
+	bulk->arena = NULL;
+	bulk->offset = 0;
+}
+
 void iof_bulk_free(void *ptr, off_t bulk_offset)
 {
 	struct iof_local_bulk *bulk = (ptr + bulk_offset);
 
-	bulk_free_helper(ptr, bulk);
+	if (!bulk->buf)
+		return;
+
+	if (bulk->arena) {
+		arena_slot_free(ptr, bulk);
+	} else {
+		bulk_free_helper(ptr, bulk);
+		atomic_fetch_sub(&bulk_registered, bulk->len);
+		atomic_fetch_sub(&bulk_in_use, bulk->len);
+	}
 
 	bulk->handle = NULL;
 	bulk->buf = NULL;
 	bulk->len = 0;
 }
 
+
+/* Map and register the arena, called with the lock held on first use */
+static int arena_map(struct iof_bulk_arena *arena)
+{
+	d_sg_list_t sgl = {0};
+	d_iov_t iov = {0};
+	int flags = CRT_BULK_RW;
+	int rc;
+
+	arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (arena->base == MAP_FAILED) {
+		/* No huge pages are reserved, so ask for transparent huge
+		 * pages instead.
+		 */
+		arena->base = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena->base == MAP_FAILED) {
+			IOF_TRACE_ERROR(arena, "mmap failed: %s",
+					strerror(errno));
+			arena->base = NULL;
+			return -DER_NOMEM;
+		}
+		madvise(arena->base, arena->size, MADV_HUGEPAGE);
+	}
+
+	if (bulk_place)
+		bulk_place(arena->base, arena->size, bulk_place_arg);
+
+	iov.iov_len = arena->size;
+	iov.iov_buf = arena->base;
+	iov.iov_buf_len = arena->size;
+	sgl.sg_iovs = &iov;
+	sgl.sg_nr = 1;
+
+	if (arena->read_only)
+		flags = CRT_BULK_RO;
+
+	rc = crt_bulk_create(arena->ctx, &sgl, flags, &arena->handle);
+	if (rc) {
+		munmap(arena->base, arena->size);
+		arena->base = NULL;
+		return rc;
+	}
+
+	atomic_fetch_add(&bulk_registered, arena->size);
+
+	IOF_TRACE_DEBUG(arena, "arena of %u slots of %zu bytes: %p-%p",
+			arena->count, arena->slot_size, arena->base,
+			arena->base + arena->size - 1);
+
+	return -DER_SUCCESS;
+}
+
+int iof_bulk_arena_create(crt_context_t ctx, size_t slot_size, uint32_t count,
+			  bool read_only, struct iof_bulk_arena **arenap)
+{
+	struct iof_bulk_arena *arena;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	uint32_t i;
+	int rc;
+
+	*arenap = NULL;
+
+	if (count == 0 || slot_size == 0)
+		return -DER_INVAL;
+
+	D_ALLOC_PTR(arena);
+	if (!arena)
+		return -DER_NOMEM;
+
+	D_ALLOC_ARRAY(arena->free_slots, count);
+	if (!arena->free_slots)
+		D_GOTO(out_free, rc = -DER_NOMEM);
+
+	rc = D_MUTEX_INIT(&arena->lock, NULL);
+	if (rc != -DER_SUCCESS)
+		D_GOTO(out_free, rc);
+
+	/* Keep every slot page aligned so buffers are usable for O_DIRECT */
+	arena->slot_size = (slot_size + page_size - 1) & ~(page_size - 1);
+	arena->count = count;
+	arena->size = arena->slot_size * count;
+	arena->size = (arena->size + IOF_BULK_HUGE_PAGE - 1) &
+		~((size_t)IOF_BULK_HUGE_PAGE - 1);
+	arena->ctx = ctx;
+	arena->read_only = read_only;
+
+	/* Hand out the lowest slots first */
+	for (i = 0; i < count; i++)
+		arena->free_slots[i] = count - i - 1;
+	arena->free_count = count;
+
+	*arenap = arena;
+	return -DER_SUCCESS;
+
+out_free:
+	D_FREE(arena->free_slots);
+	D_FREE(arena);
+	return rc;
+}
+
+void iof_bulk_arena_destroy(struct iof_bulk_arena *arena)
+{
+	struct iof_local_bulk bulk = {0};
+
+	if (!arena)
+		return;
+
+	if (arena->free_count != arena->count) {
+		/* Leak the arena rather than unmap memory which may still
+		 * be in use.
+		 */
+		IOF_TRACE_ERROR(arena, "Destroying arena with %u slots in use",
+				arena->count - arena->free_count);
+		return;
+	}
+
+	if (arena->base) {
+		bulk.buf = arena->base;
+		bulk.handle = arena->handle;
+		bulk.len = arena->size;
+		bulk_free_helper(arena, &bulk);
+
+		atomic_fetch_sub(&bulk_registered, arena->size);
+	}
+
+	pthread_mutex_destroy(&arena->lock);
+	D_FREE(arena->free_slots);
+	D_FREE(arena);
+}
+
+bool iof_bulk_alloc_arena(struct iof_bulk_arena *arena, crt_context_t ctx,
+			  void *ptr, off_t bulk_offset, size_t len,
+			  bool read_only)
+{
+	struct iof_local_bulk *bulk = (ptr + bulk_offset);
+	uint32_t slot;
+	int rc;
+
+	if (!arena || len > arena->slot_size)
+		return iof_bulk_alloc(ctx, ptr, bulk_offset, len, read_only);
+
+	D_MUTEX_LOCK(&arena->lock);
+	if (!arena->base && !arena->failed) {
+		rc = arena_map(arena);
+		if (rc != -DER_SUCCESS) {
+			IOF_TRACE_WARNING(arena, "Could not map arena %d", rc);
+			arena->failed = true;
+		}
+	}
+	if (arena->failed || arena->free_count == 0) {
+		D_MUTEX_UNLOCK(&arena->lock);
+		IOF_TRACE_DEBUG(ptr, "arena not available, registering buffer");
+		return iof_bulk_alloc(ctx, ptr, bulk_offset, len, read_only);
+	}
+	slot = arena->free_slots[--arena->free_count];
+	D_MUTEX_UNLOCK(&arena->lock);
+
+	bulk->offset = slot * arena->slot_size;
+	bulk->buf = arena->base + bulk->offset;
+	bulk->handle = arena->handle;
+	bulk->len = len;
+	bulk->arena = arena;
+
+	atomic_fetch_add(&bulk_in_use, arena->slot_size);
+
+	IOF_TRACE_DEBUG(ptr, "arena slot %u: %p-%p", slot, bulk->buf,
+			bulk->buf + len - 1);
+
+	return true;
+}
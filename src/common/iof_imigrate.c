@@ -0,0 +1,113 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Encoding and decoding of batched inode migration entries, see
+ * iof_common.h
+ */
+
+#include <string.h>
+
+#include "iof_common.h"
+
+/* Size of the fixed part of each entry */
+#define IOF_IMIGRATE_ENT_HDR (sizeof(struct ios_gah) + 16)
+
+size_t iof_imigrate_ent_size(const struct iof_imigrate_ent *ent)
+{
+	return IOF_IMIGRATE_ENT_HDR + strnlen(ent->name, NAME_MAX);
+}
+
+size_t iof_imigrate_encode(const struct iof_imigrate_ent *ent, void *buf,
+			   size_t len)
+{
+	uint8_t *pos = buf;
+	uint32_t name_len = strnlen(ent->name, NAME_MAX);
+
+	if (iof_imigrate_ent_size(ent) > len)
+		return 0;
+
+	memcpy(pos, &ent->gah, sizeof(ent->gah));
+	pos += sizeof(ent->gah);
+	memcpy(pos, &ent->inode, sizeof(ent->inode));
+	memcpy(pos + 8, &ent->parent, sizeof(ent->parent));
+	memcpy(pos + 12, &name_len, sizeof(name_len));
+	pos += 16;
+
+	memcpy(pos, ent->name, name_len);
+	pos += name_len;
+
+	return pos - (uint8_t *)buf;
+}
+
+int iof_imigrate_decode(const void *buf, size_t len, int count,
+			struct iof_imigrate_ent *ents)
+{
+	const uint8_t *pos = buf;
+	const uint8_t *end = pos + len;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct iof_imigrate_ent *ent = &ents[i];
+		uint32_t name_len;
+
+		if ((size_t)(end - pos) < IOF_IMIGRATE_ENT_HDR)
+			return -DER_PROTO;
+
+		memcpy(&ent->gah, pos, sizeof(ent->gah));
+		pos += sizeof(ent->gah);
+		memcpy(&ent->inode, pos, sizeof(ent->inode));
+		memcpy(&ent->parent, pos + 8, sizeof(ent->parent));
+		memcpy(&name_len, pos + 12, sizeof(name_len));
+		pos += 16;
+
+		/* Parents must precede their children, which also rules out
+		 * loops.
+		 */
+		if (ent->parent < -1 || ent->parent >= i)
+			return -DER_PROTO;
+
+		if (name_len > NAME_MAX || (size_t)(end - pos) < name_len)
+			return -DER_PROTO;
+
+		memcpy(ent->name, pos, name_len);
+		ent->name[name_len] = '\0';
+		pos += name_len;
+	}
+
+	return -DER_SUCCESS;
+}
@@ -427,3 +427,13 @@ iof_pool_restock(struct iof_pool_type *type)
 
 	D_MUTEX_UNLOCK(&type->lock);
 }
+
+void
+iof_pool_set_max_desc(struct iof_pool_type *type, int max_desc)
+{
+	D_MUTEX_LOCK(&type->lock);
+	IOF_TRACE_INFO(type, "Descriptor limit %d -> %d", type->reg.max_desc,
+		       max_desc);
+	type->reg.max_desc = max_desc;
+	D_MUTEX_UNLOCK(&type->lock);
+}
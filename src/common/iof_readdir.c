@@ -0,0 +1,177 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Encoding and decoding of the compact readdir format, see iof_common.h */
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "iof_common.h"
+
+/* Size of the fixed part of each entry */
+#define IOF_READDIR_ENT_HDR 16
+
+static size_t varint_size(uint64_t value)
+{
+	size_t len = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		len++;
+	}
+	return len;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+size_t iof_readdir_ent_size(const struct iof_readdir_reply *reply,
+			    off_t prev)
+{
+	return IOF_READDIR_ENT_HDR +
+		varint_size(zigzag(reply->nextoff - prev)) +
+		strnlen(reply->d_name, NAME_MAX);
+}
+
+size_t iof_readdir_encode(const struct iof_readdir_reply *replies, int count,
+			  off_t base, void *buf, size_t len)
+{
+	uint8_t *pos = buf;
+	uint8_t *end = pos + len;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct iof_readdir_reply *reply = &replies[i];
+		uint64_t ino = reply->stat.st_ino;
+		uint32_t mode = reply->stat.st_mode;
+		uint16_t rc = reply->stat_rc;
+		uint8_t flags = 0;
+		uint8_t name_len = strnlen(reply->d_name, NAME_MAX);
+		uint64_t delta;
+
+		if (iof_readdir_ent_size(reply, base) > (size_t)(end - pos))
+			break;
+
+		if (reply->read_rc) {
+			rc = reply->read_rc;
+			flags |= IOF_READDIR_ENT_READ_ERR;
+		}
+
+		memcpy(pos, &ino, sizeof(ino));
+		memcpy(pos + 8, &mode, sizeof(mode));
+		memcpy(pos + 12, &rc, sizeof(rc));
+		pos[14] = flags;
+		pos[15] = name_len;
+		pos += IOF_READDIR_ENT_HDR;
+
+		delta = zigzag(reply->nextoff - base);
+		while (delta >= 0x80) {
+			*pos++ = (delta & 0x7f) | 0x80;
+			delta >>= 7;
+		}
+		*pos++ = delta;
+
+		memcpy(pos, reply->d_name, name_len);
+		pos += name_len;
+
+		base = reply->nextoff;
+	}
+
+	return pos - (uint8_t *)buf;
+}
+
+int iof_readdir_decode(const void *buf, size_t len, int count, off_t base,
+		       struct iof_readdir_reply *replies)
+{
+	const uint8_t *pos = buf;
+	const uint8_t *end = pos + len;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct iof_readdir_reply *reply = &replies[i];
+		uint64_t ino;
+		uint32_t mode;
+		uint16_t rc;
+		uint8_t name_len;
+		uint64_t delta = 0;
+		int shift = 0;
+
+		if (end - pos < IOF_READDIR_ENT_HDR)
+			return -DER_PROTO;
+
+		memcpy(&ino, pos, sizeof(ino));
+		memcpy(&mode, pos + 8, sizeof(mode));
+		memcpy(&rc, pos + 12, sizeof(rc));
+
+		memset(reply, 0, sizeof(*reply));
+		reply->stat.st_ino = ino;
+		reply->stat.st_mode = mode;
+		if (pos[14] & IOF_READDIR_ENT_READ_ERR)
+			reply->read_rc = rc;
+		else
+			reply->stat_rc = rc;
+
+		name_len = pos[15];
+		pos += IOF_READDIR_ENT_HDR;
+
+		do {
+			if (pos == end || shift > 63)
+				return -DER_PROTO;
+			delta |= (uint64_t)(*pos & 0x7f) << shift;
+			shift += 7;
+		} while (*pos++ & 0x80);
+
+		reply->nextoff = base + unzigzag(delta);
+		base = reply->nextoff;
+
+		if (end - pos < name_len)
+			return -DER_PROTO;
+
+		memcpy(reply->d_name, pos, name_len);
+		pos += name_len;
+	}
+
+	return -DER_SUCCESS;
+}
@@ -42,7 +42,7 @@
 
 #define IOF_PROTO_WRITE_BASE 0x01000000
 #define IOF_PROTO_SIGNON_BASE 0x02000000
-#define IOF_PROTO_SIGNON_VERSION 2
+#define IOF_PROTO_SIGNON_VERSION 5
 
 /*
  * Re-use the CMF_UUID type when using a GAH as they are both 128 bit types
@@ -87,6 +87,13 @@ struct crt_msg_field *imigrate_in[] = {
 	&CMF_INT,	/* inode */
 };
 
+struct crt_msg_field *imigrate_multi_in[] = {
+	&CMF_GAH,	/* gah of projection root */
+	&CMF_BULK,	/* entries, and space for results */
+	&CMF_UINT64,	/* length of entries */
+	&CMF_UINT32,	/* entry count */
+};
+
 struct crt_msg_field *string_out[] = {
 	&CMF_STRING,
 	&CMF_INT,
@@ -162,6 +169,7 @@ struct crt_msg_field *readdir_in[] = {
 	&CMF_GAH,
 	&CMF_BULK,
 	&CMF_UINT64,
+	&CMF_UINT32,
 };
 
 struct crt_msg_field *readdir_out[] = {
@@ -176,6 +184,7 @@ struct crt_msg_field *psr_out[] = {
 	&CMF_IOVEC,
 	&CMF_UINT32,
 	&CMF_UINT32,
+	&CMF_UINT32,
 	&CMF_BOOL,
 };
 
@@ -187,6 +196,7 @@ struct crt_msg_field *readx_in[] = {
 	&CMF_UINT64,	/* bulk_len */
 	&CMF_BULK,	/* xtvec_bulk */
 	&CMF_BULK,	/* data_bulk */
+	&CMF_UINT64,	/* data_bulk_off */
 };
 
 struct crt_msg_field *readx_out[] = {
@@ -215,6 +225,7 @@ struct crt_msg_field *writex_in[] = {
 	&CMF_UINT64,
 	&CMF_BULK,
 	&CMF_BULK,
+	&CMF_UINT64,
 };
 
 struct crt_msg_field *writex_out[] = {
@@ -231,9 +242,44 @@ struct crt_msg_field *setattr_in[] = {
 	&CMF_UINT32,	/* to_set */
 };
 
+struct crt_msg_field *fallocate_in[] = {
+	&CMF_GAH,	/* gah */
+	&CMF_UINT64,	/* offset */
+	&CMF_UINT64,	/* length */
+	&CMF_UINT32,	/* mode */
+};
+
+struct crt_msg_field *copy_range_in[] = {
+	&CMF_GAH,	/* source gah */
+	&CMF_GAH,	/* destination gah */
+	&CMF_UINT64,	/* source offset */
+	&CMF_UINT64,	/* destination offset */
+	&CMF_UINT64,	/* length */
+	&CMF_UINT32,	/* flags */
+};
+
+struct crt_msg_field *copy_range_out[] = {
+	&CMF_UINT64,	/* length copied */
+	&CMF_INT,	/* rc */
+	&CMF_INT,	/* err */
+};
+
+struct crt_msg_field *stats_in[] = {
+	&CMF_BULK,	/* bulk */
+	&CMF_UINT64,	/* length of bulk */
+};
+
+struct crt_msg_field *stats_out[] = {
+	&CMF_UINT64,	/* length sent */
+	&CMF_INT,	/* err */
+};
+
 /*query RPC format*/
 struct crt_req_format QUERY_RPC_FMT = DEFINE_CRT_REQ_FMT(NULL, psr_out);
 
+static struct crt_req_format STATS_RPC_FMT = DEFINE_CRT_REQ_FMT(stats_in,
+								stats_out);
+
 #define X(a, b, c)					\
 	static struct crt_req_format IOF_CRF_##a =	\
 		DEFINE_CRT_REQ_FMT(b, c);
@@ -260,6 +306,9 @@ static struct crt_proto_rpc_format iof_signon_rpc_types[] = {
 	},
 	{
 		.prf_flags = CRT_RPC_FEAT_NO_TIMEOUT,
+	},
+	{
+		.prf_req_fmt = &STATS_RPC_FMT,
 	}
 };
 
@@ -273,7 +322,7 @@ static struct crt_proto_format iof_signon_registry = {
 
 static struct crt_proto_format iof_write_registry = {
 	.cpf_name = "IOF_WRITE",
-	.cpf_ver = 2,
+	.cpf_ver = 8,
 	.cpf_count = ARRAY_SIZE(iof_write_rpc_types),
 	.cpf_prf = iof_write_rpc_types,
 	.cpf_base = IOF_PROTO_WRITE_BASE,
@@ -41,56 +41,145 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <sys/types.h>
+#include <sched.h>
 
 #include <gurt/common.h>
 
 #include "include/ios_gah.h"
 
-#define IOS_GAH_STORE_INIT_CAPACITY (1024 * 8)
-#define IOS_GAH_STORE_DELTA (1024 * 8)
 #define IOS_GAH_VERSION 1
 
+#define IOS_GAH_HEAD_INDEX(head) ((uint32_t)((head) & 0xffffffff))
+#define IOS_GAH_HEAD_NEXT(head, index) \
+	(((((head) >> 32) + 1) << 32) | (uint64_t)(index))
+
+#define IOS_GAH_STATE_IN_USE 1
+#define IOS_GAH_STATE_REVISION(state) ((state) >> 1)
+
+/* Return the entry for a fid, or NULL if the fid is not in the store */
+static struct ios_gah_ent *
+ios_gah_ent_get(struct ios_gah_store *gah_store, uint64_t fid)
+{
+	struct ios_gah_ent *segment;
+
+	if (fid >= IOS_GAH_MAX_SEGMENTS * IOS_GAH_SEGMENT_SIZE)
+		return NULL;
+
+	segment = atomic_load_consume(
+		&gah_store->segments[fid / IOS_GAH_SEGMENT_SIZE]);
+	if (!segment)
+		return NULL;
+
+	return &segment[fid % IOS_GAH_SEGMENT_SIZE];
+}
+
+/* Select which free list the calling thread should use */
+static int ios_gah_free_list_idx(void)
+{
+	int cpu = sched_getcpu();
+
+	if (cpu < 0)
+		return 0;
+
+	return cpu % IOS_GAH_FREE_LISTS;
+}
+
+/* Push an entry onto a free list */
+static void ios_gah_push(struct ios_gah_store *gah_store, int idx,
+			 struct ios_gah_ent *ent)
+{
+	struct ios_gah_free_list *list = &gah_store->free_list[idx];
+	uint64_t head;
+
+	do {
+		head = atomic_load_consume(&list->head);
+		atomic_store_release(&ent->next, IOS_GAH_HEAD_INDEX(head));
+	} while (!atomic_compare_exchange(&list->head, head,
+					  IOS_GAH_HEAD_NEXT(head,
+							    ent->fid + 1)));
+}
+
+/* Pop an entry from a free list, returns NULL if the list is empty.
+ *
+ * The entry at the head may be popped and reused by another thread while
+ * this one is reading it, however entries are never freed and the counter
+ * in the head means that the exchange will fail in this case.
+ */
+static struct ios_gah_ent *
+ios_gah_pop(struct ios_gah_store *gah_store, int idx)
+{
+	struct ios_gah_free_list *list = &gah_store->free_list[idx];
+	struct ios_gah_ent *ent;
+	uint64_t head;
+	uint32_t next;
+
+	do {
+		head = atomic_load_consume(&list->head);
+		if (IOS_GAH_HEAD_INDEX(head) == 0)
+			return NULL;
+
+		ent = ios_gah_ent_get(gah_store, IOS_GAH_HEAD_INDEX(head) - 1);
+		next = atomic_load_consume(&ent->next);
+	} while (!atomic_compare_exchange(&list->head, head,
+					  IOS_GAH_HEAD_NEXT(head, next)));
+
+	return ent;
+}
+
 /**
- * Increase the totoal capacity of the gah store by "delta" slots
+ * Add a new segment to the store, and return one entry from it.  The rest
+ * of the entries are added to the free list "idx".
  *
  * \param gah_store	[IN/OUT]	pointer to the gah_store
- * \param delta		[IN]		number of entries to add
+ * \param idx		[IN]		free list to add new entries to
+ * \param entp		[OUT]		a newly allocated entry
  */
 static int
-ios_gah_store_increase_capacity(struct ios_gah_store *gah_store, int delta)
+ios_gah_store_increase_capacity(struct ios_gah_store *gah_store, int idx,
+				struct ios_gah_ent **entp)
 {
-	void *new_array;
+	struct ios_gah_ent *new_data;
+	int capacity;
 	int ii;
 
-	/* allocate more space and copy old data over */
-	struct ios_gah_ent *new_data;
-	int new_cap = gah_store->capacity + delta;
+	D_MUTEX_LOCK(&gah_store->grow_lock);
+
+	/* Another thread may have grown the store while this one was waiting
+	 * for the lock, so check again before adding a segment.
+	 */
+	*entp = ios_gah_pop(gah_store, idx);
+	if (*entp)
+		D_GOTO(out, 0);
 
-	D_ALLOC_ARRAY(new_data, delta);
-	if (new_data == NULL)
+	capacity = atomic_load_consume(&gah_store->capacity);
+	if (capacity / IOS_GAH_SEGMENT_SIZE >= IOS_GAH_MAX_SEGMENTS) {
+		D_MUTEX_UNLOCK(&gah_store->grow_lock);
 		return -DER_NOMEM;
+	}
 
-	D_REALLOC(new_array,
-		  gah_store->ptr_array,
-		  new_cap * sizeof(struct ios_gah_ent));
-	if (!new_array) {
-		D_FREE(new_data);
+	D_ALLOC_ARRAY(new_data, IOS_GAH_SEGMENT_SIZE);
+	if (new_data == NULL) {
+		D_MUTEX_UNLOCK(&gah_store->grow_lock);
 		return -DER_NOMEM;
 	}
 
-	gah_store->ptr_array = new_array;
-	/* setup the pointer array */
-	for (ii = 0; ii < delta; ii++)
-		gah_store->ptr_array[gah_store->capacity + ii] = &new_data[ii];
+	for (ii = 0; ii < IOS_GAH_SEGMENT_SIZE; ii++)
+		new_data[ii].fid = capacity + ii;
 
-	for (ii = gah_store->capacity; ii < gah_store->capacity + delta; ii++) {
-		gah_store->ptr_array[ii]->fid = ii;
+	atomic_store_release(
+		&gah_store->segments[capacity / IOS_GAH_SEGMENT_SIZE],
+		new_data);
+	atomic_store_release(&gah_store->capacity,
+			     capacity + IOS_GAH_SEGMENT_SIZE);
 
-		/* point tail to the new tail */
-		d_list_add_tail(&gah_store->ptr_array[ii]->list,
-				&gah_store->free_list);
-	}
-	gah_store->capacity = new_cap;
+	/* Push in reverse order so that fids are handed out in order */
+	for (ii = IOS_GAH_SEGMENT_SIZE - 1; ii > 0; ii--)
+		ios_gah_push(gah_store, idx, &new_data[ii]);
+
+	*entp = &new_data[0];
+
+out:
+	D_MUTEX_UNLOCK(&gah_store->grow_lock);
 
 	return -DER_SUCCESS;
 }
@@ -123,44 +212,41 @@ static uint8_t my_crc8(uint8_t *data, size_t len)
 }
 
 /*
- * Initialize the gah store. Allocate storage, initialize the pointer array, and
- * setup the linked-lists.
+ * Initialize the gah store. Allocate the first segment and spread it across
+ * the free lists.
  *
  */
 struct ios_gah_store *ios_gah_init(d_rank_t rank)
 {
 	struct ios_gah_store *gah_store;
+	struct ios_gah_ent *data;
+	int rc;
 	int ii;
 
 	D_ALLOC_PTR(gah_store);
 	if (gah_store == NULL)
 		return NULL;
 
-	gah_store->size = 0;
-	gah_store->rank = rank;
-	gah_store->capacity = IOS_GAH_STORE_INIT_CAPACITY;
-	D_ALLOC_ARRAY(gah_store->data, IOS_GAH_STORE_INIT_CAPACITY);
-	if (gah_store->data == NULL) {
+	rc = D_MUTEX_INIT(&gah_store->grow_lock, NULL);
+	if (rc != -DER_SUCCESS) {
 		D_FREE(gah_store);
 		return NULL;
 	}
-	D_ALLOC_ARRAY(gah_store->ptr_array, IOS_GAH_STORE_INIT_CAPACITY);
-	if (gah_store->ptr_array == NULL) {
-		D_FREE(gah_store->data);
+
+	gah_store->rank = rank;
+	D_ALLOC_ARRAY(data, IOS_GAH_SEGMENT_SIZE);
+	if (data == NULL) {
+		D_MUTEX_DESTROY(&gah_store->grow_lock);
 		D_FREE(gah_store);
 		return NULL;
 	}
 
-	D_INIT_LIST_HEAD(&gah_store->free_list);
-
-	/* setup the pointer array */
-	for (ii = 0; ii < IOS_GAH_STORE_INIT_CAPACITY; ii++) {
-		gah_store->ptr_array[ii] = &gah_store->data[ii];
-		gah_store->ptr_array[ii]->fid = ii;
+	gah_store->segments[0] = data;
+	gah_store->capacity = IOS_GAH_SEGMENT_SIZE;
 
-		/* setup the linked list */
-		d_list_add_tail(&gah_store->ptr_array[ii]->list,
-				&gah_store->free_list);
+	for (ii = IOS_GAH_SEGMENT_SIZE - 1; ii >= 0; ii--) {
+		data[ii].fid = ii;
+		ios_gah_push(gah_store, ii % IOS_GAH_FREE_LISTS, &data[ii]);
 	}
 
 	return gah_store;
@@ -168,26 +254,28 @@ struct ios_gah_store *ios_gah_init(d_rank_t rank)
 
 int ios_gah_destroy(struct ios_gah_store *ios_gah_store)
 {
-	int ii = 0;
+	int capacity;
+	int ii;
 
 	if (ios_gah_store == NULL)
 		return -DER_INVAL;
 	/* check for active handles */
-	if (ios_gah_store->size != 0)
+	if (atomic_load_consume(&ios_gah_store->size) != 0)
 		return -DER_BUSY;
 
-	for (ii = 0; ii < ios_gah_store->capacity; ii++)
-		if (ios_gah_store->ptr_array[ii]->in_use)
-			return -DER_BUSY;
+	capacity = atomic_load_consume(&ios_gah_store->capacity);
+	for (ii = 0; ii < capacity; ii++) {
+		struct ios_gah_ent *ent = ios_gah_ent_get(ios_gah_store, ii);
 
-	/* free the chunck allocated on init */
-	D_FREE(ios_gah_store->ptr_array[0]);
-	/* walk down the pointer array, free all memory chuncks */
-	for (ii = IOS_GAH_STORE_INIT_CAPACITY; ii < ios_gah_store->capacity;
-	    ii += IOS_GAH_STORE_DELTA) {
-		D_FREE(ios_gah_store->ptr_array[ii]);
+		if (atomic_load_consume(&ent->state) & IOS_GAH_STATE_IN_USE)
+			return -DER_BUSY;
 	}
-	D_FREE(ios_gah_store->ptr_array);
+
+	/* walk down the segment array, free all memory chuncks */
+	for (ii = 0; ii < capacity / IOS_GAH_SEGMENT_SIZE; ii++)
+		D_FREE(ios_gah_store->segments[ii]);
+
+	D_MUTEX_DESTROY(&ios_gah_store->grow_lock);
 	D_FREE(ios_gah_store);
 
 	return -DER_SUCCESS;
@@ -198,25 +286,37 @@ int ios_gah_allocate_base(struct ios_gah_store *gah_store,
 			  void *arg)
 {
 	struct ios_gah_ent *ent;
-	int rc = -DER_SUCCESS;
+	uint64_t revision;
+	int idx;
+	int ii;
+	int rc;
 
 	if (gah == NULL)
 		return -DER_INVAL;
-	if (d_list_empty(&gah_store->free_list)) {
-		rc = ios_gah_store_increase_capacity(gah_store,
-						     IOS_GAH_STORE_DELTA);
+
+	/* Take one gah from the local free list, or from another list if the
+	 * local one is empty, and grow the store if all lists are empty.
+	 */
+	idx = ios_gah_free_list_idx();
+	for (ii = 0; ii < IOS_GAH_FREE_LISTS; ii++) {
+		ent = ios_gah_pop(gah_store, (idx + ii) % IOS_GAH_FREE_LISTS);
+		if (ent)
+			break;
+	}
+
+	if (!ent) {
+		rc = ios_gah_store_increase_capacity(gah_store, idx, &ent);
 		if (rc != -DER_SUCCESS)
 			return rc;
 	}
 
-	/* take one gah from the head of the list */
-	ent = d_list_pop_entry(&gah_store->free_list, struct ios_gah_ent, list);
+	revision = IOS_GAH_STATE_REVISION(atomic_load_consume(&ent->state))
+		+ 1;
 
-	ent->in_use = true;
-	ent->arg = arg;
+	atomic_store_release(&ent->arg, arg);
 
 	gah->fid = ent->fid;
-	gah->revision = ++ent->revision;
+	gah->revision = revision;
 	gah->reserved = 0;
 	/* setup the gah */
 	gah->version = IOS_GAH_VERSION;
@@ -224,7 +324,11 @@ int ios_gah_allocate_base(struct ios_gah_store *gah_store,
 	gah->base = base;
 	gah->crc = my_crc8((uint8_t *)gah, 120 / 8);
 
-	gah_store->size++;
+	/* Publish the entry, lookups will now succeed */
+	atomic_store_release(&ent->state,
+			     (revision << 1) | IOS_GAH_STATE_IN_USE);
+
+	atomic_inc(&gah_store->size);
 
 	return -DER_SUCCESS;
 }
@@ -238,6 +342,9 @@ int ios_gah_allocate(struct ios_gah_store *gah_store,
 int ios_gah_deallocate(struct ios_gah_store *gah_store,
 		       struct ios_gah *gah)
 {
+	struct ios_gah_ent *ent;
+	uint64_t current;
+	uint64_t state;
 	int ret;
 
 	if (!gah_store)
@@ -250,27 +357,42 @@ int ios_gah_deallocate(struct ios_gah_store *gah_store,
 	ret = ios_gah_check_version(gah);
 	if (ret != -DER_SUCCESS)
 		return ret;
-	if (gah->fid >= gah_store->capacity)
+	if (gah->fid >= atomic_load_consume(&gah_store->capacity))
 		return -DER_OVERFLOW;
-	if (!(gah_store->ptr_array[gah->fid]->in_use))
-		return -DER_NONEXIST;
-	if (gah_store->ptr_array[gah->fid]->revision != gah->revision)
-		return -DER_NONEXIST;
+	ent = ios_gah_ent_get(gah_store, gah->fid);
+	if (!ent)
+		return -DER_OVERFLOW;
+
+	/* Clear the in-use bit, only one caller can succeed here so a double
+	 * free of the same GAH is detected.
+	 */
+	state = ((uint64_t)gah->revision << 1) | IOS_GAH_STATE_IN_USE;
+	do {
+		current = atomic_load_consume(&ent->state);
+		if (current != state)
+			return -DER_NONEXIST;
+	} while (!atomic_compare_exchange(&ent->state, current,
+					  state & ~IOS_GAH_STATE_IN_USE));
 
-	gah_store->ptr_array[gah->fid]->in_use = false;
+	atomic_store_release(&ent->arg, NULL);
 
 	/* append the reclaimed entry to the list of available entires */
-	d_list_add(&gah_store->ptr_array[gah->fid]->list,
-		   &gah_store->free_list);
+	ios_gah_push(gah_store, ios_gah_free_list_idx(), ent);
 
-	gah_store->size--;
+	atomic_fetch_sub(&gah_store->size, 1);
 
 	return -DER_SUCCESS;
 }
 
+/* Lookups do not take any locks, so read the state both before and after
+ * the user pointer and only return it if the entry did not change.
+ */
 int ios_gah_get_info(struct ios_gah_store *gah_store,
 		     struct ios_gah *gah, void **arg)
 {
+	struct ios_gah_ent *ent;
+	uint64_t state;
+	void *value;
 	int ret;
 
 	if (!arg)
@@ -288,13 +410,22 @@ int ios_gah_get_info(struct ios_gah_store *gah_store,
 		return ret;
 	if (gah_store->rank != gah->root)
 		return -DER_INVAL;
-	if (gah->fid >= gah_store->capacity)
+	ent = ios_gah_ent_get(gah_store, gah->fid);
+	if (!ent)
 		return -DER_OVERFLOW;
-	if (!(gah_store->ptr_array[gah->fid]->in_use))
+
+	state = atomic_load_consume(&ent->state);
+	if (!(state & IOS_GAH_STATE_IN_USE))
 		return -DER_NONEXIST;
-	if (gah_store->ptr_array[gah->fid]->revision != gah->revision)
+	if (IOS_GAH_STATE_REVISION(state) != gah->revision)
 		return -DER_NONEXIST;
-	*arg = (void *)(gah_store->ptr_array[gah->fid]->arg);
+
+	value = atomic_load_consume(&ent->arg);
+
+	if (atomic_load_consume(&ent->state) != state)
+		return -DER_NONEXIST;
+
+	*arg = value;
 
 	return -DER_SUCCESS;
 }
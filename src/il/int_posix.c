@@ -203,6 +203,14 @@ static int find_projections(void)
 		}
 		grp_info->psr_ep.ep_tag = tag;
 
+		/* Older CNSS versions do not export a tag count so fall back
+		 * to using the PSR tag for everything.
+		 */
+		snprintf(tmp, BUFSIZE, "iof/ionss/%d/tag_count", i);
+		rc = iof_ctrl_read_uint32(&grp_info->tag_count, tmp);
+		if (rc != 0 || grp_info->tag_count == 0)
+			grp_info->tag_count = 1;
+
 		grp_info->enabled = true;
 	}
 
@@ -316,6 +324,33 @@ static ssize_t pwritev_rpc(struct fd_entry *entry, const struct iovec *iov,
 	return bytes_written;
 }
 
+static ssize_t preadx_rpc(struct fd_entry *entry, const struct iovec *iov,
+			  int iovcnt, const struct iof_xtvec *xtvec, int xtvcnt)
+{
+	ssize_t bytes_read;
+	int errcode;
+
+	bytes_read = ioil_do_preadx(iov, iovcnt, xtvec, xtvcnt,
+				    &entry->common, &errcode);
+	if (bytes_read < 0)
+		saved_errno = errcode;
+	return bytes_read;
+}
+
+static ssize_t pwritex_rpc(struct fd_entry *entry, const struct iovec *iov,
+			   int iovcnt, const struct iof_xtvec *xtvec,
+			   int xtvcnt)
+{
+	ssize_t bytes_written;
+	int errcode;
+
+	bytes_written = ioil_do_pwritex(iov, iovcnt, xtvec, xtvcnt,
+					&entry->common, &errcode);
+	if (bytes_written < 0)
+		saved_errno = errcode;
+	return bytes_written;
+}
+
 static pthread_once_t init_links_flag = PTHREAD_ONCE_INIT;
 
 static void init_links(void)
@@ -453,6 +488,8 @@ static bool check_ioctl_on_open(int fd, struct fd_entry *entry, int flags,
 	entry->common.gah = gah_info.gah;
 	entry->common.projection = &projections[gah_info.cli_fs_id];
 	entry->common.ep = entry->common.projection->grp->psr_ep;
+	entry->common.ep.ep_tag = iof_gah_tag(entry->common.projection->grp,
+					      &entry->common.gah);
 	entry->pos = 0;
 	entry->flags = flags;
 	entry->status = IOF_IO_BYPASS;
@@ -940,6 +977,129 @@ do_real_fdatasync:
 	return __real_fdatasync(fd);
 }
 
+IOF_PUBLIC int iof_fallocate(int fd, int mode, off_t offset, off_t len)
+{
+	struct fd_entry *entry;
+	int errcode;
+	int rc;
+
+	rc = vector_get(&fd_table, fd, &entry);
+	if (rc != 0)
+		goto do_real_fallocate;
+
+	IOF_LOG_INFO("fallocate(fd=%d." GAH_PRINT_STR ", mode=%#x, "
+		     "offset=%zd, len=%zd) intercepted, bypass=%s", fd,
+		     GAH_PRINT_VAL(entry->common.gah), mode, offset, len,
+		     bypass_status[entry->status]);
+
+	if (drop_reference_if_disabled(entry))
+		goto do_real_fallocate;
+
+	rc = ioil_do_fallocate(&entry->common, mode, offset, len, &errcode);
+	if (rc < 0)
+		saved_errno = errcode;
+
+	vector_decref(&fd_table, entry);
+
+	RESTORE_ERRNO(rc < 0);
+
+	return rc;
+
+do_real_fallocate:
+	return __real_fallocate(fd, mode, offset, len);
+}
+
+#ifdef HAVE_COPY_FILE_RANGE
+/* Look up a descriptor for copy_file_range(), returning NULL if it is not
+ * an IOF file with bypass enabled.
+ */
+static struct fd_entry *copy_range_entry(int fd)
+{
+	struct fd_entry *entry;
+	int rc;
+
+	rc = vector_get(&fd_table, fd, &entry);
+	if (rc != 0)
+		return NULL;
+
+	if (drop_reference_if_disabled(entry))
+		return NULL;
+
+	return entry;
+}
+
+IOF_PUBLIC ssize_t iof_copy_file_range(int fd_in, loff_t *off_in, int fd_out,
+				       loff_t *off_out, size_t len,
+				       unsigned int flags)
+{
+	struct fd_entry *src;
+	struct fd_entry *dst;
+	loff_t src_pos;
+	loff_t dst_pos;
+	loff_t *src_ptr = off_in;
+	loff_t *dst_ptr = off_out;
+	ssize_t bytes_copied;
+	int errcode;
+
+	src = copy_range_entry(fd_in);
+	dst = copy_range_entry(fd_out);
+	if (!src && !dst)
+		goto do_real_copy_file_range;
+
+	IOF_LOG_INFO("copy_file_range(fd_in=%d, fd_out=%d, len=%zu) "
+		     "intercepted, bypass in=%s out=%s", fd_in, fd_out, len,
+		     src ? bypass_status[src->status] : "none",
+		     dst ? bypass_status[dst->status] : "none");
+
+	/* The kernel does not know the file position of intercepted
+	 * descriptors, so pass it explicitly when no offset is given.
+	 */
+	if (src && !src_ptr) {
+		src_pos = src->pos;
+		src_ptr = &src_pos;
+	}
+	if (dst && !dst_ptr) {
+		dst_pos = dst->pos;
+		dst_ptr = &dst_pos;
+	}
+
+	if (src && dst && src->common.projection == dst->common.projection) {
+		bytes_copied = ioil_do_copy_range(&src->common, *src_ptr,
+						  &dst->common, *dst_ptr, len,
+						  flags, &errcode);
+		if (bytes_copied < 0) {
+			saved_errno = errcode;
+		} else {
+			*src_ptr += bytes_copied;
+			*dst_ptr += bytes_copied;
+		}
+	} else {
+		bytes_copied = __real_copy_file_range(fd_in, src_ptr, fd_out,
+						      dst_ptr, len, flags);
+		SAVE_ERRNO(bytes_copied < 0);
+	}
+
+	if (src) {
+		if (!off_in)
+			src->pos = src_pos;
+		vector_decref(&fd_table, src);
+	}
+	if (dst) {
+		if (!off_out)
+			dst->pos = dst_pos;
+		vector_decref(&fd_table, dst);
+	}
+
+	RESTORE_ERRNO(bytes_copied < 0);
+
+	return bytes_copied;
+
+do_real_copy_file_range:
+	return __real_copy_file_range(fd_in, off_in, fd_out, off_out, len,
+				      flags);
+}
+#endif
+
 IOF_PUBLIC int iof_dup(int oldfd)
 {
 	struct fd_entry *entry = NULL;
@@ -1196,5 +1356,145 @@ IOF_PUBLIC int iof_get_bypass_status(int fd)
 	return rc;
 }
 
+/* Check that the memory vector and extents of a vectored request are the
+ * same length.
+ */
+static bool xtvec_valid(const struct iovec *iov, int iovcnt,
+			const struct iof_xtvec *xtvec, int xtvcnt)
+{
+	size_t iov_len = 0;
+	size_t xt_len = 0;
+	int i;
+
+	if (iovcnt < 0 || xtvcnt < 0)
+		return false;
+
+	for (i = 0; i < iovcnt; i++)
+		iov_len += iov[i].iov_len;
+
+	for (i = 0; i < xtvcnt; i++)
+		xt_len += xtvec[i].xt_len;
+
+	return iov_len == xt_len;
+}
+
+/* Transfer each extent of a file which is not forwarded with a call to
+ * preadv() or pwritev(), stopping at the first short transfer.
+ */
+static ssize_t xtvec_real(int fd, bool write, const struct iovec *iov,
+			  int iovcnt, const struct iof_xtvec *xtvec,
+			  int xtvcnt)
+{
+	struct iovec *window;
+	ssize_t total = 0;
+	ssize_t res;
+	int nr;
+	int i;
+
+	if (iovcnt == 0 || xtvcnt == 0)
+		return 0;
+
+	window = calloc(iovcnt, sizeof(*window));
+	if (!window) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < xtvcnt; i++) {
+		nr = ioil_iov_window(iov, iovcnt, total, xtvec[i].xt_len,
+				     window);
+		if (write)
+			res = __real_pwritev(fd, window, nr, xtvec[i].xt_off);
+		else
+			res = __real_preadv(fd, window, nr, xtvec[i].xt_off);
+		if (res == -1) {
+			if (total == 0)
+				total = -1;
+			break;
+		}
+
+		total += res;
+
+		if (res < xtvec[i].xt_len)
+			break;
+	}
+
+	free(window);
+
+	return total;
+}
+
+IOF_PUBLIC ssize_t iof_preadx(int fd, const struct iovec *iov, int iovcnt,
+			      const struct iof_xtvec *xtvec, int xtvcnt)
+{
+	struct fd_entry *entry;
+	ssize_t bytes_read;
+	int rc;
+
+	if (!xtvec_valid(iov, iovcnt, xtvec, xtvcnt)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rc = vector_get(&fd_table, fd, &entry);
+	if (rc != 0)
+		goto do_real_preadx;
+
+	IOF_LOG_INFO("preadx(fd=%d." GAH_PRINT_STR ", iovcnt=%d, xtvcnt=%d) "
+		     "intercepted, bypass=%s", fd,
+		     GAH_PRINT_VAL(entry->common.gah), iovcnt, xtvcnt,
+		     bypass_status[entry->status]);
+
+	if (drop_reference_if_disabled(entry))
+		goto do_real_preadx;
+
+	bytes_read = preadx_rpc(entry, iov, iovcnt, xtvec, xtvcnt);
+
+	vector_decref(&fd_table, entry);
+
+	RESTORE_ERRNO(bytes_read < 0);
+
+	return bytes_read;
+
+do_real_preadx:
+	return xtvec_real(fd, false, iov, iovcnt, xtvec, xtvcnt);
+}
+
+IOF_PUBLIC ssize_t iof_pwritex(int fd, const struct iovec *iov, int iovcnt,
+			       const struct iof_xtvec *xtvec, int xtvcnt)
+{
+	struct fd_entry *entry;
+	ssize_t bytes_written;
+	int rc;
+
+	if (!xtvec_valid(iov, iovcnt, xtvec, xtvcnt)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rc = vector_get(&fd_table, fd, &entry);
+	if (rc != 0)
+		goto do_real_pwritex;
+
+	IOF_LOG_INFO("pwritex(fd=%d." GAH_PRINT_STR ", iovcnt=%d, xtvcnt=%d) "
+		     "intercepted, bypass=%s", fd,
+		     GAH_PRINT_VAL(entry->common.gah), iovcnt, xtvcnt,
+		     bypass_status[entry->status]);
+
+	if (drop_reference_if_disabled(entry))
+		goto do_real_pwritex;
+
+	bytes_written = pwritex_rpc(entry, iov, iovcnt, xtvec, xtvcnt);
+
+	vector_decref(&fd_table, entry);
+
+	RESTORE_ERRNO(bytes_written < 0);
+
+	return bytes_written;
+
+do_real_pwritex:
+	return xtvec_real(fd, true, iov, iovcnt, xtvec, xtvcnt);
+}
+
 FOREACH_INTERCEPT(IOIL_DECLARE_ALIAS)
 FOREACH_ALIASED_INTERCEPT(IOIL_DECLARE_ALIAS64)
@@ -96,25 +96,119 @@ read_bulk_cb(const struct crt_cb_info *cb_info)
 	iof_tracker_signal(&reply->tracker);
 }
 
-static ssize_t read_bulk(char *buff, size_t len, off_t position,
+/* Return the part of a memory vector which holds len bytes starting skip
+ * bytes in, omitting empty entries.  out must have room for iovcnt entries,
+ * returns the number used.
+ */
+int ioil_iov_window(const struct iovec *iov, int iovcnt, size_t skip,
+		    size_t len, struct iovec *out)
+{
+	size_t n;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip -= iov[i].iov_len;
+			continue;
+		}
+
+		n = iov[i].iov_len - skip;
+		if (n > len)
+			n = len;
+
+		out[count].iov_base = iov[i].iov_base + skip;
+		out[count].iov_len = n;
+		count++;
+
+		len -= n;
+		skip = 0;
+	}
+
+	return count;
+}
+
+/* Create a bulk handle covering every entry of a memory vector */
+int ioil_bulk_create(crt_context_t ctx, const struct iovec *iov, int iovcnt,
+		     int flags, crt_bulk_t *bulk)
+{
+	d_sg_list_t sgl = {0};
+	int rc;
+	int i;
+
+	sgl.sg_iovs = calloc(iovcnt, sizeof(*sgl.sg_iovs));
+	if (!sgl.sg_iovs)
+		return -DER_NOMEM;
+
+	for (i = 0; i < iovcnt; i++)
+		d_iov_set(&sgl.sg_iovs[i], iov[i].iov_base, iov[i].iov_len);
+	sgl.sg_nr = iovcnt;
+
+	rc = crt_bulk_create(ctx, &sgl, flags, bulk);
+
+	free(sgl.sg_iovs);
+
+	return rc;
+}
+
+/* Copy data into a memory vector, starting offset bytes in */
+static void iov_scatter(const struct iovec *iov, int iovcnt, size_t offset,
+			const char *src, size_t len)
+{
+	size_t n;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iov[i].iov_len) {
+			offset -= iov[i].iov_len;
+			continue;
+		}
+
+		n = iov[i].iov_len - offset;
+		if (n > len)
+			n = len;
+
+		memcpy(iov[i].iov_base + offset, src, n);
+
+		src += n;
+		len -= n;
+		offset = 0;
+	}
+}
+
+/* Read a list of extents with a single RPC
+ *
+ * The data for every extent is returned packed, in order, into the memory
+ * vector, which must not contain empty entries.  A single extent is sent in
+ * the request itself, otherwise the list is sent as a separate bulk handle
+ * and must hold no more than IOF_XTVEC_MAX extents.
+ */
+static ssize_t read_bulk(const struct iovec *iov, int iovcnt,
+			 const struct iof_xtvec *xtvec, int xtvcnt,
 			 struct iof_file_common *f_info, int *errcode)
 {
 	struct iof_projection *fs_handle;
-	struct iof_service_group *grp;
 	struct iof_readx_in *in;
 	struct iof_readx_out *out;
 	struct read_bulk_cb_r reply = {0};
 	crt_rpc_t *rpc = NULL;
-	crt_bulk_t bulk;
+	crt_bulk_t bulk = NULL;
+	crt_bulk_t xt_bulk = NULL;
+	struct iovec xt_iov;
 	ssize_t read_len = 0;
-	d_sg_list_t sgl = {0};
-	d_iov_t iov = {0};
+	size_t len = 0;
 	int rc;
+	int i;
+
+	for (i = 0; i < xtvcnt; i++)
+		len += xtvec[i].xt_len;
+
+	if (len == 0)
+		return 0;
 
 	fs_handle = f_info->projection;
-	grp = fs_handle->grp;
 
-	rc = crt_req_create(fs_handle->crt_ctx, &grp->psr_ep,
+	rc = crt_req_create(fs_handle->crt_ctx, &f_info->ep,
 			    CRT_PROTO_OPC(fs_handle->proto->cpf_base,
 					  fs_handle->proto->cpf_ver,
 					  DEF_RPC_TYPE(readx)),
@@ -128,25 +222,36 @@ static ssize_t read_bulk(char *buff, size_t len, off_t position,
 
 	in = crt_req_get(rpc);
 	in->gah = f_info->gah;
-	in->xtvec.xt_off = position;
+	in->xtvec.xt_off = xtvec[0].xt_off;
 	in->xtvec.xt_len = len;
 
-	iov.iov_len = len;
-	iov.iov_buf_len = len;
-	iov.iov_buf = (void *)buff;
-	sgl.sg_iovs = &iov;
-	sgl.sg_nr = 1;
+	if (xtvcnt > 1) {
+		xt_iov.iov_base = (void *)xtvec;
+		xt_iov.iov_len = xtvcnt * sizeof(*xtvec);
+		rc = ioil_bulk_create(fs_handle->crt_ctx, &xt_iov, 1,
+				      CRT_BULK_RO, &xt_bulk);
+		if (rc) {
+			IOF_LOG_ERROR("Failed to make extent bulk handle %d",
+				      rc);
+			crt_req_decref(rpc);
+			*errcode = EIO;
+			return -1;
+		}
+		in->xtvec_len = xtvcnt;
+		in->xtvec_bulk = xt_bulk;
+	}
 
-	rc = crt_bulk_create(fs_handle->crt_ctx, &sgl, CRT_BULK_RW,
-			     &in->data_bulk);
+	rc = ioil_bulk_create(fs_handle->crt_ctx, iov, iovcnt, CRT_BULK_RW,
+			      &bulk);
 	if (rc) {
 		IOF_LOG_ERROR("Failed to make local bulk handle %d", rc);
+		crt_req_decref(rpc);
 		*errcode = EIO;
-		return -1;
+		D_GOTO(free_bulk, read_len = -1);
 	}
 
 	iof_tracker_init(&reply.tracker, 1);
-	bulk = in->data_bulk;
+	in->data_bulk = bulk;
 
 	reply.f_info = f_info;
 
@@ -154,31 +259,32 @@ static ssize_t read_bulk(char *buff, size_t len, off_t position,
 	if (rc) {
 		IOF_LOG_ERROR("Could not send rpc, rc = %d", rc);
 		*errcode = EIO;
-		return -1;
+		D_GOTO(free_bulk, read_len = -1);
 	}
 	iof_fs_wait(fs_handle, &reply.tracker);
 
 	if (reply.err) {
 		*errcode = reply.err;
-		return -1;
+		D_GOTO(free_bulk, read_len = -1);
 	}
 
 	if (reply.rc != 0) {
 		*errcode = reply.rc;
-		return -1;
+		D_GOTO(free_bulk, read_len = -1);
 	}
 
 	out = reply.out;
 	if (out->iov_len > 0) {
 		if (out->data.iov_len != out->iov_len) {
-			/* TODO: This is a resource leak */
 			IOF_LOG_ERROR("Missing IOV %d", out->iov_len);
+			crt_req_decref(reply.rpc);
 			*errcode = EIO;
-			return -1;
+			D_GOTO(free_bulk, read_len = -1);
 		}
 		read_len = out->data.iov_len;
 		IOF_LOG_INFO("Received %#zx via immediate", read_len);
-		memcpy(buff + out->bulk_len, out->data.iov_buf, read_len);
+		iov_scatter(iov, iovcnt, out->bulk_len, out->data.iov_buf,
+			    read_len);
 	}
 	if (out->bulk_len > 0) {
 		IOF_LOG_INFO("Received %#zx via bulk", out->bulk_len);
@@ -187,13 +293,22 @@ static ssize_t read_bulk(char *buff, size_t len, off_t position,
 
 	crt_req_decref(reply.rpc);
 
-	rc = crt_bulk_free(bulk);
-	if (rc) {
-		*errcode = EIO;
-		return -1;
+	IOF_LOG_INFO("Read complete %#zx", read_len);
+
+free_bulk:
+	if (xt_bulk) {
+		rc = crt_bulk_free(xt_bulk);
+		if (rc)
+			IOF_LOG_WARNING("Failed to free extent bulk %d", rc);
 	}
 
-	IOF_LOG_INFO("Read complete %#zx", read_len);
+	if (bulk) {
+		rc = crt_bulk_free(bulk);
+		if (rc && read_len >= 0) {
+			*errcode = EIO;
+			read_len = -1;
+		}
+	}
 
 	return read_len;
 }
@@ -201,35 +316,88 @@ static ssize_t read_bulk(char *buff, size_t len, off_t position,
 ssize_t ioil_do_pread(char *buff, size_t len, off_t position,
 		      struct iof_file_common *f_info, int *errcode)
 {
+	struct iovec iov = {0};
+	struct iof_xtvec xtvec = {0};
+
 	IOF_LOG_INFO("%#zx-%#zx " GAH_PRINT_STR, position, position + len - 1,
 		     GAH_PRINT_VAL(f_info->gah));
 
-	return read_bulk(buff, len, position, f_info, errcode);
+	iov.iov_base = buff;
+	iov.iov_len = len;
+	xtvec.xt_off = position;
+	xtvec.xt_len = len;
+
+	return read_bulk(&iov, 1, &xtvec, 1, f_info, errcode);
 }
 
-/* TODO: This could be optimized to send multiple RPCs at once rather than
- * sending them serially.   Get it working first.
+/* Read a list of extents into a memory vector
+ *
+ * Each group of up to IOF_XTVEC_MAX extents is read with a single RPC, with
+ * the data for the group returned directly into the part of the memory
+ * vector which holds it.  Stops at the first short read.
  */
-ssize_t ioil_do_preadv(const struct iovec *iov, int count, off_t position,
+ssize_t ioil_do_preadx(const struct iovec *iov, int iovcnt,
+		       const struct iof_xtvec *xtvec, int xtvcnt,
 		       struct iof_file_common *f_info, int *errcode)
 {
+	struct iovec *window;
 	ssize_t bytes_read;
 	ssize_t total_read = 0;
+	size_t len;
+	int count;
+	int nr;
 	int i;
+	int j;
+
+	if (iovcnt <= 0 || xtvcnt <= 0)
+		return 0;
+
+	window = calloc(iovcnt, sizeof(*window));
+	if (!window) {
+		*errcode = ENOMEM;
+		return -1;
+	}
 
-	for (i = 0; i < count; i++) {
-		bytes_read = read_bulk(iov[i].iov_base, iov[i].iov_len,
-				       position, f_info, errcode);
+	for (i = 0; i < xtvcnt; i += count) {
+		count = xtvcnt - i;
+		if (count > IOF_XTVEC_MAX)
+			count = IOF_XTVEC_MAX;
 
-		if (bytes_read == -1)
-			return (ssize_t)-1;
+		len = 0;
+		for (j = 0; j < count; j++)
+			len += xtvec[i + j].xt_len;
 
-		if (bytes_read == 0)
-			return total_read;
+		nr = ioil_iov_window(iov, iovcnt, total_read, len, window);
+
+		bytes_read = read_bulk(window, nr, &xtvec[i], count, f_info,
+				       errcode);
+		if (bytes_read == -1) {
+			if (total_read == 0)
+				total_read = -1;
+			break;
+		}
 
-		position += bytes_read;
 		total_read += bytes_read;
+
+		if (bytes_read < len)
+			break;
 	}
 
+	free(window);
+
 	return total_read;
 }
+
+/* A preadv() is a single extent, so is read with a single RPC */
+ssize_t ioil_do_preadv(const struct iovec *iov, int count, off_t position,
+		       struct iof_file_common *f_info, int *errcode)
+{
+	struct iof_xtvec xtvec = {0};
+	int i;
+
+	xtvec.xt_off = position;
+	for (i = 0; i < count; i++)
+		xtvec.xt_len += iov[i].iov_len;
+
+	return ioil_do_preadx(iov, count, &xtvec, 1, f_info, errcode);
+}
@@ -87,28 +87,44 @@ write_cb(const struct crt_cb_info *cb_info)
 	iof_tracker_signal(&reply->tracker);
 }
 
-ssize_t ioil_do_writex(const char *buff, size_t len, off_t position,
-		       struct iof_file_common *f_info, int *errcode)
+/* Write a list of extents with a single RPC
+ *
+ * The data for every extent is taken packed, in order, from the memory
+ * vector, which must not contain empty entries.  The tail of the data is
+ * sent in the request itself if it is small enough and held in the last
+ * entry.  A single extent is sent in the request, otherwise the list is sent
+ * as a separate bulk handle and must hold no more than IOF_XTVEC_MAX
+ * extents.
+ */
+static ssize_t write_bulk(const struct iovec *iov, int iovcnt,
+			  const struct iof_xtvec *xtvec, int xtvcnt,
+			  struct iof_file_common *f_info, int *errcode)
 {
 	struct iof_projection *fs_handle;
-	struct iof_service_group *grp;
 	struct iof_writex_in *in;
 	struct write_cb_r reply = {0};
 	crt_rpc_t *rpc = NULL;
-	crt_bulk_t bulk;
-	d_sg_list_t sgl = {0};
-	d_iov_t iov = {0};
+	crt_bulk_t bulk = NULL;
+	crt_bulk_t xt_bulk = NULL;
+	struct iovec xt_iov;
+	const struct iovec *last;
+	ssize_t ret = -1;
+	size_t len = 0;
 	uint64_t imm_len;
 	uint64_t imm_offset = 0;
+	int nr = iovcnt;
 	int rc;
+	int i;
 
-	IOF_LOG_INFO("%#zx-%#zx " GAH_PRINT_STR, position,
-		     position + len - 1, GAH_PRINT_VAL(f_info->gah));
+	for (i = 0; i < xtvcnt; i++)
+		len += xtvec[i].xt_len;
+
+	if (len == 0)
+		return 0;
 
 	fs_handle = f_info->projection;
-	grp = fs_handle->grp;
 
-	rc = crt_req_create(fs_handle->crt_ctx, &grp->psr_ep,
+	rc = crt_req_create(fs_handle->crt_ctx, &f_info->ep,
 			    CRT_PROTO_OPC(fs_handle->proto->cpf_base,
 					  fs_handle->proto->cpf_ver,
 					  DEF_RPC_TYPE(writex)),
@@ -124,54 +140,274 @@ ssize_t ioil_do_writex(const char *buff, size_t len, off_t position,
 	in->gah = f_info->gah;
 
 	in->xtvec.xt_len = len;
+	last = &iov[iovcnt - 1];
 	imm_len = len % fs_handle->max_write;
-	if (imm_len <= fs_handle->max_iov_write) {
+	if (imm_len <= fs_handle->max_iov_write && imm_len <= last->iov_len) {
 		imm_offset = len - imm_len;
-		d_iov_set(&in->data, (void *)buff + imm_offset, imm_len);
+		d_iov_set(&in->data,
+			  last->iov_base + last->iov_len - imm_len, imm_len);
+		/* Drop the last entry from the bulk if it is all immediate */
+		if (imm_len == last->iov_len)
+			nr--;
 	} else {
 		imm_len = 0;
 		imm_offset = in->xtvec.xt_len;
 	}
 
 	if (imm_offset != 0) {
-		in->bulk_len = iov.iov_len = imm_offset;
-		iov.iov_buf_len = imm_offset;
-		iov.iov_buf = (void *)buff;
-		sgl.sg_iovs = &iov;
-		sgl.sg_nr = 1;
-
-		rc = crt_bulk_create(fs_handle->crt_ctx, &sgl, CRT_BULK_RO,
-				     &in->data_bulk);
+		in->bulk_len = imm_offset;
+
+		rc = ioil_bulk_create(fs_handle->crt_ctx, iov, nr, CRT_BULK_RO,
+				      &bulk);
 		if (rc) {
 			IOF_LOG_ERROR("Failed to make local bulk handle %d",
 				      rc);
+			crt_req_decref(rpc);
 			*errcode = EIO;
 			return -1;
 		}
+		in->data_bulk = bulk;
 	}
 
-	iof_tracker_init(&reply.tracker, 1);
-	in->xtvec.xt_off = position;
+	if (xtvcnt > 1) {
+		xt_iov.iov_base = (void *)xtvec;
+		xt_iov.iov_len = xtvcnt * sizeof(*xtvec);
+		rc = ioil_bulk_create(fs_handle->crt_ctx, &xt_iov, 1,
+				      CRT_BULK_RO, &xt_bulk);
+		if (rc) {
+			IOF_LOG_ERROR("Failed to make extent bulk handle %d",
+				      rc);
+			crt_req_decref(rpc);
+			D_GOTO(out, *errcode = EIO);
+		}
+		in->xtvec_len = xtvcnt;
+		in->xtvec_bulk = xt_bulk;
+	}
 
-	bulk = in->data_bulk;
+	iof_tracker_init(&reply.tracker, 1);
+	in->xtvec.xt_off = xtvec[0].xt_off;
 
 	reply.f_info = f_info;
 
 	rc = crt_req_send(rpc, write_cb, &reply);
 	if (rc) {
 		IOF_LOG_ERROR("Could not send rpc, rc = %d", rc);
-		*errcode = EIO;
-		return -1;
+		D_GOTO(out, *errcode = EIO);
 	}
 	iof_fs_wait(fs_handle, &reply.tracker);
 
+	if (reply.err)
+		D_GOTO(out, *errcode = reply.err);
+
+	if (reply.rc != 0)
+		D_GOTO(out, *errcode = reply.rc);
+
+	ret = reply.len;
+
+out:
+	if (xt_bulk) {
+		rc = crt_bulk_free(xt_bulk);
+		if (rc)
+			IOF_LOG_WARNING("Failed to free extent bulk %d", rc);
+	}
+
 	if (bulk) {
 		rc = crt_bulk_free(bulk);
-		if (rc) {
+		if (rc && ret >= 0) {
 			*errcode = EIO;
-			return -1;
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+ssize_t ioil_do_writex(const char *buff, size_t len, off_t position,
+		       struct iof_file_common *f_info, int *errcode)
+{
+	struct iovec iov = {0};
+	struct iof_xtvec xtvec = {0};
+
+	IOF_LOG_INFO("%#zx-%#zx " GAH_PRINT_STR, position,
+		     position + len - 1, GAH_PRINT_VAL(f_info->gah));
+
+	iov.iov_base = (void *)buff;
+	iov.iov_len = len;
+	xtvec.xt_off = position;
+	xtvec.xt_len = len;
+
+	return write_bulk(&iov, 1, &xtvec, 1, f_info, errcode);
+}
+
+/* Write a list of extents from a memory vector, see ioil_do_preadx() */
+ssize_t ioil_do_pwritex(const struct iovec *iov, int iovcnt,
+			const struct iof_xtvec *xtvec, int xtvcnt,
+			struct iof_file_common *f_info, int *errcode)
+{
+	struct iovec *window;
+	ssize_t bytes_written;
+	ssize_t total_write = 0;
+	size_t len;
+	int count;
+	int nr;
+	int i;
+	int j;
+
+	if (iovcnt <= 0 || xtvcnt <= 0)
+		return 0;
+
+	window = calloc(iovcnt, sizeof(*window));
+	if (!window) {
+		*errcode = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < xtvcnt; i += count) {
+		count = xtvcnt - i;
+		if (count > IOF_XTVEC_MAX)
+			count = IOF_XTVEC_MAX;
+
+		len = 0;
+		for (j = 0; j < count; j++)
+			len += xtvec[i + j].xt_len;
+
+		nr = ioil_iov_window(iov, iovcnt, total_write, len, window);
+
+		bytes_written = write_bulk(window, nr, &xtvec[i], count,
+					   f_info, errcode);
+		if (bytes_written == -1) {
+			if (total_write == 0)
+				total_write = -1;
+			break;
 		}
+
+		total_write += bytes_written;
+
+		if (bytes_written < len)
+			break;
+	}
+
+	free(window);
+
+	return total_write;
+}
+
+/* A pwritev() is a single extent, so is written with a single RPC */
+ssize_t ioil_do_pwritev(const struct iovec *iov, int count, off_t position,
+			struct iof_file_common *f_info, int *errcode)
+{
+	struct iof_xtvec xtvec = {0};
+	int i;
+
+	xtvec.xt_off = position;
+	for (i = 0; i < count; i++)
+		xtvec.xt_len += iov[i].iov_len;
+
+	return ioil_do_pwritex(iov, count, &xtvec, 1, f_info, errcode);
+}
+
+/* Reply to a RPC which returns a status, shared by copy_range and
+ * fallocate.  The copy_range reply also carries the length copied.
+ */
+struct status_cb_r {
+	ssize_t len;
+	struct iof_tracker tracker;
+	int err;
+	int rc;
+	bool copy_range;
+};
+
+static void
+status_cb(const struct crt_cb_info *cb_info)
+{
+	struct status_cb_r *reply = cb_info->cci_arg;
+	void *out = crt_reply_get(cb_info->cci_rpc);
+	int err;
+
+	if (cb_info->cci_rc != 0) {
+		IOF_LOG_INFO("Bad RPC reply %d", cb_info->cci_rc);
+		if (cb_info->cci_rc == -DER_TIMEDOUT)
+			reply->err = EAGAIN;
+		else
+			reply->err = EIO;
+		iof_tracker_signal(&reply->tracker);
+		return;
+	}
+
+	if (reply->copy_range) {
+		struct iof_copy_range_out *cr_out = out;
+
+		err = cr_out->err;
+		reply->rc = cr_out->rc;
+		reply->len = cr_out->len;
+	} else {
+		struct iof_status_out *st_out = out;
+
+		err = st_out->err;
+		reply->rc = st_out->rc;
+	}
+
+	if (err) {
+		IOF_LOG_ERROR("Error from target %d", err);
+
+		reply->err = EIO;
+
+		if (err == -DER_NOMEM)
+			reply->err = ENOMEM;
+	}
+
+	iof_tracker_signal(&reply->tracker);
+}
+
+/* Copy a range between two files in the same projection on the IONSS,
+ * without moving the data through this process.
+ */
+ssize_t ioil_do_copy_range(struct iof_file_common *src_info, off_t src_off,
+			   struct iof_file_common *dst_info, off_t dst_off,
+			   size_t len, unsigned int flags, int *errcode)
+{
+	struct iof_projection *fs_handle;
+	struct iof_copy_range_in *in;
+	struct status_cb_r reply = {0};
+	crt_rpc_t *rpc = NULL;
+	int rc;
+
+	IOF_LOG_INFO(GAH_PRINT_STR " %#zx -> " GAH_PRINT_STR " %#zx len %#zx",
+		     GAH_PRINT_VAL(src_info->gah), src_off,
+		     GAH_PRINT_VAL(dst_info->gah), dst_off, len);
+
+	fs_handle = src_info->projection;
+
+	rc = crt_req_create(fs_handle->crt_ctx, &src_info->ep,
+			    CRT_PROTO_OPC(fs_handle->proto->cpf_base,
+					  fs_handle->proto->cpf_ver,
+					  DEF_RPC_TYPE(copy_range)),
+			    &rpc);
+	if (rc || !rpc) {
+		IOF_LOG_ERROR("Could not create request, rc = %d",
+			      rc);
+		*errcode = EIO;
+		return -1;
+	}
+
+	in = crt_req_get(rpc);
+	in->gah = src_info->gah;
+	in->dst_gah = dst_info->gah;
+	in->src_off = src_off;
+	in->dst_off = dst_off;
+	in->len = len;
+	in->flags = flags;
+
+	reply.copy_range = true;
+	iof_tracker_init(&reply.tracker, 1);
+
+	rc = crt_req_send(rpc, status_cb, &reply);
+	if (rc) {
+		IOF_LOG_ERROR("Could not send rpc, rc = %d", rc);
+		*errcode = EIO;
+		return -1;
 	}
+	iof_fs_wait(fs_handle, &reply.tracker);
 
 	if (reply.err) {
 		*errcode = reply.err;
@@ -186,29 +422,58 @@ ssize_t ioil_do_writex(const char *buff, size_t len, off_t position,
 	return reply.len;
 }
 
-/* TODO: This could be optimized to send multiple RPCs at once rather than
- * sending them serially.   Get it working first.
- */
-ssize_t ioil_do_pwritev(const struct iovec *iov, int count, off_t position,
-			struct iof_file_common *f_info, int *errcode)
+int ioil_do_fallocate(struct iof_file_common *f_info, int mode, off_t offset,
+		      off_t len, int *errcode)
 {
-	ssize_t bytes_written;
-	ssize_t total_write = 0;
-	int i;
+	struct iof_projection *fs_handle;
+	struct iof_fallocate_in *in;
+	struct status_cb_r reply = {0};
+	crt_rpc_t *rpc = NULL;
+	int rc;
 
-	for (i = 0; i < count; i++) {
-		bytes_written = ioil_do_writex(iov[i].iov_base, iov[i].iov_len,
-					       position, f_info, errcode);
+	IOF_LOG_INFO(GAH_PRINT_STR " mode %#x %#zx-%#zx",
+		     GAH_PRINT_VAL(f_info->gah), mode, offset,
+		     offset + len - 1);
 
-		if (bytes_written == -1)
-			return (ssize_t)-1;
+	fs_handle = f_info->projection;
 
-		if (bytes_written == 0)
-			return total_write;
+	rc = crt_req_create(fs_handle->crt_ctx, &f_info->ep,
+			    CRT_PROTO_OPC(fs_handle->proto->cpf_base,
+					  fs_handle->proto->cpf_ver,
+					  DEF_RPC_TYPE(fallocate)),
+			    &rpc);
+	if (rc || !rpc) {
+		IOF_LOG_ERROR("Could not create request, rc = %d",
+			      rc);
+		*errcode = EIO;
+		return -1;
+	}
 
-		position += bytes_written;
-		total_write += bytes_written;
+	in = crt_req_get(rpc);
+	in->gah = f_info->gah;
+	in->offset = offset;
+	in->len = len;
+	in->mode = mode;
+
+	iof_tracker_init(&reply.tracker, 1);
+
+	rc = crt_req_send(rpc, status_cb, &reply);
+	if (rc) {
+		IOF_LOG_ERROR("Could not send rpc, rc = %d", rc);
+		*errcode = EIO;
+		return -1;
 	}
+	iof_fs_wait(fs_handle, &reply.tracker);
 
-	return total_write;
+	if (reply.err) {
+		*errcode = reply.err;
+		return -1;
+	}
+
+	if (reply.rc != 0) {
+		*errcode = reply.rc;
+		return -1;
+	}
+
+	return 0;
 }
@@ -59,6 +59,18 @@
  * all aio routines (for now)
  * fcntl (for now though we likely need for dup)
  */
+
+/* copy_file_range() is only intercepted where libc provides it, as the
+ * library cannot forward calls to a function which does not exist.
+ */
+#ifdef HAVE_COPY_FILE_RANGE
+#define FOREACH_COPY_INTERCEPT(ACTION)                                        \
+	ACTION(ssize_t, copy_file_range,                                      \
+	       (int, loff_t *, int, loff_t *, size_t, unsigned int))
+#else
+#define FOREACH_COPY_INTERCEPT(ACTION)
+#endif
+
 #define FOREACH_ALIASED_INTERCEPT(ACTION)                                     \
 	ACTION(FILE *,  fopen,     (const char *, const char *))              \
 	ACTION(FILE *,  freopen,   (const char *, const char *, FILE *))      \
@@ -68,7 +80,8 @@
 	ACTION(off_t,   lseek,     (int, off_t, int))                         \
 	ACTION(ssize_t, preadv,    (int, const struct iovec *, int, off_t))   \
 	ACTION(ssize_t, pwritev,   (int, const struct iovec *, int, off_t))   \
-	ACTION(void *,  mmap,      (void *, size_t, int, int, int, off_t))
+	ACTION(void *,  mmap,      (void *, size_t, int, int, int, off_t))     \
+	ACTION(int,     fallocate, (int, int, off_t, off_t))
 
 #define FOREACH_SINGLE_INTERCEPT(ACTION)                                      \
 	ACTION(int,     fclose,    (FILE *))                                  \
@@ -82,7 +95,8 @@
 	ACTION(int,     dup,       (int))                                     \
 	ACTION(int,     dup2,      (int, int))                                \
 	ACTION(int,     fcntl,     (int fd, int cmd, ...))                    \
-	ACTION(FILE *,  fdopen,    (int, const char *))
+	ACTION(FILE *,  fdopen,    (int, const char *))                       \
+	FOREACH_COPY_INTERCEPT(ACTION)
 
 #define FOREACH_INTERCEPT(ACTION)            \
 	FOREACH_SINGLE_INTERCEPT(ACTION)     \
@@ -142,5 +156,20 @@ ssize_t ioil_do_writex(const char *buff, size_t len, off_t position,
 		       struct iof_file_common *f_info, int *errcode);
 ssize_t ioil_do_pwritev(const struct iovec *iov, int count, off_t position,
 			struct iof_file_common *f_info, int *errcode);
+ssize_t ioil_do_preadx(const struct iovec *iov, int iovcnt,
+		       const struct iof_xtvec *xtvec, int xtvcnt,
+		       struct iof_file_common *f_info, int *errcode);
+ssize_t ioil_do_pwritex(const struct iovec *iov, int iovcnt,
+			const struct iof_xtvec *xtvec, int xtvcnt,
+			struct iof_file_common *f_info, int *errcode);
+int ioil_iov_window(const struct iovec *iov, int iovcnt, size_t skip,
+		    size_t len, struct iovec *out);
+int ioil_bulk_create(crt_context_t ctx, const struct iovec *iov, int iovcnt,
+		     int flags, crt_bulk_t *bulk);
+ssize_t ioil_do_copy_range(struct iof_file_common *src_info, off_t src_off,
+			   struct iof_file_common *dst_info, off_t dst_off,
+			   size_t len, unsigned int flags, int *errcode);
+int ioil_do_fallocate(struct iof_file_common *f_info, int mode, off_t offset,
+		      off_t len, int *errcode);
 
 #endif /* __INTERCEPT_H__ */
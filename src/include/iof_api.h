@@ -39,7 +39,9 @@
 #define __IOF_API_H__
 
 #include <stdbool.h>
+#include <sys/uio.h>
 #include <iof_defines.h>
+#include <iof_ext.h>
 
 #if defined(__cplusplus)
 extern "C" {
@@ -68,4 +70,16 @@ enum iof_bypass_status {
  */
 IOF_PUBLIC int iof_get_bypass_status(int fd);
 
+/** Read a list of extents of a file into a memory vector, or write them
+ *  from it.  The data for the extents is packed, in order, in the memory
+ *  vector, which must be the same total length as the extents.  For a file
+ *  forwarded by IOF many extents are transferred with a single request.
+ *  Returns the number of bytes transferred, stopping at the first short
+ *  transfer, or -1 with errno set.
+ */
+IOF_PUBLIC ssize_t iof_preadx(int fd, const struct iovec *iov, int iovcnt,
+			      const struct iof_xtvec *xtvec, int xtvcnt);
+IOF_PUBLIC ssize_t iof_pwritex(int fd, const struct iovec *iov, int iovcnt,
+			       const struct iof_xtvec *xtvec, int xtvcnt);
+
 #endif /* __IOF_IO_H__ */
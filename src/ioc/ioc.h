@@ -82,6 +82,8 @@ struct iof_stats {
 	ATOMIC unsigned int lookup;
 	ATOMIC unsigned int forget;
 	ATOMIC unsigned int setattr;
+	ATOMIC unsigned int copy_range;
+	ATOMIC unsigned int fallocate;
 };
 
 /**
@@ -197,9 +199,19 @@ struct iof_projection_info {
 	struct iof_pool_type		*rb_pool_page;
 	struct iof_pool_type		*rb_pool_large;
 	struct iof_pool_type		*write_pool;
+	struct iof_pool_type		*readdir_pool;
+	/** Pre-registered bulk buffers for rb_pool_large and write_pool */
+	struct iof_bulk_arena		*rb_arena;
+	struct iof_bulk_arena		*wb_arena;
 	uint32_t			max_read;
 	uint32_t			max_iov_read;
 	uint32_t			readdir_size;
+	/** Bulk threshold negotiated with the IONSS, the upper bound for
+	 * proj.max_iov_write which can be lowered through ctrl_fs
+	 */
+	uint32_t			max_iov_write_limit;
+	/** RPC timeout in seconds, can be changed through ctrl_fs */
+	uint32_t			timeout;
 	/** set to error code if projection is off-line */
 	int				offline_reason;
 	/** Hash table of open inodes */
@@ -689,6 +701,8 @@ struct iof_dir_handle {
 	struct iof_readdir_reply	*replies;
 	int				reply_count;
 	void				*replies_base;
+	/** Pre-registered bulk buffer holding the replies, if any */
+	struct iof_rdb			*rdb;
 	/** Set to True if the current batch of replies is the final one */
 	int				last_replies;
 	/** Set to 1 initially, but 0 if there is a unrecoverable error */
@@ -775,12 +789,19 @@ struct iof_file_handle {
 			_rc;						\
 		})
 
+/** Number of buffers in the per-projection read and write arenas, descriptors
+ * allocated beyond this register their own buffers.
+ */
+#define IOC_BULK_ARENA_SLOTS 16
+
 /** Read buffer descriptor */
 struct iof_rb {
 	struct ioc_request		rb_req;
 	struct fuse_bufvec		fbuf;
 	struct iof_local_bulk		lb;
 	struct iof_pool_type		*pt;
+	/** Arena to allocate lb from, or NULL */
+	struct iof_bulk_arena		*arena;
 	size_t				buf_size;
 	bool				failure;
 };
@@ -792,6 +813,18 @@ struct iof_wb {
 	bool				failure;
 };
 
+/** Readdir buffer descriptor
+ *
+ * A bulk buffer of readdir_size bytes which is registered once and then
+ * reused for readdir RPCs.
+ */
+struct iof_rdb {
+	d_list_t			list;
+	struct iof_projection_info	*fsh;
+	struct iof_local_bulk		lb;
+	bool				failure;
+};
+
 /** Common request type.
  *
  * Used for getattr, setattr and close only.
@@ -812,6 +845,23 @@ struct ioc_inode_migrate {
 	struct iof_projection_info *im_fsh;
 };
 
+/* State for migrating inodes in batches, used if the projection has
+ * IOF_IMIGRATE_MULTI set.  The inodes are held in pre-order so that parents
+ * precede their children, and are sent one batch at a time.
+ */
+struct ioc_imigrate_multi {
+	struct iof_projection_info	*imm_fsh;
+	struct ioc_inode_entry		**imm_ies;
+	/* Index of the parent of each inode in imm_ies, or -1 */
+	int				*imm_parents;
+	struct iof_local_bulk		imm_lb;
+	int				imm_count;
+	/* First inode, count and encoded length of the batch in flight */
+	int				imm_start;
+	int				imm_batch;
+	size_t				imm_len;
+};
+
 /** Entry request type.
  *
  * Request for all RPC types that can return a new inode.
@@ -904,6 +954,13 @@ void ioc_ll_symlink(fuse_req_t, const char *, fuse_ino_t, const char *);
 
 void ioc_ll_fsync(fuse_req_t, fuse_ino_t, int, struct fuse_file_info *);
 
+void ioc_ll_copy_file_range(fuse_req_t, fuse_ino_t, off_t,
+			    struct fuse_file_info *, fuse_ino_t, off_t,
+			    struct fuse_file_info *, size_t, int);
+
+void ioc_ll_fallocate(fuse_req_t, fuse_ino_t, int, off_t, off_t,
+		      struct fuse_file_info *);
+
 bool iof_entry_cb(struct ioc_request *);
 
 #endif
@@ -247,6 +247,10 @@ struct fuse_lowlevel_ops *iof_get_fuse_ops(uint64_t flags)
 	fuse_ops->rename = ioc_ll_rename;
 	fuse_ops->fsync = ioc_ll_fsync;
 	fuse_ops->write = ioc_ll_write;
+	fuse_ops->fallocate = ioc_ll_fallocate;
+#if defined(FUSE_MAKE_VERSION) && FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+	fuse_ops->copy_file_range = ioc_ll_copy_file_range;
+#endif
 
 	if (flags & IOF_FUSE_WRITE_BUF)
 		fuse_ops->write_buf = ioc_ll_write_buf;
@@ -474,6 +474,228 @@ out:
 	D_FREE(im);
 }
 
+/* Add ie, and any of its children marked for failover, to imm in
+ * pre-order.  If imm_ies is NULL then only count them.
+ */
+static void imigrate_multi_add(struct ioc_imigrate_multi *imm,
+			       struct ioc_inode_entry *ie, int parent)
+{
+	struct ioc_inode_entry *iec;
+	int idx;
+
+	if (!ie->failover)
+		return;
+
+	idx = imm->imm_count++;
+	if (imm->imm_ies) {
+		imm->imm_ies[idx] = ie;
+		imm->imm_parents[idx] = parent;
+	}
+
+	d_list_for_each_entry(iec, &ie->ie_ie_children, ie_ie_list)
+		imigrate_multi_add(imm, iec, idx);
+}
+
+/* Encode as many inodes as will fit, starting at imm_start, into the bulk
+ * buffer.  Parents in an earlier batch have already been migrated so are
+ * referenced by their new GAH, or if that failed then only the inode is
+ * sent in the hope it is already open on the server.
+ */
+static void imigrate_multi_encode(struct ioc_imigrate_multi *imm)
+{
+	struct iof_projection_info *fs_handle = imm->imm_fsh;
+	struct iof_imigrate_ent ent;
+	size_t pos = 0;
+	size_t size;
+	int n;
+
+	for (n = 0; imm->imm_start + n < imm->imm_count &&
+		     n < IOF_IMIGRATE_MAX_COUNT; n++) {
+		int idx = imm->imm_start + n;
+		int parent = imm->imm_parents[idx];
+		struct ioc_inode_entry *ie = imm->imm_ies[idx];
+
+		memset(&ent, 0, sizeof(ent));
+		ent.inode = ie->stat.st_ino;
+		ent.parent = -1;
+		strncpy(ent.name, ie->name, NAME_MAX);
+
+		if (parent >= imm->imm_start) {
+			ent.parent = parent - imm->imm_start;
+		} else if (parent == -1) {
+			ent.gah = fs_handle->gah;
+		} else if (H_GAH_IS_VALID(imm->imm_ies[parent])) {
+			ent.gah = imm->imm_ies[parent]->gah;
+		} else {
+			ent.gah = fs_handle->gah;
+			ent.name[0] = '\0';
+		}
+
+		size = iof_imigrate_ent_size(&ent);
+		if (IOF_IMIGRATE_RES_OFFSET(pos + size) +
+		    sizeof(struct iof_imigrate_res) * (n + 1) >
+		    imm->imm_lb.len)
+			break;
+
+		pos += iof_imigrate_encode(&ent, imm->imm_lb.buf + pos, size);
+	}
+
+	imm->imm_batch = n;
+	imm->imm_len = pos;
+}
+
+static void imigrate_multi_cb(const struct crt_cb_info *cb_info);
+
+/* Send the next batch, or if there are none left then release imm and
+ * drop the reference on the projection taken when it was created.
+ */
+static void imigrate_multi_next(struct ioc_imigrate_multi *imm)
+{
+	struct iof_projection_info *fs_handle = imm->imm_fsh;
+	struct iof_imigrate_multi_in *in;
+	crt_rpc_t *rpc = NULL;
+	crt_endpoint_t ep;
+	d_rank_t rank;
+	int rc;
+	int i;
+
+	while (imm->imm_start < imm->imm_count) {
+		imigrate_multi_encode(imm);
+
+		IOF_TRACE_INFO(fs_handle, "Migrating %d of %d inodes from %d",
+			       imm->imm_batch, imm->imm_count, imm->imm_start);
+
+		rank = atomic_load_consume(&fs_handle->proj.grp->pri_srv_rank);
+
+		ep.ep_tag = 0;
+		ep.ep_rank = rank;
+		ep.ep_grp = fs_handle->proj.grp->dest_grp;
+
+		rc = crt_req_create(fs_handle->proj.crt_ctx, &ep,
+				    FS_TO_OP(fs_handle, imigrate_multi), &rpc);
+		if (rc == -DER_SUCCESS && rpc) {
+			in = crt_req_get(rpc);
+			in->gah = fs_handle->gah;
+			in->bulk = imm->imm_lb.handle;
+			in->len = imm->imm_len;
+			in->count = imm->imm_batch;
+
+			rc = crt_req_send(rpc, imigrate_multi_cb, imm);
+			if (rc == -DER_SUCCESS)
+				return;
+		}
+
+		IOF_TRACE_ERROR(fs_handle, "Failed to send RPC %d", rc);
+		for (i = 0; i < imm->imm_batch; i++)
+			H_GAH_SET_INVALID(imm->imm_ies[imm->imm_start + i]);
+		imm->imm_start += imm->imm_batch;
+	}
+
+	IOF_BULK_FREE(imm, imm_lb);
+	D_FREE(imm->imm_ies);
+	D_FREE(imm->imm_parents);
+	D_FREE(imm);
+
+	gah_decref(fs_handle);
+}
+
+/* Callback for the batched inode migrate RPC.
+ *
+ * Update the GAH for every inode in the batch which was found, and mark the
+ * rest invalid, then move on to the next batch.
+ */
+static void imigrate_multi_cb(const struct crt_cb_info *cb_info)
+{
+	struct ioc_imigrate_multi *imm = cb_info->cci_arg;
+	struct iof_status_out *out = crt_reply_get(cb_info->cci_rpc);
+	struct iof_imigrate_res *res;
+	int rc = cb_info->cci_rc;
+	int i;
+
+	if (rc == -DER_SUCCESS)
+		rc = out->err;
+
+	if (rc != -DER_SUCCESS)
+		IOF_TRACE_WARNING(imm->imm_fsh,
+				  "RPC failure %d, %d inodes going offline",
+				  rc, imm->imm_batch);
+
+	res = imm->imm_lb.buf + IOF_IMIGRATE_RES_OFFSET(imm->imm_len);
+
+	for (i = 0; i < imm->imm_batch; i++) {
+		struct ioc_inode_entry *ie = imm->imm_ies[imm->imm_start + i];
+
+		if (rc != -DER_SUCCESS) {
+			H_GAH_SET_INVALID(ie);
+			continue;
+		}
+
+		if (res[i].rc != 0 || res[i].err != -DER_SUCCESS) {
+			IOF_TRACE_WARNING(ie, "inode %lu going offline %d %d",
+					  ie->stat.st_ino, res[i].rc,
+					  res[i].err);
+			H_GAH_SET_INVALID(ie);
+			continue;
+		}
+
+		IOF_TRACE_INFO(ie, GAH_PRINT_STR " -> " GAH_PRINT_STR,
+			       GAH_PRINT_VAL(ie->gah),
+			       GAH_PRINT_VAL(res[i].gah));
+		ie->gah = res[i].gah;
+	}
+
+	imm->imm_start += imm->imm_batch;
+	imigrate_multi_next(imm);
+}
+
+/* Migrate all inodes marked for failover using batched RPCs.
+ *
+ * Returns false if the batch could not be set up, in which case the caller
+ * should fall back to migrating each inode individually.
+ */
+static bool imigrate_multi_start(struct iof_projection_info *fs_handle)
+{
+	struct ioc_imigrate_multi *imm;
+	struct ioc_inode_entry *ie;
+
+	D_ALLOC_PTR(imm);
+	if (!imm)
+		return false;
+
+	imm->imm_fsh = fs_handle;
+
+	d_list_for_each_entry(ie, &fs_handle->p_ie_children, ie_ie_list)
+		imigrate_multi_add(imm, ie, -1);
+
+	if (imm->imm_count == 0) {
+		D_FREE(imm);
+		return true;
+	}
+
+	D_ALLOC_ARRAY(imm->imm_ies, imm->imm_count);
+	D_ALLOC_ARRAY(imm->imm_parents, imm->imm_count);
+	if (!imm->imm_ies || !imm->imm_parents)
+		D_GOTO(err, 0);
+
+	if (!IOF_BULK_ALLOC(fs_handle->proj.crt_ctx, imm, imm_lb,
+			    IOF_IMIGRATE_BULK_SIZE, false))
+		D_GOTO(err, 0);
+
+	imm->imm_count = 0;
+	d_list_for_each_entry(ie, &fs_handle->p_ie_children, ie_ie_list)
+		imigrate_multi_add(imm, ie, -1);
+
+	gah_addref(fs_handle);
+	imigrate_multi_next(imm);
+	return true;
+
+err:
+	D_FREE(imm->imm_ies);
+	D_FREE(imm->imm_parents);
+	D_FREE(imm);
+	return false;
+}
+
 /* Update projection to identify inodes which relate to open files.
  */
 static void inode_check(struct iof_projection_info *fs_handle)
@@ -513,6 +735,10 @@ static void inode_check(struct iof_projection_info *fs_handle)
 	IOF_TRACE_DEBUG(fs_handle,
 			"traverse returned %d", rc);
 
+	if ((fs_handle->flags & IOF_IMIGRATE_MULTI) &&
+	    imigrate_multi_start(fs_handle))
+		return;
+
 	d_list_for_each_entry(ie, &fs_handle->p_ie_children, ie_ie_list)
 		imigrate_send(fs_handle, ie, NULL);
 }
@@ -890,6 +1116,7 @@ int
 iof_fs_resend(struct ioc_request *request)
 {
 	struct iof_projection_info *fs_handle = request->fsh;
+	struct ios_gah *tag_gah;
 	crt_endpoint_t ep;
 	int ret;
 	int rc;
@@ -929,7 +1156,6 @@ iof_fs_resend(struct ioc_request *request)
 		IOF_TRACE_DEBUG(request, GAH_PRINT_STR, GAH_PRINT_VAL(*gah));
 	}
 
-	ep.ep_tag = 0;
 	ep.ep_grp = fs_handle->proj.grp->dest_grp;
 
 	/* Pick an appropriate rank, for most cases this is the root of the GAH
@@ -941,12 +1167,14 @@ iof_fs_resend(struct ioc_request *request)
 			D_GOTO(err, ret = EHOSTDOWN);
 		}
 		ep.ep_rank = request->ir_inode->gah.root;
+		tag_gah = &request->ir_inode->gah;
 		break;
 	case RHS_FILE:
 		if (!F_GAH_IS_VALID(request->ir_file)) {
 			D_GOTO(err, ret = EHOSTDOWN);
 		}
 		ep.ep_rank = request->ir_file->common.gah.root;
+		tag_gah = &request->ir_file->common.gah;
 		break;
 	case RHS_DIR:
 		if (!H_GAH_IS_VALID(request->ir_dir)) {
@@ -956,12 +1184,16 @@ iof_fs_resend(struct ioc_request *request)
 			D_GOTO(err, ret = EHOSTDOWN);
 		}
 		ep.ep_rank = request->ir_dir->gah.root;
+		tag_gah = &request->ir_dir->gah;
 		break;
 	case RHS_ROOT:
 	default:
 		ep.ep_rank = fs_handle->gah.root;
+		tag_gah = &fs_handle->gah;
 	}
 
+	ep.ep_tag = iof_gah_tag(fs_handle->proj.grp, tag_gah);
+
 	/* Defer clean up until the output is copied. */
 	rc = crt_req_set_endpoint(request->rpc, &ep);
 	if (rc) {
@@ -1067,6 +1299,16 @@ static int iof_uint64_read(char *buf, size_t buflen, void *arg)
 	return CNSS_SUCCESS;
 }
 
+/* The tag count is not known until the query RPC completes so export it as
+ * a variable rather than a constant.
+ */
+static uint64_t tag_count_read_cb(void *arg)
+{
+	struct iof_service_group *grp = arg;
+
+	return grp->tag_count;
+}
+
 /* Attach to a CaRT group
  *
  * Returns true on success.
@@ -1138,6 +1380,8 @@ attach_group(struct iof_state *iof_state, struct iof_group_info *group)
 					  group->grp.psr_ep.ep_rank);
 	cb->register_ctrl_constant_uint64(ionss_dir, "psr_tag",
 					  group->grp.psr_ep.ep_tag);
+	cb->register_ctrl_uint64_variable(ionss_dir, "tag_count",
+					  tag_count_read_cb, NULL, &group->grp);
 	/* Fix this when we actually have multiple IONSS apps */
 	cb->register_ctrl_constant(ionss_dir, "name", group->grp_name);
 
@@ -1204,6 +1448,8 @@ dh_init(void *arg, void *handle)
 	IOC_REQUEST_INIT(&dh->open_req, handle);
 	IOC_REQUEST_INIT(&dh->close_req, handle);
 	dh->rpc = NULL;
+	dh->rdb = NULL;
+	dh->replies_base = NULL;
 }
 
 /* Reset a RPC in a re-usable descriptor.  If the RPC pointer is valid
@@ -1239,6 +1485,12 @@ dh_reset(void *arg)
 		crt_req_decref(dh->rpc);
 	dh->rpc = NULL;
 
+	if (dh->rdb)
+		iof_pool_release(dh->open_req.fsh->readdir_pool, dh->rdb);
+	dh->rdb = NULL;
+
+	D_FREE(dh->replies_base);
+
 	if (dh->open_req.rpc)
 		crt_req_decref(dh->open_req.rpc);
 
@@ -1498,6 +1750,7 @@ rb_page_init(void *arg, void *handle)
 	rb->fbuf.buf[0].fd = -1;
 	rb->failure = false;
 	rb->lb.buf = NULL;
+	rb->arena = NULL;
 }
 
 static void
@@ -1507,6 +1760,7 @@ rb_large_init(void *arg, void *handle)
 
 	rb_page_init(arg, handle);
 	rb->buf_size = rb->rb_req.fsh->max_read;
+	rb->arena = rb->rb_req.fsh->rb_arena;
 }
 
 static bool
@@ -1526,8 +1780,8 @@ rb_reset(void *arg)
 	}
 
 	if (!rb->lb.buf) {
-		IOF_BULK_ALLOC(rb->rb_req.fsh->proj.crt_ctx, rb, lb,
-			       rb->buf_size, false);
+		IOF_BULK_ALLOC_ARENA(rb->arena, rb->rb_req.fsh->proj.crt_ctx,
+				     rb, lb, rb->buf_size, false);
 		if (!rb->lb.buf)
 			return false;
 	}
@@ -1582,8 +1836,9 @@ wb_reset(void *arg)
 	}
 
 	if (!wb->lb.buf) {
-		IOF_BULK_ALLOC(wb->wb_req.fsh->proj.crt_ctx, wb, lb,
-			       wb->wb_req.fsh->proj.max_write, true);
+		IOF_BULK_ALLOC_ARENA(wb->wb_req.fsh->wb_arena,
+				     wb->wb_req.fsh->proj.crt_ctx, wb, lb,
+				     wb->wb_req.fsh->proj.max_write, true);
 		if (!wb->lb.buf)
 			return false;
 	}
@@ -1611,6 +1866,44 @@ wb_release(void *arg)
 	IOF_BULK_FREE(wb, lb);
 }
 
+static void
+rdb_init(void *arg, void *handle)
+{
+	struct iof_rdb *rdb = arg;
+
+	rdb->fsh = handle;
+	rdb->failure = false;
+	rdb->lb.buf = NULL;
+}
+
+static bool
+rdb_reset(void *arg)
+{
+	struct iof_rdb *rdb = arg;
+
+	if (rdb->failure) {
+		IOF_BULK_FREE(rdb, lb);
+		rdb->failure = false;
+	}
+
+	if (!rdb->lb.buf) {
+		IOF_BULK_ALLOC(rdb->fsh->proj.crt_ctx, rdb, lb,
+			       rdb->fsh->readdir_size, false);
+		if (!rdb->lb.buf)
+			return false;
+	}
+
+	return true;
+}
+
+static void
+rdb_release(void *arg)
+{
+	struct iof_rdb *rdb = arg;
+
+	IOF_BULK_FREE(rdb, lb);
+}
+
 static int
 iof_check_complete(void *arg)
 {
@@ -1727,6 +2020,24 @@ iof_thread_stop(struct iof_ctx *iof_ctx)
 	return (int)(uintptr_t)rtn;
 }
 
+static uint64_t bulk_registered_read_cb(void *arg)
+{
+	uint64_t registered;
+	uint64_t in_use;
+
+	iof_bulk_usage(&registered, &in_use);
+	return registered;
+}
+
+static uint64_t bulk_in_use_read_cb(void *arg)
+{
+	uint64_t registered;
+	uint64_t in_use;
+
+	iof_bulk_usage(&registered, &in_use);
+	return in_use;
+}
+
 static int iof_reg(void *arg, struct cnss_plugin_cb *cb, size_t cb_size)
 {
 	struct iof_state *iof_state = arg;
@@ -1807,6 +2118,11 @@ static int iof_reg(void *arg, struct cnss_plugin_cb *cb, size_t cb_size)
 	cb->register_ctrl_constant_uint64(cb->plugin_dir, "ioctl_version",
 					  IOF_IOCTL_VERSION);
 
+	cb->register_ctrl_uint64_variable(cb->plugin_dir, "bulk_registered",
+					  bulk_registered_read_cb, NULL, NULL);
+	cb->register_ctrl_uint64_variable(cb->plugin_dir, "bulk_in_use",
+					  bulk_in_use_read_cb, NULL, NULL);
+
 	/*registrations*/
 	ret = crt_register_eviction_cb(ioc_eviction_cb, iof_state);
 	if (ret) {
@@ -1882,6 +2198,84 @@ static int online_write_cb(uint64_t value, void *arg)
 	return CNSS_SUCCESS;
 }
 
+static uint64_t max_iov_write_read_cb(void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+
+	return fs_handle->proj.max_iov_write;
+}
+
+/* Writes of up to max_iov_write bytes carry their data in the RPC, it can be
+ * lowered to force bulk transfers but not raised above the IONSS limit.
+ */
+static int max_iov_write_write_cb(uint64_t value, void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+
+	if (value > fs_handle->max_iov_write_limit)
+		return EINVAL;
+
+	IOF_TRACE_INFO(fs_handle, "max_iov_write %u -> %lu",
+		       fs_handle->proj.max_iov_write, value);
+	fs_handle->proj.max_iov_write = value;
+
+	return CNSS_SUCCESS;
+}
+
+static uint64_t poll_interval_read_cb(void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+
+	return fs_handle->ctx_array[0].poll_interval;
+}
+
+/* Each progress thread reads the poll interval on every call to
+ * crt_progress() so the new value is used from the next iteration.
+ */
+static int poll_interval_write_cb(uint64_t value, void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+	int i;
+
+	if (value > UINT32_MAX)
+		return EINVAL;
+
+	IOF_TRACE_INFO(fs_handle, "poll_interval %u -> %lu",
+		       fs_handle->ctx_array[0].poll_interval, value);
+	for (i = 0; i < fs_handle->ctx_num; i++)
+		fs_handle->ctx_array[i].poll_interval = value;
+
+	return CNSS_SUCCESS;
+}
+
+static uint64_t timeout_read_cb(void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+
+	return fs_handle->timeout;
+}
+
+static int timeout_write_cb(uint64_t value, void *arg)
+{
+	struct iof_projection_info *fs_handle = arg;
+	int rc;
+
+	if (value == 0 || value > UINT32_MAX)
+		return EINVAL;
+
+	rc = crt_context_set_timeout(fs_handle->proj.crt_ctx, value);
+	if (rc != -DER_SUCCESS) {
+		IOF_TRACE_ERROR(fs_handle, "Context timeout not set %d", rc);
+		return EIO;
+	}
+
+	IOF_TRACE_INFO(fs_handle, "timeout %u -> %lu", fs_handle->timeout,
+		       value);
+	fs_handle->timeout = value;
+
+	return CNSS_SUCCESS;
+}
+
 #define REGISTER_STAT(_STAT) cb->register_ctrl_variable(	\
 		fs_handle->stats_dir,				\
 		#_STAT,						\
@@ -1943,6 +2337,11 @@ initialize_projection(struct iof_state *iof_state,
 				  .release = wb_release,
 				  POOL_TYPE_INIT(iof_wb, wb_req.ir_list)};
 
+	struct iof_pool_reg rdb = {.init = rdb_init,
+				   .reset = rdb_reset,
+				   .release = rdb_release,
+				   POOL_TYPE_INIT(iof_rdb, list)};
+
 	cb = iof_state->cb;
 
 	/* TODO: This is presumably wrong although it's not
@@ -2048,6 +2447,7 @@ initialize_projection(struct iof_state *iof_state,
 	fs_handle->max_iov_read = fs_info->max_iov_read;
 	fs_handle->proj.max_write = fs_info->max_write;
 	fs_handle->proj.max_iov_write = fs_info->max_iov_write;
+	fs_handle->max_iov_write_limit = fs_info->max_iov_write;
 	fs_handle->readdir_size = fs_info->readdir_size;
 	fs_handle->gah = fs_info->gah;
 
@@ -2112,9 +2512,10 @@ initialize_projection(struct iof_state *iof_state,
 					  "max_write",
 					  fs_handle->proj.max_write);
 
-	cb->register_ctrl_constant_uint64(fs_handle->fs_dir,
-					  "max_iov_write",
-					  fs_handle->proj.max_iov_write);
+	cb->register_ctrl_uint64_variable(fs_handle->fs_dir, "max_iov_write",
+					  max_iov_write_read_cb,
+					  max_iov_write_write_cb,
+					  fs_handle);
 
 	cb->register_ctrl_constant_uint64(fs_handle->fs_dir,
 				  "readdir_size",
@@ -2155,6 +2556,8 @@ initialize_projection(struct iof_state *iof_state,
 		REGISTER_STAT(write);
 		REGISTER_STAT(fsync);
 		REGISTER_STAT(setattr);
+		REGISTER_STAT(copy_range);
+		REGISTER_STAT(fallocate);
 		REGISTER_STAT64(write_bytes);
 	}
 
@@ -2178,6 +2581,7 @@ initialize_projection(struct iof_state *iof_state,
 		IOF_TRACE_ERROR(iof_state, "Context timeout not set");
 		D_GOTO(err, 0);
 	}
+	fs_handle->timeout = fs_info->timeout;
 
 	for (i = 0; i < fs_handle->ctx_num; i++) {
 		fs_handle->ctx_array[i].crt_ctx       = fs_handle->proj.crt_ctx;
@@ -2194,6 +2598,19 @@ initialize_projection(struct iof_state *iof_state,
 		}
 	}
 
+	/* Tunables which act on the context and progress threads so can only
+	 * be registered once they exist.
+	 */
+	cb->register_ctrl_uint64_variable(fs_handle->fs_dir, "poll_interval",
+					  poll_interval_read_cb,
+					  poll_interval_write_cb,
+					  fs_handle);
+
+	cb->register_ctrl_uint64_variable(fs_handle->fs_dir, "timeout",
+					  timeout_read_cb,
+					  timeout_write_cb,
+					  fs_handle);
+
 	args.argc = 4;
 	if (!writeable)
 		args.argc++;
@@ -2272,6 +2689,27 @@ initialize_projection(struct iof_state *iof_state,
 	if (!fs_handle->fh_pool)
 		D_GOTO(err, 0);
 
+	/* Failure to create an arena is not fatal, buffers are then
+	 * registered individually as they are allocated.
+	 */
+	ret = iof_bulk_arena_create(fs_handle->proj.crt_ctx,
+				    fs_handle->max_read, IOC_BULK_ARENA_SLOTS,
+				    false, &fs_handle->rb_arena);
+	if (ret != -DER_SUCCESS)
+		IOF_TRACE_WARNING(fs_handle, "Could not create read arena %d",
+				  ret);
+
+	if (writeable) {
+		ret = iof_bulk_arena_create(fs_handle->proj.crt_ctx,
+					    fs_handle->proj.max_write,
+					    IOC_BULK_ARENA_SLOTS, true,
+					    &fs_handle->wb_arena);
+		if (ret != -DER_SUCCESS)
+			IOF_TRACE_WARNING(fs_handle,
+					  "Could not create write arena %d",
+					  ret);
+	}
+
 	fs_handle->rb_pool_page = iof_pool_register(&fs_handle->pool, &rb_page);
 	if (!fs_handle->rb_pool_page)
 		D_GOTO(err, 0);
@@ -2284,6 +2722,10 @@ initialize_projection(struct iof_state *iof_state,
 	if (!fs_handle->write_pool)
 		D_GOTO(err, 0);
 
+	fs_handle->readdir_pool = iof_pool_register(&fs_handle->pool, &rdb);
+	if (!fs_handle->readdir_pool)
+		D_GOTO(err, 0);
+
 	if (!cb->register_fuse_fs(cb->handle,
 				  NULL,
 				  fuse_ops,
@@ -2306,6 +2748,8 @@ initialize_projection(struct iof_state *iof_state,
 	return true;
 err:
 	iof_pool_destroy(&fs_handle->pool);
+	iof_bulk_arena_destroy(fs_handle->rb_arena);
+	iof_bulk_arena_destroy(fs_handle->wb_arena);
 	D_FREE(fuse_ops);
 	D_FREE(fs_handle);
 	return false;
@@ -2367,6 +2811,10 @@ query_projections(struct iof_state *iof_state,
 
 	query = crt_reply_get(query_rpc);
 
+	group->grp.tag_count = query->tag_count ? query->tag_count : 1;
+	IOF_TRACE_INFO(iof_state, "Using %u tags for %s",
+		       group->grp.tag_count, group->grp_name);
+
 	iof_state->iof_ctx.poll_interval = query->poll_interval;
 	iof_state->iof_ctx.callback_fn = query->progress_callback ?
 					 iof_check_complete : NULL;
@@ -2631,6 +3079,9 @@ static int iof_deregister_fuse(void *arg)
 
 	iof_pool_destroy(&fs_handle->pool);
 
+	iof_bulk_arena_destroy(fs_handle->rb_arena);
+	iof_bulk_arena_destroy(fs_handle->wb_arena);
+
 	rc = pthread_mutex_destroy(&fs_handle->od_lock);
 	if (rc != 0) {
 		IOF_TRACE_ERROR(fs_handle,
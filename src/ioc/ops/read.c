@@ -149,6 +149,7 @@ void ioc_ll_read(fuse_req_t req, fuse_ino_t ino, size_t len,
 	in->xtvec.xt_off = position;
 	in->xtvec.xt_len = len;
 	in->data_bulk = rb->lb.handle;
+	in->data_bulk_off = rb->lb.offset;
 	IOF_TRACE_LINK(rb->rb_req.rpc, rb, "read_bulk_rpc");
 
 	rc = iof_fs_send(&rb->rb_req);
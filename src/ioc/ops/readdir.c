@@ -78,6 +78,54 @@ readdir_cb(const struct crt_cb_info *cb_info)
 	iof_tracker_signal(&reply->tracker);
 }
 
+/*
+ * Decode a compact readdir reply into a newly allocated array of replies,
+ * from either the inline iov or the bulk buffer.
+ */
+static int readdir_decode(struct iof_dir_handle *dir_handle,
+			  struct iof_readdir_out *out,
+			  struct iof_local_bulk *lb, off_t offset)
+{
+	struct iof_readdir_reply *replies;
+	void *buf;
+	size_t len;
+	int count;
+	int rc;
+
+	if (out->iov_count > 0) {
+		count = out->iov_count;
+		buf = out->replies.iov_buf;
+		len = out->replies.iov_len;
+	} else if (out->bulk_count > 0 && lb) {
+		count = out->bulk_count;
+		buf = lb->buf;
+		len = lb->len;
+	} else {
+		dir_handle->reply_count = 0;
+		dir_handle->replies = NULL;
+		dir_handle->rpc = NULL;
+		return 0;
+	}
+
+	D_ALLOC_ARRAY(replies, count);
+	if (!replies)
+		return ENOMEM;
+
+	rc = iof_readdir_decode(buf, len, count, offset, replies);
+	if (rc != -DER_SUCCESS) {
+		IOF_TRACE_ERROR(dir_handle, "Invalid compact reply %d", rc);
+		D_FREE(replies);
+		return EIO;
+	}
+
+	dir_handle->reply_count = count;
+	dir_handle->last_replies = out->last;
+	dir_handle->replies = replies;
+	dir_handle->replies_base = replies;
+	dir_handle->rpc = NULL;
+	return 0;
+}
+
 /*
  * Send, and wait for a readdir() RPC.  Populate the dir_handle with the
  * replies, count and rpc which a reference is held on.
@@ -90,10 +138,9 @@ static int readdir_get_data(struct iof_dir_handle *dir_handle, off_t offset)
 	struct iof_projection_info *fs_handle = dir_handle->open_req.fsh;
 	struct iof_readdir_in *in;
 	struct readdir_cb_r reply = {0};
+	struct iof_rdb *rdb;
 	crt_rpc_t *rpc = NULL;
-	crt_bulk_t bulk = 0;
-	d_iov_t iov = {0};
-	size_t len = fs_handle->readdir_size;
+	bool compact = fs_handle->flags & IOF_READDIR_COMPACT;
 	int ret = 0;
 	int rc;
 
@@ -110,43 +157,35 @@ static int readdir_get_data(struct iof_dir_handle *dir_handle, off_t offset)
 	in->gah = dir_handle->gah;
 	D_MUTEX_UNLOCK(&fs_handle->gah_lock);
 	in->offset = offset;
+	if (compact)
+		in->flags = IOF_READDIR_COMPACT;
 
-	iov.iov_len = len;
-	iov.iov_buf_len = len;
-	D_ALLOC(iov.iov_buf, len);
-
-	if (iov.iov_buf) {
-		d_sg_list_t sgl = {0};
-
-		sgl.sg_iovs = &iov;
-		sgl.sg_nr = 1;
-		rc = crt_bulk_create(fs_handle->proj.crt_ctx, &sgl, CRT_BULK_RW,
-				     &in->bulk);
-		if (rc) {
-			IOF_TRACE_ERROR(dir_handle,
-					"Failed to make local bulk handle %d",
-					rc);
-			D_FREE(iov.iov_buf);
-			crt_req_decref(rpc);
-			D_GOTO(out, ret = EIO);
-		}
-		bulk = in->bulk;
-	}
+	/* Use a pre-registered buffer for the bulk transfer if one is
+	 * available, otherwise the server will reply inline.
+	 */
+	rdb = iof_pool_acquire(fs_handle->readdir_pool);
+	if (rdb)
+		in->bulk = rdb->lb.handle;
 
 	iof_tracker_init(&reply.tracker, 1);
 	rc = crt_req_send(rpc, readdir_cb, &reply);
 	if (rc) {
 		IOF_TRACE_ERROR(dir_handle,
 				"Could not send rpc, rc = %d", rc);
-		return EIO;
+		D_GOTO(out, ret = EIO);
 	}
 
 	iof_fs_wait(&fs_handle->proj, &reply.tracker);
 
-	if (reply.err != 0)
+	if (reply.err != 0) {
+		if (rdb)
+			rdb->failure = true;
 		D_GOTO(out, ret = reply.err);
+	}
 
 	if (reply.out->err != 0) {
+		if (rdb)
+			rdb->failure = true;
 		if (reply.out->err == -DER_NONEXIST)
 			H_GAH_SET_INVALID(dir_handle);
 		IOF_TRACE_ERROR(dir_handle,
@@ -158,6 +197,12 @@ static int readdir_get_data(struct iof_dir_handle *dir_handle, off_t offset)
 			"Reply received iov: %d bulk: %d", reply.out->iov_count,
 			reply.out->bulk_count);
 
+	if (compact) {
+		ret = readdir_decode(dir_handle, reply.out,
+				     rdb ? &rdb->lb : NULL, offset);
+		goto out;
+	}
+
 	if (reply.out->iov_count > 0) {
 		dir_handle->reply_count = reply.out->iov_count;
 
@@ -170,12 +215,13 @@ static int readdir_get_data(struct iof_dir_handle *dir_handle, off_t offset)
 		dir_handle->rpc = reply.rpc;
 		dir_handle->last_replies = reply.out->last;
 		goto out_with_rpc;
-	} else if (reply.out->bulk_count > 0) {
+	} else if (reply.out->bulk_count > 0 && rdb) {
 		dir_handle->reply_count = reply.out->bulk_count;
 		dir_handle->last_replies = reply.out->last;
-		dir_handle->replies = iov.iov_buf;
+		dir_handle->replies = rdb->lb.buf;
 		dir_handle->rpc = NULL;
-		dir_handle->replies_base = iov.iov_buf;
+		dir_handle->rdb = rdb;
+		rdb = NULL;
 	} else {
 		dir_handle->reply_count = 0;
 		dir_handle->replies = NULL;
@@ -187,14 +233,9 @@ out:
 		crt_req_decref(reply.rpc);
 
 out_with_rpc:
-	if (iov.iov_buf && iov.iov_buf != dir_handle->replies)
-		D_FREE(iov.iov_buf);
-
-	if (bulk) {
-		rc = crt_bulk_free(bulk);
-		if (rc)
-			ret = EIO;
-	}
+	if (rdb)
+		iof_pool_release(fs_handle->readdir_pool, rdb);
+	iof_pool_restock(fs_handle->readdir_pool);
 
 	return ret;
 }
@@ -214,6 +255,10 @@ static int readdir_next_reply_consume(struct iof_dir_handle *dir_handle)
 		if (dir_handle->rpc) {
 			crt_req_decref(dir_handle->rpc);
 			dir_handle->rpc = NULL;
+		} else if (dir_handle->rdb) {
+			iof_pool_release(dir_handle->open_req.fsh->readdir_pool,
+					 dir_handle->rdb);
+			dir_handle->rdb = NULL;
 		} else if (dir_handle->replies_base) {
 			D_FREE(dir_handle->replies_base);
 		}
@@ -101,6 +101,7 @@ ioc_writex(size_t len, off_t position, struct iof_wb *wb)
 	} else {
 		in->bulk_len = len;
 		in->data_bulk = wb->lb.handle;
+		in->data_bulk_off = wb->lb.offset;
 	}
 
 	in->xtvec.xt_off = position;
@@ -0,0 +1,230 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Adaptive control of the number of concurrent backend operations.
+ *
+ * The number of active reads or writes per projection is adjusted between
+ * configured bounds based on the latency and throughput of backend
+ * operations.  Samples are collected in windows of one operation per
+ * current slot, and at the end of each window:
+ *
+ * If the mean latency has more than doubled from the baseline the backend
+ * is overloaded, and the limit is cut by a quarter.
+ *
+ * If the limit was raised for the previous window but throughput did not
+ * improve then the backend is saturated, and the increase is reverted.
+ *
+ * Otherwise if latency is within a quarter of the baseline the limit is
+ * raised by one.
+ *
+ * The baseline is the lowest mean latency seen.  Whilst at the lower bound
+ * it moves towards the observed latency so that the controller recovers if
+ * the backend becomes permanently slower.  The limit starts at the upper
+ * bound, which was the fixed number of slots before the limit was adaptive,
+ * so that existing configurations are not throttled until the backend is
+ * seen to be overloaded.
+ */
+
+#include <time.h>
+
+#include "ionss.h"
+#include "log.h"
+
+uint64_t ionss_aimd_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int ionss_aimd_init(struct ionss_aimd *ctl, const char *name,
+		    uint32_t min, uint32_t max)
+{
+	int rc;
+
+	rc = D_MUTEX_INIT(&ctl->lock, NULL);
+	if (rc != -DER_SUCCESS)
+		return rc;
+
+	if (min == 0)
+		min = 1;
+	if (min > max)
+		min = max;
+
+	ctl->name = name;
+	ctl->min = min;
+	ctl->max = max;
+	atomic_store_release(&ctl->limit, max);
+	ctl->window_start = 0;
+	ctl->count = 0;
+	ctl->lat_sum = 0;
+	ctl->bytes = 0;
+	ctl->base_lat = 0;
+	ctl->last_tput = 0;
+	ctl->raised = false;
+	ctl->increases = 0;
+	ctl->decreases = 0;
+
+	return -DER_SUCCESS;
+}
+
+void ionss_aimd_fini(struct ionss_aimd *ctl)
+{
+	IOF_LOG_INFO("%s limit %u (%u-%u) increases %lu decreases %lu",
+		     ctl->name, atomic_load_consume(&ctl->limit), ctl->min,
+		     ctl->max,
+		     ctl->increases, ctl->decreases);
+	D_MUTEX_DESTROY(&ctl->lock);
+}
+
+/* Change the bounds of a running controller, clamping the current limit to
+ * the new range and starting a new window.  Slots above a reduced limit are
+ * dropped as the operations using them complete.
+ */
+void ionss_aimd_set_range(struct ionss_aimd *ctl, uint32_t min, uint32_t max)
+{
+	uint32_t limit;
+
+	if (min == 0)
+		min = 1;
+	if (min > max)
+		min = max;
+
+	D_MUTEX_LOCK(&ctl->lock);
+
+	limit = atomic_load_consume(&ctl->limit);
+	if (limit < min)
+		limit = min;
+	if (limit > max)
+		limit = max;
+
+	IOF_LOG_INFO("%s range %u-%u -> %u-%u limit %u", ctl->name, ctl->min,
+		     ctl->max, min, max, limit);
+
+	ctl->min = min;
+	ctl->max = max;
+	atomic_store_release(&ctl->limit, limit);
+	ctl->window_start = 0;
+	ctl->count = 0;
+	ctl->lat_sum = 0;
+	ctl->bytes = 0;
+	ctl->raised = false;
+
+	D_MUTEX_UNLOCK(&ctl->lock);
+}
+
+/* Process a complete window, called with the lock held */
+static void
+aimd_update(struct ionss_aimd *ctl, uint64_t now)
+{
+	uint64_t lat = ctl->lat_sum / ctl->count;
+	uint64_t elapsed = now - ctl->window_start;
+	uint64_t tput = 0;
+	uint32_t old = atomic_load_consume(&ctl->limit);
+	uint32_t limit = old;
+
+	/* Bytes per ms */
+	if (elapsed)
+		tput = ctl->bytes * 1000000 / elapsed;
+
+	if (ctl->base_lat == 0 || lat < ctl->base_lat)
+		ctl->base_lat = lat;
+	else if (old == ctl->min)
+		ctl->base_lat += (lat - ctl->base_lat) / 8;
+
+	/* Always drop at least one slot, as a quarter rounds down to zero
+	 * for small limits.
+	 */
+	if (lat > ctl->base_lat * 2)
+		limit -= limit >= 4 ? limit / 4 : 1;
+	else if (ctl->raised && tput <= ctl->last_tput)
+		limit--;
+	else if (lat <= ctl->base_lat + ctl->base_lat / 4)
+		limit++;
+
+	if (limit < ctl->min)
+		limit = ctl->min;
+	if (limit > ctl->max)
+		limit = ctl->max;
+
+	ctl->raised = limit > old;
+	ctl->last_tput = tput;
+
+	if (limit > old)
+		ctl->increases++;
+	else if (limit < old)
+		ctl->decreases++;
+
+	if (limit != old) {
+		IOF_LOG_INFO("%s limit %u -> %u latency %luns base %luns "
+			     "throughput %lu bytes/ms", ctl->name, old,
+			     limit, lat, ctl->base_lat, tput);
+		atomic_store_release(&ctl->limit, limit);
+	}
+
+	ctl->window_start = now;
+	ctl->count = 0;
+	ctl->lat_sum = 0;
+	ctl->bytes = 0;
+}
+
+void ionss_aimd_sample(struct ionss_aimd *ctl, uint64_t start, ssize_t bytes)
+{
+	uint64_t now;
+
+	if (ctl->min == ctl->max)
+		return;
+
+	now = ionss_aimd_now();
+
+	D_MUTEX_LOCK(&ctl->lock);
+
+	if (ctl->window_start == 0)
+		ctl->window_start = start;
+
+	ctl->count++;
+	ctl->lat_sum += now - start;
+	if (bytes > 0)
+		ctl->bytes += bytes;
+
+	if (ctl->count >= atomic_load_consume(&ctl->limit))
+		aimd_update(ctl, now);
+
+	D_MUTEX_UNLOCK(&ctl->lock);
+}
@@ -0,0 +1,599 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Shared block cache for the IONSS read path.
+ *
+ * Blocks are keyed by (inode, block number) and are max_read_size bytes long
+ * so a read segment which does not cross a block boundary can be served with
+ * a single bulk put directly from the cache.  Each block owns a bulk buffer
+ * which is registered once when the block is first created and then recycled
+ * on eviction so there is no registration on the critical path once the cache
+ * is warm.
+ *
+ * The cache is split into a number of shards each with their own lock, hash
+ * buckets and LRU list.  Blocks which are in use by an in-progress read hold
+ * a reference so are never recycled, if they are invalidated whilst in use
+ * they are unhashed and reclaimed when the last reference is dropped.
+ *
+ * Writes and truncates through the IONSS invalidate blocks explicitly.  To
+ * detect changes made outside of the IONSS, or re-use of inode numbers,
+ * blocks are validated against the ctime of the file when they are filled
+ * and at most once every IONSS_CACHE_REVALIDATE_NS after that, so external
+ * changes may not be seen for up to that long.
+ *
+ * Lookups from the progress threads only take blocks which have been
+ * validated recently and never touch the file.  Filling and revalidating
+ * blocks is done by ionss_cache_get() on the data lanes.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "iof_common.h"
+#include "ionss.h"
+#include "log.h"
+
+#define IONSS_CACHE_SHARDS 16
+
+/* Time for which a block is served without checking the file has changed */
+#define IONSS_CACHE_REVALIDATE_NS (1000ULL * 1000 * 1000)
+
+struct ionss_cache_shard {
+	pthread_mutex_t		lock;
+	d_list_t		*buckets;
+	uint32_t		bucket_count;
+	/* Hashed blocks, most recently used first */
+	d_list_t		lru;
+	/* Blocks with a registered buffer but no contents */
+	d_list_t		free_list;
+	uint32_t		count;
+	uint32_t		max_count;
+};
+
+struct ionss_cache {
+	struct ios_projection		*projection;
+	struct ionss_cache_shard	shards[IONSS_CACHE_SHARDS];
+	size_t				block_size;
+	/* Incremented on every invalidation, used to detect a block being
+	 * invalidated whilst it was being filled.
+	 */
+	ATOMIC uint64_t			generation;
+	ATOMIC uint64_t			hits;
+	ATOMIC uint64_t			misses;
+	ATOMIC uint64_t			evictions;
+	ATOMIC uint64_t			invalidations;
+};
+
+static uint64_t
+cache_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static uint64_t
+cache_hash(ino_t inode_no, uint64_t block)
+{
+	uint64_t hash = (inode_no * 0x9E3779B97F4A7C15ULL) ^ block;
+
+	return hash ^ (hash >> 29);
+}
+
+static struct ionss_cache_shard *
+cache_shard(struct ionss_cache *cache, uint64_t hash)
+{
+	return &cache->shards[hash % IONSS_CACHE_SHARDS];
+}
+
+static d_list_t *
+cache_bucket(struct ionss_cache_shard *shard, uint64_t hash)
+{
+	return &shard->buckets[(hash / IONSS_CACHE_SHARDS) %
+			       shard->bucket_count];
+}
+
+/* Find a block, called with the shard lock held */
+static struct ionss_cache_block *
+cache_find(struct ionss_cache_shard *shard, uint64_t hash, ino_t inode_no,
+	   uint64_t block)
+{
+	struct ionss_cache_block *blk;
+
+	d_list_for_each_entry(blk, cache_bucket(shard, hash), hlist) {
+		if (blk->inode_no == inode_no && blk->block == block)
+			return blk;
+	}
+	return NULL;
+}
+
+/* Remove a block from the hash table and LRU, and recycle it if it is not in
+ * use.  Called with the shard lock held.
+ */
+static void
+cache_unhash(struct ionss_cache_shard *shard, struct ionss_cache_block *blk)
+{
+	d_list_del_init(&blk->hlist);
+	d_list_del_init(&blk->lru);
+	blk->hashed = false;
+	if (blk->ref == 0)
+		d_list_add(&blk->lru, &shard->free_list);
+}
+
+/* Acquire a block to fill, either from the free list or by evicting the
+ * least recently used block which is not in use.
+ *
+ * Called with the shard lock held, returns NULL and sets *alloc if a new
+ * block should be created by the caller.
+ */
+static struct ionss_cache_block *
+cache_get_free(struct ionss_cache *cache, struct ionss_cache_shard *shard,
+	       bool *alloc)
+{
+	struct ionss_cache_block *blk;
+
+	*alloc = false;
+
+	blk = d_list_pop_entry(&shard->free_list, struct ionss_cache_block,
+			       lru);
+	if (blk)
+		return blk;
+
+	if (shard->count < shard->max_count) {
+		shard->count++;
+		*alloc = true;
+		return NULL;
+	}
+
+	for (blk = d_list_entry(shard->lru.prev, struct ionss_cache_block, lru);
+	     &blk->lru != &shard->lru;
+	     blk = d_list_entry(blk->lru.prev, struct ionss_cache_block, lru)) {
+		if (blk->ref != 0)
+			continue;
+
+		d_list_del_init(&blk->hlist);
+		d_list_del_init(&blk->lru);
+		blk->hashed = false;
+		atomic_inc(&cache->evictions);
+		return blk;
+	}
+
+	return NULL;
+}
+
+static void
+cache_block_free(struct ionss_cache_block *blk)
+{
+	IOF_BULK_FREE(blk, bulk);
+	D_FREE(blk);
+}
+
+int
+ionss_cache_init(struct ios_projection *projection)
+{
+	struct ionss_cache *cache;
+	uint64_t max_blocks;
+	uint32_t per_shard;
+	int i;
+	int rc;
+
+	projection->cache = NULL;
+
+	if (projection->cache_size == 0)
+		return -DER_SUCCESS;
+
+	D_ALLOC_PTR(cache);
+	if (!cache)
+		return -DER_NOMEM;
+
+	cache->projection = projection;
+	cache->block_size = projection->max_read_size;
+
+	max_blocks = projection->cache_size / cache->block_size;
+	per_shard = (max_blocks + IONSS_CACHE_SHARDS - 1) / IONSS_CACHE_SHARDS;
+	if (per_shard == 0)
+		per_shard = 1;
+
+	for (i = 0; i < IONSS_CACHE_SHARDS; i++) {
+		struct ionss_cache_shard *shard = &cache->shards[i];
+		int j;
+
+		shard->max_count = per_shard;
+		shard->bucket_count = 8;
+		while (shard->bucket_count < per_shard)
+			shard->bucket_count <<= 1;
+
+		D_ALLOC_ARRAY(shard->buckets, shard->bucket_count);
+		if (!shard->buckets)
+			D_GOTO(err, rc = -DER_NOMEM);
+
+		for (j = 0; j < shard->bucket_count; j++)
+			D_INIT_LIST_HEAD(&shard->buckets[j]);
+
+		D_INIT_LIST_HEAD(&shard->lru);
+		D_INIT_LIST_HEAD(&shard->free_list);
+
+		rc = D_MUTEX_INIT(&shard->lock, NULL);
+		if (rc != -DER_SUCCESS) {
+			D_FREE(shard->buckets);
+			D_GOTO(err, rc);
+		}
+	}
+
+	IOF_TRACE_UP(cache, projection, "block_cache");
+	IOF_TRACE_INFO(cache, "Block cache of %u blocks of %zu bytes",
+		       per_shard * IONSS_CACHE_SHARDS, cache->block_size);
+
+	projection->cache = cache;
+	return -DER_SUCCESS;
+
+err:
+	while (--i >= 0) {
+		pthread_mutex_destroy(&cache->shards[i].lock);
+		D_FREE(cache->shards[i].buckets);
+	}
+	D_FREE(cache);
+	return rc;
+}
+
+void
+ionss_cache_fini(struct ios_projection *projection)
+{
+	struct ionss_cache *cache = projection->cache;
+	struct ionss_cache_block *blk;
+	int i;
+
+	if (!cache)
+		return;
+
+	IOF_TRACE_INFO(cache, "hits %lu misses %lu evictions %lu "
+		       "invalidations %lu",
+		       cache->hits, cache->misses, cache->evictions,
+		       cache->invalidations);
+
+	for (i = 0; i < IONSS_CACHE_SHARDS; i++) {
+		struct ionss_cache_shard *shard = &cache->shards[i];
+
+		while ((blk = d_list_pop_entry(&shard->lru,
+					       struct ionss_cache_block,
+					       lru))) {
+			if (blk->ref != 0)
+				IOF_TRACE_WARNING(blk, "Freeing block in use");
+			cache_block_free(blk);
+		}
+		while ((blk = d_list_pop_entry(&shard->free_list,
+					       struct ionss_cache_block,
+					       lru)))
+			cache_block_free(blk);
+
+		pthread_mutex_destroy(&shard->lock);
+		D_FREE(shard->buckets);
+	}
+
+	IOF_TRACE_DOWN(cache);
+	D_FREE(cache);
+	projection->cache = NULL;
+}
+
+/* Drop a reference to a block, called with the shard lock held */
+static void
+cache_release(struct ionss_cache_shard *shard, struct ionss_cache_block *blk)
+{
+	blk->ref--;
+	if (blk->ref == 0 && !blk->hashed)
+		d_list_add(&blk->lru, &shard->free_list);
+}
+
+bool
+ionss_cache_covers(struct ionss_cache *cache, off_t offset, size_t len)
+{
+	return (offset % cache->block_size) + len <= cache->block_size;
+}
+
+struct ionss_cache_block *
+ionss_cache_lookup(struct ionss_cache *cache, ino_t inode_no, off_t offset,
+		   size_t len, size_t *block_offset)
+{
+	struct ionss_cache_shard *shard;
+	struct ionss_cache_block *blk;
+	uint64_t block;
+	uint64_t hash;
+	uint64_t now;
+
+	block = offset / cache->block_size;
+	*block_offset = offset % cache->block_size;
+
+	if (*block_offset + len > cache->block_size)
+		return NULL;
+
+	hash = cache_hash(inode_no, block);
+	shard = cache_shard(cache, hash);
+	now = cache_now();
+
+	D_MUTEX_LOCK(&shard->lock);
+
+	blk = cache_find(shard, hash, inode_no, block);
+	if (!blk || now - blk->validated >= IONSS_CACHE_REVALIDATE_NS) {
+		D_MUTEX_UNLOCK(&shard->lock);
+		return NULL;
+	}
+
+	blk->ref++;
+	d_list_move(&blk->lru, &shard->lru);
+
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	atomic_inc(&cache->hits);
+	return blk;
+}
+
+struct ionss_cache_block *
+ionss_cache_get(struct ionss_file_handle *handle, off_t offset, size_t len,
+		size_t *block_offset)
+{
+	struct ionss_cache *cache = handle->projection->cache;
+	struct ionss_cache_shard *shard;
+	struct ionss_cache_block *blk;
+	struct ionss_cache_block *existing;
+	struct stat st;
+	uint64_t generation;
+	uint64_t block;
+	uint64_t hash;
+	uint64_t now;
+	ino_t inode_no = handle->mf.inode_no;
+	ssize_t res;
+	bool have_st = false;
+	bool alloc;
+	int rc;
+
+	block = offset / cache->block_size;
+	*block_offset = offset % cache->block_size;
+
+	/* Only reads which fit within a single block are cached */
+	if (*block_offset + len > cache->block_size)
+		return NULL;
+
+	hash = cache_hash(inode_no, block);
+	shard = cache_shard(cache, hash);
+	now = cache_now();
+
+	D_MUTEX_LOCK(&shard->lock);
+
+	blk = cache_find(shard, hash, inode_no, block);
+	if (blk) {
+		blk->ref++;
+		d_list_move(&blk->lru, &shard->lru);
+		if (now - blk->validated < IONSS_CACHE_REVALIDATE_NS) {
+			D_MUTEX_UNLOCK(&shard->lock);
+			atomic_inc(&cache->hits);
+			return blk;
+		}
+		D_MUTEX_UNLOCK(&shard->lock);
+
+		errno = 0;
+		rc = fstat(handle->fd, &st);
+
+		D_MUTEX_LOCK(&shard->lock);
+		if (rc == 0 && blk->hashed &&
+		    blk->ctime.tv_sec == st.st_ctim.tv_sec &&
+		    blk->ctime.tv_nsec == st.st_ctim.tv_nsec) {
+			blk->validated = now;
+			D_MUTEX_UNLOCK(&shard->lock);
+			atomic_inc(&cache->hits);
+			return blk;
+		}
+
+		/* The file has changed since the block was read */
+		if (blk->hashed) {
+			cache_unhash(shard, blk);
+			atomic_inc(&cache->invalidations);
+		}
+		cache_release(shard, blk);
+
+		if (rc) {
+			D_MUTEX_UNLOCK(&shard->lock);
+			return NULL;
+		}
+		have_st = true;
+	}
+
+	atomic_inc(&cache->misses);
+
+	generation = atomic_load_consume(&cache->generation);
+
+	if (!have_st) {
+		D_MUTEX_UNLOCK(&shard->lock);
+
+		errno = 0;
+		rc = fstat(handle->fd, &st);
+		if (rc)
+			return NULL;
+
+		D_MUTEX_LOCK(&shard->lock);
+	}
+
+	blk = cache_get_free(cache, shard, &alloc);
+
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	if (alloc) {
+		D_ALLOC_PTR(blk);
+		if (blk) {
+			D_INIT_LIST_HEAD(&blk->hlist);
+			D_INIT_LIST_HEAD(&blk->lru);
+			IOF_TRACE_UP(blk, cache, "cache_block");
+			if (!IOF_BULK_ALLOC(handle->projection->base->crt_ctx,
+					    blk, bulk, cache->block_size,
+					    true)) {
+				IOF_TRACE_DOWN(blk);
+				D_FREE(blk);
+			}
+		}
+		if (!blk) {
+			D_MUTEX_LOCK(&shard->lock);
+			shard->count--;
+			D_MUTEX_UNLOCK(&shard->lock);
+		}
+	}
+
+	/* The cache is full of blocks which are in use */
+	if (!blk)
+		return NULL;
+
+	IOF_TRACE_DEBUG(blk, "Filling block %lu of inode %lu", block,
+			inode_no);
+
+	errno = 0;
+	res = pread(handle->fd, blk->bulk.buf, cache->block_size,
+		    block * cache->block_size);
+	if (res == -1) {
+		IOF_TRACE_DEBUG(blk, "Failed to fill block %d", errno);
+		D_MUTEX_LOCK(&shard->lock);
+		d_list_add(&blk->lru, &shard->free_list);
+		D_MUTEX_UNLOCK(&shard->lock);
+		return NULL;
+	}
+
+	blk->inode_no = inode_no;
+	blk->block = block;
+	blk->len = res;
+	blk->ctime = st.st_ctim;
+	blk->validated = now;
+	blk->ref = 1;
+
+	D_MUTEX_LOCK(&shard->lock);
+
+	existing = cache_find(shard, hash, inode_no, block);
+	if (existing || generation != atomic_load_consume(&cache->generation)) {
+		/* Either another thread filled the same block or the file was
+		 * modified during the read, in either case use this copy but
+		 * do not hash it, so it's recycled after use.
+		 */
+		blk->hashed = false;
+	} else {
+		blk->hashed = true;
+		d_list_add(&blk->hlist, cache_bucket(shard, hash));
+		d_list_add(&blk->lru, &shard->lru);
+	}
+
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	return blk;
+}
+
+void
+ionss_cache_put(struct ionss_cache *cache, struct ionss_cache_block *blk)
+{
+	struct ionss_cache_shard *shard;
+
+	shard = cache_shard(cache, cache_hash(blk->inode_no, blk->block));
+
+	D_MUTEX_LOCK(&shard->lock);
+	cache_release(shard, blk);
+	D_MUTEX_UNLOCK(&shard->lock);
+}
+
+void
+ionss_cache_invalidate(struct ionss_cache *cache, ino_t inode_no,
+		       off_t offset, size_t len)
+{
+	struct ionss_cache_block *blk;
+	uint64_t block;
+	uint64_t last;
+
+	if (!cache || len == 0)
+		return;
+
+	atomic_inc(&cache->generation);
+
+	last = (offset + len - 1) / cache->block_size;
+	for (block = offset / cache->block_size; block <= last; block++) {
+		uint64_t hash = cache_hash(inode_no, block);
+		struct ionss_cache_shard *shard = cache_shard(cache, hash);
+
+		D_MUTEX_LOCK(&shard->lock);
+		blk = cache_find(shard, hash, inode_no, block);
+		if (blk) {
+			cache_unhash(shard, blk);
+			atomic_inc(&cache->invalidations);
+		}
+		D_MUTEX_UNLOCK(&shard->lock);
+	}
+}
+
+void
+ionss_cache_invalidate_inode(struct ionss_cache *cache, ino_t inode_no)
+{
+	struct ionss_cache_block *blk;
+	struct ionss_cache_block *next;
+	int i;
+
+	if (!cache)
+		return;
+
+	atomic_inc(&cache->generation);
+
+	for (i = 0; i < IONSS_CACHE_SHARDS; i++) {
+		struct ionss_cache_shard *shard = &cache->shards[i];
+
+		D_MUTEX_LOCK(&shard->lock);
+		d_list_for_each_entry_safe(blk, next, &shard->lru, lru) {
+			if (blk->inode_no != inode_no)
+				continue;
+			cache_unhash(shard, blk);
+			atomic_inc(&cache->invalidations);
+		}
+		D_MUTEX_UNLOCK(&shard->lock);
+	}
+}
+
+void
+ionss_cache_read_stats(struct ionss_cache *cache,
+		       struct iof_projection_stats *ps)
+{
+	if (!cache)
+		return;
+
+	ps->cache_hits = atomic_load_consume(&cache->hits);
+	ps->cache_misses = atomic_load_consume(&cache->misses);
+	ps->cache_evictions = atomic_load_consume(&cache->evictions);
+	ps->cache_invalidations = atomic_load_consume(&cache->invalidations);
+}
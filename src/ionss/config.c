@@ -38,6 +38,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <yaml.h>
 
 #include "log.h"
@@ -71,12 +72,18 @@
 	X(max_iov_write_size, set_size)		\
 	X(max_read_count, set_decimal)		\
 	X(max_write_count, set_decimal)		\
+	X(min_read_count, set_decimal)		\
+	X(min_write_count, set_decimal)		\
 	X(inode_htable_size, set_decimal)	\
 	X(cnss_thread_count, set_decimal)	\
 	X(cnss_timeout, set_decimal)		\
+	X(cache_size, set_size64)		\
+	X(data_thread_count, set_decimal)	\
+	X(direct_io_size, set_size)		\
 	X(cnss_threads, set_flag)		\
 	X(fuse_read_buf, set_flag)		\
 	X(fuse_write_buf, set_flag)		\
+	X(io_uring, set_flag)			\
 	X(failover, set_feature)		\
 	X(writeable, set_feature)
 
@@ -85,7 +92,15 @@
 	X(poll_interval, set_decimal)		\
 	X(cnss_poll_interval, set_decimal)	\
 	X(thread_count, set_decimal)		\
-	X(progress_callback, set_flag)
+	X(stat_thread_count, set_decimal)	\
+	X(meta_thread_count, set_decimal)	\
+	X(setup_thread_count, set_decimal)	\
+	X(client_weights, set_weights)		\
+	X(max_open_files, set_decimal)		\
+	X(progress_callback, set_flag)		\
+	X(numa_bind, set_flag)			\
+	X(numa_spread, set_flag)		\
+	X(numa_interface, set_string)
 
 #define PROJ_OPTIONS				\
 	X(full_path, set_string, false)		\
@@ -99,9 +114,17 @@ PROJ_OPTIONS
 
 const char	*default_group_name		= "IONSS";
 const uint32_t	default_thread_count		= 2;
+const uint32_t	default_stat_thread_count	= 4;
+const uint32_t	default_meta_thread_count	= 4;
+const uint32_t	default_setup_thread_count	= 8;
+const uint32_t	default_max_open_files		= 0;
 const uint32_t	default_poll_interval		= (1000 * 1000);
 const uint32_t	default_cnss_poll_interval	= (1);
 const bool	default_progress_callback	= true;
+const bool	default_numa_bind		= false;
+const bool	default_numa_spread		= false;
+char *const	default_numa_interface		= NULL;
+struct ionss_client_weights *const default_client_weights = NULL;
 const uint32_t	default_readdir_size		= (64 * 1024);
 const uint32_t	default_max_read_size		= (1024 * 1024);
 const uint32_t	default_max_write_size		= (1024 * 1024);
@@ -109,12 +132,18 @@ const uint32_t	default_max_iov_read_size	= 64;
 const uint32_t	default_max_iov_write_size	= 64;
 const uint32_t	default_max_read_count		= 3;
 const uint32_t	default_max_write_count		= 3;
+const uint32_t	default_min_read_count		= 1;
+const uint32_t	default_min_write_count		= 1;
 const uint32_t	default_inode_htable_size	= 5;
 const uint32_t	default_cnss_thread_count	= 0;
 const uint32_t	default_cnss_timeout		= 60;
+const uint64_t	default_cache_size		= 0;
+const uint32_t	default_data_thread_count	= 2;
+const uint32_t	default_direct_io_size		= 0;
 const bool	default_cnss_threads		= true;
 const bool	default_fuse_read_buf		= true;
 const bool	default_fuse_write_buf		= true;
+const bool	default_io_uring		= false;
 const bool	default_failover		= true;
 const bool	default_writeable		= true;
 
@@ -151,18 +180,18 @@ struct parsed_option_s *find_option(struct parsed_option_s *options,
 }
 
 /*
- * Parse a uint32_t from a command line option and allow either k or m
- * suffixes.  Updates the value if str contains a valid value or returns
- * -1 on failure.
+ * Parse a uint64_t from a command line option and allow either k, m or g
+ * suffixes.  Updates the value if str
+ * contains a valid value or returns -1 on failure.
  */
-static int parse_number(uint32_t *value, const char *str,
-			int len, uint32_t multiplier)
+static int parse_number64(uint64_t *value, const char *str,
+			  int len, uint64_t multiplier)
 {
-	uint32_t new_value = *value;
+	uint64_t new_value = *value;
 	char fmt[10];
 
 	/* Read the numeric value */
-	snprintf(fmt, 10, "%%%du", len);
+	snprintf(fmt, 10, "%%%d" SCNu64, len);
 	if (sscanf(str, fmt, &new_value) != 1)
 		return -1;
 
@@ -173,6 +202,9 @@ static int parse_number(uint32_t *value, const char *str,
 	switch (*str) {
 	case '\0':
 		break;
+	case 'g':
+	case 'G':
+		new_value *= multiplier;
 	case 'm':
 	case 'M':
 		new_value *= multiplier;
@@ -185,7 +217,29 @@ static int parse_number(uint32_t *value, const char *str,
 		return -1;
 	}
 	*value = new_value;
-	IOF_LOG_DEBUG("Setting option value: %u", new_value);
+	IOF_LOG_DEBUG("Setting option value: %" PRIu64, new_value);
+	return 0;
+}
+
+/*
+ * Parse a uint32_t from a command line option, as parse_number64() but
+ * failing if the value does not fit.
+ */
+static int parse_number(uint32_t *value, const char *str,
+			int len, uint32_t multiplier)
+{
+	uint64_t new_value = *value;
+	int rc;
+
+	rc = parse_number64(&new_value, str, len, multiplier);
+	if (rc)
+		return rc;
+
+	if (new_value > UINT32_MAX) {
+		IOF_LOG_ERROR("Value too large %.*s", len, str);
+		return -1;
+	}
+	*value = new_value;
 	return 0;
 }
 
@@ -213,6 +267,19 @@ static int set_size(struct parsed_option_s *option,
 			    (int)node->data.scalar.length, 1024);
 }
 
+/* As set_size() but for options which may be larger than 4GiB */
+static int set_size64(struct parsed_option_s *option,
+		      yaml_document_t *document, yaml_node_t *node)
+{
+	if (node->type != YAML_SCALAR_NODE) {
+		IOF_LOG_ERROR("Invalid YAML node type");
+		return -1;
+	}
+	return parse_number64(&option->buf,
+			      (char *)node->data.scalar.value,
+			      (int)node->data.scalar.length, 1024);
+}
+
 static int parse_boolean(bool *value, char *str, int len, char *list[2])
 
 {
@@ -275,6 +342,55 @@ static int set_string(struct parsed_option_s *option,
 	return ret;
 }
 
+/* Parse a mapping of client rank to weight */
+static int set_weights(struct parsed_option_s *option,
+		       yaml_document_t *document, yaml_node_t *node)
+{
+	struct ionss_client_weights *weights;
+	yaml_node_t *key_node, *val_node;
+	yaml_node_pair_t *node_pair;
+	int count;
+	int i = 0;
+
+	if (node->type != YAML_MAPPING_NODE) {
+		IOF_LOG_ERROR("Invalid YAML node type");
+		return -1;
+	}
+
+	count = node->data.mapping.pairs.top - node->data.mapping.pairs.start;
+	D_ALLOC(weights, sizeof(*weights) + count * sizeof(weights->entries[0]));
+	if (!weights)
+		return -1;
+	weights->count = count;
+
+	for (node_pair = node->data.mapping.pairs.start;
+	     node_pair < node->data.mapping.pairs.top; node_pair++, i++) {
+		key_node = yaml_document_get_node(document, node_pair->key);
+		val_node = yaml_document_get_node(document, node_pair->value);
+		if (key_node->type != YAML_SCALAR_NODE ||
+		    val_node->type != YAML_SCALAR_NODE)
+			goto err;
+		if (parse_number(&weights->entries[i].rank,
+				 (char *)key_node->data.scalar.value,
+				 (int)key_node->data.scalar.length, 1))
+			goto err;
+		if (parse_number(&weights->entries[i].weight,
+				 (char *)val_node->data.scalar.value,
+				 (int)val_node->data.scalar.length, 1))
+			goto err;
+		if (weights->entries[i].weight == 0) {
+			IOF_LOG_ERROR("Client weights must be non-zero");
+			goto err;
+		}
+	}
+
+	option->ptr_val = weights;
+	return 0;
+err:
+	D_FREE(weights);
+	return -1;
+}
+
 static int parse_node(yaml_document_t *document, yaml_node_t *node,
 		      struct parsed_option_s *options, int num_options)
 {
@@ -502,3 +618,25 @@ cleanup:
 		fclose(fp);
 	return ret;
 }
+
+/* Free the memory allocated by parse_config() for a configuration which was
+ * not used to start the IONSS, such as one read when reloading.  May be
+ * called after parse_config() has failed.
+ */
+void free_config(struct ios_base *base)
+{
+	int i;
+
+	if (base->projection_array) {
+		for (i = 0; i < base->projection_count; i++) {
+			D_FREE(base->projection_array[i].full_path);
+			D_FREE(base->projection_array[i].mount_path);
+		}
+		D_FREE(base->projection_array);
+	}
+
+	if (base->group_name != default_group_name)
+		D_FREE(base->group_name);
+	D_FREE(base->client_weights);
+	D_FREE(base->numa_interface);
+}
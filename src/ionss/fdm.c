@@ -0,0 +1,433 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Descriptor management for inode handles.
+ *
+ * Every inode which a client has looked up is represented by an O_PATH
+ * descriptor, so with a large number of client inodes the IONSS can run out
+ * of descriptors.  Where the filesystem supports it a file handle is saved
+ * with name_to_handle_at() when the inode is first looked up, and only a
+ * bounded number of descriptors are kept open, with the least recently used
+ * being closed and reopened on demand with open_by_handle_at().
+ *
+ * Descriptors are pinned whilst in use by a handler, and only unpinned
+ * handles are on the LRU list so can be closed.  Handles for which no file
+ * handle could be saved, or projections where open_by_handle_at() is not
+ * permitted, are never closed so are not counted against the limit.
+ *
+ * Handles are spread over a number of shards by inode number, each with its
+ * own lock, LRU list and share of the limit, so that metadata handlers
+ * running in parallel do not all contend on one lock.
+ *
+ * The manager also keeps a read-only descriptor for each handle, opened on
+ * first use, for setattr, and opens new descriptors for open and opendir
+ * from the file handle rather than resolving a /proc/self/fd path.  Both
+ * descriptors count towards the limit.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ionss.h"
+#include "log.h"
+
+#define FDM_HANDLE_SIZE MAX_HANDLE_SZ
+
+static struct ionss_fdm_shard *
+fdm_shard(struct ionss_fdm *fdm, struct ionss_file_handle *fh)
+{
+	return &fdm->shards[fh->mf.inode_no % IONSS_FDM_SHARDS];
+}
+
+int ionss_fdm_init(struct ionss_fdm *fdm, uint32_t max_open)
+{
+	struct ionss_fdm_shard *shard;
+	uint32_t shard_max;
+	int rc;
+	int i;
+
+	/* Round up so that a small limit still allows every shard one
+	 * descriptor.
+	 */
+	shard_max = max_open / IONSS_FDM_SHARDS;
+	if (max_open % IONSS_FDM_SHARDS)
+		shard_max++;
+
+	fdm->max_open = max_open;
+
+	for (i = 0; i < IONSS_FDM_SHARDS; i++) {
+		shard = &fdm->shards[i];
+
+		rc = D_MUTEX_INIT(&shard->lock, NULL);
+		if (rc != -DER_SUCCESS) {
+			while (--i >= 0)
+				D_MUTEX_DESTROY(&fdm->shards[i].lock);
+			return rc;
+		}
+
+		D_INIT_LIST_HEAD(&shard->lru);
+		shard->max_open = shard_max;
+		shard->open_count = 0;
+		shard->reopens = 0;
+		shard->evictions = 0;
+	}
+
+	IOF_LOG_INFO("Keeping at most %u inode descriptors open",
+		       max_open);
+
+	return -DER_SUCCESS;
+}
+
+void ionss_fdm_read_stats(struct ionss_fdm *fdm, struct ionss_fdm_stats *st)
+{
+	struct ionss_fdm_shard *shard;
+	int i;
+
+	memset(st, 0, sizeof(*st));
+	st->max_open = fdm->max_open;
+
+	for (i = 0; i < IONSS_FDM_SHARDS; i++) {
+		shard = &fdm->shards[i];
+
+		D_MUTEX_LOCK(&shard->lock);
+		st->open_count += shard->open_count;
+		st->reopens += shard->reopens;
+		st->evictions += shard->evictions;
+		D_MUTEX_UNLOCK(&shard->lock);
+	}
+}
+
+void ionss_fdm_fini(struct ionss_fdm *fdm)
+{
+	struct ionss_fdm_stats st;
+	int i;
+
+	ionss_fdm_read_stats(fdm, &st);
+
+	IOF_LOG_INFO("open %u reopens %lu evictions %lu",
+		       st.open_count, st.reopens, st.evictions);
+
+	for (i = 0; i < IONSS_FDM_SHARDS; i++)
+		D_MUTEX_DESTROY(&fdm->shards[i].lock);
+}
+
+/* Save a file handle for the projection root, and check that it can be used
+ * to reopen files.  open_by_handle_at() requires CAP_DAC_READ_SEARCH so is
+ * often not available, and cannot use the O_PATH root descriptor to identify
+ * the mount so a second descriptor is opened for that.
+ */
+void ionss_fdm_projection_init(struct ios_projection *projection)
+{
+	struct file_handle *fhandle;
+	int fd;
+	int rc;
+
+	projection->fd_by_handle = false;
+	projection->mount_fd = -1;
+
+	D_ALLOC(fhandle, sizeof(*fhandle) + FDM_HANDLE_SIZE);
+	if (!fhandle)
+		return;
+
+	fhandle->handle_bytes = FDM_HANDLE_SIZE;
+
+	errno = 0;
+	rc = name_to_handle_at(projection->root->fd, "", fhandle,
+			       &projection->mount_id, AT_EMPTY_PATH);
+	if (rc != 0) {
+		IOF_TRACE_INFO(projection, "File handles not supported %d",
+			       errno);
+		D_GOTO(out, 0);
+	}
+
+	errno = 0;
+	projection->mount_fd = open(projection->root->proc_fd_name,
+				    O_DIRECTORY | O_RDONLY);
+	if (projection->mount_fd == -1) {
+		IOF_TRACE_INFO(projection, "Could not open root %d", errno);
+		D_GOTO(out, 0);
+	}
+
+	errno = 0;
+	fd = open_by_handle_at(projection->mount_fd, fhandle,
+			       O_PATH | O_RDONLY);
+	if (fd == -1) {
+		IOF_TRACE_INFO(projection, "Reopen by handle not permitted %d",
+			       errno);
+		close(projection->mount_fd);
+		projection->mount_fd = -1;
+		D_GOTO(out, 0);
+	}
+	close(fd);
+
+	projection->fd_by_handle = true;
+
+out:
+	D_FREE(fhandle);
+}
+
+void ionss_fdm_projection_fini(struct ios_projection *projection)
+{
+	if (projection->mount_fd != -1)
+		close(projection->mount_fd);
+	projection->mount_fd = -1;
+	projection->fd_by_handle = false;
+}
+
+/* Close the descriptors for a handle, called with the shard lock held */
+static void
+fdm_close(struct ionss_fdm_shard *shard, struct ionss_file_handle *fh)
+{
+	IOF_TRACE_DEBUG(fh, "Closing %d %d", fh->fd, fh->attr_fd);
+
+	close(fh->fd);
+	fh->fd = -1;
+	shard->open_count--;
+
+	if (fh->attr_fd != -1) {
+		close(fh->attr_fd);
+		fh->attr_fd = -1;
+		shard->open_count--;
+	}
+}
+
+/* Close least recently used descriptors until under the limit, called with
+ * the shard lock held.
+ */
+static void
+fdm_evict(struct ionss_fdm_shard *shard)
+{
+	struct ionss_file_handle *fh;
+
+	while (shard->open_count > shard->max_open &&
+	       !d_list_empty(&shard->lru)) {
+		fh = d_list_entry(shard->lru.next, struct ionss_file_handle,
+				  fd_lru);
+		d_list_del_init(&fh->fd_lru);
+
+		fdm_close(shard, fh);
+		shard->evictions++;
+	}
+}
+
+void ionss_fdm_add(struct ionss_fdm *fdm, struct ionss_file_handle *fh)
+{
+	struct ios_projection *projection = fh->projection;
+	struct ionss_fdm_shard *shard;
+	struct file_handle *fhandle;
+	int mount_id;
+	int rc;
+
+	D_INIT_LIST_HEAD(&fh->fd_lru);
+
+	if (!projection->fd_by_handle)
+		return;
+
+	D_ALLOC(fhandle, sizeof(*fhandle) + FDM_HANDLE_SIZE);
+	if (!fhandle)
+		return;
+
+	fhandle->handle_bytes = FDM_HANDLE_SIZE;
+
+	/* Inodes on a different mount to the projection root, or for which
+	 * the filesystem cannot provide a handle, are kept open.
+	 */
+	rc = name_to_handle_at(fh->fd, "", fhandle, &mount_id, AT_EMPTY_PATH);
+	if (rc != 0 || mount_id != projection->mount_id) {
+		D_FREE(fhandle);
+		return;
+	}
+
+	fh->fhandle = fhandle;
+
+	shard = fdm_shard(fdm, fh);
+
+	D_MUTEX_LOCK(&shard->lock);
+	shard->open_count++;
+	d_list_add_tail(&fh->fd_lru, &shard->lru);
+	fdm_evict(shard);
+	D_MUTEX_UNLOCK(&shard->lock);
+}
+
+void ionss_fdm_remove(struct ionss_fdm *fdm, struct ionss_file_handle *fh)
+{
+	struct ionss_fdm_shard *shard;
+
+	/* Handles without a file handle are not counted */
+	if (!fh->fhandle) {
+		close(fh->fd);
+		fh->fd = -1;
+		return;
+	}
+
+	shard = fdm_shard(fdm, fh);
+
+	D_MUTEX_LOCK(&shard->lock);
+	d_list_del_init(&fh->fd_lru);
+	if (fh->fd != -1)
+		fdm_close(shard, fh);
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	D_FREE(fh->fhandle);
+}
+
+int ionss_fd_get(struct ionss_fdm *fdm, struct ionss_file_handle *fh)
+{
+	struct ionss_fdm_shard *shard;
+	int fd;
+
+	if (!fh->fhandle)
+		return fh->fd;
+
+	shard = fdm_shard(fdm, fh);
+
+	D_MUTEX_LOCK(&shard->lock);
+
+	if (fh->fd == -1) {
+		errno = 0;
+		fd = open_by_handle_at(fh->projection->mount_fd, fh->fhandle,
+				       fh->mf.flags);
+		if (fd == -1) {
+			fd = -errno;
+			D_MUTEX_UNLOCK(&shard->lock);
+			IOF_TRACE_WARNING(fh, "Could not reopen %d", -fd);
+			return fd;
+		}
+
+		fh->fd = fd;
+		snprintf(fh->proc_fd_name, 64, "/proc/self/fd/%d", fh->fd);
+		shard->open_count++;
+		shard->reopens++;
+		IOF_TRACE_DEBUG(fh, "Reopened as %d", fh->fd);
+	}
+
+	if (fh->fd_users++ == 0)
+		d_list_del_init(&fh->fd_lru);
+
+	fd = fh->fd;
+
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	return fd;
+}
+
+void ionss_fd_put(struct ionss_fdm *fdm, struct ionss_file_handle *fh)
+{
+	struct ionss_fdm_shard *shard;
+
+	if (!fh->fhandle)
+		return;
+
+	shard = fdm_shard(fdm, fh);
+
+	D_MUTEX_LOCK(&shard->lock);
+
+	if (--fh->fd_users == 0) {
+		d_list_add_tail(&fh->fd_lru, &shard->lru);
+		fdm_evict(shard);
+	}
+
+	D_MUTEX_UNLOCK(&shard->lock);
+}
+
+int ionss_fd_open(struct ionss_file_handle *fh, int flags)
+{
+	int fd;
+
+	errno = 0;
+	if (fh->fhandle) {
+		fd = open_by_handle_at(fh->projection->mount_fd, fh->fhandle,
+				       flags);
+		if (fd == -1)
+			return -errno;
+		return fd;
+	}
+
+	fd = open(fh->proc_fd_name, flags);
+	if (fd == -1)
+		return -errno;
+	return fd;
+}
+
+int ionss_fd_get_attr(struct ionss_fdm *fdm, struct ionss_file_handle *fh,
+		      bool *cached)
+{
+	struct ionss_fdm_shard *shard;
+	int fd;
+
+	/* Handles which cannot be evicted do not keep a second descriptor,
+	 * as it would never be closed.
+	 */
+	if (!fh->fhandle) {
+		*cached = false;
+		return ionss_fd_open(fh, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	}
+
+	*cached = true;
+
+	shard = fdm_shard(fdm, fh);
+
+	D_MUTEX_LOCK(&shard->lock);
+	fd = fh->attr_fd;
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	if (fd != -1)
+		return fd;
+
+	/* Only a read-only descriptor is cached, as holding a writable one
+	 * would cause exec of the file to fail with ETXTBSY.
+	 */
+	fd = ionss_fd_open(fh, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0)
+		return fd;
+
+	D_MUTEX_LOCK(&shard->lock);
+	if (fh->attr_fd == -1) {
+		fh->attr_fd = fd;
+		shard->open_count++;
+	} else {
+		close(fd);
+		fd = fh->attr_fd;
+	}
+	D_MUTEX_UNLOCK(&shard->lock);
+
+	return fd;
+}
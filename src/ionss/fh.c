@@ -53,13 +53,10 @@ int ios_fh_alloc(struct ios_projection *projection,
 	if (!fh)
 		return -DER_NOMEM;
 
-	D_RWLOCK_WRLOCK(&base->gah_rwlock);
-
 	rc = ios_gah_allocate(base->gs, &fh->gah, fh);
 	if (rc) {
 		IOF_LOG_ERROR("Failed to acquire GAH %d", rc);
 		iof_pool_release(projection->fh_pool, fh);
-		D_RWLOCK_UNLOCK(&base->gah_rwlock);
 		return -DER_NOMEM;
 	}
 
@@ -67,8 +64,6 @@ int ios_fh_alloc(struct ios_projection *projection,
 
 	*fhp = fh;
 
-	D_RWLOCK_UNLOCK(&base->gah_rwlock);
-
 	IOF_TRACE_INFO(fh, GAH_PRINT_FULL_STR, GAH_PRINT_FULL_VAL(fh->gah));
 
 	return 0;
@@ -81,8 +76,6 @@ void ios_fh_decref(struct ionss_file_handle *fh, int count)
 	uint oldref;
 	int rc;
 
-	D_RWLOCK_WRLOCK(&base->gah_rwlock);
-
 	oldref = atomic_fetch_sub(&fh->ref, count);
 
 	D_ASSERTF(oldref != 0, "Unexpected fh refcount: %d\n", oldref);
@@ -91,72 +84,155 @@ void ios_fh_decref(struct ionss_file_handle *fh, int count)
 			GAH_PRINT_VAL(fh->gah), count, oldref - count);
 
 	if (oldref != count)
-		D_GOTO(out, 0);
+		return;
 
 	IOF_TRACE_DEBUG(fh, "Closing %d", fh->fd);
 
-	rc = close(fh->fd);
-	if (rc != 0)
-		IOF_TRACE_ERROR(fh, "Failed to close file %d", fh->fd);
-
+	/* Remove the GAH before closing the file so no new references can be
+	 * taken by ios_fh_find()
+	 */
 	rc = ios_gah_deallocate(base->gs, &fh->gah);
 	if (rc)
 		IOF_TRACE_ERROR(fh, "Failed to deallocate GAH %d", rc);
 
+	if (fh->mf.type == inode_handle) {
+		ionss_fdm_remove(&base->fdm, fh);
+	} else {
+		rc = close(fh->fd);
+		if (rc != 0)
+			IOF_TRACE_ERROR(fh, "Failed to close file %d", fh->fd);
+	}
+
+	if (fh->direct_fd != -1) {
+		rc = close(fh->direct_fd);
+		if (rc != 0)
+			IOF_TRACE_ERROR(fh, "Failed to close file %d",
+					fh->direct_fd);
+	}
+
 	iof_pool_release(projection->fh_pool, fh);
+}
+
+/* Take a reference on a file handle, but only if it is not already being
+ * closed.
+ */
+static bool ios_fh_addref_not_zero(struct ionss_file_handle *fh)
+{
+	uint oldref;
 
-out:
-	D_RWLOCK_UNLOCK(&base->gah_rwlock);
+	do {
+		oldref = atomic_load_consume(&fh->ref);
+		if (oldref == 0)
+			return false;
+	} while (!atomic_compare_exchange(&fh->ref, oldref, oldref + 1));
+
+	IOF_TRACE_DEBUG(fh, GAH_PRINT_STR " addref to %d",
+			GAH_PRINT_VAL(fh->gah), oldref + 1);
+
+	return true;
 }
 
+/* Lookup a file handle from a GAH without taking any locks.
+ *
+ * File handle descriptors are only freed when the projection is torn down
+ * so it is safe to access one after the GAH has been deallocated, however it
+ * may have been closed and reused in the meantime.  To handle this take a
+ * reference only if the handle is still open, then check that the GAH still
+ * refers to the same handle before returning it.
+ */
 struct ionss_file_handle *
 ios_fh_find(struct ios_base *base, struct ios_gah *gah)
 {
 	struct ionss_file_handle *fh = NULL;
-	uint oldref;
+	void *check = NULL;
 	int rc;
 
-	D_RWLOCK_RDLOCK(&base->gah_rwlock);
-
 	rc = ios_gah_get_info(base->gs, gah, (void **)&fh);
 	if (rc || !fh) {
 		IOF_TRACE_ERROR(&base,
 				"Failed to load fh from " GAH_PRINT_FULL_STR " %d -%s",
 				GAH_PRINT_FULL_VAL(*gah), rc, d_errstr(rc));
-		D_GOTO(out, fh = NULL);
+		return NULL;
 	}
 
-	oldref = atomic_fetch_add(&fh->ref, 1);
-
-	IOF_TRACE_DEBUG(fh, GAH_PRINT_STR " addref to %d",
-			GAH_PRINT_VAL(fh->gah), oldref + 1);
+	if (!ios_fh_addref_not_zero(fh)) {
+		IOF_TRACE_INFO(&base, GAH_PRINT_STR " is being closed",
+			       GAH_PRINT_VAL(*gah));
+		return NULL;
+	}
 
-out:
-	D_RWLOCK_UNLOCK(&base->gah_rwlock);
+	rc = ios_gah_get_info(base->gs, gah, &check);
+	if (rc || check != fh) {
+		IOF_TRACE_INFO(&base, GAH_PRINT_STR " closed during lookup",
+			       GAH_PRINT_VAL(*gah));
+		ios_fh_decref(fh, 1);
+		return NULL;
+	}
 
 	return fh;
 }
 
+void ios_dirh_decref(struct ionss_dir_handle *dirh, int count)
+{
+	uint oldref;
+	int rc;
+
+	oldref = atomic_fetch_sub(&dirh->ref, count);
+
+	D_ASSERTF(oldref >= count, "Unexpected dirh refcount: %d\n", oldref);
+
+	IOF_TRACE_DEBUG(dirh, "decref %d to %d", count, oldref - count);
+
+	if (oldref != count)
+		return;
+
+	IOF_TRACE_DEBUG(dirh, "Closing %d", dirh->fd);
+	rc = close(dirh->fd);
+	if (rc != 0)
+		IOF_TRACE_DEBUG(dirh, "Failed to close directory %d",
+				dirh->fd);
+
+	iof_pool_release(dirh->projection->dh_pool, dirh);
+}
+
+/* Lookup a directory handle from a GAH without taking any locks, in the
+ * same way as ios_fh_find().
+ */
 struct ionss_dir_handle *
 ios_dirh_find(struct ios_base *base, struct ios_gah *gah)
 {
 	struct ionss_dir_handle *dirh = NULL;
+	void *check = NULL;
+	uint oldref;
 	int rc;
 
-	D_RWLOCK_RDLOCK(&base->gah_rwlock);
-
 	rc = ios_gah_get_info(base->gs, gah, (void **)&dirh);
 	if (rc || !dirh) {
 		IOF_TRACE_ERROR(&base,
 				"Failed to load dirh from " GAH_PRINT_FULL_STR " %d -%s",
 				GAH_PRINT_FULL_VAL(*gah), rc, d_errstr(rc));
-		D_GOTO(out, dirh = NULL);
+		return NULL;
 	}
 
-	IOF_TRACE_DEBUG(dirh, GAH_PRINT_STR, GAH_PRINT_VAL(*gah));
+	do {
+		oldref = atomic_load_consume(&dirh->ref);
+		if (oldref == 0) {
+			IOF_TRACE_INFO(&base, GAH_PRINT_STR " is being closed",
+				       GAH_PRINT_VAL(*gah));
+			return NULL;
+		}
+	} while (!atomic_compare_exchange(&dirh->ref, oldref, oldref + 1));
+
+	rc = ios_gah_get_info(base->gs, gah, &check);
+	if (rc || check != dirh) {
+		IOF_TRACE_INFO(&base, GAH_PRINT_STR " closed during lookup",
+			       GAH_PRINT_VAL(*gah));
+		ios_dirh_decref(dirh, 1);
+		return NULL;
+	}
 
-out:
-	D_RWLOCK_UNLOCK(&base->gah_rwlock);
+	IOF_TRACE_DEBUG(dirh, GAH_PRINT_STR " addref to %d",
+			GAH_PRINT_VAL(*gah), oldref + 1);
 
 	return dirh;
 }
@@ -38,6 +38,7 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <signal.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
@@ -62,6 +63,7 @@
 #define SHUTDOWN_BCAST_OP (0xFFF0)
 
 static int shutdown;
+static volatile sig_atomic_t reload_pending;
 static ATOMIC unsigned int cnss_count;
 
 static struct ios_base base;
@@ -287,18 +289,25 @@ iof_getattr_handler(crt_rpc_t *rpc)
 	struct iof_gah_in *in = crt_req_get(rpc);
 	struct iof_attr_out *out = crt_reply_get(rpc);
 	struct ionss_file_handle *handle;
+	int fd;
 	int rc;
 
 	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
 	if (out->err)
 		goto out;
 
+	fd = ionss_fd_get(&base.fdm, handle);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
+
 	errno = 0;
-	rc = fstat(handle->fd, &out->stat);
+	rc = fstat(fd, &out->stat);
 
 	if (rc)
 		out->rc = errno;
 
+	ionss_fd_put(&base.fdm, handle);
+
 out:
 	IOF_LOG_DEBUG("result err %d rc %d",
 		      out->err, out->rc);
@@ -327,13 +336,11 @@ iof_opendir_handler(crt_rpc_t *rpc)
 
 	IOF_TRACE_DEBUG(parent, GAH_PRINT_STR, GAH_PRINT_VAL(in->gah));
 
-	errno = 0;
-	fd = open(parent->proc_fd_name, O_DIRECTORY | O_RDONLY);
-
-	if (fd == -1)
-		D_GOTO(out, out->rc = errno);
+	fd = ionss_fd_open(parent, O_DIRECTORY | O_RDONLY);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
 
-	D_ALLOC_PTR(local_handle);
+	local_handle = iof_pool_acquire(parent->projection->dh_pool);
 	if (!local_handle) {
 		close(fd);
 		D_GOTO(out, out->err = -DER_NOMEM);
@@ -341,18 +348,12 @@ iof_opendir_handler(crt_rpc_t *rpc)
 
 	IOF_TRACE_UP(local_handle, parent, "open_directory");
 
-	local_handle->projection = parent->projection;
 	local_handle->fd = fd;
-	local_handle->h_dir = fdopendir(local_handle->fd);
-	local_handle->offset = 0;
 
-	D_RWLOCK_WRLOCK(&base.gah_rwlock);
 	rc = ios_gah_allocate(base.gs, &out->gah, local_handle);
-	D_RWLOCK_UNLOCK(&base.gah_rwlock);
 
 	if (rc != -DER_SUCCESS) {
-		closedir(local_handle->h_dir);
-		D_FREE(local_handle);
+		ios_dirh_decref(local_handle, 1);
 		D_GOTO(out, out->err = rc);
 	}
 
@@ -366,57 +367,124 @@ out:
 	if (rc)
 		IOF_LOG_ERROR("response not sent, rc = %d", rc);
 
-	if (parent)
+	if (parent) {
+		iof_pool_restock(parent->projection->dh_pool);
 		ios_fh_decref(parent, 1);
+	}
 }
 
-int iof_readdir_bulk_cb(const struct crt_bulk_cb_info *cb_info)
+static int
+iof_readdir_bulk_cb(const struct crt_bulk_cb_info *cb_info)
 {
-	struct iof_readdir_out *out = crt_reply_get(cb_info->bci_bulk_desc->bd_rpc);
-	d_iov_t iov = {0};
-	d_sg_list_t sgl = {0};
+	struct ionss_active_readdir *ard = cb_info->bci_arg;
+	struct iof_readdir_out *out = crt_reply_get(ard->rpc);
 	int rc;
 
 	if (cb_info->bci_rc) {
 		out->err = cb_info->bci_rc;
-		goto out;
+		ard->failed = true;
 	}
 
-	sgl.sg_iovs = &iov;
-	sgl.sg_nr = 1;
+	rc = crt_reply_send(ard->rpc);
+	if (rc)
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+
+	crt_req_decref(ard->rpc);
 
-	rc = crt_bulk_access(cb_info->bci_bulk_desc->bd_local_hdl, &sgl);
-	if (rc) {
-		out->err = rc;
-		goto out;
+	iof_pool_release(ard->projection->rd_pool, ard);
+
+	return 0;
+}
+
+/* Send the replies for a readdir RPC, either inline or via bulk.
+ *
+ * Called once all entries have been stat'ed, possibly from a stat pool
+ * thread.  Consumes the reference on the RPC and the descriptor, if any.
+ *
+ * If the client requested the compact format then the replies are encoded
+ * into the bulk buffer, which fill will have ensured is large enough,
+ * otherwise they are already in it.
+ */
+static void
+iof_readdir_send(crt_rpc_t *rpc, struct ionss_active_readdir *ard,
+		 int reply_idx)
+{
+	struct iof_readdir_in *in = crt_req_get(rpc);
+	struct iof_readdir_out *out = crt_reply_get(rpc);
+	struct crt_bulk_desc bulk_desc = {0};
+	size_t buf_len = sizeof(struct iof_readdir_reply) * reply_idx;
+	bool use_bulk = reply_idx > IONSS_READDIR_ENTRIES_PER_RPC;
+	int rc;
+
+	IOF_LOG_INFO("Sending %d replies", reply_idx);
+
+	if (reply_idx && (in->flags & IOF_READDIR_COMPACT)) {
+		buf_len = iof_readdir_encode(ard->replies, reply_idx,
+					     in->offset, ard->local_bulk.buf,
+					     ard->len);
+		use_bulk = buf_len > IOF_READDIR_INLINE_SIZE;
 	}
 
-	IOF_LOG_DEBUG("Freeing buffer %p", iov.iov_buf);
-	D_FREE(iov.iov_buf);
+	if (use_bulk) {
+		bulk_desc.bd_rpc = rpc;
+		bulk_desc.bd_bulk_op = CRT_BULK_PUT;
+		bulk_desc.bd_remote_hdl = in->bulk;
+		bulk_desc.bd_local_hdl = ard->local_bulk.handle;
+		bulk_desc.bd_len = buf_len;
 
-	rc = crt_bulk_free(cb_info->bci_bulk_desc->bd_local_hdl);
-	if (rc)
-		out->err = rc;
+		out->bulk_count = reply_idx;
 
-out:
-	rc = crt_reply_send(cb_info->bci_bulk_desc->bd_rpc);
+		rc = crt_bulk_transfer(&bulk_desc, iof_readdir_bulk_cb,
+				       ard, NULL);
+		if (rc) {
+			ard->failed = true;
+			out->bulk_count = 0;
+			out->err = rc;
+			goto out;
+		}
+
+		return;
+	} else if (reply_idx) {
+		out->iov_count = reply_idx;
+		d_iov_set(&out->replies, ard->local_bulk.buf, buf_len);
+	}
 
+out:
+	rc = crt_reply_send(rpc);
 	if (rc)
-		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+		IOF_LOG_ERROR(" response not sent, rc = %d", rc);
 
-	crt_req_decref(cb_info->bci_bulk_desc->bd_rpc);
+	crt_req_decref(rpc);
 
-	return 0;
+	if (ard)
+		iof_pool_release(ard->projection->rd_pool, ard);
+}
+
+static void
+iof_readdir_stat_cb(struct ionss_stat_job *job)
+{
+	struct ionss_active_readdir *ard;
+	struct ionss_dir_handle *dirh;
+
+	ard = container_of(job, struct ionss_active_readdir, job);
+
+	/* The job used the directory fd, so the handle was kept open until
+	 * now.  Take the reference before sending as that releases ard.
+	 */
+	dirh = ard->dirh;
+	ard->dirh = NULL;
+
+	iof_readdir_send(ard->rpc, ard, job->count);
+
+	ios_dirh_decref(dirh, 1);
 }
 
 /*
  * Read dirent from a directory and reply to the origin.
  *
- * TODO:
- * Use readdir_r().  This code is not thread safe.
- * Parse GAH better.  If a invalid GAH is passed then it's handled but we
- * really should pass this back to the client properly so it doesn't retry.
- *
+ * Entries are read in batches with getdents64(), and then stat'ed in
+ * parallel by the stat pool if one is configured, with the reply being sent
+ * once all entries are complete.
  */
 static void
 iof_readdir_handler(crt_rpc_t *rpc)
@@ -424,17 +492,17 @@ iof_readdir_handler(crt_rpc_t *rpc)
 	struct iof_readdir_in *in = crt_req_get(rpc);
 	struct iof_readdir_out *out = crt_reply_get(rpc);
 	struct ionss_dir_handle *handle;
-	struct iof_readdir_reply *replies = NULL;
+	struct iof_readdir_reply *replies;
+	struct ionss_active_readdir *ard = NULL;
+	bool compact = in->flags & IOF_READDIR_COMPACT;
 	int max_reply_count;
-	struct dirent *dir_entry;
-	struct crt_bulk_desc bulk_desc = {0};
-	crt_bulk_t local_bulk_hdl = {0};
-	d_sg_list_t sgl = {0};
-	d_iov_t iov = {0};
 	size_t len = 0;
+	size_t space;
 	int reply_idx = 0;
 	int rc;
 
+	crt_req_addref(rpc);
+
 	VALIDATE_ARGS_GAH_DIR(rpc, in, out, handle);
 
 	IOF_LOG_INFO(GAH_PRINT_STR " offset %zi rpc %p",
@@ -443,6 +511,12 @@ iof_readdir_handler(crt_rpc_t *rpc)
 	if (out->err)
 		goto out;
 
+	ard = iof_pool_acquire(handle->projection->rd_pool);
+	if (!ard) {
+		out->err = -DER_NOMEM;
+		goto out;
+	}
+
 	if (in->bulk) {
 		rc = crt_bulk_get_len(in->bulk, &len);
 		if (rc || !len) {
@@ -450,126 +524,74 @@ iof_readdir_handler(crt_rpc_t *rpc)
 			goto out;
 		}
 
-		if (len > handle->projection->readdir_size) {
+		if (len > ard->local_bulk.len) {
 			IOF_LOG_WARNING("invalid readdir size %zi", len);
-			len = handle->projection->readdir_size;
+			len = ard->local_bulk.len;
 		}
-
-		max_reply_count = len / sizeof(struct iof_readdir_reply);
 	} else {
 		IOF_LOG_INFO("No bulk descriptor, replying inline");
-		max_reply_count = IONSS_READDIR_ENTRIES_PER_RPC;
-		len = sizeof(struct iof_readdir_reply) * max_reply_count;
-	}
-
-	IOF_LOG_DEBUG("max_replies %d len %zi bulk %p", max_reply_count, len,
-		      in->bulk);
-
-	D_ALLOC_ARRAY(replies, max_reply_count);
-	if (!replies) {
-		out->err = -DER_NOMEM;
-		goto out;
-	}
-
-	if (handle->offset != in->offset) {
-		IOF_LOG_DEBUG("Changing offset %zi %zi",
-			      handle->offset, in->offset);
-		seekdir(handle->h_dir, in->offset);
-		handle->offset = in->offset;
+		if (compact)
+			len = IOF_READDIR_INLINE_SIZE;
+		else
+			len = sizeof(struct iof_readdir_reply) *
+				IONSS_READDIR_ENTRIES_PER_RPC;
+		if (len > ard->local_bulk.len)
+			len = ard->local_bulk.len;
 	}
 
-	reply_idx = 0;
-	do {
-		errno = 0;
-		dir_entry = readdir(handle->h_dir);
-
-		if (!dir_entry) {
-			if (errno == 0) {
-				IOF_LOG_DEBUG("Last entry %d", reply_idx);
-				/* End of directory */
-				out->last = 1;
-			} else {
-				/* An error occoured */
-				replies[reply_idx].read_rc = errno;
-				reply_idx++;
+	/* In compact mode the limit is on the encoded size rather than the
+	 * number of entries, so allow for the smallest possible entries and
+	 * build the replies in a separate array before encoding them.
+	 */
+	if (compact) {
+		max_reply_count = len / IOF_READDIR_ENT_MIN;
+		if (!ard->replies) {
+			ard->max_replies = ard->local_bulk.len /
+				IOF_READDIR_ENT_MIN;
+			D_ALLOC_ARRAY(ard->replies, ard->max_replies);
+			if (!ard->replies) {
+				out->err = -DER_NOMEM;
+				goto out;
 			}
-
-			goto out;
 		}
+		replies = ard->replies;
+	} else {
+		max_reply_count = len / sizeof(struct iof_readdir_reply);
+		replies = ard->local_bulk.buf;
+	}
+	space = len;
 
-		if (strncmp(".", dir_entry->d_name, 2) == 0)
-			continue;
-
-		if (strncmp("..", dir_entry->d_name, 3) == 0)
-			continue;
-
-		handle->offset = telldir(handle->h_dir);
-		replies[reply_idx].nextoff = handle->offset;
-
-		/* TODO: Check this */
-		strncpy(replies[reply_idx].d_name, dir_entry->d_name, NAME_MAX);
+	IOF_LOG_DEBUG("max_replies %d len %zi bulk %p", max_reply_count, len,
+		      in->bulk);
 
-		IOF_LOG_DEBUG("File '%s' nextoff %zi", dir_entry->d_name,
-			      handle->offset);
+	reply_idx = ionss_readdir_fill(handle, in->offset, replies,
+				       max_reply_count,
+				       compact ? &space : NULL,
+				       &out->last);
+	if (reply_idx == 0)
+		goto out;
 
-		errno = 0;
-		rc = fstatat(handle->fd,
-			     replies[reply_idx].d_name,
-			     &replies[reply_idx].stat,
-			     AT_SYMLINK_NOFOLLOW);
-		if (rc != 0)
-			replies[reply_idx].stat_rc = errno;
+	ard->rpc = rpc;
+	ard->len = len;
+	ard->job.cb = iof_readdir_stat_cb;
+	ard->job.replies = replies;
+	ard->job.count = reply_idx;
+	ard->job.fd = handle->fd;
+	/* Pass the reference on the handle to the job */
+	ard->dirh = handle;
+
+	/* Only use the pool if there is more than one chunk of work,
+	 * otherwise the overhead of handing off outweighs the benefit.
+	 */
+	if (reply_idx == 1 || ionss_stat_submit(base.stat_lane, &ard->job))
+		ionss_stat_job_run(&ard->job);
 
-		reply_idx++;
-	} while (reply_idx < (max_reply_count));
+	return;
 
 out:
-
-	IOF_LOG_INFO("Sending %d replies", reply_idx);
-
-	if (reply_idx > IONSS_READDIR_ENTRIES_PER_RPC) {
-		crt_req_addref(rpc);
-
-		iov.iov_len = sizeof(struct iof_readdir_reply) * reply_idx;
-		iov.iov_buf = replies;
-		iov.iov_buf_len = sizeof(struct iof_readdir_reply) * reply_idx;
-		sgl.sg_iovs = &iov;
-		sgl.sg_nr = 1;
-
-		rc = crt_bulk_create(rpc->cr_ctx, &sgl, CRT_BULK_RO,
-				     &local_bulk_hdl);
-		if (rc) {
-			out->err = rc;
-			goto out;
-		}
-
-		bulk_desc.bd_rpc = rpc;
-		bulk_desc.bd_bulk_op = CRT_BULK_PUT;
-		bulk_desc.bd_remote_hdl = in->bulk;
-		bulk_desc.bd_local_hdl = local_bulk_hdl;
-		bulk_desc.bd_len = sizeof(struct iof_readdir_reply) * reply_idx;
-
-		out->bulk_count = reply_idx;
-
-		rc = crt_bulk_transfer(&bulk_desc, iof_readdir_bulk_cb,
-				       NULL, NULL);
-		if (rc) {
-			out->err = rc;
-			goto out;
-		}
-
-		return;
-	} else if (reply_idx) {
-		out->iov_count = reply_idx;
-		d_iov_set(&out->replies, &replies[0],
-			  sizeof(struct iof_readdir_reply) * reply_idx);
-	}
-
-	rc = crt_reply_send(rpc);
-	if (rc)
-		IOF_LOG_ERROR(" response not sent, rc = %d", rc);
-
-	D_FREE(replies);
+	iof_readdir_send(rpc, ard, reply_idx);
+	if (handle)
+		ios_dirh_decref(handle, 1);
 }
 
 static void
@@ -581,26 +603,22 @@ iof_closedir_handler(crt_rpc_t *rpc)
 
 	IOF_LOG_INFO(GAH_PRINT_STR, GAH_PRINT_VAL(in->gah));
 
-	rc = ios_gah_get_info(base.gs, &in->gah, (void **)&handle);
-	if (rc != -DER_SUCCESS)
-		IOF_LOG_DEBUG("Failed to load DIR* from gah %p %d",
-			      &in->gah, rc);
+	handle = ios_dirh_find(&base, &in->gah);
+	if (!handle)
+		IOF_LOG_DEBUG("Failed to load DIR* from gah %p", &in->gah);
 
+	/* Remove the GAH so that no new lookups can find the handle, and drop
+	 * the reference it held.  The directory is closed once any readdir
+	 * requests still using it have completed.
+	 */
 	if (handle) {
-		IOF_LOG_DEBUG("Closing %p", handle->h_dir);
-		rc = closedir(handle->h_dir);
-		if (rc != 0)
-			IOF_TRACE_DEBUG(handle,
-					"Failed to close directory %p",
-					handle->h_dir);
-		IOF_TRACE_DOWN(handle);
-		D_FREE(handle);
+		rc = ios_gah_deallocate(base.gs, &in->gah);
+		if (rc == -DER_SUCCESS)
+			ios_dirh_decref(handle, 2);
+		else
+			ios_dirh_decref(handle, 1);
 	}
 
-	D_RWLOCK_WRLOCK(&base.gah_rwlock);
-	ios_gah_deallocate(base.gs, &in->gah);
-	D_RWLOCK_UNLOCK(&base.gah_rwlock);
-
 	rc = crt_reply_send(rpc);
 	if (rc)
 		IOF_LOG_ERROR("response not sent, rc = %d", rc);
@@ -673,6 +691,21 @@ htable_mf_find(struct ios_projection *projection,
 	return handle;
 }
 
+/* Open a second descriptor for a file with O_DIRECT, to be used for large
+ * aligned reads and writes.  Failure is not an error as not all filesystems
+ * support direct I/O, in which case the page cache is always used.
+ */
+static void
+iof_open_direct(struct ionss_file_handle *handle)
+{
+	int flags = handle->mf.flags & ~(O_CREAT | O_EXCL | O_TRUNC | O_NOCTTY);
+
+	errno = 0;
+	handle->direct_fd = open(handle->proc_fd_name, flags | O_DIRECT);
+	if (handle->direct_fd == -1)
+		IOF_TRACE_INFO(handle, "Direct I/O not available %d", errno);
+}
+
 /* Create a new handle based on mf and fd, insert into hash table whilst
  * checking for existing entries.  Will return either handle with
  * reference held, or NULL for ENOMEM.
@@ -700,6 +733,16 @@ htable_mf_insert(struct ios_projection *projection,
 	snprintf(handle->proc_fd_name, 64, "/proc/self/fd/%d", handle->fd);
 	atomic_fetch_add(&handle->ht_ref, 1);
 
+	if (mf->type == open_handle &&
+	    atomic_load_consume(&projection->direct_io_size))
+		iof_open_direct(handle);
+
+	/* Add before inserting so that the handle is never visible to other
+	 * threads before the descriptor manager is tracking it.
+	 */
+	if (mf->type == inode_handle)
+		ionss_fdm_add(&base.fdm, handle);
+
 	rlink = d_hash_rec_find_insert(&projection->file_ht, mf, sizeof(*mf),
 				       &handle->clist);
 	if (rlink != &handle->clist) {
@@ -885,6 +928,7 @@ lookup_common(crt_rpc_t *rpc, struct iof_gah_string_in *in,
 	struct ios_projection		*projection = NULL;
 	struct ionss_mini_file		mf = {.type = inode_handle,
 					      .flags = O_PATH | O_NOATIME | O_NOFOLLOW | O_RDONLY};
+	int				parent_fd;
 	int				fd;
 
 	if (out->err || out->rc)
@@ -892,10 +936,16 @@ lookup_common(crt_rpc_t *rpc, struct iof_gah_string_in *in,
 
 	projection = parent->projection;
 
+	parent_fd = ionss_fd_get(&base.fdm, parent);
+	if (parent_fd < 0)
+		D_GOTO(out, out->rc = -parent_fd);
+
 	errno = 0;
-	fd = openat(parent->fd, in->name.name, mf.flags);
-	if (fd == -1) {
+	fd = openat(parent_fd, in->name.name, mf.flags);
+	if (fd == -1)
 		out->rc = errno;
+	ionss_fd_put(&base.fdm, parent);
+	if (fd == -1) {
 		if (!out->rc)
 			out->err = -DER_MISC;
 		goto out;
@@ -959,13 +1009,16 @@ iof_open_handler(crt_rpc_t *rpc)
 	IOF_TRACE_DEBUG(parent, GAH_PRINT_STR " flags 0%o",
 			GAH_PRINT_VAL(in->gah), in->flags);
 
-	errno = 0;
-	fd = open(parent->proc_fd_name, in->flags);
-	if (fd == -1) {
-		out->rc = errno;
+	fd = ionss_fd_open(parent, in->flags);
+	if (fd < 0) {
+		out->rc = -fd;
 		goto out;
 	}
 
+	if (in->flags & O_TRUNC)
+		ionss_cache_invalidate_inode(projection->cache,
+					     parent->mf.inode_no);
+
 	mf.flags = in->flags;
 	find_and_insert(projection, fd, &mf, out);
 
@@ -998,6 +1051,7 @@ iof_create_handler(crt_rpc_t *rpc)
 					       .flags = O_PATH | O_NOATIME | O_RDONLY};
 	int ifd;
 	char *path = NULL;
+	int parent_fd;
 	int fd;
 	int rc;
 
@@ -1012,12 +1066,17 @@ iof_create_handler(crt_rpc_t *rpc)
 	IOF_TRACE_DEBUG(parent, "path '%s' flags 0%o mode 0%o",
 			in->common.name.name, in->flags, in->mode);
 
+	parent_fd = ionss_fd_get(&base.fdm, parent);
+	if (parent_fd < 0)
+		D_GOTO(out, out->rc = -parent_fd);
+
 	errno = 0;
-	fd = openat(parent->fd, in->common.name.name, in->flags, in->mode);
-	if (fd == -1) {
+	fd = openat(parent_fd, in->common.name.name, in->flags, in->mode);
+	if (fd == -1)
 		out->rc = errno;
+	ionss_fd_put(&base.fdm, parent);
+	if (fd == -1)
 		goto out;
-	}
 
 	mf.flags = in->flags;
 
@@ -1073,6 +1132,7 @@ iof_imigrate_handler(crt_rpc_t *rpc)
 	struct ionss_file_handle	*fh;
 	struct ionss_mini_file		mf = {.type = inode_handle,
 					      .flags = O_PATH | O_NOATIME | O_NOFOLLOW | O_RDONLY};
+	int parent_fd;
 	int rc;
 	int fd;
 
@@ -1100,7 +1160,12 @@ iof_imigrate_handler(crt_rpc_t *rpc)
 	if (in->name.name[0] == '\0')
 		D_GOTO(out, out->rc = ENOENT);
 
-	fd = openat(parent->fd, in->name.name, mf.flags);
+	parent_fd = ionss_fd_get(&base.fdm, parent);
+	if (parent_fd < 0)
+		D_GOTO(out, out->rc = -parent_fd);
+
+	fd = openat(parent_fd, in->name.name, mf.flags);
+	ionss_fd_put(&base.fdm, parent);
 	if (fd == -1) {
 		IOF_TRACE_DEBUG(rpc,
 				"No file at location '%s'",
@@ -1149,757 +1214,2484 @@ out:
 	IOF_TRACE_DOWN(rpc);
 }
 
-/* Handle a close from a client.
- * For close RPCs there is no reply so simply ack the RPC first
- * and then do the work off the critical path.
+/* Batched inode migration.
+ *
+ * The entries are pulled from the client and grouped by parent, each group
+ * is then resolved as a single job on the metadata lane, with the parent
+ * descriptor pinned for the whole group.  Once a group is resolved the
+ * groups for any of its entries which have children are submitted, so
+ * independent subtrees are resolved in parallel.  The last job to complete
+ * pushes the results back and replies.
  */
+struct ionss_imigrate {
+	crt_rpc_t			*rpc;
+	struct ios_projection		*projection;
+	struct iof_local_bulk		local_bulk;
+	struct iof_imigrate_ent		*ents;
+	struct iof_imigrate_res		*res;
+	struct ionss_file_handle	**fhs;
+	/* Child lists, first[count] holds the entries with no parent in
+	 * the batch
+	 */
+	int				*first;
+	int				*next;
+	ATOMIC int			pending;
+	int				count;
+};
+
+struct ionss_imigrate_job {
+	struct ionss_lane_op	op;
+	struct ionss_imigrate	*im;
+	int			group;
+};
+
 static void
-iof_close_handler(crt_rpc_t *rpc)
+iof_imigrate_free(struct ionss_imigrate *im)
 {
-	struct iof_gah_in *in = crt_req_get(rpc);
-	struct ionss_file_handle *handle;
+	if (im->local_bulk.buf)
+		IOF_BULK_FREE(im, local_bulk);
+	D_FREE(im->ents);
+	D_FREE(im->fhs);
+	D_FREE(im->first);
+	D_FREE(im->next);
+	D_FREE(im);
+}
+
+/* Called once the results have been pushed, or failed to be */
+static int
+iof_imigrate_multi_bulk_put(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_imigrate *im = cb_info->bci_arg;
+	struct iof_status_out *out = crt_reply_get(im->rpc);
 	int rc;
+	int i;
 
-	rc = crt_reply_send(rpc);
+	if (cb_info->bci_rc) {
+		out->err = cb_info->bci_rc;
+
+		/* The client will never see these handles so drop the
+		 * hash table references taken on its behalf.
+		 */
+		for (i = 0; i < im->count; i++)
+			if (im->fhs[i])
+				d_hash_rec_decref(&im->projection->file_ht,
+						  &im->fhs[i]->clist);
+	}
+
+	rc = crt_reply_send(im->rpc);
 	if (rc)
-		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+		IOF_TRACE_ERROR(im->rpc, "response not sent, ret = %d", rc);
 
-	handle = ios_fh_find(&base, &in->gah);
+	IOF_TRACE_DOWN(im->rpc);
+	crt_req_decref(im->rpc);
+	iof_imigrate_free(im);
+	return 0;
+}
 
-	if (!handle)
+static void
+iof_imigrate_multi_send(struct ionss_imigrate *im)
+{
+	struct iof_imigrate_multi_in *in = crt_req_get(im->rpc);
+	struct crt_bulk_desc bulk_desc = {0};
+	struct crt_bulk_cb_info cb_info = {0};
+	int rc;
+
+	bulk_desc.bd_rpc = im->rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_PUT;
+	bulk_desc.bd_remote_hdl = in->bulk;
+	bulk_desc.bd_remote_off = IOF_IMIGRATE_RES_OFFSET(in->len);
+	bulk_desc.bd_local_hdl = im->local_bulk.handle;
+	bulk_desc.bd_local_off = bulk_desc.bd_remote_off;
+	bulk_desc.bd_len = sizeof(*im->res) * im->count;
+
+	if (D_SHOULD_FAIL(IONSS_FI_IMIGRATE_PUT))
+		D_GOTO(err, rc = -DER_MISC);
+
+	rc = crt_bulk_transfer(&bulk_desc, iof_imigrate_multi_bulk_put, im,
+			       NULL);
+	if (rc == -DER_SUCCESS)
 		return;
 
-	ios_fh_decref(handle, 1);
-	d_hash_rec_decref(&handle->projection->file_ht, &handle->clist);
+err:
+	cb_info.bci_arg = im;
+	cb_info.bci_rc = rc;
+	iof_imigrate_multi_bulk_put(&cb_info);
 }
 
+/* Resolve a single entry, either from the hash table by inode or, if the
+ * parent is known, by name relative to it.  On success the handle holds a
+ * reference on behalf of the client.
+ */
 static void
-iof_fsync_handler(crt_rpc_t *rpc)
+iof_imigrate_resolve(struct ionss_imigrate *im, int idx, int parent_fd)
 {
-	struct iof_gah_in *in = crt_req_get(rpc);
-	struct iof_status_out *out = crt_reply_get(rpc);
-	struct ionss_file_handle *handle;
-	int rc;
+	struct iof_imigrate_ent		*ent = &im->ents[idx];
+	struct iof_imigrate_res		*res = &im->res[idx];
+	struct ionss_file_handle	*fh;
+	struct ionss_mini_file		mf = {.type = inode_handle,
+					      .flags = O_PATH | O_NOATIME | O_NOFOLLOW | O_RDONLY};
+	struct stat stbuf;
+	int fd;
 
-	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
-	if (out->err)
-		goto out;
+	mf.inode_no = ent->inode;
 
-	VALIDATE_WRITE(handle->projection, out);
-	if (out->err || out->rc)
+	fh = htable_mf_find(im->projection, &mf);
+	if (fh)
 		goto out;
 
-	errno = 0;
-	rc = fsync(handle->fd);
-	if (rc)
-		out->rc = errno;
+	if (parent_fd < 0 || ent->name[0] == '\0')
+		D_GOTO(err, res->rc = ENOENT);
 
-out:
-	IOF_LOG_DEBUG("result err %d rc %d",
-		      out->err, out->rc);
+	fd = openat(parent_fd, ent->name, mf.flags);
+	if (fd == -1)
+		D_GOTO(err, res->rc = ENOENT);
 
-	rc = crt_reply_send(rpc);
-	if (rc)
-		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+	if (fstat(fd, &stbuf) != 0 || stbuf.st_ino != mf.inode_no) {
+		IOF_TRACE_DEBUG(im->rpc, "Wrong file at location '%s' %lu",
+				ent->name, mf.inode_no);
+		close(fd);
+		D_GOTO(err, res->rc = ENOENT);
+	}
 
-	if (handle)
-		ios_fh_decref(handle, 1);
+	fh = htable_mf_insert(im->projection, &mf, fd);
+	if (!fh) {
+		close(fd);
+		D_GOTO(err, res->err = -DER_NOMEM);
+	}
+
+out:
+	im->fhs[idx] = fh;
+	res->gah = fh->gah;
+	return;
+
+err:
+	IOF_TRACE_DEBUG(im->rpc, "inode %lu not found %d %d", mf.inode_no,
+			res->rc, res->err);
 }
 
+static void iof_imigrate_submit(struct ionss_imigrate *, int group);
+
+/* Resolve all entries in a group, then submit the groups below them */
 static void
-iof_fdatasync_handler(crt_rpc_t *rpc)
+iof_imigrate_run(struct ionss_imigrate *im, int group)
 {
-	struct iof_gah_in *in = crt_req_get(rpc);
-	struct iof_status_out *out = crt_reply_get(rpc);
-	struct ionss_file_handle *handle;
-	int rc;
+	struct ionss_file_handle *parent = NULL;
+	int parent_fd = -1;
+	int i;
 
-	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
-	if (out->err)
-		goto out;
+	if (group < im->count)
+		parent = im->fhs[group];
 
-	VALIDATE_WRITE(handle->projection, out);
-	if (out->err || out->rc)
-		goto out;
+	if (parent)
+		parent_fd = ionss_fd_get(&base.fdm, parent);
 
-	errno = 0;
-	rc = fdatasync(handle->fd);
-	if (rc)
-		out->rc = errno;
+	for (i = im->first[group]; i != -1; i = im->next[i]) {
+		struct ionss_file_handle *root;
+		int root_fd = -1;
 
-out:
-	IOF_LOG_DEBUG("result err %d rc %d",
-		      out->err, out->rc);
+		if (group < im->count) {
+			iof_imigrate_resolve(im, i, parent_fd);
+			continue;
+		}
 
-	rc = crt_reply_send(rpc);
+		/* Entries without a parent in the batch each name their
+		 * own.
+		 */
+		root = ios_fh_find(&base, &im->ents[i].gah);
+		if (root && root->projection != im->projection) {
+			ios_fh_decref(root, 1);
+			root = NULL;
+		}
+		if (root)
+			root_fd = ionss_fd_get(&base.fdm, root);
 
-	if (rc)
-		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+		iof_imigrate_resolve(im, i, root_fd);
 
-	if (handle)
-		ios_fh_decref(handle, 1);
+		if (root_fd >= 0)
+			ionss_fd_put(&base.fdm, root);
+		if (root)
+			ios_fh_decref(root, 1);
+	}
+
+	if (parent_fd >= 0)
+		ionss_fd_put(&base.fdm, parent);
+
+	/* Children of failed entries are still submitted, as they may be
+	 * found by inode.
+	 */
+	for (i = im->first[group]; i != -1; i = im->next[i])
+		if (im->first[i] != -1)
+			iof_imigrate_submit(im, i);
+
+	if (atomic_fetch_sub(&im->pending, 1) == 1)
+		iof_imigrate_multi_send(im);
 }
 
-_Static_assert(sizeof(struct ionss_io_req_desc) <=
-	       sizeof(struct iof_readx_out),
-	       "struct iof_readx_out needs to be large enough to contain"
-	       " struct ionss_io_req_desc");
+static void
+iof_imigrate_job_run(struct ionss_lane_op *op)
+{
+	struct ionss_imigrate_job *job;
+	struct ionss_imigrate *im;
+	int group;
 
-static int iof_read_bulk_cb(const struct crt_bulk_cb_info *cb_info);
-static void iof_process_read_bulk(struct ionss_active_read *ard);
+	job = container_of(op, struct ionss_imigrate_job, op);
+	im = job->im;
+	group = job->group;
+	D_FREE(job);
 
-void iof_read_check_and_send(struct ios_projection *projection)
+	iof_imigrate_run(im, group);
+}
+
+/* Queue a group to the metadata lane, or run it directly if there is none */
+static void
+iof_imigrate_submit(struct ionss_imigrate *im, int group)
 {
-	struct ionss_io_req_desc *rrd;
-	struct ionss_active_read *ard;
+	struct ionss_imigrate_job *job;
 
-	D_MUTEX_LOCK(&projection->lock);
-	if (d_list_empty(&projection->read_list)) {
-		projection->current_read_count--;
-		IOF_LOG_DEBUG("Dropping read slot (%d/%d)",
-			      projection->current_read_count,
-			      projection->max_read_count);
-		D_MUTEX_UNLOCK(&projection->lock);
-		return;
-	}
+	atomic_fetch_add(&im->pending, 1);
 
-	ard = iof_pool_acquire(projection->ar_pool);
-	if (!ard) {
-		projection->current_read_count--;
-		IOF_TRACE_DEBUG(projection,
-				"No ARD slot available (%d/%d)",
-				projection->current_read_count,
-				projection->max_read_count);
-		D_MUTEX_UNLOCK(&projection->lock);
+	if (!base.meta_lane)
+		goto inline_run;
+
+	D_ALLOC_PTR(job);
+	if (!job)
+		goto inline_run;
+
+	job->op.fn = iof_imigrate_job_run;
+	job->im = im;
+	job->group = group;
+
+	if (ionss_lane_submit(base.meta_lane, &job->op) == 0)
 		return;
-	}
 
-	rrd = d_list_pop_entry(&projection->read_list,
-			       struct ionss_io_req_desc, list);
+	D_FREE(job);
+
+inline_run:
+	iof_imigrate_run(im, group);
+}
+
+/* Called once the entries have been pulled from the client */
+static int
+iof_imigrate_multi_bulk_get(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_imigrate *im = cb_info->bci_arg;
+	struct iof_imigrate_multi_in *in = crt_req_get(im->rpc);
+	struct iof_status_out *out = crt_reply_get(im->rpc);
+	int rc;
+	int i;
 
-	IOF_TRACE_UP(ard, rrd->handle, "ard");
-	IOF_TRACE_DEBUG(ard, "Submiting new read (%d/%d)",
-			projection->current_read_count,
-			projection->max_read_count);
+	if (cb_info->bci_rc)
+		D_GOTO(out, out->err = cb_info->bci_rc);
 
-	D_MUTEX_UNLOCK(&projection->lock);
+	rc = iof_imigrate_decode(im->local_bulk.buf, in->len, im->count,
+				 im->ents);
+	if (rc != -DER_SUCCESS)
+		D_GOTO(out, out->err = rc);
 
-	ard->rpc = rrd->rpc;
-	ard->handle = rrd->handle;
+	/* Build the child lists in reverse so they are resolved in the
+	 * order the client sent them.
+	 */
+	for (i = 0; i <= im->count; i++)
+		im->first[i] = -1;
+	for (i = im->count - 1; i >= 0; i--) {
+		int parent = im->ents[i].parent;
+
+		if (parent == -1)
+			parent = im->count;
+		im->next[i] = im->first[parent];
+		im->first[parent] = i;
+	}
 
-	/* Reset the borrowed output to 0 */
-	memset(rrd, 0, sizeof(*rrd));
+	/* Hold a reference for the duration of the submission so the reply
+	 * is not sent before all top level groups are queued.
+	 */
+	atomic_store_release(&im->pending, 1);
+	iof_imigrate_submit(im, im->count);
+	if (atomic_fetch_sub(&im->pending, 1) == 1)
+		iof_imigrate_multi_send(im);
 
-	iof_process_read_bulk(ard);
+	return 0;
+
+out:
+	rc = crt_reply_send(im->rpc);
+	if (rc)
+		IOF_TRACE_ERROR(im->rpc, "response not sent, ret = %d", rc);
+
+	IOF_TRACE_DOWN(im->rpc);
+	crt_req_decref(im->rpc);
+	iof_imigrate_free(im);
+	return 0;
 }
 
-/* Process a read request
- *
- * This function processes a single rrd and either submits a bulk read with
- * the result of completes and frees the request
- */
 static void
-iof_process_read_bulk(struct ionss_active_read *ard)
+iof_imigrate_multi_handler(crt_rpc_t *rpc)
 {
-	struct ionss_file_handle *handle = ard->handle;
-	struct iof_readx_in *in = crt_req_get(ard->rpc);
-	struct iof_readx_out *out = crt_reply_get(ard->rpc);
-	struct ios_projection *projection = ard->handle->projection;
-	struct crt_bulk_desc bulk_desc = {0};
-	size_t count;
-	off_t offset;
-	bool more_to_do = false;
+	struct iof_imigrate_multi_in	*in = crt_req_get(rpc);
+	struct iof_status_out		*out = crt_reply_get(rpc);
+	struct ionss_file_handle	*root = NULL;
+	struct ionss_imigrate		*im = NULL;
+	struct crt_bulk_desc		bulk_desc = {0};
+	size_t				buf_len;
 	int rc;
 
-	count = in->xtvec.xt_len - ard->segment_offset;
-	/* Only read max_read_size at a time */
-	if (count > projection->max_read_size)
-		count = projection->max_read_size;
-	ard->req_len = count;
-	offset = in->xtvec.xt_off + ard->segment_offset;
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, root);
+	if (out->err)
+		goto out;
 
-	IOF_TRACE_DEBUG(ard, "Reading from fd=%d %#zx-%#zx", handle->fd, offset,
-			offset + count - 1);
+	IOF_TRACE_UP(rpc, root, "inode_migrate_multi");
 
-	errno = 0;
-	ard->read_len = pread(handle->fd, ard->local_bulk.buf, count, offset);
-	if (ard->read_len == -1) {
-		out->rc = errno;
-		goto out;
-	} else if (ard->read_len <= projection->max_iov_read_size) {
-		/* Can send last bit in immediate data */
-		out->iov_len = ard->read_len;
-		d_iov_set(&out->data, ard->local_bulk.buf,
-			  ard->read_len);
-		goto out;
-	}
+	if (in->count == 0 || in->count > IOF_IMIGRATE_MAX_COUNT ||
+	    in->len > IOF_IMIGRATE_BULK_SIZE || !in->bulk)
+		D_GOTO(out, out->err = -DER_INVAL);
 
-	bulk_desc.bd_rpc = ard->rpc;
-	bulk_desc.bd_bulk_op = CRT_BULK_PUT;
-	bulk_desc.bd_remote_hdl = in->data_bulk;
-	bulk_desc.bd_remote_off = ard->data_offset;
-	bulk_desc.bd_local_hdl = ard->local_bulk.handle;
-	bulk_desc.bd_len = ard->read_len;
+	IOF_TRACE_DEBUG(rpc, "Migrating %u inodes", in->count);
 
-	IOF_TRACE_DEBUG(ard, "Sending bulk " GAH_PRINT_STR,
-			GAH_PRINT_VAL(in->gah));
+	D_ALLOC_PTR(im);
+	if (!im)
+		D_GOTO(out, out->err = -DER_NOMEM);
 
-	ard->data_offset += ard->req_len;
-	ard->segment_offset += ard->req_len;
+	im->rpc = rpc;
+	im->projection = root->projection;
+	im->count = in->count;
 
-	if (ard->segment_offset < in->xtvec.xt_len &&
-	    ard->read_len == ard->req_len)
-		more_to_do = true;
+	D_ALLOC_ARRAY(im->ents, im->count);
+	D_ALLOC_ARRAY(im->fhs, im->count);
+	D_ALLOC_ARRAY(im->first, im->count + 1);
+	D_ALLOC_ARRAY(im->next, im->count);
+	if (!im->ents || !im->fhs || !im->first || !im->next)
+		D_GOTO(out, out->err = -DER_NOMEM);
 
-	rc = crt_bulk_transfer(&bulk_desc, iof_read_bulk_cb, ard, NULL);
-	if (rc != -DER_SUCCESS) {
-		out->err = rc;
-		ard->failed = true;
-		goto out;
-	}
+	buf_len = IOF_IMIGRATE_RES_OFFSET(in->len) +
+		sizeof(*im->res) * im->count;
+	if (!IOF_BULK_ALLOC(root->projection->base->crt_ctx, im, local_bulk,
+			    buf_len, false))
+		D_GOTO(out, out->err = -DER_NOMEM);
 
-	if (more_to_do)
-		return;
+	im->res = im->local_bulk.buf + IOF_IMIGRATE_RES_OFFSET(in->len);
 
-	/* Do not call crt_reply_send() in this case as it'll be done in the
-	 * bulk handler however it's safe to drop the handle as the read
-	 * has completed at this point.
-	 */
-	ios_fh_decref(handle, 1);
+	bulk_desc.bd_rpc = rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_GET;
+	bulk_desc.bd_remote_hdl = in->bulk;
+	bulk_desc.bd_local_hdl = im->local_bulk.handle;
+	bulk_desc.bd_len = in->len;
+
+	crt_req_addref(rpc);
+	rc = crt_bulk_transfer(&bulk_desc, iof_imigrate_multi_bulk_get, im,
+			       NULL);
+	if (rc) {
+		crt_req_decref(rpc);
+		D_GOTO(out, out->err = rc);
+	}
 
+	ios_fh_decref(root, 1);
 	return;
-out:
 
-	rc = crt_reply_send(ard->rpc);
+out:
+	if (im)
+		iof_imigrate_free(im);
 
+	rc = crt_reply_send(rpc);
 	if (rc)
-		IOF_TRACE_ERROR(ard, "response not sent, ret = %d", rc);
-
-	crt_req_decref(ard->rpc);
-
-	iof_pool_release(projection->ar_pool, ard);
+		IOF_TRACE_ERROR(rpc, "response not sent, ret = %d", rc);
 
-	ios_fh_decref(handle, 1);
+	if (root)
+		ios_fh_decref(root, 1);
 
-	iof_read_check_and_send(projection);
+	IOF_TRACE_DOWN(rpc);
 }
 
-/* Completion callback for bulk read request
- *
- * This function is called when a put to the client has completed for a bulk
- * read.
+/* Handle a close from a client.
+ * For close RPCs there is no reply so simply ack the RPC first
+ * and then do the work off the critical path.
  */
-static int
-iof_read_bulk_cb(const struct crt_bulk_cb_info *cb_info)
+static void
+iof_close_handler(crt_rpc_t *rpc)
 {
-	struct ionss_active_read *ard = cb_info->bci_arg;
-	struct ios_projection *projection = ard->handle->projection;
-	struct iof_readx_out *out = crt_reply_get(ard->rpc);
-	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	struct iof_gah_in *in = crt_req_get(rpc);
+	struct ionss_file_handle *handle;
 	int rc;
 
-	if (cb_info->bci_rc) {
-		out->err = cb_info->bci_rc;
-		ard->failed = true;
-	} else {
-		out->bulk_len += ard->read_len;
-	}
-
-	if (ard->segment_offset < in->xtvec.xt_len &&
-	    ard->read_len == ard->req_len) {
-		/* Get the next segment */
-		iof_process_read_bulk(ard);
-		return 0;
-	}
-
-	rc = crt_reply_send(ard->rpc);
-
+	rc = crt_reply_send(rpc);
 	if (rc)
-		IOF_TRACE_ERROR(ard, "response not sent, ret = %d", rc);
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
 
-	crt_req_decref(ard->rpc);
+	handle = ios_fh_find(&base, &in->gah);
 
-	iof_pool_release(projection->ar_pool, ard);
+	if (!handle)
+		return;
 
-	iof_read_check_and_send(projection);
-	return 0;
+	ios_fh_decref(handle, 1);
+	d_hash_rec_decref(&handle->projection->file_ht, &handle->clist);
 }
 
-/*
- * The target of a bulk_read RPC from a client, replies using bulk data.
- *
- * Pulls the RPC off the network, allocates a read request descriptor, checks
- * active read count and either submits the read or queues it for later.
- */
 static void
-iof_readx_handler(crt_rpc_t *rpc)
+iof_fsync_handler(crt_rpc_t *rpc)
 {
-	struct iof_readx_in *in = crt_req_get(rpc);
-	struct iof_readx_out *out = crt_reply_get(rpc);
-	/* Use the output temporarily to store minimal info about
-	 * the read.
-	 */
-	struct ionss_io_req_desc *rrd;
+	struct iof_gah_in *in = crt_req_get(rpc);
+	struct iof_status_out *out = crt_reply_get(rpc);
 	struct ionss_file_handle *handle;
-	struct ionss_active_read *ard;
-	struct ios_projection *projection;
+	uint64_t start;
 	int rc;
 
 	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
 	if (out->err)
 		goto out;
 
-	/* TODO: Only immediate xtvec supported for now */
-	if (in->xtvec_len > 0) {
-		IOF_LOG_WARNING("xtvec not yet supported for read");
-		out->err = -DER_NOSYS;
+	VALIDATE_WRITE(handle->projection, out);
+	if (out->err || out->rc)
 		goto out;
-	}
-
-	crt_req_addref(rpc);
-
-	projection = handle->projection;
-
-	D_MUTEX_LOCK(&projection->lock);
-
-	/* Try and acquire a active read descriptor, if one is available then
-	 * start the read, else add it to the list
-	 */
-	ard = iof_pool_acquire(projection->ar_pool);
-	if (ard) {
-		projection->current_read_count++;
-		IOF_TRACE_UP(ard, handle, "ard");
-		IOF_TRACE_DEBUG(ard, "Injecting new read (%d/%d)",
-				projection->current_read_count,
-				projection->max_read_count);
-		D_MUTEX_UNLOCK(&projection->lock);
-		ard->rpc = rpc;
-		ard->handle = handle;
-		iof_process_read_bulk(ard);
-	} else {
-		/* Piggyback the output descriptor space to store the read
-		 * descriptor whilst in the read queue
-		 */
-		rrd = crt_reply_get(rpc);
 
-		rrd->rpc = rpc;
-		rrd->handle = handle;
-		d_list_add_tail(&rrd->list, &projection->read_list);
-		D_MUTEX_UNLOCK(&projection->lock);
-	}
+	start = ionss_aimd_now();
+	errno = 0;
+	rc = fsync(handle->fd);
+	if (rc)
+		out->rc = errno;
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(fsync), IOF_STATS_BACKEND,
+			   start);
 
-	return;
 out:
+	IOF_LOG_DEBUG("result err %d rc %d",
+		      out->err, out->rc);
 
-	IOF_LOG_DEBUG("Failed to read %d " GAH_PRINT_STR, out->err,
-		      GAH_PRINT_VAL(in->gah));
 	rc = crt_reply_send(rpc);
-
 	if (rc)
-		IOF_LOG_ERROR("response not sent, rc = %d", rc);
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
 
 	if (handle)
 		ios_fh_decref(handle, 1);
 }
 
 static void
-iof_rename_handler(crt_rpc_t *rpc)
+iof_fdatasync_handler(crt_rpc_t *rpc)
 {
-	struct iof_rename_in		*in = crt_req_get(rpc);
-	struct iof_status_out		*out = crt_reply_get(rpc);
-	struct ionss_file_handle	*old_parent = NULL;
-	struct ionss_file_handle	*new_parent = NULL;
+	struct iof_gah_in *in = crt_req_get(rpc);
+	struct iof_status_out *out = crt_reply_get(rpc);
+	struct ionss_file_handle *handle;
+	uint64_t start;
 	int rc;
 
-	old_parent = ios_fh_find(&base, &in->old_gah);
-	if (!old_parent)
-		D_GOTO(out, out->err = -DER_NOSYS);
-
-	new_parent = ios_fh_find(&base, &in->new_gah);
-	if (!new_parent)
-		D_GOTO(out, out->err = -DER_NOSYS);
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
+	if (out->err)
+		goto out;
 
-	VALIDATE_WRITE(old_parent->projection, out);
+	VALIDATE_WRITE(handle->projection, out);
 	if (out->err || out->rc)
-		D_GOTO(out, 0);
+		goto out;
 
+	start = ionss_aimd_now();
 	errno = 0;
-
-#if 1
-	if (in->flags)
-		rc = syscall(SYS_renameat2,
-			     old_parent->fd, in->old_name.name,
-			     new_parent->fd, in->new_name.name,
-			     in->flags);
-	else
-		rc = renameat(old_parent->fd, in->old_name.name,
-			      new_parent->fd, in->new_name.name);
-#else
-	rc = renameat2(old_parent->fd, in->old_name.name,
-		       new_parent->fd, in->new_name.name,
-		       in->flags);
-#endif
+	rc = fdatasync(handle->fd);
 	if (rc)
 		out->rc = errno;
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(fdatasync),
+			   IOF_STATS_BACKEND, start);
 
 out:
-	if (out->rc == ENOTSUP)
-		IOF_TRACE_WARNING(old_parent,
-				  "old '%s' new '%s' flags %d err %d rc %d",
-				  in->old_name.name, in->new_name.name,
-				  in->flags, out->err, out->rc);
-	else
-		IOF_TRACE_DEBUG(old_parent,
-				"old '%s' new '%s' flags %d err %d rc %d",
-				in->old_name.name, in->new_name.name,
-				in->flags, out->err, out->rc);
+	IOF_LOG_DEBUG("result err %d rc %d",
+		      out->err, out->rc);
 
 	rc = crt_reply_send(rpc);
+
 	if (rc)
 		IOF_LOG_ERROR("response not sent, ret = %d", rc);
 
-	if (old_parent)
-		ios_fh_decref(old_parent, 1);
-
-	if (new_parent)
-		ios_fh_decref(new_parent, 1);
+	if (handle)
+		ios_fh_decref(handle, 1);
 }
 
-static void
-iof_symlink_handler(crt_rpc_t *rpc)
+/* Upper limit on the length of a single copy_range RPC, so one request does
+ * not hold a handler thread for an unbounded time.  Clients loop on short
+ * copies in the same way as for short writes.
+ */
+#define IONSS_COPY_RANGE_MAX (64 * 1024 * 1024)
+
+/* Copy a range with pread() and pwrite(), used when copy_file_range() is
+ * not available or not supported between the two files.
+ *
+ * Returns the number of bytes copied, or -errno if nothing was copied.
+ */
+static ssize_t
+iof_copy_range_rw(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+		  size_t len, size_t buf_size)
 {
-	struct iof_two_string_in	*in = crt_req_get(rpc);
-	struct iof_entry_out		*out = crt_reply_get(rpc);
-	struct ionss_file_handle	*parent;
+	size_t copied = 0;
+	size_t seg;
+	ssize_t rlen;
+	ssize_t wlen;
+	int rc = 0;
+	char *buf;
 
-	int rc;
+	if (buf_size > len)
+		buf_size = len;
 
-	VALIDATE_ARGS_GAH_STR2(rpc, in, out, parent);
-	if (out->err)
-		goto out;
-	IOF_TRACE_UP(rpc, parent, "symlink");
+	D_ALLOC(buf, buf_size);
+	if (!buf)
+		return -ENOMEM;
 
-	VALIDATE_WRITE(parent->projection, out);
-	if (out->err || out->rc)
-		goto out;
+	while (copied < len) {
+		seg = len - copied;
+		if (seg > buf_size)
+			seg = buf_size;
 
-	errno = 0;
-	rc = symlinkat(in->oldpath, parent->fd, in->common.name.name);
+		rlen = pread(src_fd, buf, seg, src_off + copied);
+		if (rlen <= 0) {
+			if (rlen < 0)
+				rc = errno;
+			break;
+		}
 
-	if (rc)
-		out->rc = errno;
+		wlen = pwrite(dst_fd, buf, rlen, dst_off + copied);
+		if (wlen < 0) {
+			rc = errno;
+			break;
+		}
+		copied += wlen;
+		if (wlen != rlen)
+			break;
+	}
 
-out:
-	lookup_common(rpc, &in->common, out, parent);
-	IOF_TRACE_DEBUG(parent,
-			"newpath '%s' oldpath '%s' result err %d rc %d",
-			in->common.name.name, in->oldpath, out->err, out->rc);
+	D_FREE(buf);
+
+	if (copied == 0 && rc != 0)
+		return -rc;
+	return copied;
 }
 
+/* Copy a range between two files without moving the data through the
+ * client.  copy_file_range() lets the kernel, or the backend filesystem,
+ * copy without a round trip through user space and fall back to pread()
+ * and pwrite() where it is not supported.
+ */
 static void
-iof_mkdir_handler(crt_rpc_t *rpc)
+iof_copy_range_handler(crt_rpc_t *rpc)
 {
-	struct iof_create_in *in = crt_req_get(rpc);
-	struct iof_entry_out *out = crt_reply_get(rpc);
-	struct ionss_file_handle *parent;
+	struct iof_copy_range_in *in = crt_req_get(rpc);
+	struct iof_copy_range_out *out = crt_reply_get(rpc);
+	struct ionss_file_handle *src = NULL;
+	struct ionss_file_handle *dst = NULL;
+	struct ios_projection *projection;
+	ssize_t copied = -ENOSYS;
+	size_t len;
+	int src_fd;
+	int dst_fd;
 	int rc;
 
-	VALIDATE_ARGS_GAH_FILE_H(rpc, in->common, out, parent);
-	if (out->err)
-		goto out;
-
-	IOF_TRACE_UP(rpc, parent, "mkdir");
+	src = ios_fh_find(&base, &in->gah);
+	if (!src)
+		D_GOTO(out, out->err = -DER_NONEXIST);
 
-	VALIDATE_WRITE(parent->projection, out);
-	if (out->err || out->rc)
-		goto out;
+	dst = ios_fh_find(&base, &in->dst_gah);
+	if (!dst)
+		D_GOTO(out, out->err = -DER_NONEXIST);
 
-	errno = 0;
-	rc = mkdirat(parent->fd, in->common.name.name, in->mode);
+	IOF_TRACE_LINK(rpc, dst, "rpc");
 
-	if (rc)
-		out->rc = errno;
+	/* Both files must be in the same projection, as the source is only
+	 * checked for read access against the destination projection.
+	 */
+	if (src->projection != dst->projection)
+		D_GOTO(out, out->rc = EXDEV);
 
-	IOF_TRACE_DEBUG(parent, "dir '%s' rc %d",
-			in->common.name.name, out->rc);
-out:
-	lookup_common(rpc, &in->common, out, parent);
-}
+	projection = dst->projection;
+	VALIDATE_WRITE(projection, out);
+	if (out->err || out->rc)
+		D_GOTO(out, 0);
 
-/* This function needs additional checks to handle longer links.
- *
- */
+	src_fd = ionss_fd_get(&base.fdm, src);
+	if (src_fd < 0)
+		D_GOTO(out, out->rc = -src_fd);
 
-static void
-iof_readlink_handler(crt_rpc_t *rpc)
-{
-	struct iof_gah_in *in = crt_req_get(rpc);
-	struct iof_string_out *out = crt_reply_get(rpc);
-	struct ionss_file_handle *file = NULL;
-	char reply[IOF_MAX_PATH_LEN] = {0};
-	int rc;
+	dst_fd = ionss_fd_get(&base.fdm, dst);
+	if (dst_fd < 0) {
+		ionss_fd_put(&base.fdm, src);
+		D_GOTO(out, out->rc = -dst_fd);
+	}
 
-	VALIDATE_ARGS_GAH_FILE(rpc, in, out, file);
-	if (out->err)
-		goto out;
+	len = in->len;
+	if (len > IONSS_COPY_RANGE_MAX)
+		len = IONSS_COPY_RANGE_MAX;
 
-	errno = 0;
-	rc = readlinkat(file->fd, "", reply, IOF_MAX_PATH_LEN);
+#ifdef HAVE_COPY_FILE_RANGE
+	{
+		loff_t src_off = in->src_off;
+		loff_t dst_off = in->dst_off;
 
-	if (rc < 0)
-		out->rc = errno;
-	else
-		out->path = (d_string_t)reply;
+		errno = 0;
+		copied = copy_file_range(src_fd, &src_off, dst_fd, &dst_off,
+					 len, in->flags);
+		if (copied < 0)
+			copied = -errno;
+	}
+#endif
+	if ((copied == -ENOSYS || copied == -EXDEV ||
+	     copied == -EOPNOTSUPP) && in->flags == 0)
+		copied = iof_copy_range_rw(src_fd, in->src_off, dst_fd,
+					   in->dst_off, len,
+					   projection->max_write_size);
+
+	ionss_fd_put(&base.fdm, dst);
+	ionss_fd_put(&base.fdm, src);
+
+	if (copied < 0)
+		D_GOTO(out, out->rc = -copied);
+
+	if (copied > 0) {
+		ionss_cache_invalidate(projection->cache, dst->mf.inode_no,
+				       in->dst_off, copied);
+		atomic_add(&projection->write_bytes, copied);
+	}
+	out->len = copied;
 
 out:
+	IOF_TRACE_DEBUG(rpc, "len %#lx copied %#lx err %d rc %d", in->len,
+			out->len, out->err, out->rc);
+
 	rc = crt_reply_send(rpc);
 	if (rc)
 		IOF_LOG_ERROR("response not sent, ret = %d", rc);
 
-	if (file)
-		ios_fh_decref(file, 1);
+	if (dst)
+		ios_fh_decref(dst, 1);
+	if (src)
+		ios_fh_decref(src, 1);
 }
 
-static void iof_unlink_handler(crt_rpc_t *rpc)
+/* fallocate() modes which are passed through to the backend */
+#define IONSS_FALLOCATE_MODES \
+	(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)
+
+static void
+iof_fallocate_handler(crt_rpc_t *rpc)
 {
-	struct iof_unlink_in *in = crt_req_get(rpc);
+	struct iof_fallocate_in *in = crt_req_get(rpc);
 	struct iof_status_out *out = crt_reply_get(rpc);
-	struct ionss_file_handle *parent;
+	struct ionss_file_handle *handle;
+	int fd;
 	int rc;
 
-	VALIDATE_ARGS_GAH_FILE(rpc, in, out, parent);
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
 	if (out->err)
 		goto out;
 
-	VALIDATE_WRITE(parent->projection, out);
+	VALIDATE_WRITE(handle->projection, out);
 	if (out->err || out->rc)
 		goto out;
 
-	errno = 0;
-	rc = unlinkat(parent->fd, in->name.name, in->flags ? AT_REMOVEDIR : 0);
+	if (in->mode & ~IONSS_FALLOCATE_MODES)
+		D_GOTO(out, out->rc = EOPNOTSUPP);
+
+	fd = ionss_fd_get(&base.fdm, handle);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
 
+	errno = 0;
+	rc = fallocate(fd, in->mode, in->offset, in->len);
 	if (rc)
 		out->rc = errno;
 
-	IOF_TRACE_DEBUG(parent, "%s '%s' rc %d",
-			in->flags ? "dir" : "file", in->name.name, out->rc);
+	ionss_fd_put(&base.fdm, handle);
+
+	/* Punching holes and zeroing change the file contents */
+	if (rc == 0 && (in->mode & (FALLOC_FL_PUNCH_HOLE |
+				    FALLOC_FL_ZERO_RANGE)))
+		ionss_cache_invalidate(handle->projection->cache,
+				       handle->mf.inode_no, in->offset,
+				       in->len);
+
 out:
+	IOF_TRACE_DEBUG(rpc, "mode %#x offset %#lx len %#lx err %d rc %d",
+			in->mode, in->offset, in->len, out->err, out->rc);
+
 	rc = crt_reply_send(rpc);
 	if (rc)
-		IOF_TRACE_ERROR(rpc, "response not sent, ret = %d", rc);
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
 
-	if (parent)
-		ios_fh_decref(parent, 1);
+	if (handle)
+		ios_fh_decref(handle, 1);
 }
 
-#define VALIDATE_WRITEX_IN(in, out, max_iov_write_size)			\
-	do {								\
-		uint64_t xtlen = (in)->xtvec.xt_len;			\
-		size_t bulk_len;					\
-		int _rc;						\
-		if ((in)->data.iov_len > max_iov_write_size) {		\
-			out->err = -DER_MISC;				\
-			break;						\
-		}							\
-		if (xtlen != ((in)->bulk_len + (in)->data.iov_len)) {	\
-			out->err = -DER_MISC;				\
-			break;						\
-		}							\
-		if ((in)->bulk_len == 0) /*no bulk */			\
-			break;						\
-		_rc = crt_bulk_get_len((in)->data_bulk, &bulk_len);	\
-		if (_rc != 0) {						\
-			out->err = _rc;					\
-			break;						\
-		}							\
-		if ((in)->bulk_len > bulk_len) {			\
-			out->err = -DER_MISC;				\
-			break;						\
-		}							\
-	} while (0)
-
 _Static_assert(sizeof(struct ionss_io_req_desc) <=
-	       sizeof(struct iof_writex_out),
-	       "struct iof_writex_out needs to be large enough to contain"
+	       sizeof(struct iof_readx_out),
+	       "struct iof_readx_out needs to be large enough to contain"
 	       " struct ionss_io_req_desc");
 
-static int iof_write_bulk(const struct crt_bulk_cb_info *cb_info);
-static void iof_process_write(struct ionss_active_write *awd);
+/* Return the rank which sent a RPC, used to schedule queued requests */
+static d_rank_t
+iof_rpc_src_rank(crt_rpc_t *rpc)
+{
+	d_rank_t rank = IONSS_NO_RANK;
+	int rc;
 
-void iof_write_check_and_send(struct ios_projection *projection)
+	rc = crt_req_src_rank_get(rpc, &rank);
+	if (rc != -DER_SUCCESS)
+		IOF_LOG_DEBUG("Could not get source rank %d", rc);
+
+	return rank;
+}
+
+static uint64_t
+iof_read_cost(struct ionss_io_req_desc *rrd)
 {
-	struct ionss_io_req_desc *wrd;
-	struct ionss_active_write *awd;
-	struct iof_writex_in *in;
-	struct iof_writex_out *out;
+	struct iof_readx_in *in = crt_req_get(rrd->rpc);
 
-	D_MUTEX_LOCK(&projection->lock);
-	if (d_list_empty(&projection->write_list)) {
-		projection->current_write_count--;
-		IOF_TRACE_DEBUG(projection, "Dropping write slot (%d/%d)",
-				projection->current_write_count,
-				projection->max_write_count);
-		D_MUTEX_UNLOCK(&projection->lock);
-		return;
-	}
+	return in->xtvec.xt_len;
+}
 
-	awd = iof_pool_acquire(projection->aw_pool);
-	if (!awd) {
-		projection->current_write_count--;
-		IOF_TRACE_DEBUG(projection, "No AWD slot available (%d/%d)",
-				projection->current_write_count,
-				projection->max_write_count);
-		D_MUTEX_UNLOCK(&projection->lock);
-		return;
-	}
+static uint64_t
+iof_write_cost(struct ionss_io_req_desc *wrd)
+{
+	struct iof_writex_in *in = crt_req_get(wrd->rpc);
+
+	return in->xtvec.xt_len;
+}
+
+/* Check the extent list of a vectored request before accepting it */
+static int
+iof_xtvec_check(uint64_t count, crt_bulk_t bulk)
+{
+	size_t len;
+	int rc;
 
-	wrd = d_list_pop_entry(&projection->write_list,
-			       struct ionss_io_req_desc, list);
+	if (count == 0)
+		return -DER_SUCCESS;
 
-	IOF_TRACE_UP(awd, wrd->handle, "awd");
-	IOF_TRACE_DEBUG(awd, "Submiting new write (%d/%d)",
-			projection->current_write_count,
-			projection->max_write_count);
+	if (count > IOF_XTVEC_MAX)
+		return -DER_INVAL;
 
-	D_MUTEX_UNLOCK(&projection->lock);
+	rc = crt_bulk_get_len(bulk, &len);
+	if (rc != -DER_SUCCESS)
+		return rc;
 
-	awd->rpc = wrd->rpc;
-	awd->handle = wrd->handle;
+	if (len < count * sizeof(struct iof_xtvec))
+		return -DER_INVAL;
 
-	in = crt_req_get(awd->rpc);
-	out = crt_reply_get(awd->rpc);
+	return -DER_SUCCESS;
+}
 
-	/* Reset the borrowed output to 0 */
-	memset(wrd, 0, sizeof(*wrd));
+/* Pull the extent list of a vectored request from the client */
+static int
+iof_xtvec_fetch(crt_rpc_t *rpc, crt_bulk_t remote, uint64_t count,
+		struct iof_local_bulk *local, crt_bulk_cb_t cb, void *arg)
+{
+	struct crt_bulk_desc bulk_desc = {0};
 
-	if (in->xtvec.xt_len == 0)
-		out->err = -DER_NOSYS;
+	bulk_desc.bd_rpc = rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_GET;
+	bulk_desc.bd_remote_hdl = remote;
+	bulk_desc.bd_local_hdl = local->handle;
+	bulk_desc.bd_local_off = local->offset;
+	bulk_desc.bd_len = count * sizeof(struct iof_xtvec);
 
-	iof_process_write(awd);
+	return crt_bulk_transfer(&bulk_desc, cb, arg, NULL);
 }
 
-/* Process a write request
+/* Check an extent list pulled from the client and merge adjacent extents
  *
- * This function submits a bulk pull to get the data to write
+ * The data for every extent is packed in the data bulk, so extents which are
+ * contiguous in the file are also contiguous in the buffer and are merged
+ * into a single run.  Returns the number of runs, or a negative error if the
+ * extents do not add up to the length of the request.
  */
-static void
-iof_process_write(struct ionss_active_write *awd)
+static int
+iof_xtvec_prepare(struct iof_xtvec *xtvec, uint64_t count, uint64_t total)
 {
-	struct ionss_file_handle *handle = awd->handle;
-	struct iof_writex_in *in = crt_req_get(awd->rpc);
-	struct iof_writex_out *out = crt_reply_get(awd->rpc);
-	struct ios_projection *projection = awd->handle->projection;
-	struct crt_bulk_desc bulk_desc = {0};
-	ssize_t bytes_written;
-	off_t offset;
-	int rc;
+	uint64_t len = 0;
+	uint64_t i;
+	int runs = 0;
 
-	if (out->err)
-		D_GOTO(out, 0);
+	for (i = 0; i < count; i++) {
+		if (xtvec[i].xt_len == 0)
+			continue;
 
-	if (in->bulk_len == 0 || awd->segment_offset == in->bulk_len) {
-		offset = in->xtvec.xt_off + awd->segment_offset;
-		IOF_TRACE_DEBUG(awd, "Writing to fd=%d %#zx-%#zx", handle->fd,
-				offset, offset + in->data.iov_len - 1);
-		errno = 0;
-		bytes_written = pwrite(handle->fd, in->data.iov_buf,
-				       in->data.iov_len, offset);
-		if (bytes_written == -1)
-			out->rc = errno;
-		else
-			out->len += bytes_written;
-		D_GOTO(out, 0);
+		if (xtvec[i].xt_off + xtvec[i].xt_len < xtvec[i].xt_off ||
+		    len + xtvec[i].xt_len < len)
+			return -DER_INVAL;
+
+		len += xtvec[i].xt_len;
+
+		if (runs > 0 && xtvec[runs - 1].xt_off +
+		    xtvec[runs - 1].xt_len == xtvec[i].xt_off) {
+			xtvec[runs - 1].xt_len += xtvec[i].xt_len;
+			continue;
+		}
+
+		xtvec[runs++] = xtvec[i];
 	}
 
-	awd->req_len = in->xtvec.xt_len - awd->segment_offset;
-	/* Only write max_write_size at a time */
-	if (awd->req_len > projection->max_write_size)
-		awd->req_len = projection->max_write_size;
+	if (runs == 0 || len != total)
+		return -DER_INVAL;
 
-	bulk_desc.bd_rpc = awd->rpc;
-	bulk_desc.bd_bulk_op = CRT_BULK_GET;
-	bulk_desc.bd_remote_hdl = in->data_bulk;
-	bulk_desc.bd_remote_off = awd->data_offset;
-	bulk_desc.bd_local_hdl = awd->local_bulk.handle;
-	bulk_desc.bd_len = awd->req_len;
+	return runs;
+}
 
-	IOF_TRACE_DEBUG(awd, "Fetching bulk " GAH_PRINT_STR,
-			GAH_PRINT_VAL(in->gah));
+/* Read or write part of a vectored request
+ *
+ * Transfers len bytes from data_off within the packed data of the request,
+ * with one pread() or pwrite() for each run it covers.  Stops at the first
+ * short transfer, and returns the number of bytes transferred or a negative
+ * errno if the first call failed.
+ */
+static ssize_t
+iof_xtvec_io(struct ionss_file_handle *handle, bool write,
+	     struct iof_xtvec *xtvec, uint32_t count, uint64_t data_off,
+	     void *buf, size_t len)
+{
+	uint64_t start = 0;
+	size_t done = 0;
+	uint32_t i;
+
+	for (i = 0; i < count && done < len; i++) {
+		uint64_t pos = data_off + done;
+		uint64_t skip;
+		size_t n;
+		ssize_t res;
+
+		if (pos >= start + xtvec[i].xt_len) {
+			start += xtvec[i].xt_len;
+			continue;
+		}
 
-	rc = crt_bulk_transfer(&bulk_desc, iof_write_bulk, awd, NULL);
-	if (rc) {
-		awd->failed = true;
-		D_GOTO(out, out->err = rc);
-	}
+		skip = pos - start;
+		n = xtvec[i].xt_len - skip;
+		if (n > len - done)
+			n = len - done;
 
-	/* Do not call crt_reply_send() in this case as it'll be done in the
-	 * bulk handler
-	 */
+		errno = 0;
+		if (write)
+			res = pwrite(handle->fd, buf + done, n,
+				     xtvec[i].xt_off + skip);
+		else
+			res = pread(handle->fd, buf + done, n,
+				    xtvec[i].xt_off + skip);
+		if (res == -1) {
+			if (done == 0)
+				return -errno;
+			break;
+		}
 
-	return;
-out:
+		if (write && res > 0)
+			ionss_cache_invalidate(handle->projection->cache,
+					       handle->mf.inode_no,
+					       xtvec[i].xt_off + skip, res);
+
+		done += res;
+		if (res < n)
+			break;
+
+		start += xtvec[i].xt_len;
+	}
 
-	rc = crt_reply_send(awd->rpc);
+	return done;
+}
+
+static int iof_read_bulk_cb(const struct crt_bulk_cb_info *cb_info);
+static void iof_process_read_bulk(struct ionss_active_read *ard);
+static void iof_read_complete(struct ionss_active_read *ard, ssize_t res);
+static void iof_read_send(struct ionss_active_read *ard);
+static void iof_read_finish(struct ionss_active_read *ard);
+static int iof_read_xtvec_cb(const struct crt_bulk_cb_info *cb_info);
+
+/* Allocate the buffers for a read descriptor.
+ *
+ * This is done on first use rather than when the descriptor is created so
+ * that buffers, and the arena, are not registered at startup for
+ * projections which may never be read.
+ */
+static bool
+ar_alloc_buffers(struct ionss_active_read *ard)
+{
+	int i;
+
+	for (i = 0; i < IONSS_READ_BUFFERS; i++) {
+		if (ard->local_bulk[i].buf)
+			continue;
+		IOF_BULK_ALLOC_ARENA(ard->projection->ar_arena,
+				     ard->projection->base->crt_ctx,
+				     ard,
+				     local_bulk[i],
+				     ard->projection->max_read_size,
+				     true);
+		if (!ard->local_bulk[i].buf)
+			return false;
+	}
+	return true;
+}
+
+/* Start processing a read, reading the first segment into the first buffer.
+ *
+ * For a vectored read the extent list is pulled from the client first, and
+ * the read is started again once it has arrived.
+ */
+static void
+iof_read_start(struct ionss_active_read *ard)
+{
+	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	struct iof_readx_out *out = crt_reply_get(ard->rpc);
+	int rc;
+
+	if (!ar_alloc_buffers(ard)) {
+		out->err = -DER_NOMEM;
+		ard->failed = true;
+		iof_read_finish(ard);
+		return;
+	}
+
+	if (in->xtvec_len > 0 && ard->xtvec_count == 0) {
+		if (!ard->xt_bulk.buf)
+			IOF_BULK_ALLOC(ard->projection->base->crt_ctx, ard,
+				       xt_bulk,
+				       IOF_XTVEC_MAX * sizeof(struct iof_xtvec),
+				       false);
+		if (!ard->xt_bulk.buf) {
+			out->err = -DER_NOMEM;
+			iof_read_finish(ard);
+			return;
+		}
+
+		rc = iof_xtvec_fetch(ard->rpc, in->xtvec_bulk, in->xtvec_len,
+				     &ard->xt_bulk, iof_read_xtvec_cb, ard);
+		if (rc != -DER_SUCCESS) {
+			out->err = rc;
+			iof_read_finish(ard);
+		}
+		return;
+	}
+
+	ard->buf = 0;
+	atomic_store_release(&ard->pending, 1);
+	iof_process_read_bulk(ard);
+}
+
+/* Completion callback for the pull of the extent list of a vectored read */
+static int
+iof_read_xtvec_cb(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_active_read *ard = cb_info->bci_arg;
+	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	struct iof_readx_out *out = crt_reply_get(ard->rpc);
+	int rc = cb_info->bci_rc;
+
+	if (rc == -DER_SUCCESS)
+		rc = iof_xtvec_prepare(ard->xt_bulk.buf, in->xtvec_len,
+				       in->xtvec.xt_len);
+	if (rc < 0) {
+		IOF_TRACE_WARNING(ard, "Invalid extent list %d", rc);
+		out->err = rc;
+		iof_read_finish(ard);
+		return 0;
+	}
+
+	IOF_TRACE_DEBUG(ard, "Reading %lu extents in %d runs", in->xtvec_len,
+			rc);
+
+	ard->xtvec_count = rc;
+	iof_read_start(ard);
+
+	return 0;
+}
+
+/* Called as each read completes, to either reuse the slot for the next
+ * queued read or drop it.  Slots are dropped if the adaptive limit has been
+ * reduced below the current count, and if the limit has been raised then
+ * additional slots are started for queued reads.
+ */
+void iof_read_check_and_send(struct ios_projection *projection)
+{
+	struct ionss_io_req_desc *rrd;
+	struct ionss_active_read *ard;
+	uint64_t queued;
+	uint32_t limit;
+	bool grow;
+
+	do {
+		D_MUTEX_LOCK(&projection->lock);
+		limit = ionss_aimd_limit(&projection->read_ctl);
+		if (ionss_sched_empty(&projection->read_sched) ||
+		    projection->current_read_count > limit) {
+			projection->current_read_count--;
+			IOF_LOG_DEBUG("Dropping read slot (%d/%d)",
+				      projection->current_read_count, limit);
+			D_MUTEX_UNLOCK(&projection->lock);
+			return;
+		}
+
+		ard = iof_pool_acquire(projection->ar_pool);
+		if (!ard) {
+			projection->current_read_count--;
+			IOF_TRACE_DEBUG(projection,
+					"No ARD slot available (%d/%d)",
+					projection->current_read_count, limit);
+			D_MUTEX_UNLOCK(&projection->lock);
+			return;
+		}
+
+		rrd = ionss_sched_dequeue(&projection->read_sched, &queued);
+
+		IOF_TRACE_UP(ard, rrd->handle, "ard");
+		IOF_TRACE_DEBUG(ard, "Submiting new read (%d/%d)",
+				projection->current_read_count, limit);
+
+		grow = projection->current_read_count < limit &&
+			!ionss_sched_empty(&projection->read_sched);
+		if (grow)
+			projection->current_read_count++;
+
+		D_MUTEX_UNLOCK(&projection->lock);
+
+		ard->rpc = rrd->rpc;
+		ard->handle = rrd->handle;
+
+		ionss_stats_record(&base.stats, DEF_RPC_TYPE(readx),
+				   IOF_STATS_QUEUE, queued);
+
+		/* Reset the borrowed output to 0 */
+		memset(rrd, 0, sizeof(*rrd));
+
+		iof_read_start(ard);
+	} while (grow);
+}
+
+static void
+iof_read_uring_cb(struct ionss_uring_op *op, int res)
+{
+	struct ionss_active_read *ard = container_of(op,
+						     struct ionss_active_read,
+						     uop);
+
+	iof_read_complete(ard, res);
+}
+
+/* Select the descriptor to use for a backend read or write
+ *
+ * If direct I/O is enabled then large transfers which are suitably aligned
+ * bypass the page cache.  Unaligned transfers are not split or padded with
+ * read-modify-write cycles, as concurrent requests could then lose updates
+ * to shared blocks, instead they use the page cache which the kernel keeps
+ * coherent with direct I/O.
+ */
+static int
+iof_io_fd(struct ionss_file_handle *handle, const void *buf, size_t len,
+	  off_t offset)
+{
+	struct ios_projection *projection = handle->projection;
+	uint32_t direct_io_size;
+
+	if (handle->direct_fd == -1)
+		return handle->fd;
+
+	/* direct_io_size may have been set to 0 since the file was opened */
+	direct_io_size = atomic_load_consume(&projection->direct_io_size);
+	if (direct_io_size == 0 || len < direct_io_size)
+		return handle->fd;
+
+	if ((offset | len | (uintptr_t)buf) & (IONSS_DIRECT_ALIGN - 1))
+		return handle->fd;
+
+	return handle->direct_fd;
+}
+
+/* Complete the current segment from a cache block */
+static void
+iof_read_cache_complete(struct ionss_active_read *ard,
+			struct ionss_cache_block *cblk)
+{
+	ssize_t res = 0;
+
+	ard->cblk[ard->buf] = cblk;
+	if (cblk->len > ard->cblk_offset[ard->buf])
+		res = cblk->len - ard->cblk_offset[ard->buf];
+	if (res > ard->req_len)
+		res = ard->req_len;
+	iof_read_complete(ard, res);
+}
+
+/* Read the current segment with pread(), or fill it from the cache, and
+ * complete it
+ */
+static void
+iof_read_direct(struct ionss_active_read *ard)
+{
+	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	ssize_t res;
+
+	if (ard->cache_fill) {
+		struct ionss_cache_block *cblk;
+
+		ard->cache_fill = false;
+		cblk = ionss_cache_get(ard->handle,
+				       in->xtvec.xt_off + ard->segment_offset,
+				       ard->req_len,
+				       &ard->cblk_offset[ard->buf]);
+		if (cblk) {
+			iof_read_cache_complete(ard, cblk);
+			return;
+		}
+	}
+
+	if (ard->xtvec_count) {
+		res = iof_xtvec_io(ard->handle, false, ard->xt_bulk.buf,
+				   ard->xtvec_count, ard->segment_offset,
+				   ard->local_bulk[ard->buf].buf,
+				   ard->req_len);
+		iof_read_complete(ard, res);
+		return;
+	}
+
+	errno = 0;
+	res = pread(ard->io_fd, ard->local_bulk[ard->buf].buf,
+		    ard->req_len, in->xtvec.xt_off + ard->segment_offset);
+	if (res == -1)
+		res = -errno;
+
+	iof_read_complete(ard, res);
+}
+
+static void
+iof_read_lane_cb(struct ionss_lane_op *op)
+{
+	struct ionss_active_read *ard = container_of(op,
+						     struct ionss_active_read,
+						     lop);
+
+	iof_read_direct(ard);
+}
+
+/* Process a read request
+ *
+ * This function reads the segment at segment_offset into the current buffer,
+ * either from the cache, by submitting it to the io_uring or by reading it
+ * directly, and then completes it.  Only the cache lookup is done inline,
+ * filling or revalidating a block is done on a data lane.
+ */
+static void
+iof_process_read_bulk(struct ionss_active_read *ard)
+{
+	struct ionss_file_handle *handle = ard->handle;
+	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	struct ios_projection *projection = ard->projection;
+	void *buf = ard->local_bulk[ard->buf].buf;
+	size_t count;
+	off_t offset;
+	int rc;
+
+	count = in->xtvec.xt_len - ard->segment_offset;
+	/* Only read max_read_size at a time */
+	if (count > projection->max_read_size)
+		count = projection->max_read_size;
+	ard->req_len = count;
+	offset = in->xtvec.xt_off + ard->segment_offset;
+
+	/* Vectored reads are read run by run on a data lane, bypassing the
+	 * cache and io_uring which only handle a single extent.
+	 */
+	if (ard->xtvec_count) {
+		ard->io_fd = handle->fd;
+		ard->io_start = ionss_aimd_now();
+		ard->lop.fn = iof_read_lane_cb;
+		if (ionss_lane_submit(projection->data_lane, &ard->lop) == 0)
+			return;
+		iof_read_direct(ard);
+		return;
+	}
+
+	ard->io_fd = iof_io_fd(handle, buf, count, offset);
+
+	IOF_TRACE_DEBUG(ard, "Reading from fd=%d %#zx-%#zx into %d",
+			ard->io_fd, offset, offset + count - 1, ard->buf);
+
+	ard->cache_fill = (projection->cache &&
+			   ionss_cache_covers(projection->cache, offset,
+					      count));
+	if (ard->cache_fill) {
+		struct ionss_cache_block *cblk;
+
+		cblk = ionss_cache_lookup(projection->cache,
+					  handle->mf.inode_no, offset, count,
+					  &ard->cblk_offset[ard->buf]);
+		if (cblk) {
+			ard->cache_fill = false;
+			iof_read_cache_complete(ard, cblk);
+			return;
+		}
+	}
+
+	ard->io_start = ionss_aimd_now();
+
+	if (projection->uring && !ard->cache_fill) {
+		ard->uop.cb = iof_read_uring_cb;
+		rc = ionss_uring_read(projection->uring, &ard->uop, ard->io_fd,
+				      buf, count, offset);
+		if (rc == -DER_SUCCESS)
+			return;
+		IOF_TRACE_DEBUG(ard, "Falling back to pread %d", rc);
+	}
+
+	/* Keep blocking reads off the progress threads if possible */
+	ard->lop.fn = iof_read_lane_cb;
+	if (ionss_lane_submit(projection->data_lane, &ard->lop) == 0)
+		return;
+
+	iof_read_direct(ard);
+}
+
+/* Complete a read of a segment
+ *
+ * Called with the result of reading a segment.  If the bulk put of the
+ * previous segment is still in progress then whichever of the two completes
+ * last continues processing the request.
+ */
+static void
+iof_read_complete(struct ionss_active_read *ard, ssize_t res)
+{
+	ard->read_len = res;
+
+	if (ard->io_start) {
+		ionss_aimd_sample(&ard->projection->read_ctl, ard->io_start,
+				  res);
+		ionss_stats_record(&base.stats, DEF_RPC_TYPE(readx),
+				   IOF_STATS_BACKEND, ard->io_start);
+		ard->io_start = 0;
+	}
+
+	if (atomic_fetch_sub(&ard->pending, 1) != 1)
+		return;
+
+	iof_read_send(ard);
+}
+
+/* Reply to a read request and release the descriptor */
+static void
+iof_read_finish(struct ionss_active_read *ard)
+{
+	struct ios_projection *projection = ard->projection;
+	int rc;
+	int i;
+
+	for (i = 0; i < IONSS_READ_BUFFERS; i++) {
+		if (!ard->cblk[i])
+			continue;
+		ionss_cache_put(projection->cache, ard->cblk[i]);
+		ard->cblk[i] = NULL;
+	}
+
+	rc = crt_reply_send(ard->rpc);
+
+	if (rc)
+		IOF_TRACE_ERROR(ard, "response not sent, ret = %d", rc);
+
+	crt_req_decref(ard->rpc);
+
+	ios_fh_decref(ard->handle, 1);
+
+	iof_pool_release(projection->ar_pool, ard);
+
+	iof_read_check_and_send(projection);
+}
+
+/* Send a segment to the client
+ *
+ * Called once the segment in the current buffer has been read and any
+ * previous bulk put has completed.  Either completes the request or submits a
+ * bulk put of the segment, and if there is more data to read then reads the
+ * next segment into the other buffer whilst the put is in progress so that
+ * the backend filesystem and the network are kept busy at the same time.
+ */
+static void
+iof_read_send(struct ionss_active_read *ard)
+{
+	struct iof_readx_in *in = crt_req_get(ard->rpc);
+	struct iof_readx_out *out = crt_reply_get(ard->rpc);
+	struct ios_projection *projection = ard->projection;
+	struct iof_local_bulk *local_bulk = &ard->local_bulk[ard->buf];
+	struct ionss_cache_block *cblk = ard->cblk[ard->buf];
+	struct crt_bulk_desc bulk_desc = {0};
+	bool read_ahead;
+	int rc;
+
+	/* The put of the previous segment failed */
+	if (out->err)
+		goto out;
+
+	if (ard->read_len < 0) {
+		out->rc = -ard->read_len;
+		goto out;
+	} else if (ard->read_len <= projection->max_iov_read_size) {
+		/* Can send last bit in immediate data */
+		if (cblk)
+			memcpy(local_bulk->buf,
+			       cblk->bulk.buf + ard->cblk_offset[ard->buf],
+			       ard->read_len);
+		out->iov_len = ard->read_len;
+		d_iov_set(&out->data, local_bulk->buf, ard->read_len);
+		goto out;
+	}
+
+	bulk_desc.bd_rpc = ard->rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_PUT;
+	bulk_desc.bd_remote_hdl = in->data_bulk;
+	bulk_desc.bd_remote_off = in->data_bulk_off + ard->data_offset;
+	bulk_desc.bd_local_hdl = local_bulk->handle;
+	bulk_desc.bd_local_off = local_bulk->offset;
+	bulk_desc.bd_len = ard->read_len;
+	if (cblk) {
+		bulk_desc.bd_local_hdl = cblk->bulk.handle;
+		bulk_desc.bd_local_off = ard->cblk_offset[ard->buf];
+	}
+
+	IOF_TRACE_DEBUG(ard, "Sending bulk from %d " GAH_PRINT_STR, ard->buf,
+			GAH_PRINT_VAL(in->gah));
+
+	ard->data_offset += ard->req_len;
+	ard->segment_offset += ard->req_len;
+	ard->put_len = ard->read_len;
+	ard->put_buf = ard->buf;
+
+	read_ahead = (ard->segment_offset < in->xtvec.xt_len &&
+		      ard->read_len == ard->req_len);
+	ard->read_ahead = read_ahead;
+
+	/* Wait for the put to complete, and if reading ahead for the next
+	 * segment to be read into the other buffer.  Once the transfer has
+	 * been submitted the descriptor may be released by the callback so
+	 * only use the local copy of read_ahead after this point.
+	 */
+	if (read_ahead) {
+		ard->buf = (ard->buf + 1) % IONSS_READ_BUFFERS;
+		atomic_store_release(&ard->pending, 2);
+	} else {
+		atomic_store_release(&ard->pending, 1);
+	}
+
+	ard->bulk_start = ionss_aimd_now();
+	rc = crt_bulk_transfer(&bulk_desc, iof_read_bulk_cb, ard, NULL);
+	if (rc != -DER_SUCCESS) {
+		out->err = rc;
+		ard->failed = true;
+		goto out;
+	}
+
+	if (read_ahead)
+		iof_process_read_bulk(ard);
+
+	/* Do not call crt_reply_send() in this case as it'll be done once
+	 * the bulk transfer has completed.
+	 */
+	return;
+out:
+	iof_read_finish(ard);
+}
+
+/* Completion callback for bulk read request
+ *
+ * This function is called when a put to the client has completed for a bulk
+ * read.
+ */
+static int
+iof_read_bulk_cb(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_active_read *ard = cb_info->bci_arg;
+	struct ios_projection *projection = ard->projection;
+	struct iof_readx_out *out = crt_reply_get(ard->rpc);
+
+	if (ard->cblk[ard->put_buf]) {
+		ionss_cache_put(projection->cache, ard->cblk[ard->put_buf]);
+		ard->cblk[ard->put_buf] = NULL;
+	}
+
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(readx), IOF_STATS_BULK,
+			   ard->bulk_start);
+
+	if (cb_info->bci_rc) {
+		out->err = cb_info->bci_rc;
+		ard->failed = true;
+	} else {
+		out->bulk_len += ard->put_len;
+		atomic_add(&projection->read_bytes, ard->put_len);
+	}
+
+	if (atomic_fetch_sub(&ard->pending, 1) != 1)
+		return 0;
+
+	/* Send the next segment, which has already been read */
+	if (ard->read_ahead)
+		iof_read_send(ard);
+	else
+		iof_read_finish(ard);
+
+	return 0;
+}
+
+/*
+ * The target of a bulk_read RPC from a client, replies using bulk data.
+ *
+ * Pulls the RPC off the network, allocates a read request descriptor, checks
+ * active read count and either submits the read or queues it for later.
+ */
+static void
+iof_readx_handler(crt_rpc_t *rpc)
+{
+	struct iof_readx_in *in = crt_req_get(rpc);
+	struct iof_readx_out *out = crt_reply_get(rpc);
+	/* Use the output temporarily to store minimal info about
+	 * the read.
+	 */
+	struct ionss_io_req_desc *rrd;
+	struct ionss_file_handle *handle;
+	struct ionss_active_read *ard = NULL;
+	struct ios_projection *projection;
+	int rc;
+
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
+	if (out->err)
+		goto out;
+
+	out->err = iof_xtvec_check(in->xtvec_len, in->xtvec_bulk);
+	if (out->err) {
+		IOF_LOG_WARNING("Invalid extent list for read %lu",
+				in->xtvec_len);
+		goto out;
+	}
+
+	crt_req_addref(rpc);
+
+	projection = handle->projection;
+
+	D_MUTEX_LOCK(&projection->lock);
+
+	/* Try and acquire a active read descriptor, if one is available then
+	 * start the read, else add it to the list
+	 */
+	if (projection->current_read_count <
+	    ionss_aimd_limit(&projection->read_ctl))
+		ard = iof_pool_acquire(projection->ar_pool);
+	if (ard) {
+		projection->current_read_count++;
+		IOF_TRACE_UP(ard, handle, "ard");
+		IOF_TRACE_DEBUG(ard, "Injecting new read (%d/%d)",
+				projection->current_read_count,
+				ionss_aimd_limit(&projection->read_ctl));
+		D_MUTEX_UNLOCK(&projection->lock);
+		ard->rpc = rpc;
+		ard->handle = handle;
+		iof_read_start(ard);
+	} else {
+		/* Piggyback the output descriptor space to store the read
+		 * descriptor whilst in the read queue
+		 */
+		rrd = crt_reply_get(rpc);
+
+		rrd->rpc = rpc;
+		rrd->handle = handle;
+		rc = ionss_sched_enqueue(&projection->read_sched, rrd,
+					 iof_rpc_src_rank(rpc));
+		D_MUTEX_UNLOCK(&projection->lock);
+		if (rc != -DER_SUCCESS) {
+			memset(rrd, 0, sizeof(*rrd));
+			crt_req_decref(rpc);
+			D_GOTO(out, out->err = rc);
+		}
+	}
+
+	return;
+out:
+
+	IOF_LOG_DEBUG("Failed to read %d " GAH_PRINT_STR, out->err,
+		      GAH_PRINT_VAL(in->gah));
+	rc = crt_reply_send(rpc);
+
+	if (rc)
+		IOF_LOG_ERROR("response not sent, rc = %d", rc);
+
+	if (handle)
+		ios_fh_decref(handle, 1);
+}
+
+static void
+iof_rename_handler(crt_rpc_t *rpc)
+{
+	struct iof_rename_in		*in = crt_req_get(rpc);
+	struct iof_status_out		*out = crt_reply_get(rpc);
+	struct ionss_file_handle	*old_parent = NULL;
+	struct ionss_file_handle	*new_parent = NULL;
+	int old_fd;
+	int new_fd;
+	int rc;
+
+	old_parent = ios_fh_find(&base, &in->old_gah);
+	if (!old_parent)
+		D_GOTO(out, out->err = -DER_NOSYS);
+
+	new_parent = ios_fh_find(&base, &in->new_gah);
+	if (!new_parent)
+		D_GOTO(out, out->err = -DER_NOSYS);
+
+	VALIDATE_WRITE(old_parent->projection, out);
+	if (out->err || out->rc)
+		D_GOTO(out, 0);
+
+	old_fd = ionss_fd_get(&base.fdm, old_parent);
+	if (old_fd < 0)
+		D_GOTO(out, out->rc = -old_fd);
+
+	new_fd = ionss_fd_get(&base.fdm, new_parent);
+	if (new_fd < 0) {
+		ionss_fd_put(&base.fdm, old_parent);
+		D_GOTO(out, out->rc = -new_fd);
+	}
+
+	errno = 0;
+
+#if 1
+	if (in->flags)
+		rc = syscall(SYS_renameat2,
+			     old_fd, in->old_name.name,
+			     new_fd, in->new_name.name,
+			     in->flags);
+	else
+		rc = renameat(old_fd, in->old_name.name,
+			      new_fd, in->new_name.name);
+#else
+	rc = renameat2(old_fd, in->old_name.name,
+		       new_fd, in->new_name.name,
+		       in->flags);
+#endif
+	if (rc)
+		out->rc = errno;
+
+	ionss_fd_put(&base.fdm, new_parent);
+	ionss_fd_put(&base.fdm, old_parent);
+
+out:
+	if (out->rc == ENOTSUP)
+		IOF_TRACE_WARNING(old_parent,
+				  "old '%s' new '%s' flags %d err %d rc %d",
+				  in->old_name.name, in->new_name.name,
+				  in->flags, out->err, out->rc);
+	else
+		IOF_TRACE_DEBUG(old_parent,
+				"old '%s' new '%s' flags %d err %d rc %d",
+				in->old_name.name, in->new_name.name,
+				in->flags, out->err, out->rc);
+
+	rc = crt_reply_send(rpc);
+	if (rc)
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+
+	if (old_parent)
+		ios_fh_decref(old_parent, 1);
+
+	if (new_parent)
+		ios_fh_decref(new_parent, 1);
+}
+
+static void
+iof_symlink_handler(crt_rpc_t *rpc)
+{
+	struct iof_two_string_in	*in = crt_req_get(rpc);
+	struct iof_entry_out		*out = crt_reply_get(rpc);
+	struct ionss_file_handle	*parent;
+	int fd;
+	int rc;
+
+	VALIDATE_ARGS_GAH_STR2(rpc, in, out, parent);
+	if (out->err)
+		goto out;
+	IOF_TRACE_UP(rpc, parent, "symlink");
+
+	VALIDATE_WRITE(parent->projection, out);
+	if (out->err || out->rc)
+		goto out;
+
+	fd = ionss_fd_get(&base.fdm, parent);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
+
+	errno = 0;
+	rc = symlinkat(in->oldpath, fd, in->common.name.name);
+
+	if (rc)
+		out->rc = errno;
+
+	ionss_fd_put(&base.fdm, parent);
+
+out:
+	lookup_common(rpc, &in->common, out, parent);
+	IOF_TRACE_DEBUG(parent,
+			"newpath '%s' oldpath '%s' result err %d rc %d",
+			in->common.name.name, in->oldpath, out->err, out->rc);
+}
+
+static void
+iof_mkdir_handler(crt_rpc_t *rpc)
+{
+	struct iof_create_in *in = crt_req_get(rpc);
+	struct iof_entry_out *out = crt_reply_get(rpc);
+	struct ionss_file_handle *parent;
+	int fd;
+	int rc;
+
+	VALIDATE_ARGS_GAH_FILE_H(rpc, in->common, out, parent);
+	if (out->err)
+		goto out;
+
+	IOF_TRACE_UP(rpc, parent, "mkdir");
+
+	VALIDATE_WRITE(parent->projection, out);
+	if (out->err || out->rc)
+		goto out;
+
+	fd = ionss_fd_get(&base.fdm, parent);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
+
+	errno = 0;
+	rc = mkdirat(fd, in->common.name.name, in->mode);
+
+	if (rc)
+		out->rc = errno;
+
+	ionss_fd_put(&base.fdm, parent);
+
+	IOF_TRACE_DEBUG(parent, "dir '%s' rc %d",
+			in->common.name.name, out->rc);
+out:
+	lookup_common(rpc, &in->common, out, parent);
+}
+
+/* This function needs additional checks to handle longer links.
+ *
+ */
+
+static void
+iof_readlink_handler(crt_rpc_t *rpc)
+{
+	struct iof_gah_in *in = crt_req_get(rpc);
+	struct iof_string_out *out = crt_reply_get(rpc);
+	struct ionss_file_handle *file = NULL;
+	char reply[IOF_MAX_PATH_LEN] = {0};
+	int fd;
+	int rc;
+
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, file);
+	if (out->err)
+		goto out;
+
+	fd = ionss_fd_get(&base.fdm, file);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
+
+	errno = 0;
+	rc = readlinkat(fd, "", reply, IOF_MAX_PATH_LEN);
+
+	if (rc < 0)
+		out->rc = errno;
+	else
+		out->path = (d_string_t)reply;
+
+	ionss_fd_put(&base.fdm, file);
+
+out:
+	rc = crt_reply_send(rpc);
+	if (rc)
+		IOF_LOG_ERROR("response not sent, ret = %d", rc);
+
+	if (file)
+		ios_fh_decref(file, 1);
+}
+
+static void iof_unlink_handler(crt_rpc_t *rpc)
+{
+	struct iof_unlink_in *in = crt_req_get(rpc);
+	struct iof_status_out *out = crt_reply_get(rpc);
+	struct ionss_file_handle *parent;
+	int fd;
+	int rc;
+
+	VALIDATE_ARGS_GAH_FILE(rpc, in, out, parent);
+	if (out->err)
+		goto out;
+
+	VALIDATE_WRITE(parent->projection, out);
+	if (out->err || out->rc)
+		goto out;
+
+	fd = ionss_fd_get(&base.fdm, parent);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
+
+	errno = 0;
+	rc = unlinkat(fd, in->name.name, in->flags ? AT_REMOVEDIR : 0);
+
+	if (rc)
+		out->rc = errno;
+
+	ionss_fd_put(&base.fdm, parent);
+
+	IOF_TRACE_DEBUG(parent, "%s '%s' rc %d",
+			in->flags ? "dir" : "file", in->name.name, out->rc);
+out:
+	rc = crt_reply_send(rpc);
+	if (rc)
+		IOF_TRACE_ERROR(rpc, "response not sent, ret = %d", rc);
+
+	if (parent)
+		ios_fh_decref(parent, 1);
+}
+
+#define VALIDATE_WRITEX_IN(in, out, max_iov_write_size)			\
+	do {								\
+		uint64_t xtlen = (in)->xtvec.xt_len;			\
+		size_t bulk_len;					\
+		int _rc;						\
+		if ((in)->data.iov_len > max_iov_write_size) {		\
+			out->err = -DER_MISC;				\
+			break;						\
+		}							\
+		if (xtlen != ((in)->bulk_len + (in)->data.iov_len)) {	\
+			out->err = -DER_MISC;				\
+			break;						\
+		}							\
+		if ((in)->bulk_len == 0) /*no bulk */			\
+			break;						\
+		_rc = crt_bulk_get_len((in)->data_bulk, &bulk_len);	\
+		if (_rc != 0) {						\
+			out->err = _rc;					\
+			break;						\
+		}							\
+		if ((in)->bulk_len > bulk_len) {			\
+			out->err = -DER_MISC;				\
+			break;						\
+		}							\
+	} while (0)
+
+_Static_assert(sizeof(struct ionss_io_req_desc) <=
+	       sizeof(struct iof_writex_out),
+	       "struct iof_writex_out needs to be large enough to contain"
+	       " struct ionss_io_req_desc");
+
+static int iof_write_bulk(const struct crt_bulk_cb_info *cb_info);
+static void iof_write_complete(struct ionss_active_write *awd, ssize_t res);
+static void iof_write_next(struct ionss_active_write *awd);
+static void iof_write_start(struct ionss_active_write *awd);
+static void iof_write_finish(struct ionss_active_write *awd);
+static void iof_write_batch_complete(struct ionss_active_write *awd,
+				     ssize_t res);
+
+/* Decide if a queued write can be merged into an active one
+ *
+ * Requests for the same handle are merged if they extend the current extent
+ * at either end and still fit in a single buffer.  The search stops at the
+ * first request for the same handle which cannot be merged so that
+ * overlapping writes are not reordered.
+ */
+static int
+iof_write_match(struct ionss_io_req_desc *wrd, void *arg)
+{
+	struct ionss_active_write *awd = arg;
+	struct iof_writex_in *in;
+
+	if (wrd->handle != awd->handle)
+		return 0;
+
+	in = crt_req_get(wrd->rpc);
+
+	if (in->xtvec.xt_len == 0 || in->xtvec_len > 0 ||
+	    awd->batch_len + in->xtvec.xt_len > awd->projection->max_write_size)
+		return -1;
+
+	if (in->xtvec.xt_off == awd->batch_offset + awd->batch_len)
+		return 1;
+
+	if (in->xtvec.xt_off + in->xtvec.xt_len == awd->batch_offset)
+		return 1;
+
+	return -1;
+}
+
+/* Merge queued writes which are adjacent to a newly dequeued one
+ *
+ * Small writes from the same client are frequently contiguous, for example
+ * appends to a log file, so rather than issue a backend write for each one
+ * the data for all of them is gathered into a single buffer and written
+ * together.  Called with the projection lock held.
+ */
+static void
+iof_write_coalesce(struct ionss_active_write *awd)
+{
+	struct ios_projection *projection = awd->projection;
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+	struct ionss_io_req_desc *wrd;
+	uint64_t queued;
+	d_rank_t rank;
+
+	awd->batch[0] = awd->rpc;
+	awd->batch_count = 1;
+	awd->batch_offset = in->xtvec.xt_off;
+	awd->batch_len = in->xtvec.xt_len;
+
+	/* Vectored writes are never merged */
+	if (awd->batch_len == 0 || in->xtvec_len > 0)
+		return;
+
+	rank = iof_rpc_src_rank(awd->rpc);
+
+	while (awd->batch_count < IONSS_WRITE_BATCH) {
+		wrd = ionss_sched_take(&projection->write_sched, rank,
+				       iof_write_match, awd, &queued);
+		if (!wrd)
+			break;
+
+		in = crt_req_get(wrd->rpc);
+		if (in->xtvec.xt_off < awd->batch_offset) {
+			memmove(&awd->batch[1], &awd->batch[0],
+				sizeof(awd->batch[0]) * awd->batch_count);
+			awd->batch[0] = wrd->rpc;
+			awd->batch_offset = in->xtvec.xt_off;
+		} else {
+			awd->batch[awd->batch_count] = wrd->rpc;
+		}
+		awd->batch_count++;
+		awd->batch_len += in->xtvec.xt_len;
+
+		ionss_stats_record(&base.stats, DEF_RPC_TYPE(writex),
+				   IOF_STATS_QUEUE, queued);
+
+		/* Reset the borrowed output to 0 */
+		memset(wrd, 0, sizeof(*wrd));
+	}
+
+	if (awd->batch_count > 1)
+		IOF_TRACE_DEBUG(awd, "Merged %d writes %#lx-%#lx",
+				awd->batch_count, awd->batch_offset,
+				awd->batch_offset + awd->batch_len - 1);
+}
+
+/* Called as each write completes, see iof_read_check_and_send() */
+void iof_write_check_and_send(struct ios_projection *projection)
+{
+	struct ionss_io_req_desc *wrd;
+	struct ionss_active_write *awd;
+	struct iof_writex_in *in;
+	struct iof_writex_out *out;
+	uint64_t queued;
+	uint32_t limit;
+	bool grow;
+
+	do {
+		D_MUTEX_LOCK(&projection->lock);
+		limit = ionss_aimd_limit(&projection->write_ctl);
+		if (ionss_sched_empty(&projection->write_sched) ||
+		    projection->current_write_count > limit) {
+			projection->current_write_count--;
+			IOF_TRACE_DEBUG(projection,
+					"Dropping write slot (%d/%d)",
+					projection->current_write_count,
+					limit);
+			D_MUTEX_UNLOCK(&projection->lock);
+			return;
+		}
+
+		awd = iof_pool_acquire(projection->aw_pool);
+		if (!awd) {
+			projection->current_write_count--;
+			IOF_TRACE_DEBUG(projection,
+					"No AWD slot available (%d/%d)",
+					projection->current_write_count,
+					limit);
+			D_MUTEX_UNLOCK(&projection->lock);
+			return;
+		}
+
+		wrd = ionss_sched_dequeue(&projection->write_sched, &queued);
+
+		IOF_TRACE_UP(awd, wrd->handle, "awd");
+		IOF_TRACE_DEBUG(awd, "Submiting new write (%d/%d)",
+				projection->current_write_count, limit);
+
+		awd->rpc = wrd->rpc;
+		awd->handle = wrd->handle;
+
+		ionss_stats_record(&base.stats, DEF_RPC_TYPE(writex),
+				   IOF_STATS_QUEUE, queued);
+
+		/* Reset the borrowed output to 0 */
+		memset(wrd, 0, sizeof(*wrd));
+
+		iof_write_coalesce(awd);
+
+		grow = projection->current_write_count < limit &&
+			!ionss_sched_empty(&projection->write_sched);
+		if (grow)
+			projection->current_write_count++;
+
+		D_MUTEX_UNLOCK(&projection->lock);
+
+		in = crt_req_get(awd->rpc);
+		out = crt_reply_get(awd->rpc);
+
+		if (in->xtvec.xt_len == 0)
+			out->err = -DER_NOSYS;
+
+		iof_write_start(awd);
+	} while (grow);
+}
+
+static void
+iof_write_uring_cb(struct ionss_uring_op *op, int res)
+{
+	struct ionss_active_write *awd = container_of(op,
+						      struct ionss_active_write,
+						      uop);
+
+	iof_write_complete(awd, res);
+}
+
+/* Write the current buffer with pwrite() and complete it */
+static void
+iof_write_direct(struct ionss_active_write *awd)
+{
+	ssize_t res;
+
+	if (awd->xtvec_count) {
+		res = iof_xtvec_io(awd->handle, true, awd->xt_bulk.buf,
+				   awd->xtvec_count, awd->write_offset,
+				   (void *)awd->write_buf, awd->write_len);
+		iof_write_complete(awd, res);
+		return;
+	}
+
+	errno = 0;
+	res = pwrite(awd->io_fd, awd->write_buf, awd->write_len,
+		     awd->write_offset);
+	if (res == -1)
+		res = -errno;
+
+	iof_write_complete(awd, res);
+}
+
+static void
+iof_write_lane_cb(struct ionss_lane_op *op)
+{
+	struct ionss_active_write *awd = container_of(op,
+						      struct ionss_active_write,
+						      lop);
+
+	iof_write_direct(awd);
+}
+
+/* Write a single buffer to the file, either by submitting it to the io_uring
+ * or a data lane, or by writing it directly, and then completing it.
+ */
+static void
+iof_write_submit(struct ionss_active_write *awd, const void *buf, size_t len,
+		 off_t offset)
+{
+	struct ionss_file_handle *handle = awd->handle;
+	struct ios_projection *projection = awd->projection;
+	int rc;
+
+	awd->io_fd = iof_io_fd(handle, buf, len, offset);
+
+	IOF_TRACE_DEBUG(awd, "Writing to fd=%d %#zx-%#zx", awd->io_fd,
+			offset, offset + len - 1);
+
+	awd->write_buf = buf;
+	awd->write_len = len;
+	awd->write_offset = offset;
+	awd->io_start = ionss_aimd_now();
+
+	if (projection->uring) {
+		awd->uop.cb = iof_write_uring_cb;
+		rc = ionss_uring_write(projection->uring, &awd->uop,
+				       awd->io_fd, buf, len, offset);
+		if (rc == -DER_SUCCESS)
+			return;
+		IOF_TRACE_DEBUG(awd, "Falling back to pwrite %d", rc);
+	}
+
+	/* Keep blocking writes off the progress threads if possible */
+	awd->lop.fn = iof_write_lane_cb;
+	if (ionss_lane_submit(projection->data_lane, &awd->lop) == 0)
+		return;
+
+	iof_write_direct(awd);
+}
+
+/* Write the part of the request at data_off within its data
+ *
+ * Vectored writes are written run by run on a data lane, as for reads,
+ * with write_offset holding the offset within the data.
+ */
+static void
+iof_write_segment(struct ionss_active_write *awd, const void *buf,
+		  size_t len, uint64_t data_off)
+{
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+
+	if (!awd->xtvec_count) {
+		iof_write_submit(awd, buf, len, in->xtvec.xt_off + data_off);
+		return;
+	}
+
+	IOF_TRACE_DEBUG(awd, "Writing %#zx bytes at %#lx of %u runs", len,
+			data_off, awd->xtvec_count);
+
+	awd->io_fd = awd->handle->fd;
+	awd->write_buf = buf;
+	awd->write_len = len;
+	awd->write_offset = data_off;
+	awd->io_start = ionss_aimd_now();
+
+	awd->lop.fn = iof_write_lane_cb;
+	if (ionss_lane_submit(awd->projection->data_lane, &awd->lop) == 0)
+		return;
+
+	iof_write_direct(awd);
+}
+
+/* Called as each bulk pull or write completes.  Once the last outstanding
+ * operation has completed processing continues with the next step.
+ */
+static void
+iof_write_join(struct ionss_active_write *awd)
+{
+	if (atomic_fetch_sub(&awd->pending, 1) != 1)
+		return;
+
+	iof_write_next(awd);
+}
+
+/* Fetch the next segment of bulk data into the current buffer */
+static void
+iof_write_fetch(struct ionss_active_write *awd)
+{
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+	struct iof_writex_out *out = crt_reply_get(awd->rpc);
+	struct crt_bulk_desc bulk_desc = {0};
+	uint64_t len;
+	int rc;
+
+	len = in->bulk_len - awd->data_offset;
+	/* Only write max_write_size at a time */
+	if (len > awd->projection->max_write_size)
+		len = awd->projection->max_write_size;
+
+	awd->seg_offset[awd->buf] = awd->data_offset;
+	awd->seg_len[awd->buf] = len;
+	awd->have_data = true;
+
+	bulk_desc.bd_rpc = awd->rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_GET;
+	bulk_desc.bd_remote_hdl = in->data_bulk;
+	bulk_desc.bd_remote_off = in->data_bulk_off + awd->data_offset;
+	bulk_desc.bd_local_hdl = awd->local_bulk[awd->buf].handle;
+	bulk_desc.bd_local_off = awd->local_bulk[awd->buf].offset;
+	bulk_desc.bd_len = len;
+
+	awd->data_offset += len;
+
+	IOF_TRACE_DEBUG(awd, "Fetching bulk into %d " GAH_PRINT_STR, awd->buf,
+			GAH_PRINT_VAL(in->gah));
+
+	awd->bulk_start = ionss_aimd_now();
+	rc = crt_bulk_transfer(&bulk_desc, iof_write_bulk, awd, NULL);
+	if (rc) {
+		awd->failed = true;
+		out->err = rc;
+		iof_write_join(awd);
+	}
+}
+
+static int iof_write_batch_bulk(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_active_write *awd = cb_info->bci_arg;
+	struct iof_writex_out *out;
+
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(writex), IOF_STATS_BULK,
+			   awd->bulk_start);
+
+	if (cb_info->bci_rc) {
+		out = crt_reply_get(cb_info->bci_bulk_desc->bd_rpc);
+		out->err = cb_info->bci_rc;
+		awd->failed = true;
+	}
+
+	iof_write_join(awd);
+
+	return 0;
+}
+
+/* Start processing a merged write
+ *
+ * The data for every request is gathered into the first buffer, with bulk
+ * data pulled directly into place and immediate data copied, before being
+ * written with a single call.
+ */
+static void
+iof_write_batch_start(struct ionss_active_write *awd)
+{
+	struct crt_bulk_desc bulk_desc = {0};
+	char *buf = awd->local_bulk[0].buf;
+	struct iof_writex_in *in;
+	struct iof_writex_out *out;
+	uint64_t offset;
+	int rc;
+	int i;
+
+	awd->have_data = true;
+	awd->bulk_start = ionss_aimd_now();
+	atomic_store_release(&awd->pending, 1);
+
+	for (i = 0; i < awd->batch_count; i++) {
+		in = crt_req_get(awd->batch[i]);
+		out = crt_reply_get(awd->batch[i]);
+		offset = in->xtvec.xt_off - awd->batch_offset;
+
+		if (in->data.iov_len > 0)
+			memcpy(buf + offset + in->bulk_len, in->data.iov_buf,
+			       in->data.iov_len);
+
+		if (in->bulk_len == 0)
+			continue;
+
+		bulk_desc.bd_rpc = awd->batch[i];
+		bulk_desc.bd_bulk_op = CRT_BULK_GET;
+		bulk_desc.bd_remote_hdl = in->data_bulk;
+		bulk_desc.bd_remote_off = in->data_bulk_off;
+		bulk_desc.bd_local_hdl = awd->local_bulk[0].handle;
+		bulk_desc.bd_local_off = awd->local_bulk[0].offset + offset;
+		bulk_desc.bd_len = in->bulk_len;
+
+		atomic_fetch_add(&awd->pending, 1);
+		rc = crt_bulk_transfer(&bulk_desc, iof_write_batch_bulk, awd,
+				       NULL);
+		if (rc) {
+			atomic_fetch_sub(&awd->pending, 1);
+			out->err = rc;
+			awd->failed = true;
+		}
+	}
+
+	iof_write_join(awd);
+}
+
+/* Write the gathered data for a merged write
+ *
+ * If any bulk pull failed then only the data before the first failed
+ * request is written, as the merged extent must be contiguous.
+ */
+static void
+iof_write_batch_next(struct ionss_active_write *awd)
+{
+	struct iof_writex_in *in;
+	struct iof_writex_out *out;
+	uint64_t len = awd->batch_len;
+	int i;
+
+	if (!awd->have_data) {
+		iof_write_finish(awd);
+		return;
+	}
+	awd->have_data = false;
+
+	for (i = 0; i < awd->batch_count; i++) {
+		in = crt_req_get(awd->batch[i]);
+		out = crt_reply_get(awd->batch[i]);
+		if (out->err) {
+			len = in->xtvec.xt_off - awd->batch_offset;
+			break;
+		}
+	}
+
+	atomic_store_release(&awd->pending, 1);
+
+	if (len == 0) {
+		iof_write_batch_complete(awd, 0);
+		return;
+	}
+
+	iof_write_submit(awd, awd->local_bulk[0].buf, len, awd->batch_offset);
+}
+
+/* Allocate the buffers for a write descriptor on first use, as for reads */
+static bool
+aw_alloc_buffers(struct ionss_active_write *awd)
+{
+	int i;
+
+	for (i = 0; i < IONSS_WRITE_BUFFERS; i++) {
+		if (awd->local_bulk[i].buf)
+			continue;
+		IOF_BULK_ALLOC_ARENA(awd->projection->aw_arena,
+				     awd->projection->base->crt_ctx,
+				     awd,
+				     local_bulk[i],
+				     awd->projection->max_write_size,
+				     false);
+		if (!awd->local_bulk[i].buf)
+			return false;
+	}
+	return true;
+}
+
+/* Completion callback for the pull of the extent list of a vectored write */
+static int
+iof_write_xtvec_cb(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_active_write *awd = cb_info->bci_arg;
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+	struct iof_writex_out *out = crt_reply_get(awd->rpc);
+	int rc = cb_info->bci_rc;
+
+	if (rc == -DER_SUCCESS)
+		rc = iof_xtvec_prepare(awd->xt_bulk.buf, in->xtvec_len,
+				       in->xtvec.xt_len);
+	if (rc < 0) {
+		IOF_TRACE_WARNING(awd, "Invalid extent list %d", rc);
+		out->err = rc;
+		iof_write_finish(awd);
+		return 0;
+	}
+
+	IOF_TRACE_DEBUG(awd, "Writing %lu extents in %d runs", in->xtvec_len,
+			rc);
+
+	awd->xtvec_count = rc;
+	iof_write_start(awd);
+
+	return 0;
+}
+
+/* Start processing a write request
+ *
+ * Fetches the first segment of bulk data or, if there is none, writes the
+ * immediate data.  For a vectored write the extent list is pulled from the
+ * client first, and the write is started again once it has arrived.
+ */
+static void
+iof_write_start(struct ionss_active_write *awd)
+{
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+	struct iof_writex_out *out = crt_reply_get(awd->rpc);
+	int rc;
+	int i;
+
+	if (!aw_alloc_buffers(awd)) {
+		for (i = 0; i < awd->batch_count; i++) {
+			out = crt_reply_get(awd->batch[i]);
+			out->err = -DER_NOMEM;
+		}
+		awd->failed = true;
+		iof_write_finish(awd);
+		return;
+	}
+
+	if (awd->batch_count > 1) {
+		iof_write_batch_start(awd);
+		return;
+	}
+
+	if (!out->err && in->xtvec_len > 0 && awd->xtvec_count == 0) {
+		if (!awd->xt_bulk.buf)
+			IOF_BULK_ALLOC(awd->projection->base->crt_ctx, awd,
+				       xt_bulk,
+				       IOF_XTVEC_MAX * sizeof(struct iof_xtvec),
+				       false);
+		if (!awd->xt_bulk.buf) {
+			out->err = -DER_NOMEM;
+			iof_write_finish(awd);
+			return;
+		}
+
+		rc = iof_xtvec_fetch(awd->rpc, in->xtvec_bulk, in->xtvec_len,
+				     &awd->xt_bulk, iof_write_xtvec_cb, awd);
+		if (rc != -DER_SUCCESS) {
+			out->err = rc;
+			iof_write_finish(awd);
+		}
+		return;
+	}
+
+	awd->buf = 0;
+	atomic_store_release(&awd->pending, 1);
+
+	if (out->err || in->bulk_len == 0) {
+		iof_write_join(awd);
+		return;
+	}
+
+	iof_write_fetch(awd);
+}
+
+/* Reply to all merged write requests and release the descriptor */
+static void
+iof_write_finish(struct ionss_active_write *awd)
+{
+	struct ios_projection *projection = awd->projection;
+	int rc;
+	int i;
+
+	for (i = 0; i < awd->batch_count; i++) {
+		rc = crt_reply_send(awd->batch[i]);
+
+		if (rc)
+			IOF_TRACE_ERROR(awd, "response not sent, ret = %d", rc);
+
+		crt_req_decref(awd->batch[i]);
+	}
+
+	ios_fh_decref(awd->handle, awd->batch_count);
+
+	iof_pool_release(projection->aw_pool, awd);
+
+	iof_write_check_and_send(projection);
+}
+
+/* Process the next step of a write request
+ *
+ * Called once all outstanding bulk pulls and writes have completed.  If a
+ * segment has been fetched then it's written to the file, and whilst that is
+ * happening the following segment is pulled into the other buffer so that
+ * the network and the backend filesystem are kept busy at the same time.
+ * Writes are always submitted in order, with the immediate data last.
+ */
+static void
+iof_write_next(struct ionss_active_write *awd)
+{
+	struct iof_writex_in *in = crt_req_get(awd->rpc);
+	struct iof_writex_out *out = crt_reply_get(awd->rpc);
+	int buf;
+
+	if (awd->batch_count > 1) {
+		iof_write_batch_next(awd);
+		return;
+	}
+
+	if (out->err || out->rc) {
+		iof_write_finish(awd);
+		return;
+	}
+
+	if (awd->have_data) {
+		buf = awd->buf;
+		awd->have_data = false;
+
+		if (awd->data_offset < in->bulk_len) {
+			atomic_store_release(&awd->pending, 2);
+			awd->buf = (awd->buf + 1) % IONSS_WRITE_BUFFERS;
+			iof_write_fetch(awd);
+		} else {
+			atomic_store_release(&awd->pending, 1);
+		}
+
+		iof_write_segment(awd, awd->local_bulk[buf].buf,
+				  awd->seg_len[buf], awd->seg_offset[buf]);
+		return;
+	}
+
+	if (in->data.iov_len > 0 && !awd->imm_done) {
+		awd->imm_done = true;
+		atomic_store_release(&awd->pending, 1);
+		iof_write_segment(awd, in->data.iov_buf, in->data.iov_len,
+				  in->bulk_len);
+		return;
+	}
+
+	iof_write_finish(awd);
+}
+
+static int iof_write_bulk(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_active_write *awd = cb_info->bci_arg;
+	struct iof_writex_out *out = crt_reply_get(awd->rpc);
+
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(writex), IOF_STATS_BULK,
+			   awd->bulk_start);
+
+	if (cb_info->bci_rc)
+		out->err = cb_info->bci_rc;
+
+	iof_write_join(awd);
+
+	return 0;
+}
+
+/* Complete a merged write
+ *
+ * Each request is credited with the part of its extent which was written, or
+ * is failed if the write failed or was cut short by an earlier bulk failure.
+ */
+static void
+iof_write_batch_complete(struct ionss_active_write *awd, ssize_t res)
+{
+	struct ionss_file_handle *handle = awd->handle;
+	struct iof_writex_in *in;
+	struct iof_writex_out *out;
+	uint64_t offset;
+	int i;
 
-	if (rc)
-		IOF_TRACE_ERROR(awd, "response not sent, ret = %d", rc);
+	if (res > 0)
+		ionss_cache_invalidate(awd->projection->cache,
+				       handle->mf.inode_no, awd->batch_offset,
+				       res);
 
-	crt_req_decref(awd->rpc);
+	for (i = 0; i < awd->batch_count; i++) {
+		in = crt_req_get(awd->batch[i]);
+		out = crt_reply_get(awd->batch[i]);
+		offset = in->xtvec.xt_off - awd->batch_offset;
 
-	iof_pool_release(projection->aw_pool, awd);
+		if (out->err)
+			continue;
 
-	ios_fh_decref(handle, 1);
+		if (res < 0) {
+			out->rc = -res;
+		} else if (offset >= res) {
+			if (awd->failed)
+				out->rc = EIO;
+		} else {
+			out->len = res - offset;
+			if (out->len > in->xtvec.xt_len)
+				out->len = in->xtvec.xt_len;
+		}
+	}
 
-	iof_write_check_and_send(projection);
+	iof_write_join(awd);
 }
 
-static int iof_write_bulk(const struct crt_bulk_cb_info *cb_info)
+/* Complete a write of a single buffer
+ *
+ * Called with the result of writing either a bulk segment or the immediate
+ * data.
+ */
+static void
+iof_write_complete(struct ionss_active_write *awd, ssize_t res)
 {
-	struct ionss_active_write *awd = cb_info->bci_arg;
 	struct ionss_file_handle *handle = awd->handle;
-	struct ios_projection *projection = handle->projection;
 	struct iof_writex_out *out = crt_reply_get(awd->rpc);
-	struct iof_writex_in *in = crt_req_get(awd->rpc);
-	ssize_t bytes_written;
-	off_t offset;
-	int rc;
 
-	if (cb_info->bci_rc)
-		D_GOTO(out, out->err = cb_info->bci_rc);
+	ionss_aimd_sample(&awd->projection->write_ctl, awd->io_start, res);
+	ionss_stats_record(&base.stats, DEF_RPC_TYPE(writex),
+			   IOF_STATS_BACKEND, awd->io_start);
+	if (res > 0)
+		atomic_add(&awd->projection->write_bytes, res);
 
-	offset = in->xtvec.xt_off + awd->segment_offset;
-	IOF_TRACE_DEBUG(awd, "Writing to fd=%d %#zx-%#zx", handle->fd,
-			offset, offset + awd->req_len - 1);
-	errno = 0;
-	bytes_written = pwrite(handle->fd, awd->local_bulk.buf,
-			       awd->req_len, offset);
-	if (bytes_written == -1) {
-		D_GOTO(out, out->rc = errno);
-	} else {
-		out->len += bytes_written;
-		if (out->len < in->xtvec.xt_len) {
-			awd->segment_offset += awd->req_len;
-			awd->data_offset += awd->req_len;
-			iof_process_write(awd);
-			return 0;
-		}
+	if (awd->batch_count > 1) {
+		iof_write_batch_complete(awd, res);
+		return;
 	}
 
-out:
-	rc = crt_reply_send(awd->rpc);
-
-	if (rc)
-		IOF_TRACE_ERROR(awd, "response not sent, ret = %d", rc);
-
-	crt_req_decref(awd->rpc);
-
-	iof_pool_release(projection->aw_pool, awd);
-
-	ios_fh_decref(handle, 1);
-
-	iof_write_check_and_send(projection);
+	if (res < 0) {
+		out->rc = -res;
+	} else {
+		/* Vectored writes invalidate the cache for each run */
+		if (!awd->xtvec_count)
+			ionss_cache_invalidate(awd->projection->cache,
+					       handle->mf.inode_no,
+					       awd->write_offset, res);
+		out->len += res;
+	}
 
-	return 0;
+	iof_write_join(awd);
 }
 
 static void
@@ -1908,7 +3700,7 @@ iof_writex_handler(crt_rpc_t *rpc)
 	struct iof_writex_in *in = crt_req_get(rpc);
 	struct iof_writex_out *out = crt_reply_get(rpc);
 	struct ionss_io_req_desc *wrd;
-	struct ionss_active_write *awd;
+	struct ionss_active_write *awd = NULL;
 	struct ionss_file_handle *handle;
 	struct ios_projection *projection;
 	int rc;
@@ -1927,11 +3719,11 @@ iof_writex_handler(crt_rpc_t *rpc)
 	if (out->err)
 		D_GOTO(out, 0);
 
-	/* TODO: Only immediate xtvec supported for now */
-	if (in->xtvec_len > 0) {
+	out->err = iof_xtvec_check(in->xtvec_len, in->xtvec_bulk);
+	if (out->err) {
 		IOF_TRACE_WARNING(projection,
-				  "xtvec not yet supported for write");
-		out->err = -DER_NOSYS;
+				  "Invalid extent list for write %lu",
+				  in->xtvec_len);
 		goto out;
 	}
 
@@ -1942,17 +3734,21 @@ iof_writex_handler(crt_rpc_t *rpc)
 	/* Try and acquire a active write descriptor, if one is available then
 	 * start the write, else add it to the list
 	 */
-	awd = iof_pool_acquire(projection->aw_pool);
+	if (projection->current_write_count <
+	    ionss_aimd_limit(&projection->write_ctl))
+		awd = iof_pool_acquire(projection->aw_pool);
 	if (awd) {
 		projection->current_write_count++;
 		IOF_TRACE_UP(awd, handle, "awd");
 		IOF_TRACE_DEBUG(awd, "Injecting new write (%d/%d)",
 				projection->current_write_count,
-				projection->max_write_count);
+				ionss_aimd_limit(&projection->write_ctl));
 		D_MUTEX_UNLOCK(&projection->lock);
 		awd->rpc = rpc;
 		awd->handle = handle;
-		iof_process_write(awd);
+		awd->batch[0] = rpc;
+		awd->batch_count = 1;
+		iof_write_start(awd);
 	} else {
 		/* Piggyback the output descriptor space to store the write
 		 * descriptor whilst in the write queue
@@ -1961,8 +3757,14 @@ iof_writex_handler(crt_rpc_t *rpc)
 
 		wrd->rpc = rpc;
 		wrd->handle = handle;
-		d_list_add_tail(&wrd->list, &projection->write_list);
+		rc = ionss_sched_enqueue(&projection->write_sched, wrd,
+					 iof_rpc_src_rank(rpc));
 		D_MUTEX_UNLOCK(&projection->lock);
+		if (rc != -DER_SUCCESS) {
+			memset(wrd, 0, sizeof(*wrd));
+			crt_req_decref(rpc);
+			D_GOTO(out, out->err = rc);
+		}
 	}
 	/* Do not call crt_reply_send() in this case as it'll be done in
 	 * the bulk handler.
@@ -1984,7 +3786,10 @@ static void iof_setattr_handler(crt_rpc_t *rpc)
 	struct iof_setattr_in *in = crt_req_get(rpc);
 	struct iof_attr_out *out = crt_reply_get(rpc);
 	struct ionss_file_handle *handle;
+	/* Descriptor of the handle itself, pinned for inode handles */
+	int hfd = -1;
 	int fd = -1;
+	bool cached = true;
 	int rc;
 
 	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
@@ -1996,20 +3801,20 @@ static void iof_setattr_handler(crt_rpc_t *rpc)
 		goto out;
 
 	if (handle->mf.type == inode_handle) {
-		int e;
-
-		errno = 0;
-		fd = open(handle->proc_fd_name, O_RDONLY);
-		e = errno;
-
-		if (fd == -1) {
-			IOF_TRACE_INFO(handle, "Failed to re-open %d", e);
-			if (e != EACCES && (in->to_set & FUSE_SET_ATTR_MODE))
+		hfd = ionss_fd_get(&base.fdm, handle);
+		if (hfd < 0)
+			D_GOTO(out, out->rc = -hfd);
+
+		fd = ionss_fd_get_attr(&base.fdm, handle, &cached);
+		if (fd < 0) {
+			IOF_TRACE_INFO(handle, "Failed to re-open %d", -fd);
+			if (fd != -EACCES && (in->to_set & FUSE_SET_ATTR_MODE))
 				D_GOTO(out, out->err = -DER_MISC);
+			fd = -1;
 		}
-		IOF_TRACE_DEBUG(handle, "Re-opened %d as %d", handle->fd, fd);
+		IOF_TRACE_DEBUG(handle, "Re-opened %d as %d", hfd, fd);
 	} else {
-		fd = handle->fd;
+		hfd = fd = handle->fd;
 	}
 
 	/* Now set any attributes as requested by FUSE.  Try each bit that this
@@ -2078,10 +3883,33 @@ static void iof_setattr_handler(crt_rpc_t *rpc)
 	if (in->to_set & FUSE_SET_ATTR_SIZE) {
 		IOF_TRACE_DEBUG(handle, "setting size to %#lx",
 				in->stat.st_size);
-		errno = 0;
-		rc = ftruncate(fd, in->stat.st_size);
-		if (rc)
-			D_GOTO(out, out->rc = errno);
+		/* The cached descriptor is read-only, so open a writable one
+		 * for just this request.
+		 */
+		if (handle->mf.type == inode_handle) {
+			int wfd;
+
+			wfd = ionss_fd_open(handle,
+					    O_WRONLY | O_NOCTTY | O_NONBLOCK);
+			if (wfd < 0)
+				D_GOTO(out, out->rc = -wfd);
+
+			errno = 0;
+			rc = ftruncate(wfd, in->stat.st_size);
+			if (rc)
+				out->rc = errno;
+			close(wfd);
+		} else {
+			errno = 0;
+			rc = ftruncate(fd, in->stat.st_size);
+			if (rc)
+				out->rc = errno;
+		}
+		if (out->rc)
+			goto out;
+
+		ionss_cache_invalidate_inode(handle->projection->cache,
+					     handle->mf.inode_no);
 
 		in->to_set &= ~(FUSE_SET_ATTR_SIZE);
 	}
@@ -2131,7 +3959,7 @@ static void iof_setattr_handler(crt_rpc_t *rpc)
 	}
 
 	errno = 0;
-	rc = fstat(handle->fd, &out->stat);
+	rc = fstat(hfd, &out->stat);
 	if (rc)
 		out->rc = errno;
 
@@ -2144,8 +3972,12 @@ out:
 		IOF_TRACE_ERROR(handle, "response not sent, ret = %d", rc);
 
 	if (handle) {
-		if (handle->mf.type == inode_handle && fd != -1)
-			close(fd);
+		if (handle->mf.type == inode_handle) {
+			if (fd != -1 && !cached)
+				close(fd);
+			if (hfd >= 0)
+				ionss_fd_put(&base.fdm, handle);
+		}
 
 		ios_fh_decref(handle, 1);
 	}
@@ -2157,19 +3989,26 @@ static void iof_statfs_handler(crt_rpc_t *rpc)
 	struct iof_data_out *out = crt_reply_get(rpc);
 	struct ionss_file_handle *handle;
 	struct statvfs buf;
+	int fd;
 	int rc;
 
 	VALIDATE_ARGS_GAH_FILE(rpc, in, out, handle);
 	if (out->err)
 		goto out;
 
-	errno = 0;
-	rc = fstatvfs(handle->fd, &buf);
+	fd = ionss_fd_get(&base.fdm, handle);
+	if (fd < 0)
+		D_GOTO(out, out->rc = -fd);
 
-	if (rc) {
+	errno = 0;
+	rc = fstatvfs(fd, &buf);
+	if (rc)
 		out->rc = errno;
+
+	ionss_fd_put(&base.fdm, handle);
+
+	if (rc)
 		goto out;
-	}
 
 	/* Fuse ignores these three values on the client so zero them
 	 * out here first
@@ -2188,7 +4027,20 @@ out:
 		ios_fh_decref(handle, 1);
 }
 
-#define X(a, b, c) iof_##a##_handler,
+/* Count every RPC before passing it to its handler */
+#define X(a, b, c)							\
+	static void							\
+	iof_##a##_counted_handler(crt_rpc_t *rpc)			\
+	{								\
+		ionss_stats_count(&base.stats, DEF_RPC_TYPE(a));	\
+		iof_##a##_handler(rpc);					\
+	}
+
+IOF_RPCS_LIST
+
+#undef X
+
+#define X(a, b, c) iof_##a##_counted_handler,
 
 static crt_rpc_cb_t write_handlers[] = {
 	IOF_RPCS_LIST
@@ -2196,6 +4048,147 @@ static crt_rpc_cb_t write_handlers[] = {
 
 #undef X
 
+/* RPCs which are run on the metadata lane.  Reads and writes are not
+ * included as they only queue work for the data lane, nor are fsync,
+ * fdatasync, copy_range and fallocate which may block for long periods
+ * during heavy writes or on large ranges.
+ */
+#define IONSS_META_RPCS	\
+	X(opendir)		\
+	X(readdir)		\
+	X(closedir)		\
+	X(getattr)		\
+	X(rename)		\
+	X(unlink)		\
+	X(open)			\
+	X(create)		\
+	X(close)		\
+	X(mkdir)		\
+	X(readlink)		\
+	X(symlink)		\
+	X(statfs)		\
+	X(lookup)		\
+	X(setattr)		\
+	X(imigrate)
+
+/* RPCs which are run on the data lane of the projection they target, as
+ * they move data within the backend and may take a long time on large
+ * ranges.  The input of each starts with the GAH of the file.
+ */
+#define IONSS_DATA_RPCS	\
+	X(copy_range)		\
+	X(fallocate)
+
+struct ionss_lane_req {
+	struct ionss_lane_op	op;
+	crt_rpc_t		*rpc;
+	crt_rpc_cb_t		handler;
+	int			opc;
+};
+
+/* Run a handler, recording the time spent in it as backend time as lane
+ * handlers make their filesystem calls directly.
+ */
+static void
+iof_lane_call(crt_rpc_t *rpc, crt_rpc_cb_t handler, int opc)
+{
+	uint64_t start = ionss_aimd_now();
+
+	handler(rpc);
+	ionss_stats_record(&base.stats, opc, IOF_STATS_BACKEND, start);
+}
+
+static void
+iof_lane_run(struct ionss_lane_op *op)
+{
+	struct ionss_lane_req *req = container_of(op, struct ionss_lane_req,
+						  op);
+
+	ionss_stats_record(&base.stats, req->opc, IOF_STATS_QUEUE,
+			   req->op.queued);
+	iof_lane_call(req->rpc, req->handler, req->opc);
+	crt_req_decref(req->rpc);
+	D_FREE(req);
+}
+
+/* Pass a RPC to a lane, or run it directly if there is none */
+static void
+iof_lane_dispatch(struct ionss_lane *lane, crt_rpc_t *rpc,
+		  crt_rpc_cb_t handler, int opc)
+{
+	struct ionss_lane_req *req;
+
+	ionss_stats_count(&base.stats, opc);
+
+	if (!lane)
+		goto inline_handler;
+
+	D_ALLOC_PTR(req);
+	if (!req)
+		goto inline_handler;
+
+	req->op.fn = iof_lane_run;
+	req->rpc = rpc;
+	req->handler = handler;
+	req->opc = opc;
+	crt_req_addref(rpc);
+
+	if (ionss_lane_submit(lane, &req->op) == 0)
+		return;
+
+	crt_req_decref(rpc);
+	D_FREE(req);
+
+inline_handler:
+	iof_lane_call(rpc, handler, opc);
+}
+
+/* Pass a RPC to the data lane of the projection owning the GAH at the start
+ * of its input.  If the GAH is not valid then the handler runs inline, and
+ * will reply with the error.
+ */
+static void
+iof_data_dispatch(crt_rpc_t *rpc, crt_rpc_cb_t handler, int opc)
+{
+	struct ios_gah *gah = crt_req_get(rpc);
+	struct ionss_file_handle *handle;
+	struct ionss_lane *lane = NULL;
+
+	handle = ios_fh_find(&base, gah);
+	if (handle) {
+		lane = handle->projection->data_lane;
+		ios_fh_decref(handle, 1);
+	}
+
+	iof_lane_dispatch(lane, rpc, handler, opc);
+}
+
+#define X(a)								\
+	static void							\
+	iof_##a##_meta_handler(crt_rpc_t *rpc)				\
+	{								\
+		iof_lane_dispatch(base.meta_lane, rpc,			\
+				  iof_##a##_handler, DEF_RPC_TYPE(a));	\
+	}
+
+IONSS_META_RPCS
+
+#undef X
+
+#define X(a)								\
+	_Static_assert(offsetof(struct iof_##a##_in, gah) == 0,	\
+		       "struct iof_" #a "_in must start with the GAH");	\
+	static void							\
+	iof_##a##_data_handler(crt_rpc_t *rpc)				\
+	{								\
+		iof_data_dispatch(rpc, iof_##a##_handler,		\
+				  DEF_RPC_TYPE(a));			\
+	}
+
+IONSS_DATA_RPCS
+
+#undef X
+
 /*
  * Process filesystem query from CNSS
  * This function currently uses dummy data to send back to CNSS
@@ -2207,6 +4200,7 @@ iof_query_handler(crt_rpc_t *query_rpc)
 	int ret;
 
 	query->poll_interval = base.cnss_poll_interval;
+	query->tag_count = base.ctx_count;
 	query->progress_callback = base.progress_callback;
 	query->count = base.projection_count;
 	d_iov_set(&query->query_list, base.fs_list,
@@ -2219,9 +4213,88 @@ iof_query_handler(crt_rpc_t *query_rpc)
 	atomic_fetch_add(&cnss_count, 1);
 }
 
+struct ionss_stats_req {
+	crt_rpc_t		*rpc;
+	struct iof_local_bulk	local_bulk;
+};
+
+static int
+iof_stats_bulk_cb(const struct crt_bulk_cb_info *cb_info)
+{
+	struct ionss_stats_req *req = cb_info->bci_arg;
+	struct iof_stats_out *out = crt_reply_get(req->rpc);
+	int rc;
+
+	if (cb_info->bci_rc) {
+		out->len = 0;
+		out->err = cb_info->bci_rc;
+	}
+
+	rc = crt_reply_send(req->rpc);
+	if (rc)
+		IOF_LOG_ERROR("stats rpc response not sent, ret = %d", rc);
+
+	crt_req_decref(req->rpc);
+	IOF_BULK_FREE(req, local_bulk);
+	D_FREE(req);
+	return 0;
+}
+
+/* Send the current statistics to a client, see struct iof_ionss_stats */
+static void
+iof_stats_handler(crt_rpc_t *rpc)
+{
+	struct iof_stats_in *in = crt_req_get(rpc);
+	struct iof_stats_out *out = crt_reply_get(rpc);
+	struct crt_bulk_desc bulk_desc = {0};
+	struct ionss_stats_req *req;
+	int rc;
+
+	if (!in->bulk || in->len < sizeof(struct iof_ionss_stats))
+		D_GOTO(out, out->err = -DER_INVAL);
+
+	D_ALLOC_PTR(req);
+	if (!req)
+		D_GOTO(out, out->err = -DER_NOMEM);
+
+	req->rpc = rpc;
+	if (!IOF_BULK_ALLOC(base.crt_ctx, req, local_bulk, IOF_STATS_SIZE,
+			    true)) {
+		D_FREE(req);
+		D_GOTO(out, out->err = -DER_NOMEM);
+	}
+
+	out->len = ionss_stats_read(&base, req->local_bulk.buf,
+				    in->len < IOF_STATS_SIZE ?
+				    in->len : IOF_STATS_SIZE);
+
+	bulk_desc.bd_rpc = rpc;
+	bulk_desc.bd_bulk_op = CRT_BULK_PUT;
+	bulk_desc.bd_remote_hdl = in->bulk;
+	bulk_desc.bd_local_hdl = req->local_bulk.handle;
+	bulk_desc.bd_len = out->len;
+
+	crt_req_addref(rpc);
+	rc = crt_bulk_transfer(&bulk_desc, iof_stats_bulk_cb, req, NULL);
+	if (rc == -DER_SUCCESS)
+		return;
+
+	crt_req_decref(rpc);
+	IOF_BULK_FREE(req, local_bulk);
+	D_FREE(req);
+	out->len = 0;
+	out->err = rc;
+
+out:
+	rc = crt_reply_send(rpc);
+	if (rc)
+		IOF_LOG_ERROR("stats rpc response not sent, ret = %d", rc);
+}
+
 static crt_rpc_cb_t signon_handlers[] = {
 	iof_query_handler,
 	cnss_detach_handler,
+	iof_stats_handler,
 };
 
 int ionss_register(void)
@@ -2237,6 +4310,14 @@ int ionss_register(void)
 		return ret;
 	}
 
+#define X(a) write_handlers[DEF_RPC_TYPE(a)] = iof_##a##_meta_handler;
+	IONSS_META_RPCS
+#undef X
+
+#define X(a) write_handlers[DEF_RPC_TYPE(a)] = iof_##a##_data_handler;
+	IONSS_DATA_RPCS
+#undef X
+
 	ret = iof_register(NULL, write_handlers);
 	if (ret) {
 		IOF_LOG_ERROR("RPC server handler registration failed,"
@@ -2260,22 +4341,275 @@ static int check_shutdown(void *arg)
 	return *valuep;
 }
 
+/* Timeout in microseconds for crt_progress() whilst io_uring requests are in
+ * flight.  Completions do not wake crt_progress() so this bounds the latency
+ * they see, without the progress threads spinning for the duration of every
+ * backend request.
+ */
+#define IONSS_URING_POLL_INTERVAL 50
+
+/* Reap any completed io_uring requests for all projections.
+ *
+ * Returns the timeout to use for the next call to crt_progress(), which is
+ * short if there are requests in flight so that they are reaped promptly.
+ */
+static uint32_t uring_progress(struct ios_base *b)
+{
+	uint32_t poll_interval;
+	bool busy = false;
+	int i;
+
+	for (i = 0; i < b->projection_count; i++) {
+		struct ios_projection *projection = &b->projection_array[i];
+
+		if (!projection->uring)
+			continue;
+
+		ionss_uring_reap(projection->uring);
+		if (ionss_uring_busy(projection->uring))
+			busy = true;
+	}
+
+	poll_interval = atomic_load_consume(&b->poll_interval);
+	if (busy && poll_interval > IONSS_URING_POLL_INTERVAL)
+		return IONSS_URING_POLL_INTERVAL;
+	return poll_interval;
+}
+
+static bool uring_busy(struct ios_base *b)
+{
+	int i;
+
+	for (i = 0; i < b->projection_count; i++) {
+		if (ionss_uring_busy(b->projection_array[i].uring))
+			return true;
+	}
+	return false;
+}
+
+/* Reap io_uring requests which were in flight at shutdown.  The completions
+ * may start further bulk transfers or backend requests, so keep progressing
+ * the context until all rings are idle, after which the rings can be torn
+ * down safely.
+ */
+static void uring_drain(struct ios_base *b, crt_context_t crt_ctx)
+{
+	int rc;
+
+	while (uring_busy(b)) {
+		rc = crt_progress(crt_ctx, IONSS_URING_POLL_INTERVAL,
+				  NULL, NULL);
+		if (rc != 0 && rc != -DER_TIMEDOUT) {
+			IOF_LOG_ERROR("crt_progress failed at exit rc: %d",
+				      rc);
+			break;
+		}
+		uring_progress(b);
+	}
+}
+
+static void reload_handler(int signum)
+{
+	reload_pending = 1;
+}
+
+/* Log options which have changed in the configuration file but only take
+ * effect on restart.
+ */
+#define RELOAD_RESTART(old, new, name, entity)				\
+	do {								\
+		if ((old)->name != (new)->name)				\
+			IOF_TRACE_WARNING(entity, "Option %s changed, "	\
+					  "restart required", #name);	\
+	} while (0)
+
+/* Limit a reloaded read or write count to the capacity the projection was
+ * started with, lowering the minimum to match if required.
+ */
+static void
+reload_clamp_count(struct ios_projection *projection, const char *type,
+		   uint32_t *max_count, uint32_t *min_count, uint32_t cap)
+{
+	if (*max_count > cap) {
+		IOF_TRACE_WARNING(projection, "max_%s_count %u above startup "
+				  "value %u, restart required", type,
+				  *max_count, cap);
+		*max_count = cap;
+	}
+	if (*min_count > *max_count)
+		*min_count = *max_count;
+}
+
+/* Re-read the configuration file and apply any tunables which can be
+ * changed whilst running.  This is triggered by SIGHUP and called from a
+ * progress thread so does not race with startup or shutdown.
+ *
+ * The concurrency limits for reads and writes and the direct I/O threshold
+ * are applied per projection, and the poll interval globally.  The sizes of
+ * buffers are negotiated with the CNSS at attach so cannot be changed, and
+ * the concurrency limits cannot be raised above their startup values as the
+ * io_uring and bulk arenas are sized from them.
+ */
+static void reload_config(struct ios_base *b)
+{
+	struct ios_base new = {0};
+	int i;
+	int j;
+
+	IOF_TRACE_INFO(b, "Reloading configuration from %s", b->config_file);
+
+	if (parse_config(b->config_file, &new)) {
+		IOF_TRACE_ERROR(b, "Invalid configuration, not reloaded");
+		D_GOTO(out, 0);
+	}
+
+	for (i = 0; i < new.projection_count; i++) {
+		struct ios_projection *proj = &new.projection_array[i];
+
+		if (proj->max_read_count == 0 || proj->max_write_count == 0) {
+			IOF_TRACE_ERROR(b, "Invalid read or write count for %s,"
+					" not reloaded", proj->full_path);
+			D_GOTO(out, 0);
+		}
+	}
+
+	RELOAD_RESTART(b, &new, thread_count, b);
+	RELOAD_RESTART(b, &new, stat_thread_count, b);
+	RELOAD_RESTART(b, &new, meta_thread_count, b);
+	RELOAD_RESTART(b, &new, max_open_files, b);
+	RELOAD_RESTART(b, &new, cnss_poll_interval, b);
+
+	if (new.poll_interval != b->poll_interval) {
+		IOF_TRACE_INFO(b, "poll_interval %u -> %u",
+			       atomic_load_consume(&b->poll_interval),
+			       new.poll_interval);
+		atomic_store_release(&b->poll_interval, new.poll_interval);
+	}
+
+	for (i = 0; i < b->projection_count; i++) {
+		struct ios_projection *projection = &b->projection_array[i];
+		struct ios_projection *proj = NULL;
+
+		for (j = 0; j < new.projection_count; j++) {
+			if (strcmp(new.projection_array[j].full_path,
+				   projection->full_path) == 0) {
+				proj = &new.projection_array[j];
+				break;
+			}
+		}
+
+		if (!proj) {
+			IOF_TRACE_WARNING(projection, "Projection %s removed, "
+					  "restart required",
+					  projection->full_path);
+			continue;
+		}
+
+		if (!projection->active)
+			continue;
+
+		RELOAD_RESTART(projection, proj, max_read_size, projection);
+		RELOAD_RESTART(projection, proj, max_write_size, projection);
+		RELOAD_RESTART(projection, proj, max_iov_read_size, projection);
+		RELOAD_RESTART(projection, proj, max_iov_write_size,
+			       projection);
+		RELOAD_RESTART(projection, proj, readdir_size, projection);
+		RELOAD_RESTART(projection, proj, cache_size, projection);
+		RELOAD_RESTART(projection, proj, data_thread_count, projection);
+
+		reload_clamp_count(projection, "read", &proj->max_read_count,
+				   &proj->min_read_count,
+				   projection->read_count_cap);
+		reload_clamp_count(projection, "write", &proj->max_write_count,
+				   &proj->min_write_count,
+				   projection->write_count_cap);
+
+		if (proj->min_read_count != projection->min_read_count ||
+		    proj->max_read_count != projection->max_read_count) {
+			projection->min_read_count = proj->min_read_count;
+			projection->max_read_count = proj->max_read_count;
+			iof_pool_set_max_desc(projection->ar_pool,
+					      projection->max_read_count);
+			ionss_aimd_set_range(&projection->read_ctl,
+					     projection->min_read_count,
+					     projection->max_read_count);
+		}
+
+		if (proj->min_write_count != projection->min_write_count ||
+		    proj->max_write_count != projection->max_write_count) {
+			projection->min_write_count = proj->min_write_count;
+			projection->max_write_count = proj->max_write_count;
+			iof_pool_set_max_desc(projection->aw_pool,
+					      projection->max_write_count);
+			ionss_aimd_set_range(&projection->write_ctl,
+					     projection->min_write_count,
+					     projection->max_write_count);
+		}
+
+		if (proj->direct_io_size != projection->direct_io_size) {
+			IOF_TRACE_INFO(projection, "direct_io_size %u -> %u",
+				       atomic_load_consume(
+					       &projection->direct_io_size),
+				       proj->direct_io_size);
+			atomic_store_release(&projection->direct_io_size,
+					     proj->direct_io_size);
+		}
+	}
+
+	if (new.projection_count > b->projection_count)
+		IOF_TRACE_WARNING(b, "Projections added, restart required");
+
+out:
+	free_config(&new);
+}
+
+/* Check for, and apply, a pending configuration reload */
+static void reload_check(struct ios_base *b)
+{
+	if (!reload_pending)
+		return;
+
+	reload_pending = 0;
+	reload_config(b);
+}
+
+/* Progress thread state, each thread progresses its own CaRT context */
+struct ios_progress_thread {
+	struct ios_base	*base;
+	crt_context_t	crt_ctx;
+	pthread_t	tid;
+	int		index;
+};
+
 static void *progress_thread(void *arg)
 {
+	struct ios_progress_thread *t = arg;
+	struct ios_base		*b = t->base;
+	uint32_t		timeout;
 	int			rc;
-	struct ios_base *b = (struct ios_base *)arg;
+
+	if (b->numa_spread || b->numa_bind)
+		ionss_numa_bind_thread(b->numa, b->numa_spread, t->index);
+
+	timeout = atomic_load_consume(&b->poll_interval);
 
 	/* progress loop */
 	do {
-		rc = crt_progress(b->crt_ctx, b->poll_interval,
+		rc = crt_progress(t->crt_ctx, timeout,
 				  b->callback_fn, &shutdown);
 		if (rc != 0 && rc != -DER_TIMEDOUT) {
 			IOF_LOG_ERROR("crt_progress failed rc: %d", rc);
 			break;
 		}
 
+		timeout = uring_progress(b);
+
+		if (t->index == 0)
+			reload_check(b);
 	} while (!shutdown);
 
+	uring_drain(b, t->crt_ctx);
+
 	/* progress until a timeout to flush the queue.  We still need some
 	 * support from CaRT for this (See CART-333).   The problem is corpc
 	 * aggregation happens after the user callback is executed so we may
@@ -2283,7 +4617,7 @@ static void *progress_thread(void *arg)
 	 * the sender.
 	 */
 	for (;;) {
-		rc = crt_progress(b->crt_ctx, 1000, NULL, NULL);
+		rc = crt_progress(t->crt_ctx, 1000, NULL, NULL);
 		if (rc == -DER_TIMEDOUT)
 			break;
 		if (rc != 0) {
@@ -2424,6 +4758,12 @@ static void show_help(const char *prog)
 	"#################     IOF Configuration File     ################\n"
 	"#################################################################\n"
 	"\n"
+	"# The file is re-read on SIGHUP.  poll_interval and the read and\n"
+	"# write counts take effect immediately, although the counts cannot be\n"
+	"# raised above their values at startup.  direct_io_size applies to\n"
+	"# files opened after the change, except that \"0\" also stops direct\n"
+	"# I/O on files already open.  Other changes require a restart\n"
+	"\n"
 	"# Minimally, this file must contain a list of projections\n"
 	"# consisting of paths to the directories to be projected\n"
 	"projections:\n"
@@ -2463,9 +4803,46 @@ static void show_help(const char *prog)
 	"# Number of threads to be used on the IONSS\n"
 	"thread_count:           2\n"
 	"\n"
+	"# Number of threads used to stat directory entries during readdir,\n"
+	"# \"0\" stats entries on the progress thread\n"
+	"stat_thread_count:      4\n"
+	"\n"
+	"# Number of threads used to handle metadata requests, so that they are\n"
+	"# not delayed behind data transfers.  \"0\" handles them on the\n"
+	"# progress threads\n"
+	"meta_thread_count:      4\n"
+	"\n"
+	"# Number of threads used to set up projections in parallel at startup,\n"
+	"# \"0\" or \"1\" sets them up one at a time\n"
+	"setup_thread_count:     8\n"
+	"\n"
+	"# Maximum number of descriptors to keep open for inodes looked up by\n"
+	"# clients, where the filesystem allows them to be reopened on demand.\n"
+	"# \"0\" uses half of the open file limit\n"
+	"max_open_files:         0\n"
+	"\n"
+	"# Relative share of bandwidth given to each client rank when reads or\n"
+	"# writes are queued, clients not listed have a weight of 1.  Not set\n"
+	"# by default, e.g.\n"
+	"# client_weights:\n"
+	"#   0:                  4\n"
+	"#   1:                  2\n"
+	"\n"
 	"# Enable/disable use of CART progress callback function on IONSS and CNSS\n"
 	"progress_callback:      true\n"
 	"\n"
+	"# Bind progress threads, and place bulk buffers, on the NUMA node the\n"
+	"# network interface is attached to.  Other threads are not bound\n"
+	"numa_bind:              false\n"
+	"\n"
+	"# Spread progress threads over all NUMA nodes, with at least one\n"
+	"# context per node.  Bulk buffers remain local to the interface\n"
+	"numa_spread:            false\n"
+	"\n"
+	"# Network interface or device used to find the local NUMA node.  Not\n"
+	"# set by default, in which case OFI_INTERFACE or OFI_DOMAIN is used\n"
+	"# numa_interface:       ib0\n"
+	"\n"
 	"# The following options can be specified either per projection or\n"
 	"# globally. If both are specified, the value specified for that\n"
 	"# projection takes precedence\n"
@@ -2493,6 +4870,10 @@ static void show_help(const char *prog)
 	"# true: 'ioc_ll_write_buf'; false: 'ioc_ll_write'\n"
 	"fuse_write_buf:         true\n"
 	"\n"
+	"# Use io_uring to submit file reads and writes asynchronously from\n"
+	"# the IONSS, falling back to pread/pwrite if it is not available\n"
+	"io_uring:               false\n"
+	"\n"
 	"# Controls whether a client fails over to a new primary service\n"
 	"# rank (PSR) in case the current PSR gets evicted. Valid values\n"
 	"# are \"auto\" and \"disable\". If \"auto\" is specified, fail-over\n"
@@ -2506,6 +4887,21 @@ static void show_help(const char *prog)
 	"# available permissions\n"
 	"writeable:              auto\n"
 	"\n"
+	"# Size of the shared block cache used to serve reads on the IONSS.\n"
+	"# Data is cached in blocks of max_read_size, \"0\" disables the cache.\n"
+	"# Values larger than 4G are allowed, e.g. \"16g\".  Changes to files\n"
+	"# made outside of the IONSS may not be seen for up to one second\n"
+	"cache_size:             0\n"
+	"\n"
+	"# Number of threads used for file reads and writes which are not\n"
+	"# submitted to the io_uring, \"0\" uses the progress threads\n"
+	"data_thread_count:      2\n"
+	"\n"
+	"# Minimum size of reads and writes which bypass the page cache on\n"
+	"# the IONSS by using O_DIRECT.  Only transfers aligned to 4K use\n"
+	"# direct I/O, others use the page cache as normal, \"0\" disables\n"
+	"direct_io_size:         0\n"
+	"\n"
 	"# Size of the buffer to be used for a readdir operation\n"
 	"readdir_size:           64K\n"
 	"\n"
@@ -2515,6 +4911,15 @@ static void show_help(const char *prog)
 	"# Maximum number of concurrent write operations on the IONSS\n"
 	"max_write_count:              3\n"
 	"\n"
+	"# Minimum number of concurrent read operations on the IONSS.  The\n"
+	"# limit starts at max_read_count and is adjusted between this and\n"
+	"# max_read_count according to the observed latency and throughput,\n"
+	"# set equal to max to disable\n"
+	"min_read_count:               1\n"
+	"\n"
+	"# Minimum number of concurrent write operations on the IONSS\n"
+	"min_write_count:              1\n"
+	"\n"
 	"# Size of the buffer to be used for a bulk read operation\n"
 	"max_read_size:               1M\n"
 	"\n"
@@ -2552,12 +4957,47 @@ fh_reset(void *arg)
 
 	fh->ht_ref = 0;
 	fh->ref = 0;
+	fh->direct_fd = -1;
+	fh->attr_fd = -1;
+	fh->fhandle = NULL;
+	fh->fd_users = 0;
+	D_INIT_LIST_HEAD(&fh->fd_lru);
 	atomic_fetch_add(&fh->ref, 1);
 	memset(&fh->proc_fd_name, 0, 64);
 
 	return true;
 }
 
+static void
+dh_init(void *arg, void *handle)
+{
+	struct ionss_dir_handle *dirh = arg;
+
+	dirh->projection = handle;
+}
+
+static bool
+dh_reset(void *arg)
+{
+	struct ionss_dir_handle *dirh = arg;
+
+	dirh->ref = 0;
+	dirh->dents_len = 0;
+	dirh->dents_pos = 0;
+	dirh->offset = 0;
+	atomic_fetch_add(&dirh->ref, 1);
+
+	return true;
+}
+
+static void
+dh_release(void *arg)
+{
+	struct ionss_dir_handle *dirh = arg;
+
+	D_FREE(dirh->dents);
+}
+
 static void
 ar_init(void *arg, void *handle)
 {
@@ -2570,24 +5010,18 @@ static bool
 ar_reset(void *arg)
 {
 	struct ionss_active_read *ard = arg;
+	int i;
 
 	ard->data_offset = 0;
 	ard->segment_offset = 0;
+	ard->xtvec_count = 0;
 
+	/* Buffers are allocated on first use by ar_alloc_buffers() */
 	if (ard->failed) {
-		IOF_BULK_FREE(ard, local_bulk);
-		ard->failed = false;
-	}
-
-	if (!ard->local_bulk.buf) {
-		IOF_BULK_ALLOC(ard->projection->base->crt_ctx,
-			       ard,
-			       local_bulk,
-			       ard->projection->max_read_size,
-			       true);
-		if (!ard->local_bulk.buf)
-			return false;
+		for (i = 0; i < IONSS_READ_BUFFERS; i++)
+			IOF_BULK_FREE(ard, local_bulk[i]);
 	}
+	ard->failed = false;
 
 	return true;
 }
@@ -2596,8 +5030,11 @@ static void
 ar_release(void *arg)
 {
 	struct ionss_active_read *ard = arg;
+	int i;
 
-	IOF_BULK_FREE(ard, local_bulk);
+	for (i = 0; i < IONSS_READ_BUFFERS; i++)
+		IOF_BULK_FREE(ard, local_bulk[i]);
+	IOF_BULK_FREE(ard, xt_bulk);
 }
 
 static void
@@ -2612,22 +5049,56 @@ static bool
 aw_reset(void *arg)
 {
 	struct ionss_active_write *awd = arg;
+	int i;
 
 	awd->data_offset = 0;
-	awd->segment_offset = 0;
+	awd->have_data = false;
+	awd->imm_done = false;
+	awd->batch_count = 0;
+	awd->xtvec_count = 0;
 
+	/* Buffers are allocated on first use by aw_alloc_buffers() */
 	if (awd->failed) {
-		IOF_BULK_FREE(awd, local_bulk);
-		awd->failed = false;
+		for (i = 0; i < IONSS_WRITE_BUFFERS; i++)
+			IOF_BULK_FREE(awd, local_bulk[i]);
 	}
+	awd->failed = false;
+
+	return true;
+}
+
+static void
+aw_release(void *arg)
+{
+	struct ionss_active_write *awd = arg;
+	int i;
+
+	for (i = 0; i < IONSS_WRITE_BUFFERS; i++)
+		IOF_BULK_FREE(awd, local_bulk[i]);
+	IOF_BULK_FREE(awd, xt_bulk);
+}
+
+static void
+rd_init(void *arg, void *handle)
+{
+	struct ionss_active_readdir *ard = arg;
 
-	if (!awd->local_bulk.buf) {
-		IOF_BULK_ALLOC(awd->projection->base->crt_ctx,
-			       awd,
-			       local_bulk,
-			       awd->projection->max_write_size,
-			       false);
-		if (!awd->local_bulk.buf)
+	ard->projection = handle;
+}
+
+static bool
+rd_reset(void *arg)
+{
+	struct ionss_active_readdir *ard = arg;
+
+	if (ard->failed)
+		IOF_BULK_FREE(ard, local_bulk);
+	ard->failed = false;
+
+	if (!ard->local_bulk.buf) {
+		IOF_BULK_ALLOC(ard->projection->base->crt_ctx, ard, local_bulk,
+			       ard->projection->readdir_size, true);
+		if (!ard->local_bulk.buf)
 			return false;
 	}
 
@@ -2635,11 +5106,312 @@ aw_reset(void *arg)
 }
 
 static void
-aw_release(void *arg)
+rd_release(void *arg)
 {
-	struct ionss_active_write *awd = arg;
+	struct ionss_active_readdir *ard = arg;
+
+	IOF_BULK_FREE(ard, local_bulk);
+	D_FREE(ard->replies);
+}
+
+/* Open the export directory of a projection and create its root handle.
+ *
+ * Returns an error if the export cannot be opened, which is fatal, other
+ * failures leave the projection inactive.
+ */
+static int
+projection_open(struct ios_projection *projection)
+{
+	struct stat buf = {0};
+	struct iof_pool_reg fhp = {.init = fh_init,
+				   .reset = fh_reset,
+				   POOL_TYPE_INIT(ionss_file_handle,
+						  clist)};
+	struct iof_pool_reg dhp = {.init = dh_init,
+				   .reset = dh_reset,
+				   .release = dh_release,
+				   POOL_TYPE_INIT(ionss_dir_handle,
+						  list)};
+	int fd;
+	int rc;
+
+	IOF_TRACE_UP(projection, &base, "projection");
+
+	rc = iof_pool_init(&projection->pool, projection);
+	if (rc != -DER_SUCCESS)
+		return rc;
+
+	fd = open(projection->full_path,
+		  O_DIRECTORY | O_PATH | O_NOATIME | O_RDONLY);
+	if (fd == -1) {
+		IOF_LOG_ERROR("Could not open export directory %s",
+			      projection->full_path);
+		return -DER_MISC;
+	}
+
+	projection->active = 0;
+	projection->base = &base;
+	rc = d_hash_table_create_inplace(D_HASH_FT_RWLOCK |
+					 D_HASH_FT_EPHEMERAL,
+					 projection->inode_htable_size,
+					 NULL, &hops,
+					 &projection->file_ht);
+	if (rc != 0) {
+		IOF_LOG_ERROR("Could not create hash table");
+		return -DER_SUCCESS;
+	}
+
+	rc = D_MUTEX_INIT(&projection->lock, NULL);
+	if (rc != -DER_SUCCESS)
+		return -DER_SUCCESS;
+
+	ionss_sched_init(&projection->read_sched,
+			 projection->max_read_size,
+			 base.client_weights, iof_read_cost);
+	ionss_sched_init(&projection->write_sched,
+			 projection->max_write_size,
+			 base.client_weights, iof_write_cost);
+
+	rc = ionss_aimd_init(&projection->read_ctl, "read",
+			     projection->min_read_count,
+			     projection->max_read_count);
+	if (rc != -DER_SUCCESS)
+		return -DER_SUCCESS;
+
+	rc = ionss_aimd_init(&projection->write_ctl, "write",
+			     projection->min_write_count,
+			     projection->max_write_count);
+	if (rc != -DER_SUCCESS)
+		return -DER_SUCCESS;
+
+	errno = 0;
+	rc = fstat(fd, &buf);
+	if (rc) {
+		IOF_LOG_ERROR("Could not stat export path %s %d",
+			      projection->full_path, errno);
+		return -DER_MISC;
+	}
+
+	projection->dev_no = buf.st_dev;
+
+	/* Perform this test only if the user has not
+	 * explicitly disabled write for this projection
+	 *
+	 * TODO: Similar test for fail-over
+	 */
+	if (projection->writeable)
+		projection->writeable = (faccessat(fd, ".",
+						   W_OK, 0) == 0);
+	projection->fh_pool = iof_pool_register(&projection->pool,
+						&fhp);
+	if (!projection->fh_pool)
+		return -DER_SUCCESS;
+
+	projection->dh_pool = iof_pool_register(&projection->pool,
+						&dhp);
+	if (!projection->dh_pool)
+		return -DER_SUCCESS;
+
+	rc = ios_fh_alloc(projection, &projection->root);
+	if (rc != 0)
+		return -DER_SUCCESS;
+
+	projection->root->fd = fd;
+	projection->root->mf.inode_no = buf.st_ino;
+	snprintf(projection->root->proc_fd_name, 64,
+		 "/proc/self/fd/%d",
+		 projection->root->fd);
+	atomic_fetch_add(&projection->root->ht_ref, 1);
+
+	rc = d_hash_rec_insert(&projection->file_ht,
+			       &projection->root->mf,
+			       sizeof(projection->root->mf),
+			       &projection->root->clist, 0);
+	if (rc != 0) {
+		IOF_LOG_ERROR("Could not insert into hash table");
+		return -DER_SUCCESS;
+	}
+
+	ionss_fdm_projection_init(projection);
+
+	IOF_LOG_INFO("Projecting %s", projection->full_path);
+	IOF_LOG_INFO("Access: Read-%s; Failover: %s",
+		     projection->writeable ? "Write" : "Only",
+		     projection->failover ? "Enabled" : "Disabled");
+	projection->active = true;
+	projection->id = projection - base.projection_array;
+
+	return -DER_SUCCESS;
+}
+
+/* Create the pools, caches and worker threads for an active projection */
+static int
+projection_start(struct ios_projection *projection)
+{
+	struct iof_pool_reg arp = {.init = ar_init,
+				   .reset = ar_reset,
+				   .release = ar_release,
+				   .max_desc = projection->max_read_count,
+				   POOL_TYPE_INIT(ionss_active_read,
+						  list)};
+	struct iof_pool_reg awp = {.init = aw_init,
+				   .reset = aw_reset,
+				   .release = aw_release,
+				   .max_desc = projection->max_write_count,
+				   POOL_TYPE_INIT(ionss_active_write,
+						  list)};
+	struct iof_pool_reg rdp = {.init = rd_init,
+				   .reset = rd_reset,
+				   .release = rd_release,
+				   POOL_TYPE_INIT(ionss_active_readdir,
+						  list)};
+	int rc;
+
+	if (!projection->active)
+		return -DER_SUCCESS;
+
+	projection->read_count_cap = projection->max_read_count;
+	projection->write_count_cap = projection->max_write_count;
+
+	/* Register the pools first, if any fail then the projection is
+	 * disabled before any threads or buffers are created for it, as
+	 * inactive projections are skipped at shutdown.
+	 */
+	projection->ar_pool = iof_pool_register(&projection->pool, &arp);
+	if (!projection->ar_pool)
+		goto disable;
+	projection->aw_pool = iof_pool_register(&projection->pool, &awp);
+	if (!projection->aw_pool)
+		goto disable;
+	projection->rd_pool = iof_pool_register(&projection->pool, &rdp);
+	if (!projection->rd_pool)
+		goto disable;
+
+	/* Failure to create an arena is not fatal, buffers are then
+	 * registered individually as they are allocated.
+	 */
+	rc = iof_bulk_arena_create(base.crt_ctx,
+				   projection->max_read_size,
+				   projection->max_read_count *
+				   IONSS_READ_BUFFERS,
+				   true, &projection->ar_arena);
+	if (rc != -DER_SUCCESS)
+		IOF_TRACE_WARNING(projection,
+				  "Could not create read arena %d", rc);
+	rc = iof_bulk_arena_create(base.crt_ctx,
+				   projection->max_write_size,
+				   projection->max_write_count *
+				   IONSS_WRITE_BUFFERS,
+				   false, &projection->aw_arena);
+	if (rc != -DER_SUCCESS)
+		IOF_TRACE_WARNING(projection,
+				  "Could not create write arena %d", rc);
+
+	rc = ionss_cache_init(projection);
+	if (rc != -DER_SUCCESS)
+		IOF_TRACE_WARNING(projection,
+				  "Could not create block cache %d", rc);
+
+	if (projection->io_uring) {
+		rc = ionss_uring_init(&projection->uring,
+				      projection->max_read_count +
+				      projection->max_write_count);
+		if (rc != -DER_SUCCESS)
+			IOF_TRACE_WARNING(projection,
+					  "io_uring not available, "
+					  "using synchronous I/O");
+	}
+
+	rc = ionss_lane_init(&projection->data_lane, "data",
+			     projection->data_thread_count);
+	if (rc != -DER_SUCCESS)
+		IOF_TRACE_WARNING(projection,
+				  "Could not start data lane %d, "
+				  "using progress threads", rc);
+
+	return -DER_SUCCESS;
+
+disable:
+	IOF_TRACE_ERROR(projection, "Could not register pools, disabling");
+	projection->active = false;
+	return -DER_SUCCESS;
+}
+
+/* State for running a setup function over all projections in parallel */
+struct ios_setup {
+	int			(*fn)(struct ios_projection *);
+	ATOMIC uint32_t		next;
+	ATOMIC int		rc;
+};
+
+static void *
+setup_thread(void *arg)
+{
+	struct ios_setup *setup = arg;
+	uint32_t i;
+	int rc;
+
+	while ((i = atomic_fetch_add(&setup->next, 1)) <
+	       base.projection_count) {
+		rc = setup->fn(&base.projection_array[i]);
+		if (rc != -DER_SUCCESS)
+			atomic_store_release(&setup->rc, rc);
+	}
+
+	return NULL;
+}
+
+/* Call fn for every projection, using up to setup_thread_count threads
+ * including the calling one, so that slow filesystems and memory
+ * registration for one projection do not delay the others.
+ *
+ * Returns -DER_SUCCESS or the error from one of the failed calls.
+ */
+static int
+setup_projections(int (*fn)(struct ios_projection *))
+{
+	struct ios_setup setup = {.fn = fn};
+	pthread_t *threads = NULL;
+	uint32_t count = base.setup_thread_count;
+	uint32_t started = 0;
+	uint32_t i;
+	int rc;
+
+	if (count > base.projection_count)
+		count = base.projection_count;
+
+	if (count > 1)
+		D_ALLOC_ARRAY(threads, count - 1);
+
+	if (threads) {
+		for (started = 0; started < count - 1; started++) {
+			rc = pthread_create(&threads[started], NULL,
+					    setup_thread, &setup);
+			if (rc != 0) {
+				IOF_LOG_WARNING("Only started %u setup threads",
+						started);
+				break;
+			}
+		}
+	}
+
+	setup_thread(&setup);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	D_FREE(threads);
+
+	return atomic_load_consume(&setup.rc);
+}
+
+/* Log the time taken by a startup phase, and start timing the next one */
+static void
+startup_phase(const char *name, uint64_t *start)
+{
+	uint64_t now = ionss_aimd_now();
 
-	IOF_BULK_FREE(awd, local_bulk);
+	IOF_LOG_INFO("Startup: %s took %lu us", name, (now - *start) / 1000);
+	*start = now;
 }
 
 int main(int argc, char **argv)
@@ -2648,16 +5420,19 @@ int main(int argc, char **argv)
 	int i;
 	int ret;
 	int exit_rc = -DER_SUCCESS;
-	int err;
 	int c;
 	struct rlimit rlim = {0};
+	struct sigaction sa = {0};
+	uint64_t startup_start;
+	uint64_t phase_start;
 
 	char *version = iof_get_version();
 
 	iof_log_init("ION", "IONSS", NULL);
 	IOF_LOG_INFO("IONSS version: %s", version);
 
-	D_RWLOCK_INIT(&base.gah_rwlock, NULL);
+	startup_start = ionss_aimd_now();
+	phase_start = startup_start;
 
 	while (1) {
 		static struct option long_options[] = {
@@ -2701,6 +5476,13 @@ int main(int argc, char **argv)
 		iof_log_close();
 		exit(1);
 	}
+	base.config_file = config_file;
+
+	/* Re-read the configuration file on SIGHUP */
+	sa.sa_handler = reload_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGHUP, &sa, NULL);
 
 	IOF_TRACE_ROOT(&base, "ionss");
 
@@ -2725,6 +5507,17 @@ int main(int argc, char **argv)
 			D_GOTO(cleanup, exit_rc = -DER_MISC);
 	}
 
+	if (base.max_open_files == 0) {
+		if (rlim.rlim_cur / 2 > UINT32_MAX)
+			base.max_open_files = UINT32_MAX;
+		else
+			base.max_open_files = rlim.rlim_cur / 2;
+	}
+
+	ret = ionss_fdm_init(&base.fdm, base.max_open_files);
+	if (ret)
+		D_GOTO(cleanup, exit_rc = ret);
+
 	D_ALLOC_ARRAY(base.fs_list, base.projection_count);
 	if (!base.fs_list) {
 		D_GOTO(cleanup, exit_rc = -DER_NOMEM);
@@ -2732,6 +5525,25 @@ int main(int argc, char **argv)
 
 	IOF_LOG_INFO("Projecting %d exports", base.projection_count);
 
+	startup_phase("configuration", &phase_start);
+
+	/* Only progress threads are bound, as they start, so that CaRT
+	 * internal threads and lane workers keep the cpuset of the process.
+	 * Bulk buffers are placed from here on.
+	 */
+	if (base.numa_bind || base.numa_spread) {
+		ret = ionss_numa_init(&base.numa, base.numa_interface);
+		if (ret != -DER_SUCCESS)
+			IOF_LOG_WARNING("NUMA topology not available %d", ret);
+	}
+	if (base.numa_bind && base.numa)
+		iof_bulk_set_placement(ionss_numa_place, base.numa);
+	if (base.numa_spread &&
+	    base.thread_count < ionss_numa_node_count(base.numa))
+		base.thread_count = ionss_numa_node_count(base.numa);
+
+	startup_phase("topology", &phase_start);
+
 	/*initialize CaRT*/
 	ret = crt_init(base.group_name, CRT_FLAG_BIT_SERVER);
 	if (ret) {
@@ -2750,6 +5562,8 @@ int main(int argc, char **argv)
 
 	base.gs = ios_gah_init(base.my_rank);
 
+	startup_phase("CaRT initialisation", &phase_start);
+
 	/*
 	 * Populate the projection_array with every projection.
 	 *
@@ -2758,111 +5572,14 @@ int main(int argc, char **argv)
 	 * symbolic links.
 	 * The maximum path length of exports is checked.
 	 *
-	 * TODO: The error handling here needs an overhaul, and this code
-	 * probably wants to be in a helper function.
+	 * Projections are set up in parallel.
+	 *
+	 * TODO: The error handling here needs an overhaul.
 	 */
-	err = 0;
-
-	for (i = 0; i < base.projection_count; i++) {
-		struct ios_projection *projection = &base.projection_array[i];
-		struct stat buf = {0};
-		struct iof_pool_reg fhp = {.init = fh_init,
-					   .reset = fh_reset,
-					   POOL_TYPE_INIT(ionss_file_handle,
-							  clist)};
-		int fd;
-		int rc;
-
-		IOF_TRACE_UP(projection, &base, "projection");
-
-		ret = iof_pool_init(&projection->pool, projection);
-		if (ret != -DER_SUCCESS) {
-			D_GOTO(shutdown, exit_rc = ret);
-		}
-
-		fd = open(projection->full_path,
-			  O_DIRECTORY | O_PATH | O_NOATIME | O_RDONLY);
-		if (fd == -1) {
-			IOF_LOG_ERROR("Could not open export directory %s",
-				      projection->full_path);
-			err = 1;
-
-			continue;
-		}
-
-		projection->active = 0;
-		projection->base = &base;
-		rc = d_hash_table_create_inplace(D_HASH_FT_RWLOCK |
-						 D_HASH_FT_EPHEMERAL,
-						 projection->inode_htable_size,
-						 NULL, &hops,
-						 &projection->file_ht);
-		if (rc != 0) {
-			IOF_LOG_ERROR("Could not create hash table");
-			continue;
-		}
-
-		rc = D_MUTEX_INIT(&projection->lock, NULL);
-		if (rc != -DER_SUCCESS)
-			continue;
-
-		D_INIT_LIST_HEAD(&projection->read_list);
-		D_INIT_LIST_HEAD(&projection->write_list);
-
-		errno = 0;
-		rc = fstat(fd, &buf);
-		if (rc) {
-			IOF_LOG_ERROR("Could not stat export path %s %d",
-				      projection->full_path, errno);
-			err = 1;
-			continue;
-		}
-
-		projection->dev_no = buf.st_dev;
-
-		/* Perform this test only if the user has not
-		 * explicitly disabled write for this projection
-		 *
-		 * TODO: Similar test for fail-over
-		 */
-		if (projection->writeable)
-			projection->writeable = (faccessat(fd, ".",
-							   W_OK, 0) == 0);
-		projection->fh_pool = iof_pool_register(&projection->pool,
-							&fhp);
-		if (!projection->fh_pool)
-			continue;
-
-		rc = ios_fh_alloc(projection, &projection->root);
-		if (rc != 0)
-			continue;
-
-		projection->root->fd = fd;
-		projection->root->mf.inode_no = buf.st_ino;
-		snprintf(projection->root->proc_fd_name, 64,
-			 "/proc/self/fd/%d",
-			 projection->root->fd);
-		atomic_fetch_add(&projection->root->ht_ref, 1);
-
-		rc = d_hash_rec_insert(&projection->file_ht,
-				       &projection->root->mf,
-				       sizeof(projection->root->mf),
-				       &projection->root->clist, 0);
-		if (rc != 0) {
-			IOF_LOG_ERROR("Could not insert into hash table");
-			continue;
-		}
-
-		IOF_LOG_INFO("Projecting %s", projection->full_path);
-		IOF_LOG_INFO("Access: Read-%s; Failover: %s",
-			     projection->writeable ? "Write" : "Only",
-			     projection->failover ? "Enabled" : "Disabled");
-		projection->active = true;
-		projection->id = i;
-	}
-	if (err) {
-		D_GOTO(cleanup, exit_rc = -DER_MISC);
-	}
+	ret = setup_projections(projection_open);
+	startup_phase("opening projections", &phase_start);
+	if (ret != -DER_SUCCESS)
+		D_GOTO(cleanup, exit_rc = ret);
 
 	ret = filesystem_lookup();
 	if (ret) {
@@ -2871,39 +5588,36 @@ int main(int argc, char **argv)
 		goto shutdown;
 	}
 
-	ret = crt_context_create(&base.crt_ctx);
-	if (ret) {
-		IOF_LOG_ERROR("Could not create context");
-		D_GOTO(shutdown, exit_rc = ret);
-	}
+	startup_phase("filesystem lookup", &phase_start);
 
-	for (i = 0; i < base.projection_count; i++) {
-		struct ios_projection *projection = &base.projection_array[i];
+	/* Create one context per progress thread, clients are told how many
+	 * there are in the query RPC and spread their requests over them by
+	 * endpoint tag.  Bulk buffers are registered against the first
+	 * context, but as all contexts share the same transport they can be
+	 * used for transfers from any of them.
+	 */
+	D_ALLOC_ARRAY(base.crt_ctx_array,
+		      base.thread_count ? base.thread_count : 1);
+	if (!base.crt_ctx_array)
+		D_GOTO(shutdown, exit_rc = -DER_NOMEM);
 
-		struct iof_pool_reg arp = {.init = ar_init,
-					   .reset = ar_reset,
-					   .release = ar_release,
-					   .max_desc = projection->max_read_count,
-					   POOL_TYPE_INIT(ionss_active_read,
-							  list)};
-		struct iof_pool_reg awp = {.init = aw_init,
-					   .reset = aw_reset,
-					   .release = aw_release,
-					   .max_desc = projection->max_write_count,
-					   POOL_TYPE_INIT(ionss_active_write,
-							  list)};
+	do {
+		ret = crt_context_create(&base.crt_ctx_array[base.ctx_count]);
+		if (ret) {
+			IOF_LOG_ERROR("Could not create context %d",
+				      base.ctx_count);
+			D_GOTO(shutdown, exit_rc = ret);
+		}
+		base.ctx_count++;
+	} while (base.ctx_count < base.thread_count);
 
-		if (!projection->active)
-			continue;
-		projection->ar_pool = iof_pool_register(&projection->pool,
-							&arp);
-		if (!projection->ar_pool)
-			projection->active = 0;
-		projection->aw_pool = iof_pool_register(&projection->pool,
-							&awp);
-		if (!projection->aw_pool)
-			projection->active = 0;
-	}
+	base.crt_ctx = base.crt_ctx_array[0];
+	IOF_LOG_INFO("Created %d contexts", base.ctx_count);
+
+	startup_phase("contexts", &phase_start);
+
+	setup_projections(projection_start);
+	startup_phase("projection resources", &phase_start);
 
 	/* Create a fs_list from the projection array */
 	for (i = 0; i < base.projection_count ; i++) {
@@ -2929,7 +5643,8 @@ int main(int argc, char **argv)
 		base.fs_list[i].timeout = projection->cnss_timeout;
 		base.fs_list[i].cnss_thread_count = projection->cnss_thread_count;
 
-		base.fs_list[i].flags = IOF_FS_DEFAULT;
+		base.fs_list[i].flags = IOF_FS_DEFAULT | IOF_READDIR_COMPACT |
+			IOF_IMIGRATE_MULTI;
 		if (projection->failover)
 			base.fs_list[i].flags |= IOF_FAILOVER;
 		if (projection->writeable)
@@ -2957,52 +5672,95 @@ int main(int argc, char **argv)
 					base.fs_list[i].dir_name.name);
 	}
 
+	ret = ionss_lane_init(&base.stat_lane, "stat",
+			      base.stat_thread_count);
+	if (ret)
+		D_GOTO(shutdown, exit_rc = ret);
+
+	ret = ionss_lane_init(&base.meta_lane, "metadata",
+			      base.meta_thread_count);
+	if (ret)
+		D_GOTO(shutdown, exit_rc = ret);
+
+	/* Data transfers give way to metadata for backend time */
+	for (i = 0; i < base.projection_count; i++)
+		ionss_lane_set_priority(base.projection_array[i].data_lane,
+					base.meta_lane);
+
 	ret = ionss_register();
 	if (ret)
 		D_GOTO(shutdown, exit_rc = ret);
 
+	startup_phase("services", &phase_start);
+	IOF_LOG_INFO("Startup complete in %lu ms",
+		     (phase_start - startup_start) / (1000 * 1000));
+
 	shutdown = 0;
 
 	if (base.thread_count == 1) {
+		uint32_t timeout = atomic_load_consume(&base.poll_interval);
 		int rc;
+
+		/* The main thread is the only progress thread */
+		if (base.numa_spread || base.numa_bind)
+			ionss_numa_bind_thread(base.numa, base.numa_spread, 0);
+
 		/* progress loop */
 		do {
-			rc = crt_progress(base.crt_ctx, base.poll_interval,
+			rc = crt_progress(base.crt_ctx, timeout,
 					  base.callback_fn, &shutdown);
 			if (rc != 0 && rc != -DER_TIMEDOUT) {
 				IOF_LOG_ERROR("crt_progress failed rc: %d", rc);
 				break;
 			}
+
+			timeout = uring_progress(&base);
+
+			reload_check(&base);
 		} while (!shutdown);
 
+		uring_drain(&base, base.crt_ctx);
+
 	} else {
-		pthread_t *progress_tids;
+		struct ios_progress_thread *threads;
 		int thread;
 
-		D_ALLOC_ARRAY(progress_tids, base.thread_count);
-		if (!progress_tids) {
+		D_ALLOC_ARRAY(threads, base.thread_count);
+		if (!threads) {
 			D_GOTO(shutdown, exit_rc = -DER_NOMEM);
 		}
 		for (thread = 0; thread < base.thread_count; thread++) {
 			IOF_LOG_INFO("Starting thread %d", thread);
-			ret = pthread_create(&progress_tids[thread], NULL,
-					     progress_thread, &base);
+			threads[thread].base = &base;
+			threads[thread].crt_ctx = base.crt_ctx_array[thread];
+			threads[thread].index = thread;
+			ret = pthread_create(&threads[thread].tid, NULL,
+					     progress_thread, &threads[thread]);
 		}
 
 		for (thread = 0; thread < base.thread_count; thread++) {
-			ret = pthread_join(progress_tids[thread], NULL);
+			ret = pthread_join(threads[thread].tid, NULL);
 
 			if (ret)
 				IOF_LOG_ERROR("Could not join progress "
 					      "thread %d", thread);
 		}
-		D_FREE(progress_tids);
+		D_FREE(threads);
 	}
 
 	IOF_LOG_INFO("Shutting down, threads terminated");
 
 shutdown:
 
+	/* Wait for any outstanding metadata and readdir requests, data lanes
+	 * are stopped later so no longer yield to the metadata lane.
+	 */
+	for (i = 0; i < base.projection_count; i++)
+		ionss_lane_set_priority(base.projection_array[i].data_lane,
+					NULL);
+	ionss_lane_fini(base.meta_lane);
+	ionss_lane_fini(base.stat_lane);
+
 	/* After shutdown has been invoked close all files and free any memory,
 	 * in normal operation all files should be closed as a result of CNSS
 	 * requests prior to shutdown being triggered however perform a full
@@ -3023,8 +5781,22 @@ shutdown:
 
 		IOF_TRACE_DEBUG(projection, "Stopping projection");
 
+		ionss_lane_fini(projection->data_lane);
+
 		release_projection_resources(projection);
 
+		ionss_fdm_projection_fini(projection);
+
+		ionss_uring_fini(projection->uring);
+
+		ionss_cache_fini(projection);
+
+		ionss_sched_fini(&projection->read_sched);
+		ionss_sched_fini(&projection->write_sched);
+
+		ionss_aimd_fini(&projection->read_ctl);
+		ionss_aimd_fini(&projection->write_ctl);
+
 		rc = pthread_mutex_destroy(&projection->lock);
 		if (rc != 0)
 			IOF_TRACE_WARNING(projection,
@@ -3032,18 +5804,27 @@ shutdown:
 
 		iof_pool_destroy(&projection->pool);
 
+		iof_bulk_arena_destroy(projection->ar_arena);
+		iof_bulk_arena_destroy(projection->aw_arena);
+
 		IOF_TRACE_DOWN(projection);
 	}
 
-	D_RWLOCK_DESTROY(&base.gah_rwlock);
+	ionss_fdm_fini(&base.fdm);
 
-	ret = crt_context_destroy(base.crt_ctx, 0);
-	if (ret) {
-		IOF_LOG_ERROR("Could not destroy context");
-		if (exit_rc == -DER_SUCCESS) {
-			exit_rc = ret;
+	while (base.ctx_count > 0) {
+		base.ctx_count--;
+		ret = crt_context_destroy(base.crt_ctx_array[base.ctx_count],
+					  0);
+		if (ret) {
+			IOF_LOG_ERROR("Could not destroy context %d",
+				      base.ctx_count);
+			if (exit_rc == -DER_SUCCESS) {
+				exit_rc = ret;
+			}
 		}
 	}
+	D_FREE(base.crt_ctx_array);
 
 	ret = crt_finalize();
 	if (ret) {
@@ -3066,6 +5847,10 @@ cleanup:
 
 	D_FREE(base.fs_list);
 
+	iof_bulk_set_placement(NULL, NULL);
+	ionss_numa_fini(base.numa);
+	D_FREE(base.numa_interface);
+
 	if (base.gs) {
 		ret = ios_gah_destroy(base.gs);
 		if (ret) {
@@ -45,12 +45,226 @@
 #include "ios_gah.h"
 #include "iof_pool.h"
 #include "iof_bulk.h"
+#include "iof_common.h"
 
 #include <gurt/list.h>
 #include <gurt/hash.h>
 
 #define IOF_MAX_FSTYPE_LEN 32
 
+/* Fault injection id used by the tests to fail pushing the results of a
+ * batched inode migrate back to the client.
+ */
+#define IONSS_FI_IMIGRATE_PUT 100
+
+/* Asynchronous I/O completion descriptor.
+ *
+ * Embedded in the active read/write descriptors and passed to the io_uring
+ * backend at submission time, the callback is invoked from the progress loop
+ * with the result of the I/O, either a byte count or a negative errno.
+ */
+struct ionss_uring_op {
+	void	(*cb)(struct ionss_uring_op *, int);
+};
+
+struct ionss_uring;
+
+/* An operation to be run on a lane */
+struct ionss_lane_op {
+	void		(*fn)(struct ionss_lane_op *);
+	d_list_t	list;
+	/* Time the operation was queued, in ns */
+	uint64_t	queued;
+};
+
+/* Statistics for a lane, wait times are from queueing to starting */
+struct ionss_lane_stats {
+	uint64_t	ops;
+	uint64_t	wait_ns;
+	uint64_t	max_wait_ns;
+	/* Times a worker waited for the priority lane */
+	uint64_t	yields;
+	uint32_t	depth;
+	uint32_t	max_depth;
+};
+
+struct ionss_lane;
+
+/* Adaptive limit on the number of concurrent backend operations, see
+ * aimd.c.  The limit starts at min and is only adjusted if min < max.
+ */
+struct ionss_aimd {
+	pthread_mutex_t	lock;
+	const char	*name;
+	ATOMIC uint32_t	limit;
+	uint32_t	min;
+	uint32_t	max;
+	/* Current window */
+	uint64_t	window_start;
+	uint64_t	lat_sum;
+	uint64_t	bytes;
+	uint32_t	count;
+	/* Baseline latency and throughput of the previous window */
+	uint64_t	base_lat;
+	uint64_t	last_tput;
+	bool		raised;
+	/* Statistics */
+	uint64_t	increases;
+	uint64_t	decreases;
+};
+
+struct ionss_cache;
+struct ionss_numa;
+
+struct ionss_stat_chunk;
+
+/* A batch of readdir replies to be stat'ed by the stat pool.
+ *
+ * The callback is invoked once all entries have been processed, from
+ * whichever thread completed the last of them.
+ */
+struct ionss_stat_job {
+	void				(*cb)(struct ionss_stat_job *);
+	struct iof_readdir_reply	*replies;
+	struct ionss_stat_chunk		*chunks;
+	int				fd;
+	int				count;
+	ATOMIC int			pending;
+};
+
+/* A block in the shared read cache.
+ *
+ * Blocks hold a reference whilst data is being sent from them, and are
+ * returned to the cache with ionss_cache_put().
+ */
+struct ionss_cache_block {
+	struct iof_local_bulk	bulk;
+	d_list_t		hlist;
+	d_list_t		lru;
+	ino_t			inode_no;
+	uint64_t		block;
+	size_t			len;
+	struct timespec		ctime;
+	/* Time ctime was last checked against the file */
+	uint64_t		validated;
+	int			ref;
+	bool			hashed;
+};
+
+/* Relative share of i/o bandwidth for client ranks, from the config file.
+ * Clients which are not listed have a weight of 1.
+ */
+struct ionss_client_weights {
+	int			count;
+	struct {
+		d_rank_t	rank;
+		uint32_t	weight;
+	} entries[];
+};
+
+/* Rank used for requests whose source cannot be determined */
+#define IONSS_NO_RANK ((d_rank_t)-1)
+
+struct ionss_io_req_desc;
+
+/* A request queued in a scheduler.  The request descriptor itself lives in
+ * the RPC reply buffer so the scheduler keeps its own state here.
+ */
+struct ionss_sched_entry {
+	d_list_t			link;
+	struct ionss_io_req_desc	*desc;
+	/* Time the request was queued */
+	uint64_t			queued;
+};
+
+/* A client with i/o requests queued in a scheduler */
+struct ionss_sched_client {
+	d_list_t		link;
+	/* Queued struct ionss_sched_entry */
+	d_list_t		queue;
+	/* Bytes which may be dequeued before moving to the next client */
+	uint64_t		deficit;
+	uint32_t		weight;
+	d_rank_t		rank;
+};
+
+/* Per-client fair share scheduler for queued i/o requests.
+ *
+ * Requests are queued per client rank and dequeued using deficit round
+ * robin, with each client being allowed quantum * weight bytes per round so
+ * that a single client issuing many requests cannot starve the others.
+ * Callers are responsible for locking.
+ */
+struct ionss_sched {
+	/* Clients with queued requests, in round robin order */
+	d_list_t		active;
+	/* Idle client descriptors, kept for reuse */
+	d_list_t		idle;
+	/* Used for requests if a client descriptor cannot be allocated */
+	struct ionss_sched_client overflow;
+	/* Unused struct ionss_sched_entry, kept for reuse */
+	d_list_t		free;
+	struct ionss_client_weights *weights;
+	/* Return the cost in bytes of a request */
+	uint64_t		(*cost)(struct ionss_io_req_desc *);
+	uint64_t		quantum;
+	/* Number of queued requests */
+	uint32_t		depth;
+};
+
+/* Descriptor manager for inode handles, see fdm.c.  Handles are spread over
+ * a number of shards by inode number, each with its own lock, LRU and share
+ * of the descriptor limit.
+ */
+#define IONSS_FDM_SHARDS 16
+
+struct ionss_fdm_shard {
+	pthread_mutex_t		lock;
+	/* Handles with an open but unused descriptor, oldest first */
+	d_list_t		lru;
+	uint32_t		open_count;
+	uint32_t		max_open;
+	uint64_t		reopens;
+	uint64_t		evictions;
+};
+
+struct ionss_fdm {
+	struct ionss_fdm_shard	shards[IONSS_FDM_SHARDS];
+	uint32_t		max_open;
+};
+
+/* Totals over all shards, see ionss_fdm_read_stats() */
+struct ionss_fdm_stats {
+	uint32_t		open_count;
+	uint32_t		max_open;
+	uint64_t		reopens;
+	uint64_t		evictions;
+};
+
+/* Per-opcode statistics, see stats.c */
+struct ionss_op_stats {
+	ATOMIC uint64_t		count;
+	ATOMIC uint64_t		samples[IOF_STATS_PHASES];
+	ATOMIC uint64_t		total_ns[IOF_STATS_PHASES];
+	ATOMIC uint64_t		hist[IOF_STATS_PHASES][IOF_STATS_BUCKETS];
+};
+
+/* Number of copies of the counters.  Each thread updates one copy, chosen
+ * when it first records a sample, so that threads do not share cachelines
+ * and the copies are summed when the statistics are read.
+ */
+#define IONSS_STATS_SHARDS 16
+
+struct ionss_stats_shard {
+	struct ionss_op_stats	ops[IOF_RPC_COUNT];
+} __attribute__((aligned(64)));
+
+struct ionss_stats {
+	struct ionss_stats_shard shards[IONSS_STATS_SHARDS];
+	/* Shard to be used by the next thread */
+	ATOMIC uint32_t		next_shard;
+};
+
 struct ios_base {
 	struct ios_projection	*projection_array;
 	struct iof_fs_info	*fs_list;
@@ -60,15 +274,38 @@ struct ios_base {
 	crt_group_t		*primary_group;
 	d_rank_t		my_rank;
 	uint32_t		num_ranks;
+	/* Primary context, used for bulk handle registration */
 	crt_context_t		crt_ctx;
-	pthread_rwlock_t	gah_rwlock;
+	/* One context per progress thread, the first is crt_ctx */
+	crt_context_t		*crt_ctx_array;
+	uint32_t		ctx_count;
 	/* Global tunable options */
 	char			*group_name;
-	uint32_t		poll_interval;
+	/* Changed by reload_config() whilst other threads are running */
+	ATOMIC uint32_t		poll_interval;
 	uint32_t		cnss_poll_interval;
 	uint32_t		thread_count;
+	uint32_t		stat_thread_count;
+	struct ionss_lane	*stat_lane;
+	uint32_t		meta_thread_count;
+	/* Metadata lane, shared by all projections as the projection is
+	 * not known until the GAH has been resolved by the handler.
+	 */
+	struct ionss_lane	*meta_lane;
+	/* Threads used to set up projections in parallel at startup */
+	uint32_t		setup_thread_count;
+	struct ionss_client_weights *client_weights;
+	uint32_t		max_open_files;
+	struct ionss_fdm	fdm;
+	struct ionss_stats	stats;
 	bool			progress_callback;
+	bool			numa_bind;
+	bool			numa_spread;
+	char			*numa_interface;
+	struct ionss_numa	*numa;
 	crt_progress_cond_cb_t  callback_fn;
+	/* Path of the configuration file, re-read on SIGHUP */
+	char			*config_file;
 };
 
 /* A miniature struct that describes a file handle, this is used
@@ -120,7 +357,19 @@ struct ionss_file_handle {
 	d_list_t		 clist;
 	struct ionss_mini_file	 mf;
 	char			 proc_fd_name[64];
-	uint			 fd;
+	/* Descriptor for the file, for inode handles this may be -1 if it has
+	 * been closed by the descriptor manager, see ionss_fd_get().
+	 */
+	int			 fd;
+	/* Cached read-only descriptor for setattr, or -1 */
+	int			 attr_fd;
+	/* Saved file handle for reopening inode handles, or NULL */
+	struct file_handle	*fhandle;
+	/* Position in the descriptor manager LRU, when not in use */
+	d_list_t		 fd_lru;
+	int			 fd_users;
+	/* Descriptor opened with O_DIRECT, or -1 */
+	int			 direct_fd;
 	ATOMIC uint		 ht_ref;
 	ATOMIC uint		 ref;
 };
@@ -131,23 +380,44 @@ struct ios_projection {
 	char			fs_type[IOF_MAX_FSTYPE_LEN];
 	struct iof_pool		pool;
 	struct iof_pool_type	*fh_pool;
+	struct iof_pool_type	*dh_pool;
 	struct iof_pool_type	*ar_pool;
 	struct iof_pool_type	*aw_pool;
+	struct iof_pool_type	*rd_pool;
+	/* Pre-registered bulk buffers for the ar_pool and aw_pool */
+	struct iof_bulk_arena	*ar_arena;
+	struct iof_bulk_arena	*aw_arena;
+	struct ionss_uring	*uring;
+	struct ionss_cache	*cache;
+	/* Lane for backend reads and writes not submitted to the io_uring */
+	struct ionss_lane	*data_lane;
 	struct ionss_file_handle	*root;
 	struct d_hash_table	file_ht;
 	uint32_t		id;
+	/* max_read_count and max_write_count at startup.  The io_uring and
+	 * bulk arenas are sized from these so a reload cannot raise the
+	 * counts above them.
+	 */
+	uint32_t		read_count_cap;
+	uint32_t		write_count_cap;
 
 	/* Per-projection tunable options */
 	uint32_t		max_read_size;
 	uint32_t		max_iov_read_size;
 	uint32_t		max_read_count;
+	uint32_t		min_read_count;
 	uint32_t		max_write_size;
 	uint32_t		max_iov_write_size;
 	uint32_t		max_write_count;
+	uint32_t		min_write_count;
 	uint32_t		inode_htable_size;
 	uint32_t		readdir_size;
 	uint32_t		cnss_timeout;
 	uint32_t		cnss_thread_count;
+	uint64_t		cache_size;
+	uint32_t		data_thread_count;
+	/* Changed by reload_config() whilst other threads are running */
+	ATOMIC uint32_t		direct_io_size;
 	char			*mount_path;
 
 	/* Per-projection tunable flags */
@@ -156,25 +426,70 @@ struct ios_projection {
 	bool			fuse_write_buf;
 	bool			writeable;
 	bool			failover;
+	bool			io_uring;
 
 	bool			active;
+	/* Inodes can be reopened with open_by_handle_at() on mount_fd */
+	bool			fd_by_handle;
+	int			mount_id;
+	int			mount_fd;
 	uint64_t		dev_no;
 	pthread_mutex_t		lock;
 	int			current_read_count;
-	d_list_t		read_list;
+	struct ionss_sched	read_sched;
+	struct ionss_aimd	read_ctl;
 	int			current_write_count;
-	d_list_t		write_list;
+	struct ionss_sched	write_sched;
+	struct ionss_aimd	write_ctl;
+	ATOMIC uint64_t		read_bytes;
+	ATOMIC uint64_t		write_bytes;
 };
 
+/* Open directory handle
+ *
+ * The GAH holds one reference which is dropped by closedir, and lookups
+ * through ios_dirh_find() take another for the duration of the request so
+ * the directory is only closed once all users have finished with it.
+ * Handles are allocated from a pool, so remain valid memory after being
+ * released, see ios_fh_find().
+ */
 struct ionss_dir_handle {
 	struct ios_projection	*projection;
-	DIR			*h_dir;
+	d_list_t		list;
+	ATOMIC uint		ref;
+	/* Buffer of entries returned by getdents64() */
+	char			*dents;
+	int			dents_len;
+	int			dents_pos;
 	uint			fd;
+	/* Offset of the next entry to be returned */
 	off_t			offset;
 };
 
 #define IONSS_READDIR_ENTRIES_PER_RPC (2)
 
+/* Active readdir descriptor
+ *
+ * Used to describe an in-progress readdir request.  Replies are sent from a
+ * bulk buffer of readdir_size bytes which is registered once and reused, and
+ * when the compact format is used the replies are first built in a separate
+ * array before being encoded into the buffer.
+ */
+struct ionss_active_readdir {
+	struct ionss_stat_job		job;
+	struct ios_projection		*projection;
+	crt_rpc_t			*rpc;
+	/* Directory being read, referenced whilst the job is running */
+	struct ionss_dir_handle		*dirh;
+	struct iof_local_bulk		local_bulk;
+	struct iof_readdir_reply	*replies;
+	int				max_replies;
+	/* Number of bytes which may be sent for this request */
+	size_t				len;
+	d_list_t			list;
+	bool				failed;
+};
+
 /*
  * Pipelining reads.
  *
@@ -188,9 +503,18 @@ struct ionss_dir_handle {
 struct ionss_io_req_desc {
 	crt_rpc_t			*rpc;
 	struct ionss_file_handle	*handle;
-	d_list_t			list;
 };
 
+/* Number of buffers per active read.  Whilst one segment is being sent to
+ * the client the next one is read into the other buffer.
+ */
+#define IONSS_READ_BUFFERS 2
+
+/* Alignment of offset, length and memory required for O_DIRECT transfers.
+ * Bulk buffers are allocated with mmap() so are always page aligned.
+ */
+#define IONSS_DIRECT_ALIGN 4096
+
 /* Active read descriptor
  *
  * Used to describe an in-progress read request.  These consume resources so
@@ -200,15 +524,48 @@ struct ionss_active_read {
 	struct ios_projection		*projection;
 	crt_rpc_t			*rpc;
 	struct ionss_file_handle	*handle;
-	struct iof_local_bulk		local_bulk;
+	struct iof_local_bulk		local_bulk[IONSS_READ_BUFFERS];
+	struct ionss_cache_block	*cblk[IONSS_READ_BUFFERS];
+	size_t				cblk_offset[IONSS_READ_BUFFERS];
+	struct ionss_uring_op		uop;
+	struct ionss_lane_op		lop;
 	d_list_t			list;
+	/* Start time of the current backend read, or 0 */
+	uint64_t			io_start;
+	/* Start time of the current bulk put */
+	uint64_t			bulk_start;
+	/* Descriptor used for the current backend read */
+	int				io_fd;
 	ssize_t				read_len;
+	ssize_t				put_len;
 	uint64_t			data_offset;
 	uint64_t			req_len;
 	uint64_t			segment_offset;
+	/* Number of outstanding reads and puts */
+	ATOMIC int			pending;
+	int				buf;
+	int				put_buf;
+	/* Extent list of a vectored read, pulled from the client and
+	 * merged into xtvec_count runs.  Zero for a single extent.
+	 */
+	struct iof_local_bulk		xt_bulk;
+	uint32_t			xtvec_count;
+	/* The current segment is to be filled from the cache */
+	bool				cache_fill;
+	bool				read_ahead;
 	bool				failed;
 };
 
+/* Number of buffers per active write.  Whilst one segment is being written
+ * to the file the next one is pulled from the client into the other buffer.
+ */
+#define IONSS_WRITE_BUFFERS 2
+
+/* Maximum number of queued write requests which can be merged into a single
+ * backend write.
+ */
+#define IONSS_WRITE_BATCH 16
+
 /* Active write descriptor
  *
  * Used to describe an in-progress write request.  These consume resources so
@@ -218,11 +575,37 @@ struct ionss_active_write {
 	struct ios_projection		*projection;
 	crt_rpc_t			*rpc;
 	struct ionss_file_handle	*handle;
-	struct iof_local_bulk		local_bulk;
+	struct iof_local_bulk		local_bulk[IONSS_WRITE_BUFFERS];
+	uint64_t			seg_offset[IONSS_WRITE_BUFFERS];
+	uint64_t			seg_len[IONSS_WRITE_BUFFERS];
+	struct ionss_uring_op		uop;
+	struct ionss_lane_op		lop;
 	uint64_t			data_offset;
-	uint64_t			req_len;
-	uint64_t			segment_offset;
+	const void			*write_buf;
+	size_t				write_len;
+	/* Start time of the current backend write */
+	uint64_t			io_start;
+	/* Start time of the current bulk pull, or pulls for a merged write */
+	uint64_t			bulk_start;
+	/* Descriptor used for the current backend write */
+	int				io_fd;
+	off_t				write_offset;
+	/* Requests merged into a single write, in offset order.  Only used
+	 * if more than one request has been merged, otherwise rpc is used.
+	 */
+	crt_rpc_t			*batch[IONSS_WRITE_BATCH];
+	int				batch_count;
+	uint64_t			batch_offset;
+	uint64_t			batch_len;
 	d_list_t			list;
+	/* Number of outstanding bulk pulls and writes */
+	ATOMIC int			pending;
+	int				buf;
+	/* Extent list of a vectored write, as for reads */
+	struct iof_local_bulk		xt_bulk;
+	uint32_t			xtvec_count;
+	bool				have_data;
+	bool				imm_done;
 	bool				failed;
 };
 
@@ -247,9 +630,288 @@ void ios_fh_decref(struct ionss_file_handle *, int);
 struct ionss_file_handle *
 ios_fh_find(struct ios_base *, struct ios_gah *);
 
+/* Lookup a directory handle from a GAH and take a reference to it */
 struct ionss_dir_handle *
 ios_dirh_find(struct ios_base *, struct ios_gah *);
 
+/* Drop references to a directory handle, closing it when the last one is
+ * dropped.
+ */
+void ios_dirh_decref(struct ionss_dir_handle *, int);
+
 int parse_config(char *path, struct ios_base *base);
+void free_config(struct ios_base *base);
+
+/* From uring.c */
+
+/* Create an io_uring instance able to hold entries requests.
+ *
+ * Returns -DER_NOSYS if io_uring is not supported, in which case the caller
+ * should fall back to synchronous I/O.
+ */
+int ionss_uring_init(struct ionss_uring **, unsigned int entries);
+
+/* Wait for all requests in flight to complete, running their callbacks */
+void ionss_uring_drain(struct ionss_uring *);
+
+void ionss_uring_fini(struct ionss_uring *);
+
+/* Submit a read or write, the callback in the op descriptor will be invoked
+ * from ionss_uring_reap() on completion.  Returns non-zero if the request
+ * could not be queued, in which case no callback will be made.
+ */
+int ionss_uring_read(struct ionss_uring *, struct ionss_uring_op *,
+		     int fd, void *buf, size_t len, off_t offset);
+
+int ionss_uring_write(struct ionss_uring *, struct ionss_uring_op *,
+		      int fd, const void *buf, size_t len, off_t offset);
+
+/* Process any completed requests, returns the number processed */
+int ionss_uring_reap(struct ionss_uring *);
+
+/* Returns true if there are requests in flight */
+bool ionss_uring_busy(struct ionss_uring *);
+
+/* From cache.c */
+
+/* Create the block cache for a projection, if enabled */
+int ionss_cache_init(struct ios_projection *);
+
+void ionss_cache_fini(struct ios_projection *);
+
+/* Returns true if the range lies within a single cache block */
+bool ionss_cache_covers(struct ionss_cache *, off_t offset, size_t len);
+
+/* Return the cache block containing the range if it is cached and does not
+ * need revalidating, and take a reference to it.  On success *block_offset
+ * is set to the offset of the range within the block.
+ *
+ * Does not block so may be called from the progress threads.
+ */
+struct ionss_cache_block *
+ionss_cache_lookup(struct ionss_cache *, ino_t, off_t offset, size_t len,
+		   size_t *block_offset);
+
+/* As ionss_cache_lookup(), but revalidate the block or read it from the file
+ * if required.
+ *
+ * Returns NULL if the range cannot be served from the cache, either because
+ * it spans blocks or because there are no blocks available.  This performs
+ * blocking i/o so should be called from a data lane.
+ */
+struct ionss_cache_block *
+ionss_cache_get(struct ionss_file_handle *, off_t offset, size_t len,
+		size_t *block_offset);
+
+/* Drop a reference taken by ionss_cache_get() */
+void ionss_cache_put(struct ionss_cache *, struct ionss_cache_block *);
+
+/* Invalidate any cached blocks for a range of an inode */
+void ionss_cache_invalidate(struct ionss_cache *, ino_t, off_t offset,
+			    size_t len);
+
+/* Invalidate all cached blocks for an inode */
+void ionss_cache_invalidate_inode(struct ionss_cache *, ino_t);
+
+/* Fill in the cache counters of a statistics snapshot */
+void ionss_cache_read_stats(struct ionss_cache *,
+			    struct iof_projection_stats *);
+
+/* From numa.c */
+
+/* Load the topology and find the node local to the network interface.  If
+ * interface is NULL then the interface or domain CaRT is using is looked up
+ * from the environment.
+ */
+int ionss_numa_init(struct ionss_numa **, const char *interface);
+
+void ionss_numa_fini(struct ionss_numa *);
+
+/* Return the number of NUMA nodes, at least one */
+int ionss_numa_node_count(struct ionss_numa *);
+
+/* Bind the calling thread to the cpus local to the interface, or if spread
+ * is true to the node for index, where index 0 is local to the interface.
+ */
+void ionss_numa_bind_thread(struct ionss_numa *, bool spread, int index);
+
+/* Bulk placement callback, places memory on the node local to the
+ * interface.  arg is the struct ionss_numa.
+ */
+void ionss_numa_place(void *addr, size_t len, void *arg);
+
+/* From readdir.c */
+
+/* Read up to max_count entries from a directory starting at offset, filling
+ * in the name and nextoff of each reply.  If space is not NULL then stop
+ * once the compact encoding of the replies would exceed *space bytes, and
+ * decrement it by the size used.  Returns the number of replies used, and
+ * sets *last if the end of the directory was reached.
+ */
+int ionss_readdir_fill(struct ionss_dir_handle *, off_t offset,
+		       struct iof_readdir_reply *, int max_count,
+		       size_t *space, int *last);
+
+/* Queue a job to the stat lane.  Returns non-zero if the job could not be
+ * queued, in which case no callback will be made.
+ */
+int ionss_stat_submit(struct ionss_lane *, struct ionss_stat_job *);
+
+/* Process a job synchronously in the calling thread */
+void ionss_stat_job_run(struct ionss_stat_job *);
+
+/* From sched.c */
+
+/* Initialise a scheduler, giving each client quantum * weight bytes per
+ * round, using cost to determine the size of each request.
+ */
+void ionss_sched_init(struct ionss_sched *, uint64_t quantum,
+		      struct ionss_client_weights *,
+		      uint64_t (*cost)(struct ionss_io_req_desc *));
+
+/* Free all memory held by a scheduler, which should be empty */
+void ionss_sched_fini(struct ionss_sched *);
+
+/* Queue a request on behalf of a client rank, returns -DER_NOMEM if the
+ * request could not be queued.
+ */
+int ionss_sched_enqueue(struct ionss_sched *, struct ionss_io_req_desc *,
+			d_rank_t rank);
+
+/* Remove and return the next request to be processed, or NULL if there are
+ * none queued.  The time the request was queued is returned in *queued.
+ */
+struct ionss_io_req_desc *ionss_sched_dequeue(struct ionss_sched *,
+					      uint64_t *queued);
+
+/* Remove and return a request queued by a client out of turn.  Requests are
+ * passed to match() in the order they were queued, which should return 1 to
+ * take the request, 0 to skip it or -1 to stop searching.
+ */
+struct ionss_io_req_desc *
+ionss_sched_take(struct ionss_sched *, d_rank_t rank,
+		 int (*match)(struct ionss_io_req_desc *, void *), void *arg,
+		 uint64_t *queued);
+
+static inline bool
+ionss_sched_empty(struct ionss_sched *sched)
+{
+	return d_list_empty(&sched->active);
+}
+
+/* From lane.c */
+
+/* Create a lane with thread_count worker threads.  If thread_count is zero
+ * then *lane is set to NULL, and operations should be run inline.
+ */
+int ionss_lane_init(struct ionss_lane **, const char *name, int thread_count);
+
+/* Stop the threads and free a lane */
+void ionss_lane_fini(struct ionss_lane *);
+
+/* Queue an operation to a lane.  Returns non-zero if there is no lane, in
+ * which case the operation is not run.
+ */
+int ionss_lane_submit(struct ionss_lane *, struct ionss_lane_op *);
+
+/* Make a lane yield to a priority lane, so that whilst the priority lane has
+ * operations queued at most half of the threads of this lane are used.  A
+ * priority of NULL removes the limit.
+ */
+void ionss_lane_set_priority(struct ionss_lane *, struct ionss_lane *priority);
+
+/* Copy the current statistics for a lane */
+void ionss_lane_get_stats(struct ionss_lane *, struct ionss_lane_stats *);
+
+/* From fdm.c */
+
+/* Initialise the descriptor manager, keeping at most max_open inode
+ * descriptors open where possible.
+ */
+int ionss_fdm_init(struct ionss_fdm *, uint32_t max_open);
+
+void ionss_fdm_fini(struct ionss_fdm *);
+
+/* Sum the descriptor counts over all shards */
+void ionss_fdm_read_stats(struct ionss_fdm *, struct ionss_fdm_stats *);
+
+/* Check if a projection supports reopening inodes by file handle, called
+ * once the root handle has been opened.
+ */
+void ionss_fdm_projection_init(struct ios_projection *);
+
+/* Release the resources used by ionss_fdm_projection_init(), once all
+ * inode handles for the projection have been closed.
+ */
+void ionss_fdm_projection_fini(struct ios_projection *);
+
+/* Start managing a newly opened inode handle */
+void ionss_fdm_add(struct ionss_fdm *, struct ionss_file_handle *);
+
+/* Stop managing an inode handle, and close its descriptors */
+void ionss_fdm_remove(struct ionss_fdm *, struct ionss_file_handle *);
+
+/* Return an open descriptor for a handle, reopening it if required, or a
+ * negative errno.  The descriptor will not be closed until ionss_fd_put()
+ * is called.
+ */
+int ionss_fd_get(struct ionss_fdm *, struct ionss_file_handle *);
+
+void ionss_fd_put(struct ionss_fdm *, struct ionss_file_handle *);
+
+/* Open a new descriptor for a handle with flags, or return a negative
+ * errno.  The caller owns the new descriptor.
+ */
+int ionss_fd_open(struct ionss_file_handle *, int flags);
+
+/* Return a read-only descriptor suitable for setattr on a handle, which
+ * should have been pinned with ionss_fd_get(), or a negative errno.  If
+ * *cached is set to false on return then the descriptor should be closed by
+ * the caller.  Writable descriptors are never cached, as they would stop the
+ * file being executed, so truncate should use ionss_fd_open() instead.
+ */
+int ionss_fd_get_attr(struct ionss_fdm *, struct ionss_file_handle *,
+		      bool *cached);
+
+/* From aimd.c */
+
+int ionss_aimd_init(struct ionss_aimd *, const char *name, uint32_t min,
+		    uint32_t max);
+
+void ionss_aimd_fini(struct ionss_aimd *);
+
+/* Change the bounds of the limit, may be called whilst in use */
+void ionss_aimd_set_range(struct ionss_aimd *, uint32_t min, uint32_t max);
+
+/* Return the current time in ns, for passing to ionss_aimd_sample() and
+ * ionss_stats_record()
+ */
+uint64_t ionss_aimd_now(void);
+
+/* Record the completion of a backend operation which started at start */
+void ionss_aimd_sample(struct ionss_aimd *, uint64_t start, ssize_t bytes);
+
+/* Return the current limit */
+static inline uint32_t
+ionss_aimd_limit(struct ionss_aimd *ctl)
+{
+	return atomic_load_consume(&ctl->limit);
+}
+
+/* From stats.c */
+
+/* Count an RPC of type op */
+void ionss_stats_count(struct ionss_stats *, int op);
+
+/* Record the time since start against a phase of op, does nothing if start
+ * is 0.
+ */
+void ionss_stats_record(struct ionss_stats *, int op, enum iof_stats_phase,
+			uint64_t start);
+
+/* Fill buf with a struct iof_ionss_stats, returning the number of bytes
+ * used or 0 if len is too short.
+ */
+size_t ionss_stats_read(struct ios_base *, void *buf, size_t len);
 
 #endif
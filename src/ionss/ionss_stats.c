@@ -0,0 +1,485 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Poll the IONSS ranks of a group for statistics and print rates.
+ *
+ * Each sample is compared with the previous one from the same rank so the
+ * figures printed are for the last interval only.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "version.h"
+#include "log.h"
+#include "iof_common.h"
+#include "iof_fs.h"
+#include "iof_bulk.h"
+
+#define X(a, b, c) #a,
+
+static const char * const op_names[] = {
+	IOF_RPCS_LIST
+};
+
+#undef X
+
+static const char * const phase_names[] = {
+	"queue",
+	"backend",
+	"bulk",
+};
+
+struct stats_rank {
+	struct iof_local_bulk	bulk;
+	struct iof_ionss_stats	*prev;
+	bool			have_prev;
+};
+
+struct stats_req {
+	struct iof_tracker	tracker;
+	uint64_t		len;
+	int			rc;
+};
+
+static ATOMIC int stop;
+
+static void *progress_thread(void *arg)
+{
+	crt_context_t crt_ctx = arg;
+	int rc;
+
+	while (!atomic_load_consume(&stop)) {
+		rc = crt_progress(crt_ctx, 1000 * 1000, NULL, NULL);
+		if (rc != 0 && rc != -DER_TIMEDOUT) {
+			IOF_LOG_ERROR("crt_progress failed rc: %d", rc);
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void stats_cb(const struct crt_cb_info *cb_info)
+{
+	struct stats_req *req = cb_info->cci_arg;
+	struct iof_stats_out *out = crt_reply_get(cb_info->cci_rpc);
+
+	req->rc = cb_info->cci_rc;
+	if (req->rc == -DER_SUCCESS) {
+		req->rc = out->err;
+		req->len = out->len;
+	}
+
+	iof_tracker_signal(&req->tracker);
+}
+
+/* Fetch the current statistics from a rank into its bulk buffer */
+static int fetch_stats(crt_context_t crt_ctx, struct crt_proto_format *proto,
+		       crt_endpoint_t *ep, struct stats_rank *sr)
+{
+	struct stats_req req = {0};
+	struct iof_stats_in *in;
+	crt_rpc_t *rpc = NULL;
+	int rc;
+
+	rc = crt_req_create(crt_ctx, ep,
+			    CRT_PROTO_OPC(proto->cpf_base, proto->cpf_ver,
+					  IOF_SIGNON_STATS),
+			    &rpc);
+	if (rc != -DER_SUCCESS || !rpc)
+		return rc ? rc : -DER_NOMEM;
+
+	in = crt_req_get(rpc);
+	in->bulk = sr->bulk.handle;
+	in->len = sr->bulk.len;
+
+	iof_tracker_init(&req.tracker, 1);
+	rc = crt_req_send(rpc, stats_cb, &req);
+	if (rc != -DER_SUCCESS)
+		return rc;
+
+	iof_tracker_wait(&req.tracker);
+
+	if (req.rc == -DER_SUCCESS && req.len < sizeof(struct iof_ionss_stats))
+		return -DER_PROTO;
+
+	return req.rc;
+}
+
+/* Return the bucket containing the pct percentile of the difference
+ * between two histograms.
+ */
+static int percentile(const uint64_t *cur, const uint64_t *prev,
+		      uint64_t total, int pct)
+{
+	uint64_t want = (total * pct + 99) / 100;
+	uint64_t seen = 0;
+	int i;
+
+	for (i = 0; i < IOF_STATS_BUCKETS - 1; i++) {
+		seen += cur[i] - prev[i];
+		if (seen >= want)
+			break;
+	}
+
+	return i;
+}
+
+static void print_ops(const struct iof_ionss_stats *cur,
+		      const struct iof_ionss_stats *prev, double secs)
+{
+	int op;
+	int phase;
+
+	printf("  %-16s %10s", "op", "ops/s");
+	for (phase = 0; phase < IOF_STATS_PHASES; phase++)
+		printf(" %8s_us %7s_p99", phase_names[phase],
+		       phase_names[phase]);
+	printf("\n");
+
+	for (op = 0; op < IOF_RPC_COUNT && op < cur->op_count; op++) {
+		const struct iof_op_stats *c = &cur->ops[op];
+		const struct iof_op_stats *p = &prev->ops[op];
+		uint64_t count = c->count - p->count;
+
+		if (count == 0)
+			continue;
+
+		printf("  %-16s %10.1f", op_names[op], count / secs);
+
+		for (phase = 0; phase < IOF_STATS_PHASES; phase++) {
+			uint64_t samples = c->samples[phase] -
+				p->samples[phase];
+			uint64_t ns = c->total_ns[phase] - p->total_ns[phase];
+			int p99;
+
+			if (samples == 0) {
+				printf(" %11s %11s", "-", "-");
+				continue;
+			}
+
+			p99 = percentile(c->hist[phase], p->hist[phase],
+					 samples, 99);
+			/* Print the upper bound of the bucket, or the lower
+			 * bound of the last one which has no upper bound.
+			 */
+			printf(" %11.1f", (double)ns / samples / 1000);
+			if (p99 < IOF_STATS_BUCKETS - 1)
+				printf(" %11llu", 1ULL << p99);
+			else
+				printf(" %10llu+", 1ULL << (p99 - 1));
+		}
+		printf("\n");
+	}
+}
+
+static void print_lane(const char *name, const struct iof_lane_stats *cur,
+		       const struct iof_lane_stats *prev, double secs)
+{
+	uint64_t ops = cur->ops - prev->ops;
+
+	printf("%s lane: %.1f ops/s depth %u/%u mean wait %.1fus"
+	       " max wait %.1fus yields %.1f/s\n", name, ops / secs,
+	       cur->depth, cur->max_depth,
+	       ops ? (double)(cur->wait_ns - prev->wait_ns) / ops / 1000 : 0.0,
+	       (double)cur->max_wait_ns / 1000,
+	       (cur->yields - prev->yields) / secs);
+}
+
+static void print_stats(d_rank_t rank, const struct iof_ionss_stats *cur,
+			const struct iof_ionss_stats *prev)
+{
+	double secs = (cur->timestamp - prev->timestamp) / 1e9;
+	uint64_t lookups;
+	int i;
+
+	if (secs <= 0)
+		return;
+
+	printf("rank %u: %.2fs\n", rank, secs);
+
+	print_ops(cur, prev, secs);
+
+	for (i = 0; i < cur->projection_count &&
+		     i < prev->projection_count; i++) {
+		const struct iof_projection_stats *c = &cur->projections[i];
+		const struct iof_projection_stats *p = &prev->projections[i];
+
+		printf("  projection %d: read %.1f MB/s write %.1f MB/s"
+		       " queued %u/%u active %u/%u limit %u/%u\n", i,
+		       (c->read_bytes - p->read_bytes) / secs / 1e6,
+		       (c->write_bytes - p->write_bytes) / secs / 1e6,
+		       c->read_queued, c->write_queued,
+		       c->read_active, c->write_active,
+		       c->read_limit, c->write_limit);
+
+		print_lane("    data", &c->data_lane, &p->data_lane, secs);
+
+		lookups = (c->cache_hits - p->cache_hits) +
+			(c->cache_misses - p->cache_misses);
+		if (lookups == 0 && c->cache_hits == 0 && c->cache_misses == 0)
+			continue;
+
+		printf("    cache: %.1f lookups/s hits %.1f%% evictions %.1f/s"
+		       " invalidations %.1f/s\n", lookups / secs,
+		       lookups ? 100.0 * (c->cache_hits - p->cache_hits) /
+		       lookups : 0.0,
+		       (c->cache_evictions - p->cache_evictions) / secs,
+		       (c->cache_invalidations - p->cache_invalidations) /
+		       secs);
+	}
+
+	print_lane("  meta", &cur->meta_lane, &prev->meta_lane, secs);
+	print_lane("  stat", &cur->stat_lane, &prev->stat_lane, secs);
+
+	printf("  inode fds: %u/%u reopens %.1f/s evictions %.1f/s\n",
+	       cur->fd_open, cur->fd_max,
+	       (cur->fd_reopens - prev->fd_reopens) / secs,
+	       (cur->fd_evictions - prev->fd_evictions) / secs);
+
+	printf("  bulk memory: %lu/%lu KiB in use\n",
+	       cur->bulk_in_use / 1024, cur->bulk_registered / 1024);
+}
+
+static void show_help(const char *prog)
+{
+	printf("Print I/O Forwarding IONSS statistics\n");
+	printf("\n");
+	printf("Usage: %s [OPTION]\n", prog);
+	printf("\n");
+	printf("\t-h, --help\tThis help text\n");
+	printf("\t-v, --version\tShow version\n");
+	printf("\t-g, --group\tIONSS group name, default IONSS\n");
+	printf("\t-r, --rank\tOnly poll this rank, default all ranks\n");
+	printf("\t-i, --interval\tSeconds between samples, default 1\n");
+	printf("\t-c, --count\tNumber of intervals to print, default "
+	       "unlimited\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct crt_proto_format *proto = NULL;
+	struct stats_rank *ranks = NULL;
+	crt_context_t crt_ctx = NULL;
+	crt_group_t *grp = NULL;
+	crt_endpoint_t ep = {0};
+	pthread_t thread;
+	char *group_name = "IONSS";
+	char *version = iof_get_version();
+	uint32_t first = 0;
+	uint32_t size = 0;
+	uint32_t interval = 1;
+	long count = -1;
+	long rank = -1;
+	int exit_rc = 1;
+	uint32_t i;
+	int rc;
+	int c;
+
+	while (1) {
+		static struct option long_options[] = {
+			{"help", no_argument, 0, 'h'},
+			{"version", no_argument, 0, 'v'},
+			{"group", required_argument, 0, 'g'},
+			{"rank", required_argument, 0, 'r'},
+			{"interval", required_argument, 0, 'i'},
+			{"count", required_argument, 0, 'c'},
+			{0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "hvg:r:i:c:", long_options, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			exit(0);
+			break;
+		case 'v':
+			printf("%s: %s\n", argv[0], version);
+			exit(0);
+			break;
+		case 'g':
+			group_name = optarg;
+			break;
+		case 'r':
+			rank = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case '?':
+			exit(1);
+			break;
+		}
+	}
+
+	if (interval == 0)
+		interval = 1;
+
+	iof_log_init("STA", "IONSS_STATS", NULL);
+
+	rc = crt_init(NULL, 0);
+	if (rc) {
+		fprintf(stderr, "crt_init failed, rc = %d\n", rc);
+		goto out_log;
+	}
+
+	rc = crt_context_create(&crt_ctx);
+	if (rc) {
+		fprintf(stderr, "crt_context_create failed, rc = %d\n", rc);
+		goto out_crt;
+	}
+
+	rc = pthread_create(&thread, NULL, progress_thread, crt_ctx);
+	if (rc) {
+		fprintf(stderr, "Could not start progress thread\n");
+		goto out_ctx;
+	}
+
+	rc = crt_group_attach(group_name, &grp);
+	if (rc) {
+		fprintf(stderr, "Could not attach to group '%s', rc = %d\n",
+			group_name, rc);
+		goto out_thread;
+	}
+
+	rc = crt_group_size(grp, &size);
+	if (rc || size == 0) {
+		fprintf(stderr, "Could not get group size, rc = %d\n", rc);
+		goto out_detach;
+	}
+
+	if (rank >= 0) {
+		if (rank >= size) {
+			fprintf(stderr, "Rank %ld not in group of %u\n", rank,
+				size);
+			goto out_detach;
+		}
+		first = rank;
+		size = rank + 1;
+	}
+
+	ep.ep_grp = grp;
+	ep.ep_rank = first;
+	rc = iof_signon_query(&ep, &proto);
+	if (rc) {
+		fprintf(stderr, "Protocol query failed, rc = %d\n", rc);
+		goto out_detach;
+	}
+
+	D_ALLOC_ARRAY(ranks, size);
+	if (!ranks)
+		goto out_detach;
+
+	for (i = first; i < size; i++) {
+		D_ALLOC(ranks[i].prev, IOF_STATS_SIZE);
+		if (!ranks[i].prev)
+			goto out_free;
+		if (!IOF_BULK_ALLOC(crt_ctx, &ranks[i], bulk, IOF_STATS_SIZE,
+				    false))
+			goto out_free;
+	}
+
+	exit_rc = 0;
+
+	/* The first sample only sets the baseline */
+	for (;;) {
+		bool printed = false;
+
+		for (i = first; i < size; i++) {
+			struct stats_rank *sr = &ranks[i];
+
+			ep.ep_rank = i;
+			rc = fetch_stats(crt_ctx, proto, &ep, sr);
+			if (rc) {
+				fprintf(stderr, "rank %u: failed, rc = %d\n",
+					i, rc);
+				sr->have_prev = false;
+				continue;
+			}
+
+			if (sr->have_prev) {
+				print_stats(i, sr->bulk.buf, sr->prev);
+				printed = true;
+			}
+
+			memcpy(sr->prev, sr->bulk.buf, IOF_STATS_SIZE);
+			sr->have_prev = true;
+		}
+
+		if (printed) {
+			printf("\n");
+			fflush(stdout);
+			if (count > 0 && --count == 0)
+				break;
+		}
+
+		sleep(interval);
+	}
+
+out_free:
+	for (i = first; i < size; i++) {
+		if (ranks[i].bulk.buf)
+			IOF_BULK_FREE(&ranks[i], bulk);
+		D_FREE(ranks[i].prev);
+	}
+	D_FREE(ranks);
+out_detach:
+	crt_group_detach(grp);
+out_thread:
+	atomic_store_release(&stop, 1);
+	pthread_join(thread, NULL);
+out_ctx:
+	crt_context_destroy(crt_ctx, 0);
+out_crt:
+	crt_finalize();
+out_log:
+	iof_log_close();
+	return exit_rc;
+}
@@ -0,0 +1,311 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Dispatch lanes for the IONSS.
+ *
+ * A lane is a queue of operations serviced by a fixed number of worker
+ * threads, and is the one worker pool implementation used by the IONSS.
+ * Metadata RPCs and backend data reads and writes are run on separate lanes
+ * so that each has its own thread budget, and a stream of large data
+ * requests cannot occupy the threads needed to answer metadata requests, or
+ * the progress threads.  The readdir stat workers are also a lane.
+ *
+ * As all lanes share the same backend filesystem a lane can be given a
+ * priority lane, and whilst that has operations queued the lane admits at
+ * most half of its threads, so data transfers cannot starve metadata of
+ * backend time.
+ *
+ * Each lane keeps statistics of queue depth and the time operations spend
+ * queued before being started.
+ */
+
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ionss.h"
+#include "log.h"
+
+/* How often a lane which is yielding to its priority lane re-checks it, in
+ * ns.  The priority lane does not wake lanes waiting on it.
+ */
+#define IONSS_LANE_YIELD_NS (1000 * 1000)
+
+struct ionss_lane {
+	const char		*name;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	d_list_t		queue;
+	pthread_t		*threads;
+	int			thread_count;
+	/* Number of operations currently running */
+	int			active;
+	/* Lane which takes priority, and the number of threads which may be
+	 * active whilst it has operations queued.
+	 */
+	struct ionss_lane	*priority;
+	int			yield_threads;
+	/* Copy of stats.depth which may be read without the lock */
+	ATOMIC uint32_t		queued;
+	bool			stop;
+	struct ionss_lane_stats	stats;
+};
+
+static uint64_t
+lane_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns true if the lane should not start another operation yet because
+ * its priority lane has work queued.  Called with the lane lock held.
+ */
+static bool
+lane_yield(struct ionss_lane *lane)
+{
+	if (!lane->priority || lane->stop ||
+	    lane->active < lane->yield_threads)
+		return false;
+
+	return atomic_load_consume(&lane->priority->queued) != 0;
+}
+
+static void
+lane_wait(struct ionss_lane *lane, bool yield)
+{
+	struct timespec ts;
+
+	if (!yield) {
+		pthread_cond_wait(&lane->cond, &lane->lock);
+		return;
+	}
+
+	lane->stats.yields++;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += IONSS_LANE_YIELD_NS;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&lane->cond, &lane->lock, &ts);
+}
+
+static void *ionss_lane_thread(void *arg)
+{
+	struct ionss_lane *lane = arg;
+	struct ionss_lane_op *op;
+	uint64_t wait;
+	bool yield;
+
+	D_MUTEX_LOCK(&lane->lock);
+	for (;;) {
+		yield = false;
+		while ((d_list_empty(&lane->queue) && !lane->stop) ||
+		       (!d_list_empty(&lane->queue) &&
+			(yield = lane_yield(lane))))
+			lane_wait(lane, yield);
+
+		op = d_list_pop_entry(&lane->queue, struct ionss_lane_op,
+				      list);
+		if (!op)
+			break;
+
+		wait = lane_now() - op->queued;
+		lane->stats.depth--;
+		atomic_store_release(&lane->queued, lane->stats.depth);
+		lane->stats.ops++;
+		lane->stats.wait_ns += wait;
+		if (wait > lane->stats.max_wait_ns)
+			lane->stats.max_wait_ns = wait;
+		lane->active++;
+		D_MUTEX_UNLOCK(&lane->lock);
+
+		op->fn(op);
+
+		D_MUTEX_LOCK(&lane->lock);
+		lane->active--;
+	}
+	D_MUTEX_UNLOCK(&lane->lock);
+
+	return NULL;
+}
+
+int ionss_lane_submit(struct ionss_lane *lane, struct ionss_lane_op *op)
+{
+	if (!lane)
+		return -DER_NOSYS;
+
+	op->queued = lane_now();
+
+	D_MUTEX_LOCK(&lane->lock);
+	d_list_add_tail(&op->list, &lane->queue);
+	lane->stats.depth++;
+	atomic_store_release(&lane->queued, lane->stats.depth);
+	if (lane->stats.depth > lane->stats.max_depth)
+		lane->stats.max_depth = lane->stats.depth;
+	pthread_cond_signal(&lane->cond);
+	D_MUTEX_UNLOCK(&lane->lock);
+
+	return -DER_SUCCESS;
+}
+
+void ionss_lane_set_priority(struct ionss_lane *lane,
+			     struct ionss_lane *priority)
+{
+	if (!lane || lane == priority)
+		return;
+
+	D_MUTEX_LOCK(&lane->lock);
+	lane->priority = priority;
+	lane->yield_threads = lane->thread_count / 2;
+	if (lane->yield_threads == 0)
+		lane->yield_threads = 1;
+	D_MUTEX_UNLOCK(&lane->lock);
+
+	if (priority)
+		IOF_LOG_INFO("%s lane yields to %s lane, %d/%d threads",
+			     lane->name, priority->name, lane->yield_threads,
+			     lane->thread_count);
+}
+
+void ionss_lane_get_stats(struct ionss_lane *lane,
+			  struct ionss_lane_stats *stats)
+{
+	if (!lane) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	D_MUTEX_LOCK(&lane->lock);
+	*stats = lane->stats;
+	D_MUTEX_UNLOCK(&lane->lock);
+}
+
+int ionss_lane_init(struct ionss_lane **lanep, const char *name,
+		    int thread_count)
+{
+	struct ionss_lane *lane;
+	int rc;
+	int i;
+
+	*lanep = NULL;
+
+	if (thread_count == 0)
+		return -DER_SUCCESS;
+
+	D_ALLOC_PTR(lane);
+	if (!lane)
+		return -DER_NOMEM;
+
+	lane->name = name;
+
+	D_ALLOC_ARRAY(lane->threads, thread_count);
+	if (!lane->threads)
+		D_GOTO(free_lane, rc = -DER_NOMEM);
+
+	rc = D_MUTEX_INIT(&lane->lock, NULL);
+	if (rc != -DER_SUCCESS)
+		D_GOTO(free_threads, rc);
+
+	rc = pthread_cond_init(&lane->cond, NULL);
+	if (rc != 0)
+		D_GOTO(free_mutex, rc = -DER_NOMEM);
+
+	D_INIT_LIST_HEAD(&lane->queue);
+
+	for (i = 0; i < thread_count; i++) {
+		rc = pthread_create(&lane->threads[i], NULL, ionss_lane_thread,
+				    lane);
+		if (rc != 0) {
+			IOF_LOG_WARNING("Only started %d %s threads", i, name);
+			break;
+		}
+		lane->thread_count++;
+	}
+
+	if (lane->thread_count == 0) {
+		pthread_cond_destroy(&lane->cond);
+		D_GOTO(free_mutex, rc = -DER_MISC);
+	}
+
+	IOF_LOG_INFO("Started %d %s threads", lane->thread_count, name);
+
+	*lanep = lane;
+	return -DER_SUCCESS;
+
+free_mutex:
+	D_MUTEX_DESTROY(&lane->lock);
+free_threads:
+	D_FREE(lane->threads);
+free_lane:
+	D_FREE(lane);
+	return rc;
+}
+
+/* Stop a lane, any operations which are still queued are run first */
+void ionss_lane_fini(struct ionss_lane *lane)
+{
+	struct ionss_lane_stats *stats;
+	int i;
+
+	if (!lane)
+		return;
+
+	D_MUTEX_LOCK(&lane->lock);
+	lane->stop = true;
+	pthread_cond_broadcast(&lane->cond);
+	D_MUTEX_UNLOCK(&lane->lock);
+
+	for (i = 0; i < lane->thread_count; i++)
+		pthread_join(lane->threads[i], NULL);
+
+	stats = &lane->stats;
+	IOF_LOG_INFO("%s lane: ops %lu max depth %u mean wait %luns"
+		     " max wait %luns yields %lu", lane->name, stats->ops,
+		     stats->max_depth,
+		     stats->ops ? stats->wait_ns / stats->ops : 0,
+		     stats->max_wait_ns, stats->yields);
+
+	pthread_cond_destroy(&lane->cond);
+	D_MUTEX_DESTROY(&lane->lock);
+	D_FREE(lane->threads);
+	D_FREE(lane);
+}
@@ -0,0 +1,277 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* NUMA placement for the IONSS.
+ *
+ * The node the network interface is attached to is found from the hwloc
+ * topology, using the interface named in the config file or the one CaRT
+ * has been told to use through OFI_INTERFACE or OFI_DOMAIN.  Progress
+ * threads bind themselves to that node when they start, and bulk buffers
+ * are placed on the node when they are mapped so they are local to the NIC
+ * regardless of which thread first touches them.  Other threads, such as
+ * those started by CaRT and the lane workers, are left unbound.
+ *
+ * Optionally progress threads are instead spread over all nodes, with one
+ * context per node.
+ *
+ * If the interface cannot be found then nothing is bound, however threads
+ * are still spread over nodes if requested.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hwloc.h>
+
+#include "ionss.h"
+#include "log.h"
+
+struct ionss_numa {
+	hwloc_topology_t	topology;
+	/* NUMA nodes, with the node local to the interface first */
+	hwloc_obj_t		*nodes;
+	int			node_count;
+	/* cpuset and nodeset local to the interface, or NULL if not known */
+	hwloc_cpuset_t		nic_cpuset;
+	hwloc_nodeset_t		nic_nodeset;
+};
+
+/* Find a network or OpenFabrics OS device by name and return the closest
+ * non-I/O object, which holds the cpuset and nodeset local to it.
+ */
+static hwloc_obj_t
+numa_find_device(struct ionss_numa *numa, const char *name)
+{
+	hwloc_obj_t obj = NULL;
+
+	if (!name)
+		return NULL;
+
+	while ((obj = hwloc_get_next_osdev(numa->topology, obj)) != NULL) {
+		if (obj->attr->osdev.type != HWLOC_OBJ_OSDEV_NETWORK &&
+		    obj->attr->osdev.type != HWLOC_OBJ_OSDEV_OPENFABRICS)
+			continue;
+		if (!obj->name || strcmp(obj->name, name) != 0)
+			continue;
+		return hwloc_get_non_io_ancestor_obj(numa->topology, obj);
+	}
+
+	IOF_LOG_INFO("Interface %s not found in topology", name);
+	return NULL;
+}
+
+static int
+numa_load_topology(struct ionss_numa *numa)
+{
+	int rc;
+
+	rc = hwloc_topology_init(&numa->topology);
+	if (rc != 0)
+		return -DER_NOMEM;
+
+#if HWLOC_API_VERSION >= 0x00020000
+	hwloc_topology_set_io_types_filter(numa->topology,
+					   HWLOC_TYPE_FILTER_KEEP_IMPORTANT);
+#else
+	hwloc_topology_set_flags(numa->topology,
+				 HWLOC_TOPOLOGY_FLAG_IO_DEVICES);
+#endif
+
+	rc = hwloc_topology_load(numa->topology);
+	if (rc != 0) {
+		IOF_LOG_ERROR("Could not load topology");
+		hwloc_topology_destroy(numa->topology);
+		return -DER_MISC;
+	}
+	return -DER_SUCCESS;
+}
+
+int ionss_numa_init(struct ionss_numa **numap, const char *interface)
+{
+	struct ionss_numa *numa;
+	hwloc_obj_t nic = NULL;
+	hwloc_obj_t node;
+	char *str = NULL;
+	int count;
+	int i;
+	int rc;
+
+	*numap = NULL;
+
+	D_ALLOC_PTR(numa);
+	if (!numa)
+		return -DER_NOMEM;
+
+	rc = numa_load_topology(numa);
+	if (rc != -DER_SUCCESS)
+		D_GOTO(out_free, rc);
+
+	count = hwloc_get_nbobjs_by_type(numa->topology, HWLOC_OBJ_NUMANODE);
+	if (count < 1)
+		count = 1;
+
+	D_ALLOC_ARRAY(numa->nodes, count);
+	if (!numa->nodes)
+		D_GOTO(out_topo, rc = -DER_NOMEM);
+
+	if (interface) {
+		nic = numa_find_device(numa, interface);
+	} else {
+		nic = numa_find_device(numa, getenv("OFI_INTERFACE"));
+		if (!nic)
+			nic = numa_find_device(numa, getenv("OFI_DOMAIN"));
+	}
+
+	if (nic && nic->cpuset && nic->nodeset) {
+		numa->nic_cpuset = hwloc_bitmap_dup(nic->cpuset);
+		numa->nic_nodeset = hwloc_bitmap_dup(nic->nodeset);
+		if (!numa->nic_cpuset || !numa->nic_nodeset)
+			D_GOTO(out_bitmap, rc = -DER_NOMEM);
+	}
+
+	/* Order the nodes so that the one the interface is attached to is
+	 * first, and is used for context 0.
+	 */
+	for (i = 0; i < count; i++) {
+		node = hwloc_get_obj_by_type(numa->topology,
+					     HWLOC_OBJ_NUMANODE, i);
+		if (!node)
+			break;
+		if (numa->nic_nodeset && numa->node_count > 0 &&
+		    hwloc_bitmap_isset(numa->nic_nodeset, node->os_index)) {
+			numa->nodes[numa->node_count] = numa->nodes[0];
+			numa->nodes[0] = node;
+		} else {
+			numa->nodes[numa->node_count] = node;
+		}
+		numa->node_count++;
+	}
+
+	if (numa->nic_cpuset)
+		hwloc_bitmap_asprintf(&str, numa->nic_cpuset);
+	IOF_LOG_INFO("%d NUMA nodes, interface cpuset %s",
+		     numa->node_count, str ? str : "unknown");
+	free(str);
+
+	*numap = numa;
+	return -DER_SUCCESS;
+
+out_bitmap:
+	hwloc_bitmap_free(numa->nic_cpuset);
+	hwloc_bitmap_free(numa->nic_nodeset);
+	D_FREE(numa->nodes);
+out_topo:
+	hwloc_topology_destroy(numa->topology);
+out_free:
+	D_FREE(numa);
+	return rc;
+}
+
+void ionss_numa_fini(struct ionss_numa *numa)
+{
+	if (!numa)
+		return;
+
+	hwloc_bitmap_free(numa->nic_cpuset);
+	hwloc_bitmap_free(numa->nic_nodeset);
+	D_FREE(numa->nodes);
+	hwloc_topology_destroy(numa->topology);
+	D_FREE(numa);
+}
+
+int ionss_numa_node_count(struct ionss_numa *numa)
+{
+	if (!numa)
+		return 1;
+	return numa->node_count ? numa->node_count : 1;
+}
+
+/* Bind the calling thread.
+ *
+ * If spread is false the thread is bound to the cpus local to the
+ * interface, otherwise to the node for the given index with index 0 being
+ * the node local to the interface.
+ */
+void ionss_numa_bind_thread(struct ionss_numa *numa, bool spread, int index)
+{
+	hwloc_const_cpuset_t cpuset;
+	int rc;
+
+	if (!numa)
+		return;
+
+	if (spread && numa->node_count > 0)
+		cpuset = numa->nodes[index % numa->node_count]->cpuset;
+	else
+		cpuset = numa->nic_cpuset;
+
+	if (!cpuset)
+		return;
+
+	rc = hwloc_set_cpubind(numa->topology, cpuset, HWLOC_CPUBIND_THREAD);
+	if (rc != 0)
+		IOF_LOG_WARNING("Could not bind thread %d: %s", index,
+				strerror(errno));
+}
+
+/* Place a bulk buffer on the node local to the interface.
+ *
+ * This is called for every bulk mapping before it is registered.  The
+ * binding is not strict so the kernel will fall back to other nodes rather
+ * than fail the allocation if the local node is out of memory.
+ */
+void ionss_numa_place(void *addr, size_t len, void *arg)
+{
+	struct ionss_numa *numa = arg;
+	int rc;
+
+	if (!numa || !numa->nic_nodeset)
+		return;
+
+#if HWLOC_API_VERSION >= 0x00020000
+	rc = hwloc_set_area_membind(numa->topology, addr, len,
+				    numa->nic_nodeset, HWLOC_MEMBIND_BIND,
+				    HWLOC_MEMBIND_BYNODESET);
+#else
+	rc = hwloc_set_area_membind_nodeset(numa->topology, addr, len,
+					    numa->nic_nodeset,
+					    HWLOC_MEMBIND_BIND, 0);
+#endif
+	if (rc != 0)
+		IOF_LOG_DEBUG("Could not place %p: %s", addr, strerror(errno));
+}
@@ -0,0 +1,253 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Directory reading for the IONSS.
+ *
+ * Directories are read in batches using getdents64() directly rather than
+ * through a DIR stream, so the kernel offset of each entry can be returned to
+ * the client for resuming.  The per-entry stat calls, which dominate on
+ * filesystems with high metadata latency, are spread over the threads of the
+ * stat lane.  Each readdir RPC is split into chunks which are queued to the
+ * lane, and the last chunk to complete invokes the callback to send the
+ * reply.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "iof_common.h"
+#include "ionss.h"
+#include "log.h"
+
+/* Size of the buffer passed to getdents64() */
+#define IONSS_DENTS_SIZE (32 * 1024)
+
+/* Number of entries to stat per unit of work */
+#define IONSS_STAT_CHUNK 8
+
+struct linux_dirent64 {
+	ino64_t		d_ino;
+	off64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+
+struct ionss_stat_chunk {
+	struct ionss_lane_op	op;
+	struct ionss_stat_job	*job;
+	int			start;
+	int			end;
+};
+
+int ionss_readdir_fill(struct ionss_dir_handle *handle, off_t offset,
+		       struct iof_readdir_reply *replies, int max_count,
+		       size_t *space, int *last)
+{
+	struct linux_dirent64 *de;
+	off_t prev = offset;
+	int idx = 0;
+	int rc;
+
+	if (handle->offset != offset) {
+		IOF_TRACE_DEBUG(handle, "Changing offset %zi %zi",
+				handle->offset, offset);
+		errno = 0;
+		if (lseek(handle->fd, offset, SEEK_SET) == (off_t)-1) {
+			memset(&replies[0], 0, sizeof(replies[0]));
+			replies[0].read_rc = errno;
+			replies[0].nextoff = offset;
+			return 1;
+		}
+		handle->offset = offset;
+		handle->dents_len = 0;
+		handle->dents_pos = 0;
+	}
+
+	if (!handle->dents) {
+		D_ALLOC(handle->dents, IONSS_DENTS_SIZE);
+		if (!handle->dents) {
+			memset(&replies[0], 0, sizeof(replies[0]));
+			replies[0].read_rc = ENOMEM;
+			replies[0].nextoff = offset;
+			return 1;
+		}
+	}
+
+	while (idx < max_count) {
+		if (handle->dents_pos >= handle->dents_len) {
+			errno = 0;
+			rc = syscall(SYS_getdents64, handle->fd, handle->dents,
+				     IONSS_DENTS_SIZE);
+			if (rc < 0) {
+				/* An error occoured */
+				if (space && *space < IOF_READDIR_ENT_MIN)
+					return idx;
+				memset(&replies[idx], 0, sizeof(replies[idx]));
+				replies[idx].read_rc = errno;
+				replies[idx].nextoff = prev;
+				return idx + 1;
+			}
+			if (rc == 0) {
+				IOF_TRACE_DEBUG(handle, "Last entry %d", idx);
+				/* End of directory */
+				*last = 1;
+				return idx;
+			}
+			handle->dents_len = rc;
+			handle->dents_pos = 0;
+		}
+
+		de = (struct linux_dirent64 *)(handle->dents +
+					       handle->dents_pos);
+
+		if (strncmp(".", de->d_name, 2) == 0 ||
+		    strncmp("..", de->d_name, 3) == 0) {
+			handle->dents_pos += de->d_reclen;
+			handle->offset = de->d_off;
+			continue;
+		}
+
+		/* The replies array is reused between requests */
+		memset(&replies[idx], 0, sizeof(replies[idx]));
+		replies[idx].nextoff = de->d_off;
+		strncpy(replies[idx].d_name, de->d_name, NAME_MAX);
+
+		/* If the reply is size limited then stop before consuming an
+		 * entry which does not fit, it will be returned next time.
+		 */
+		if (space) {
+			size_t len = iof_readdir_ent_size(&replies[idx], prev);
+
+			if (len > *space)
+				return idx;
+			*space -= len;
+		}
+
+		handle->dents_pos += de->d_reclen;
+		handle->offset = de->d_off;
+		prev = de->d_off;
+
+		IOF_TRACE_DEBUG(handle, "File '%s' nextoff %zi", de->d_name,
+				handle->offset);
+		idx++;
+	}
+
+	return idx;
+}
+
+static void ionss_stat_range(int fd, struct iof_readdir_reply *replies,
+			     int start, int end)
+{
+	int rc;
+	int i;
+
+	for (i = start; i < end; i++) {
+		if (replies[i].read_rc != 0)
+			continue;
+
+		errno = 0;
+		rc = fstatat(fd, replies[i].d_name, &replies[i].stat,
+			     AT_SYMLINK_NOFOLLOW);
+		if (rc != 0)
+			replies[i].stat_rc = errno;
+	}
+}
+
+static void ionss_stat_chunk_run(struct ionss_lane_op *op)
+{
+	struct ionss_stat_chunk *chunk;
+	struct ionss_stat_job *job;
+
+	chunk = container_of(op, struct ionss_stat_chunk, op);
+	job = chunk->job;
+
+	ionss_stat_range(job->fd, job->replies, chunk->start, chunk->end);
+
+	if (atomic_fetch_sub(&job->pending, 1) != 1)
+		return;
+
+	D_FREE(job->chunks);
+	job->cb(job);
+}
+
+int ionss_stat_submit(struct ionss_lane *lane, struct ionss_stat_job *job)
+{
+	int count;
+	int i;
+
+	if (!lane)
+		return -DER_NOSYS;
+
+	count = (job->count + IONSS_STAT_CHUNK - 1) / IONSS_STAT_CHUNK;
+
+	D_ALLOC_ARRAY(job->chunks, count);
+	if (!job->chunks)
+		return -DER_NOMEM;
+
+	atomic_store_release(&job->pending, count);
+
+	for (i = 0; i < count; i++) {
+		struct ionss_stat_chunk *chunk = &job->chunks[i];
+
+		chunk->op.fn = ionss_stat_chunk_run;
+		chunk->job = job;
+		chunk->start = i * IONSS_STAT_CHUNK;
+		chunk->end = chunk->start + IONSS_STAT_CHUNK;
+		if (chunk->end > job->count)
+			chunk->end = job->count;
+	}
+
+	/* Submission only fails if there is no lane, so once the first chunk
+	 * is queued all of them are.
+	 */
+	for (i = 0; i < count; i++)
+		ionss_lane_submit(lane, &job->chunks[i].op);
+
+	return -DER_SUCCESS;
+}
+
+void ionss_stat_job_run(struct ionss_stat_job *job)
+{
+	ionss_stat_range(job->fd, job->replies, 0, job->count);
+	job->cb(job);
+}
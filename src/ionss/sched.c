@@ -0,0 +1,251 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Fair share scheduling of queued i/o requests.
+ *
+ * When there are no active read or write slots available requests are
+ * queued, and previously this was a single FIFO per projection so one client
+ * with many outstanding requests could delay all others.  Requests are now
+ * queued per client and serviced using deficit round robin, which shares the
+ * available bandwidth between clients in proportion to their weights
+ * regardless of request size or count.
+ */
+
+#include "ionss.h"
+#include "log.h"
+
+void ionss_sched_init(struct ionss_sched *sched, uint64_t quantum,
+		      struct ionss_client_weights *weights,
+		      uint64_t (*cost)(struct ionss_io_req_desc *))
+{
+	D_INIT_LIST_HEAD(&sched->active);
+	D_INIT_LIST_HEAD(&sched->idle);
+	D_INIT_LIST_HEAD(&sched->overflow.link);
+	D_INIT_LIST_HEAD(&sched->overflow.queue);
+	sched->overflow.deficit = 0;
+	sched->overflow.weight = 1;
+	sched->overflow.rank = IONSS_NO_RANK;
+	D_INIT_LIST_HEAD(&sched->free);
+	sched->weights = weights;
+	sched->cost = cost;
+	sched->quantum = quantum ? quantum : 1;
+	sched->depth = 0;
+}
+
+void ionss_sched_fini(struct ionss_sched *sched)
+{
+	struct ionss_sched_client *client, *next;
+	struct ionss_sched_entry *entry;
+
+	d_list_for_each_entry_safe(client, next, &sched->active, link) {
+		IOF_TRACE_WARNING(sched, "Client %u has queued requests",
+				  client->rank);
+		d_list_del(&client->link);
+		if (client != &sched->overflow)
+			D_FREE(client);
+	}
+
+	d_list_for_each_entry_safe(client, next, &sched->idle, link) {
+		d_list_del(&client->link);
+		D_FREE(client);
+	}
+
+	while ((entry = d_list_pop_entry(&sched->free,
+					 struct ionss_sched_entry, link)))
+		D_FREE(entry);
+}
+
+static uint32_t
+client_weight(struct ionss_sched *sched, d_rank_t rank)
+{
+	int i;
+
+	if (!sched->weights)
+		return 1;
+
+	for (i = 0; i < sched->weights->count; i++) {
+		if (sched->weights->entries[i].rank == rank)
+			return sched->weights->entries[i].weight;
+	}
+	return 1;
+}
+
+int ionss_sched_enqueue(struct ionss_sched *sched,
+			struct ionss_io_req_desc *desc, d_rank_t rank)
+{
+	struct ionss_sched_client *client;
+	struct ionss_sched_entry *entry;
+
+	entry = d_list_pop_entry(&sched->free, struct ionss_sched_entry, link);
+	if (!entry) {
+		D_ALLOC_PTR(entry);
+		if (!entry)
+			return -DER_NOMEM;
+	}
+
+	entry->desc = desc;
+	entry->queued = ionss_aimd_now();
+
+	d_list_for_each_entry(client, &sched->active, link) {
+		if (client->rank == rank)
+			goto queue;
+	}
+
+	client = d_list_pop_entry(&sched->idle, struct ionss_sched_client,
+				  link);
+	if (!client) {
+		D_ALLOC_PTR(client);
+		if (!client) {
+			/* Fall back to sharing a single queue, which may be
+			 * unfair but is still correct.
+			 */
+			client = &sched->overflow;
+			if (d_list_empty(&client->queue))
+				d_list_add_tail(&client->link,
+						&sched->active);
+			goto queue;
+		}
+		D_INIT_LIST_HEAD(&client->queue);
+	}
+
+	client->rank = rank;
+	client->weight = client_weight(sched, rank);
+	client->deficit = 0;
+	d_list_add_tail(&client->link, &sched->active);
+
+queue:
+	d_list_add_tail(&entry->link, &client->queue);
+	sched->depth++;
+
+	return -DER_SUCCESS;
+}
+
+/* Remove an entry from a client queue, returning it to the free list */
+static struct ionss_io_req_desc *
+sched_remove(struct ionss_sched *sched, struct ionss_sched_client *client,
+	     struct ionss_sched_entry *entry, uint64_t *queued)
+{
+	d_list_move(&entry->link, &sched->free);
+	sched->depth--;
+
+	/* Idle clients do not accumulate credit */
+	if (d_list_empty(&client->queue)) {
+		d_list_del_init(&client->link);
+		client->deficit = 0;
+		if (client != &sched->overflow)
+			d_list_add(&client->link, &sched->idle);
+	}
+
+	*queued = entry->queued;
+	return entry->desc;
+}
+
+struct ionss_io_req_desc *ionss_sched_dequeue(struct ionss_sched *sched,
+					      uint64_t *queued)
+{
+	struct ionss_sched_client *client;
+	struct ionss_sched_entry *entry;
+	uint64_t cost;
+
+	if (d_list_empty(&sched->active))
+		return NULL;
+
+	/* The client at the head of the list is serviced until its next
+	 * request no longer fits within its deficit, at which point it moves
+	 * to the back and the next client receives its quantum.  As every
+	 * client gains at least one byte per round this terminates.
+	 */
+	for (;;) {
+		client = d_list_entry(sched->active.next,
+				      struct ionss_sched_client, link);
+		entry = d_list_entry(client->queue.next,
+				     struct ionss_sched_entry, link);
+		cost = sched->cost(entry->desc);
+		if (cost <= client->deficit)
+			break;
+
+		d_list_move_tail(&client->link, &sched->active);
+		client = d_list_entry(sched->active.next,
+				      struct ionss_sched_client, link);
+		client->deficit += sched->quantum * client->weight;
+	}
+
+	client->deficit -= cost;
+
+	return sched_remove(sched, client, entry, queued);
+}
+
+struct ionss_io_req_desc *
+ionss_sched_take(struct ionss_sched *sched, d_rank_t rank,
+		 int (*match)(struct ionss_io_req_desc *, void *), void *arg,
+		 uint64_t *queued)
+{
+	struct ionss_sched_client *client;
+	struct ionss_sched_entry *entry;
+	uint64_t cost;
+	int rc;
+
+	d_list_for_each_entry(client, &sched->active, link) {
+		if (client->rank == rank)
+			goto found;
+	}
+	return NULL;
+
+found:
+	d_list_for_each_entry(entry, &client->queue, link) {
+		rc = match(entry->desc, arg);
+		if (rc < 0)
+			return NULL;
+		if (rc > 0)
+			goto take;
+	}
+	return NULL;
+
+take:
+	/* Charge the client as if the request had been dequeued normally, but
+	 * without the deficit wrapping so that it is simply serviced later in
+	 * the next round.
+	 */
+	cost = sched->cost(entry->desc);
+	if (cost < client->deficit)
+		client->deficit -= cost;
+	else
+		client->deficit = 0;
+
+	return sched_remove(sched, client, entry, queued);
+}
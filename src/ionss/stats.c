@@ -0,0 +1,212 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-operation counters and latency histograms.
+ *
+ * Every RPC received is counted against its opcode, and the time spent in
+ * each phase of processing is added to a log2 histogram.  Each thread
+ * updates its own shard of the counters, so updates are relaxed atomic adds
+ * to cachelines which are not normally shared with other threads, and the
+ * shards are summed when the statistics are read.  Threads share a shard
+ * only if there are more threads than shards.
+ */
+
+#include <string.h>
+
+#include "ionss.h"
+#include "log.h"
+
+/* Index of the shard used by this thread, plus one so zero is unassigned */
+static __thread uint32_t stats_shard;
+
+static struct ionss_op_stats *
+stats_get(struct ionss_stats *stats, int op)
+{
+	if (!stats_shard)
+		stats_shard = (atomic_fetch_add(&stats->next_shard, 1) %
+			       IONSS_STATS_SHARDS) + 1;
+
+	return &stats->shards[stats_shard - 1].ops[op];
+}
+
+void ionss_stats_count(struct ionss_stats *stats, int op)
+{
+	atomic_inc(&stats_get(stats, op)->count);
+}
+
+static int
+stats_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int bucket;
+
+	if (us == 0)
+		return 0;
+
+	bucket = 64 - __builtin_clzll(us);
+	if (bucket >= IOF_STATS_BUCKETS)
+		bucket = IOF_STATS_BUCKETS - 1;
+	return bucket;
+}
+
+void ionss_stats_record(struct ionss_stats *stats, int op,
+			enum iof_stats_phase phase, uint64_t start)
+{
+	struct ionss_op_stats *s;
+	uint64_t now;
+	uint64_t ns;
+
+	if (!start)
+		return;
+
+	now = ionss_aimd_now();
+	ns = now > start ? now - start : 0;
+
+	s = stats_get(stats, op);
+	atomic_inc(&s->samples[phase]);
+	atomic_add(&s->total_ns[phase], ns);
+	atomic_inc(&s->hist[phase][stats_bucket(ns)]);
+}
+
+static void
+stats_read_lane(struct ionss_lane *lane, struct iof_lane_stats *out)
+{
+	struct ionss_lane_stats stats;
+
+	ionss_lane_get_stats(lane, &stats);
+	out->ops = stats.ops;
+	out->wait_ns = stats.wait_ns;
+	out->max_wait_ns = stats.max_wait_ns;
+	out->yields = stats.yields;
+	out->depth = stats.depth;
+	out->max_depth = stats.max_depth;
+}
+
+static void
+stats_read_projection(struct ios_projection *projection,
+		      struct iof_projection_stats *ps)
+{
+	memset(ps, 0, sizeof(*ps));
+
+	if (!projection->active)
+		return;
+
+	ps->read_bytes = atomic_load_consume(&projection->read_bytes);
+	ps->write_bytes = atomic_load_consume(&projection->write_bytes);
+
+	D_MUTEX_LOCK(&projection->lock);
+	ps->read_queued = projection->read_sched.depth;
+	ps->read_active = projection->current_read_count;
+	ps->write_queued = projection->write_sched.depth;
+	ps->write_active = projection->current_write_count;
+	D_MUTEX_UNLOCK(&projection->lock);
+
+	ps->read_limit = ionss_aimd_limit(&projection->read_ctl);
+	ps->write_limit = ionss_aimd_limit(&projection->write_ctl);
+
+	ionss_cache_read_stats(projection->cache, ps);
+
+	stats_read_lane(projection->data_lane, &ps->data_lane);
+}
+
+/* Add the counters from one shard to the output, which has been zeroed */
+static void
+stats_read_shard(struct ionss_stats_shard *shard, struct iof_ionss_stats *out)
+{
+	struct ionss_op_stats *s;
+	struct iof_op_stats *o;
+	int phase;
+	int op;
+	int i;
+
+	for (op = 0; op < IOF_RPC_COUNT; op++) {
+		s = &shard->ops[op];
+		o = &out->ops[op];
+
+		o->count += atomic_load_consume(&s->count);
+		for (phase = 0; phase < IOF_STATS_PHASES; phase++) {
+			o->samples[phase] +=
+				atomic_load_consume(&s->samples[phase]);
+			o->total_ns[phase] +=
+				atomic_load_consume(&s->total_ns[phase]);
+			for (i = 0; i < IOF_STATS_BUCKETS; i++)
+				o->hist[phase][i] +=
+					atomic_load_consume(&s->hist[phase][i]);
+		}
+	}
+}
+
+size_t ionss_stats_read(struct ios_base *b, void *buf, size_t len)
+{
+	struct iof_ionss_stats *out = buf;
+	struct ionss_fdm_stats fdm;
+	uint32_t count = b->projection_count;
+	int shard;
+	int i;
+
+	if (len < sizeof(*out))
+		return 0;
+
+	if (count > (len - sizeof(*out)) / sizeof(out->projections[0]))
+		count = (len - sizeof(*out)) / sizeof(out->projections[0]);
+
+	memset(out, 0, sizeof(*out));
+	out->timestamp = ionss_aimd_now();
+	out->op_count = IOF_RPC_COUNT;
+	out->projection_count = count;
+
+	ionss_fdm_read_stats(&b->fdm, &fdm);
+	out->fd_open = fdm.open_count;
+	out->fd_max = fdm.max_open;
+	out->fd_reopens = fdm.reopens;
+	out->fd_evictions = fdm.evictions;
+
+	iof_bulk_usage(&out->bulk_registered, &out->bulk_in_use);
+
+	stats_read_lane(b->meta_lane, &out->meta_lane);
+	stats_read_lane(b->stat_lane, &out->stat_lane);
+
+	for (shard = 0; shard < IONSS_STATS_SHARDS; shard++)
+		stats_read_shard(&b->stats.shards[shard], out);
+
+	for (i = 0; i < count; i++)
+		stats_read_projection(&b->projection_array[i],
+				      &out->projections[i]);
+
+	return sizeof(*out) + sizeof(out->projections[0]) * count;
+}
@@ -0,0 +1,415 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Minimal io_uring support for the IONSS data path.
+ *
+ * The IONSS does not depend on liburing so this file talks to the kernel
+ * directly using the raw system calls and the ring layout described in
+ * <linux/io_uring.h>.  Only the features needed by the read/write pipelines
+ * are implemented: single read and write requests, submitted from whichever
+ * thread is processing the RPC and reaped from the progress loop.
+ *
+ * If io_uring is not available at build time, or at runtime, then
+ * ionss_uring_init() fails and the caller falls back to synchronous I/O.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/syscall.h>
+
+#include "iof_common.h"
+#include "ionss.h"
+#include "log.h"
+
+#if HAVE_IO_URING && defined(__NR_io_uring_setup)
+
+#include <linux/io_uring.h>
+
+/* Maximum number of completions to process in one call to reap */
+#define IONSS_URING_REAP_BATCH 16
+
+struct ionss_uring {
+	pthread_mutex_t		sq_lock;
+	pthread_mutex_t		cq_lock;
+	ATOMIC int		inflight;
+	int			fd;
+	/* Size of the completion queue, which bounds inflight */
+	unsigned int		cq_entries;
+
+	/* Submission queue */
+	void			*sq_ring;
+	size_t			sq_ring_size;
+	unsigned int		*sq_head;
+	unsigned int		*sq_tail;
+	unsigned int		*sq_mask;
+	unsigned int		*sq_entries;
+	unsigned int		*sq_array;
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_size;
+
+	/* Completion queue */
+	void			*cq_ring;
+	size_t			cq_ring_size;
+	unsigned int		*cq_head;
+	unsigned int		*cq_tail;
+	unsigned int		*cq_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static void
+uring_unmap(struct ionss_uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+}
+
+int
+ionss_uring_init(struct ionss_uring **ringp, unsigned int entries)
+{
+	struct io_uring_params p = {0};
+	struct ionss_uring *ring;
+	void *ptr;
+	int rc;
+
+	*ringp = NULL;
+
+	D_ALLOC_PTR(ring);
+	if (!ring)
+		return -DER_NOMEM;
+
+	errno = 0;
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		IOF_LOG_WARNING("io_uring_setup() failed %d %s", errno,
+				strerror(errno));
+		D_FREE(ring);
+		return -DER_NOSYS;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries *
+		sizeof(unsigned int);
+	ptr = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED)
+		D_GOTO(err, rc = -DER_NOMEM);
+	ring->sq_ring = ptr;
+
+	ring->sq_head = ptr + p.sq_off.head;
+	ring->sq_tail = ptr + p.sq_off.tail;
+	ring->sq_mask = ptr + p.sq_off.ring_mask;
+	ring->sq_entries = ptr + p.sq_off.ring_entries;
+	ring->sq_array = ptr + p.sq_off.array;
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptr = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ptr == MAP_FAILED)
+		D_GOTO(err, rc = -DER_NOMEM);
+	ring->sqes = ptr;
+
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries *
+		sizeof(struct io_uring_cqe);
+	ptr = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	if (ptr == MAP_FAILED)
+		D_GOTO(err, rc = -DER_NOMEM);
+	ring->cq_ring = ptr;
+
+	ring->cq_head = ptr + p.cq_off.head;
+	ring->cq_tail = ptr + p.cq_off.tail;
+	ring->cq_mask = ptr + p.cq_off.ring_mask;
+	ring->cqes = ptr + p.cq_off.cqes;
+	ring->cq_entries = p.cq_entries;
+
+	rc = D_MUTEX_INIT(&ring->sq_lock, NULL);
+	if (rc != -DER_SUCCESS)
+		D_GOTO(err, rc);
+
+	rc = D_MUTEX_INIT(&ring->cq_lock, NULL);
+	if (rc != -DER_SUCCESS) {
+		pthread_mutex_destroy(&ring->sq_lock);
+		D_GOTO(err, rc);
+	}
+
+	IOF_LOG_INFO("io_uring created with %u/%u entries", p.sq_entries,
+		     p.cq_entries);
+
+	*ringp = ring;
+	return -DER_SUCCESS;
+
+err:
+	uring_unmap(ring);
+	close(ring->fd);
+	D_FREE(ring);
+	return rc;
+}
+
+void
+ionss_uring_drain(struct ionss_uring *ring)
+{
+	int rc;
+
+	if (!ring)
+		return;
+
+	while (atomic_load_consume(&ring->inflight) != 0) {
+		errno = 0;
+		rc = sys_io_uring_enter(ring->fd, 0, 1,
+					IORING_ENTER_GETEVENTS);
+		if (rc < 0 && errno != EINTR) {
+			IOF_LOG_ERROR("io_uring_enter() failed %d %s", errno,
+				      strerror(errno));
+			return;
+		}
+		ionss_uring_reap(ring);
+	}
+}
+
+void
+ionss_uring_fini(struct ionss_uring *ring)
+{
+	if (!ring)
+		return;
+
+	/* Requests should have been reaped by the progress threads before
+	 * they exited, but wait for any stragglers so that their callbacks
+	 * run and the buffers are not unmapped underneath the kernel.
+	 */
+	if (ring->inflight) {
+		IOF_LOG_WARNING("Closing io_uring with %d requests in flight",
+				ring->inflight);
+		ionss_uring_drain(ring);
+	}
+
+	uring_unmap(ring);
+	close(ring->fd);
+	pthread_mutex_destroy(&ring->cq_lock);
+	pthread_mutex_destroy(&ring->sq_lock);
+	D_FREE(ring);
+}
+
+/* Queue a single request and pass it to the kernel.
+ *
+ * Returns -DER_AGAIN if the submission queue is full, or if there are already
+ * as many requests in flight as the completion queue can hold, in which case
+ * the caller should perform the I/O synchronously.
+ */
+static int
+uring_submit(struct ionss_uring *ring, struct ionss_uring_op *op, int opcode,
+	     int fd, void *buf, size_t len, off_t offset)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int idx;
+	int rc;
+
+	D_MUTEX_LOCK(&ring->sq_lock);
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	tail = *ring->sq_tail;
+	if (tail - head >= *ring->sq_entries ||
+	    (unsigned int)atomic_load_consume(&ring->inflight) >=
+	    ring->cq_entries) {
+		D_MUTEX_UNLOCK(&ring->sq_lock);
+		return -DER_AGAIN;
+	}
+
+	idx = tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = (uint64_t)op;
+	ring->sq_array[idx] = idx;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	atomic_inc(&ring->inflight);
+
+	errno = 0;
+	rc = sys_io_uring_enter(ring->fd, 1, 0, 0);
+	if (rc != 1) {
+		/* The kernel did not consume the entry, so rewind the tail
+		 * to remove it from the ring.
+		 */
+		IOF_LOG_WARNING("io_uring_enter() failed %d %d", rc, errno);
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+		atomic_fetch_sub(&ring->inflight, 1);
+		D_MUTEX_UNLOCK(&ring->sq_lock);
+		return -DER_AGAIN;
+	}
+
+	D_MUTEX_UNLOCK(&ring->sq_lock);
+
+	return -DER_SUCCESS;
+}
+
+int
+ionss_uring_read(struct ionss_uring *ring, struct ionss_uring_op *op,
+		 int fd, void *buf, size_t len, off_t offset)
+{
+	return uring_submit(ring, op, IORING_OP_READ, fd, buf, len, offset);
+}
+
+int
+ionss_uring_write(struct ionss_uring *ring, struct ionss_uring_op *op,
+		  int fd, const void *buf, size_t len, off_t offset)
+{
+	return uring_submit(ring, op, IORING_OP_WRITE, fd, (void *)buf, len,
+			    offset);
+}
+
+int
+ionss_uring_reap(struct ionss_uring *ring)
+{
+	struct ionss_uring_op *ops[IONSS_URING_REAP_BATCH];
+	int res[IONSS_URING_REAP_BATCH];
+	unsigned int head;
+	unsigned int tail;
+	int count = 0;
+	int i;
+
+	if (!ring || atomic_load_consume(&ring->inflight) == 0)
+		return 0;
+
+	D_MUTEX_LOCK(&ring->cq_lock);
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail && count < IONSS_URING_REAP_BATCH) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+		ops[count] = (struct ionss_uring_op *)cqe->user_data;
+		res[count] = cqe->res;
+		count++;
+		head++;
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	D_MUTEX_UNLOCK(&ring->cq_lock);
+
+	if (count)
+		atomic_fetch_sub(&ring->inflight, count);
+
+	/* Invoke the callbacks without holding the lock as they will
+	 * typically submit further I/O or bulk transfers.
+	 */
+	for (i = 0; i < count; i++)
+		ops[i]->cb(ops[i], res[i]);
+
+	return count;
+}
+
+bool
+ionss_uring_busy(struct ionss_uring *ring)
+{
+	return ring && atomic_load_consume(&ring->inflight) != 0;
+}
+
+#else
+
+int
+ionss_uring_init(struct ionss_uring **ringp, unsigned int entries)
+{
+	*ringp = NULL;
+	IOF_LOG_WARNING("IONSS built without io_uring support");
+	return -DER_NOSYS;
+}
+
+void
+ionss_uring_drain(struct ionss_uring *ring)
+{
+}
+
+void
+ionss_uring_fini(struct ionss_uring *ring)
+{
+}
+
+int
+ionss_uring_read(struct ionss_uring *ring, struct ionss_uring_op *op,
+		 int fd, void *buf, size_t len, off_t offset)
+{
+	return -DER_NOSYS;
+}
+
+int
+ionss_uring_write(struct ionss_uring *ring, struct ionss_uring_op *op,
+		  int fd, const void *buf, size_t len, off_t offset)
+{
+	return -DER_NOSYS;
+}
+
+int
+ionss_uring_reap(struct ionss_uring *ring)
+{
+	return 0;
+}
+
+bool
+ionss_uring_busy(struct ionss_uring *ring)
+{
+	return false;
+}
+
+#endif
@@ -37,6 +37,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <CUnit/Basic.h>
 
 #include <ios_gah.h>
@@ -195,6 +196,104 @@ static void test_ios_gah_misc(void)
 	free(ios_gah);
 }
 
+#define THREAD_COUNT 8
+#define THREAD_HANDLES (1024 * 4)
+
+/* CUnit is not thread safe so worker threads count failures, and the main
+ * thread checks them once the workers have been joined.
+ */
+struct gah_thread_args {
+	struct ios_gah_store	*ios_gah_store;
+	pthread_t		thread;
+	int			failures;
+};
+
+#define GAH_THREAD_CHECK(args, cond)		\
+	do {					\
+		if (!(cond))			\
+			(args)->failures++;	\
+	} while (0)
+
+static void *gah_thread(void *arg)
+{
+	struct gah_thread_args *args = arg;
+	struct ios_gah_store *ios_gah_store = args->ios_gah_store;
+	struct ios_gah *ios_gah;
+	int ii, jj;
+
+	ios_gah = calloc(THREAD_HANDLES, sizeof(struct ios_gah));
+	if (!ios_gah) {
+		args->failures++;
+		return NULL;
+	}
+
+	for (jj = 0; jj < 10; jj++) {
+		for (ii = 0; ii < THREAD_HANDLES; ii++) {
+			void *info = NULL;
+
+			GAH_THREAD_CHECK(args,
+					 ios_gah_allocate(ios_gah_store,
+							  ios_gah + ii,
+							  ios_gah + ii)
+					 == -DER_SUCCESS);
+			GAH_THREAD_CHECK(args,
+					 ios_gah_get_info(ios_gah_store,
+							  ios_gah + ii, &info)
+					 == -DER_SUCCESS);
+			GAH_THREAD_CHECK(args, info == ios_gah + ii);
+		}
+
+		for (ii = 0; ii < THREAD_HANDLES; ii++) {
+			void *info = NULL;
+
+			GAH_THREAD_CHECK(args,
+					 ios_gah_deallocate(ios_gah_store,
+							    ios_gah + ii)
+					 == -DER_SUCCESS);
+			GAH_THREAD_CHECK(args,
+					 ios_gah_deallocate(ios_gah_store,
+							    ios_gah + ii)
+					 == -DER_NONEXIST);
+			GAH_THREAD_CHECK(args,
+					 ios_gah_get_info(ios_gah_store,
+							  ios_gah + ii, &info)
+					 == -DER_NONEXIST);
+		}
+	}
+
+	free(ios_gah);
+	return NULL;
+}
+
+/** test concurrent use of the store from multiple threads */
+static void test_ios_gah_threads(void)
+{
+	struct ios_gah_store *ios_gah_store;
+	struct gah_thread_args args[THREAD_COUNT] = {0};
+	int started;
+	int ii;
+
+	ios_gah_store = ios_gah_init(4);
+	CU_ASSERT_FATAL(ios_gah_store != NULL);
+
+	for (started = 0; started < THREAD_COUNT; started++) {
+		args[started].ios_gah_store = ios_gah_store;
+		if (pthread_create(&args[started].thread, NULL, gah_thread,
+				   &args[started]) != 0)
+			break;
+	}
+
+	for (ii = 0; ii < started; ii++)
+		pthread_join(args[ii].thread, NULL);
+
+	CU_ASSERT(started == THREAD_COUNT);
+	for (ii = 0; ii < started; ii++)
+		CU_ASSERT(args[ii].failures == 0);
+
+	CU_ASSERT(ios_gah_store->size == 0);
+	CU_ASSERT(ios_gah_destroy(ios_gah_store) == -DER_SUCCESS);
+}
+
 int main(int argc, char **argv)
 {
 	CU_pSuite pSuite = NULL;
@@ -214,7 +313,9 @@ int main(int argc, char **argv)
 		    test_ios_gah_allocate) ||
 	    !CU_add_test(pSuite, "ios_gah_destroy() test",
 		    test_ios_gah_destroy) ||
-	    !CU_add_test(pSuite, "ios_gah_misc test", test_ios_gah_misc)) {
+	    !CU_add_test(pSuite, "ios_gah_misc test", test_ios_gah_misc) ||
+	    !CU_add_test(pSuite, "ios_gah threaded test",
+		    test_ios_gah_threads)) {
 		CU_cleanup_registry();
 		return CU_get_error();
 	}
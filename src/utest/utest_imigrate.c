@@ -0,0 +1,157 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include <iof_common.h>
+
+int init_suite(void)
+{
+	return CUE_SUCCESS;
+}
+
+int clean_suite(void)
+{
+	return CUE_SUCCESS;
+}
+
+#define ENTRIES 64
+
+static void fill_entries(struct iof_imigrate_ent *ents, int count)
+{
+	int i;
+
+	memset(ents, 0, sizeof(*ents) * count);
+	for (i = 0; i < count; i++) {
+		snprintf(ents[i].name, sizeof(ents[i].name), "dir_%d", i * 31);
+		ents[i].inode = 0x100000000ULL + i;
+		ents[i].parent = i ? (i - 1) / 2 : -1;
+		ents[i].gah.revision = i;
+	}
+	/* An entry with no name, to be found by inode only */
+	ents[count - 1].name[0] = '\0';
+}
+
+/** test that batched imigrate entries round-trip */
+static void test_iof_imigrate_encode(void)
+{
+	struct iof_imigrate_ent in[ENTRIES];
+	struct iof_imigrate_ent out[ENTRIES];
+	char buf[ENTRIES * 64];
+	size_t len = 0;
+	size_t used;
+	int i;
+
+	fill_entries(in, ENTRIES);
+
+	for (i = 0; i < ENTRIES; i++) {
+		used = iof_imigrate_encode(&in[i], buf + len,
+					   sizeof(buf) - len);
+		CU_ASSERT(used == iof_imigrate_ent_size(&in[i]));
+		len += used;
+	}
+
+	CU_ASSERT(iof_imigrate_decode(buf, len, ENTRIES, out) ==
+		  -DER_SUCCESS);
+
+	for (i = 0; i < ENTRIES; i++) {
+		CU_ASSERT_STRING_EQUAL(in[i].name, out[i].name);
+		CU_ASSERT(in[i].inode == out[i].inode);
+		CU_ASSERT(in[i].parent == out[i].parent);
+		CU_ASSERT(in[i].gah.revision == out[i].gah.revision);
+	}
+
+	/* A short buffer should fail to decode */
+	CU_ASSERT(iof_imigrate_decode(buf, len - 1, ENTRIES, out) ==
+		  -DER_PROTO);
+
+	/* An entry that does not fit should not be encoded */
+	CU_ASSERT(iof_imigrate_encode(&in[0], buf,
+				      iof_imigrate_ent_size(&in[0]) - 1) == 0);
+}
+
+/** test that entries referring forward to a parent are rejected */
+static void test_iof_imigrate_parent(void)
+{
+	struct iof_imigrate_ent in[2];
+	struct iof_imigrate_ent out[2];
+	char buf[256];
+	size_t len;
+
+	fill_entries(in, 2);
+	in[0].parent = 1;
+
+	len = iof_imigrate_encode(&in[0], buf, sizeof(buf));
+	len += iof_imigrate_encode(&in[1], buf + len, sizeof(buf) - len);
+
+	CU_ASSERT(iof_imigrate_decode(buf, len, 2, out) == -DER_PROTO);
+
+	in[0].parent = 0;
+	len = iof_imigrate_encode(&in[0], buf, sizeof(buf));
+	CU_ASSERT(iof_imigrate_decode(buf, len, 1, out) == -DER_PROTO);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite pSuite = NULL;
+
+	if (CU_initialize_registry() != CUE_SUCCESS)
+		return CU_get_error();
+	pSuite = CU_add_suite("iof_imigrate encoding test", init_suite,
+			      clean_suite);
+	if (!pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (!CU_add_test(pSuite, "iof_imigrate encode test",
+			 test_iof_imigrate_encode) ||
+	    !CU_add_test(pSuite, "iof_imigrate parent test",
+			 test_iof_imigrate_parent)) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
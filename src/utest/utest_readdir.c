@@ -0,0 +1,164 @@
+/* Copyright (C) 2018 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted for any purpose (including commercial purposes)
+ * provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the
+ *    documentation and/or materials provided with the distribution.
+ *
+ * 3. In addition, redistributions of modified forms of the source or binary
+ *    code must carry prominent notices stating that the original code was
+ *    changed and the date of the change.
+ *
+ *  4. All publications or advertising materials mentioning features or use of
+ *     this software are asked, but not required, to acknowledge that it was
+ *     developed by Intel Corporation and credit the contributors.
+ *
+ * 5. Neither the name of Intel Corporation, nor the name of any Contributor
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include <iof_common.h>
+
+int init_suite(void)
+{
+	return CUE_SUCCESS;
+}
+
+int clean_suite(void)
+{
+	return CUE_SUCCESS;
+}
+
+#define ENTRIES 64
+
+static void fill_replies(struct iof_readdir_reply *replies, int count)
+{
+	int i;
+
+	memset(replies, 0, sizeof(*replies) * count);
+	for (i = 0; i < count; i++) {
+		snprintf(replies[i].d_name, sizeof(replies[i].d_name),
+			 "file_%d", i * 997);
+		replies[i].stat.st_ino = 1000 + i;
+		replies[i].stat.st_mode = 0100644;
+		/* Offsets from getdents64 are hashes on some filesystems so
+		 * are not always increasing.
+		 */
+		replies[i].nextoff = (i & 1) ? 0x7fffffffffff0000 - i : i * 3;
+	}
+	replies[count - 1].stat_rc = ENOENT;
+}
+
+/** test that the compact readdir format round-trips */
+static void test_iof_readdir_encode(void)
+{
+	struct iof_readdir_reply in[ENTRIES];
+	struct iof_readdir_reply out[ENTRIES];
+	char buf[ENTRIES * 64];
+	size_t expected = 0;
+	size_t len;
+	off_t prev = 42;
+	int i;
+
+	fill_replies(in, ENTRIES);
+
+	for (i = 0; i < ENTRIES; i++) {
+		expected += iof_readdir_ent_size(&in[i], prev);
+		prev = in[i].nextoff;
+	}
+
+	len = iof_readdir_encode(in, ENTRIES, 42, buf, sizeof(buf));
+	CU_ASSERT(len == expected);
+	CU_ASSERT(len < sizeof(struct iof_readdir_reply) * ENTRIES);
+
+	CU_ASSERT(iof_readdir_decode(buf, len, ENTRIES, 42, out) ==
+		  -DER_SUCCESS);
+
+	for (i = 0; i < ENTRIES; i++) {
+		CU_ASSERT_STRING_EQUAL(in[i].d_name, out[i].d_name);
+		CU_ASSERT(in[i].nextoff == out[i].nextoff);
+		CU_ASSERT(in[i].stat.st_ino == out[i].stat.st_ino);
+		CU_ASSERT(in[i].stat.st_mode == out[i].stat.st_mode);
+		CU_ASSERT(in[i].stat_rc == out[i].stat_rc);
+		CU_ASSERT(out[i].read_rc == 0);
+	}
+
+	/* A short buffer should fail to decode */
+	CU_ASSERT(iof_readdir_decode(buf, len - 1, ENTRIES, 42, out) ==
+		  -DER_PROTO);
+}
+
+/** test that encoding stops at the end of the buffer */
+static void test_iof_readdir_limit(void)
+{
+	struct iof_readdir_reply in[ENTRIES];
+	struct iof_readdir_reply out[ENTRIES];
+	char buf[ENTRIES * 64];
+	size_t expected;
+	size_t len;
+
+	fill_replies(in, ENTRIES);
+
+	in[1].read_rc = EIO;
+	expected = iof_readdir_ent_size(&in[0], 0) +
+		iof_readdir_ent_size(&in[1], in[0].nextoff);
+
+	/* Only the first two entries will fit */
+	len = iof_readdir_encode(in, ENTRIES, 0, buf, expected + 1);
+	CU_ASSERT(len == expected);
+
+	CU_ASSERT(iof_readdir_decode(buf, len, 2, 0, out) == -DER_SUCCESS);
+	CU_ASSERT(out[1].read_rc == EIO);
+	CU_ASSERT(out[1].stat_rc == 0);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite pSuite = NULL;
+
+	if (CU_initialize_registry() != CUE_SUCCESS)
+		return CU_get_error();
+	pSuite = CU_add_suite("iof_readdir encoding test", init_suite,
+			      clean_suite);
+	if (!pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (!CU_add_test(pSuite, "iof_readdir encode test",
+			 test_iof_readdir_encode) ||
+	    !CU_add_test(pSuite, "iof_readdir limit test",
+			 test_iof_readdir_limit)) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -64,8 +64,12 @@ from distutils.spawn import find_executable
 #pylint: enable=import-error
 #pylint: enable=no-name-in-module
 import operator
+import ctypes
 
 
+# enum iof_bypass_status value for a file handled by the interception library
+IOF_IO_BYPASS = 1
+
 IMPORT_MNT = None
 CTRL_DIR = None
 
@@ -507,6 +511,236 @@ class CnssChecks(iof_ionss_verify.IonssVerify,
         if self.test_local:
             self.verify_file_copy()
 
+    @unittest.skipUnless(hasattr(os, 'copy_file_range'),
+                         "copy_file_range not available")
+    def test_file_copy_range(self):
+        """Copy a range between two files in a projection"""
+
+        src_name = os.path.join(self.import_dir, 'copy_range_src')
+        dst_name = os.path.join(self.import_dir, 'copy_range_dst')
+
+        data = os.urandom(256 * 1024)
+
+        src = os.open(src_name, os.O_RDWR|os.O_CREAT)
+        dst = os.open(dst_name, os.O_RDWR|os.O_CREAT)
+        os.write(src, data)
+
+        # Copy the second half of the source to an offset in the
+        # destination, looping on short copies.
+        src_off = len(data) // 2
+        dst_off = 4096
+        while src_off < len(data):
+            copied = os.copy_file_range(src, dst, len(data) - src_off,
+                                        src_off, dst_off)
+            if copied == 0:
+                self.fail("copy_file_range stopped at %d" % src_off)
+            src_off += copied
+            dst_off += copied
+
+        # Copying from past the end of the source copies nothing.
+        copied = os.copy_file_range(src, dst, 4096, len(data), 0)
+        if copied != 0:
+            self.fail("Copied %d bytes from past end of file" % copied)
+
+        os.close(src)
+        os.close(dst)
+
+        if os.stat(dst_name).st_size != 4096 + len(data) // 2:
+            self.fail("Destination size incorrect %d" %
+                      os.stat(dst_name).st_size)
+
+        with open(dst_name, 'rb') as fd:
+            fd.seek(4096)
+            if fd.read() != data[len(data) // 2:]:
+                self.fail("Destination contents incorrect")
+
+        os.unlink(src_name)
+        os.unlink(dst_name)
+
+    def test_file_fallocate(self):
+        """Allocate space for a file"""
+
+        filename = os.path.join(self.import_dir, 'fallocate_file')
+
+        fd = os.open(filename, os.O_RDWR|os.O_CREAT)
+        os.posix_fallocate(fd, 0, 1024 * 1024)
+        size = os.fstat(fd).st_size
+        os.close(fd)
+
+        if size != 1024 * 1024:
+            self.fail("File size after fallocate incorrect %d" % size)
+
+        os.unlink(filename)
+
+    def projection_stat(self, name):
+        """Return the value of a CNSS stat for the projection holding
+        import_dir, or None if it cannot be found"""
+
+        projs_dir = os.path.join(CTRL_DIR, 'iof', 'projections')
+        for proj in os.listdir(projs_dir):
+            with open(os.path.join(projs_dir, proj, 'mount_point'), 'r') as f:
+                mount_point = f.read().strip()
+            if not self.import_dir.startswith(mount_point):
+                continue
+            stat_file = os.path.join(projs_dir, proj, 'stats', name)
+            if not os.path.exists(stat_file):
+                return None
+            with open(stat_file, 'r') as f:
+                return int(f.read())
+        return None
+
+    @staticmethod
+    def ioil_handle():
+        """Return a handle to the interception library if it is loaded
+        into this process, otherwise None"""
+
+        lib = ctypes.CDLL(None, use_errno=True)
+        if not hasattr(lib, 'iof_get_bypass_status'):
+            return None
+        return lib
+
+    @unittest.skipUnless(hasattr(os, 'preadv'), "preadv not available")
+    def test_file_preadv_pwritev(self):
+        """Vectored read and write of a file in a projection"""
+
+        filename = os.path.join(self.import_dir, 'vector_file')
+
+        bufs = [os.urandom(4096), os.urandom(512), os.urandom(64 * 1024)]
+        data = b''.join(bufs)
+
+        fd = os.open(filename, os.O_RDWR|os.O_CREAT)
+
+        # When the interception library handles this file each vector
+        # should go to the IONSS as one RPC, so the CNSS sees no reads
+        # or writes at all.
+        ioil = self.ioil_handle()
+        bypass = (ioil is not None and
+                  ioil.iof_get_bypass_status(fd) == IOF_IO_BYPASS)
+        if bypass:
+            reads = self.projection_stat('read')
+            writes = self.projection_stat('write')
+
+        written = os.pwritev(fd, bufs, 8192)
+        if written != len(data):
+            self.fail("Short pwritev %d" % written)
+
+        rbufs = [bytearray(len(b)) for b in reversed(bufs)]
+        read = os.preadv(fd, rbufs, 8192)
+        if read != len(data):
+            self.fail("Short preadv %d" % read)
+        if b''.join(rbufs) != data:
+            self.fail("preadv data incorrect")
+
+        # Reading across the end of file returns the bytes up to it.
+        rbufs = [bytearray(4096), bytearray(4096)]
+        read = os.preadv(fd, rbufs, 8192 + len(data) - 4096)
+        if read != 4096 or bytes(rbufs[0]) != data[-4096:]:
+            self.fail("preadv at end of file incorrect %d" % read)
+
+        if bypass:
+            if self.projection_stat('read') != reads:
+                self.fail("preadv was not sent by the interception library")
+            if self.projection_stat('write') != writes:
+                self.fail("pwritev was not sent by the interception library")
+
+        os.close(fd)
+
+        with open(filename, 'rb') as f:
+            f.seek(8192)
+            if f.read() != data:
+                self.fail("File contents incorrect")
+
+        os.unlink(filename)
+
+    def test_file_xtvec(self):
+        """Strided extent read and write with iof_preadx and iof_pwritex"""
+
+        ioil = self.ioil_handle()
+        if ioil is None:
+            self.skipTest("Interception library not loaded")
+
+        class IofXtvec(ctypes.Structure):
+            """struct iof_xtvec"""
+            _fields_ = [('xt_off', ctypes.c_uint64),
+                        ('xt_len', ctypes.c_uint64)]
+
+        class Iovec(ctypes.Structure):
+            """struct iovec"""
+            _fields_ = [('iov_base', ctypes.c_void_p),
+                        ('iov_len', ctypes.c_size_t)]
+
+        ioil.iof_preadx.restype = ctypes.c_ssize_t
+        ioil.iof_pwritex.restype = ctypes.c_ssize_t
+
+        filename = os.path.join(self.import_dir, 'xtvec_file')
+
+        # Eight 4k extents at a 12k stride, packed into two buffers.
+        count = 8
+        size = 4096
+        stride = 3 * size
+        data = os.urandom(count * size)
+        half = len(data) // 2
+
+        xtvec = (IofXtvec * count)()
+        for i in range(count):
+            xtvec[i].xt_off = i * stride
+            xtvec[i].xt_len = size
+
+        wbuf = ctypes.create_string_buffer(data, len(data))
+        iov = (Iovec * 2)()
+        iov[0].iov_base = ctypes.addressof(wbuf)
+        iov[0].iov_len = half
+        iov[1].iov_base = ctypes.addressof(wbuf) + half
+        iov[1].iov_len = len(data) - half
+
+        fd = os.open(filename, os.O_RDWR|os.O_CREAT|os.O_TRUNC)
+
+        bypass = ioil.iof_get_bypass_status(fd) == IOF_IO_BYPASS
+        if bypass:
+            reads = self.projection_stat('read')
+            writes = self.projection_stat('write')
+
+        written = ioil.iof_pwritex(fd, iov, 2, xtvec, count)
+        if written != len(data):
+            self.fail("Short iof_pwritex %d errno %d" %
+                      (written, ctypes.get_errno()))
+
+        rbuf = ctypes.create_string_buffer(len(data))
+        iov[0].iov_base = ctypes.addressof(rbuf)
+        iov[1].iov_base = ctypes.addressof(rbuf) + half
+        read = ioil.iof_preadx(fd, iov, 2, xtvec, count)
+        if read != len(data):
+            self.fail("Short iof_preadx %d errno %d" %
+                      (read, ctypes.get_errno()))
+        if rbuf.raw != data:
+            self.fail("iof_preadx data incorrect")
+
+        if bypass:
+            if self.projection_stat('read') != reads:
+                self.fail("iof_preadx was not sent by the "
+                          "interception library")
+            if self.projection_stat('write') != writes:
+                self.fail("iof_pwritex was not sent by the "
+                          "interception library")
+
+        os.close(fd)
+
+        # Check the extents landed at the right offsets and the gaps
+        # between them read back as zeros.
+        with open(filename, 'rb') as f:
+            contents = f.read()
+        if len(contents) != (count - 1) * stride + size:
+            self.fail("File size incorrect %d" % len(contents))
+        for i in range(count):
+            extent = contents[i * stride:i * stride + size]
+            if extent != data[i * size:(i + 1) * size]:
+                self.fail("Extent %d incorrect" % i)
+            gap = contents[i * stride + size:(i + 1) * stride]
+            if gap.strip(b'\0'):
+                self.fail("Gap after extent %d not zero" % i)
+
+        os.unlink(filename)
+
     def test_file_ftruncate(self):
         """Truncate a file"""
 
@@ -94,6 +94,10 @@ except ImportError:
 valgrind_cnss_only = False
 use_fixed_paths = False
 
+# Fault injection id for failing the batched inode migrate result push, see
+# IONSS_FI_IMIGRATE_PUT in ionss.h
+IONSS_FI_IMIGRATE_PUT = 100
+
 def unlink_file(file_name):
     """Unlink a file without failing if it doesn't exist"""
 
@@ -132,6 +136,8 @@ class Testlocal(unittest.TestCase,
     mount_dirs = []
     cnss_stats = {}
     ionss_config_file = None
+    ionss_fi_file = None
+    ionss_fault = None
     log_path = None
     internals_tracing = False
     ionss_count = 3
@@ -213,6 +219,8 @@ class Testlocal(unittest.TestCase,
         if test_name.split('.')[2].startswith('test_failover'):
             self.failover_test = True
             valgrind_cnss_only = True
+        if test_name.split('.')[2] == 'test_failover_imigrate_fail':
+            self.ionss_fault = IONSS_FI_IMIGRATE_PUT
 
         # set the standalone test flag
         self.test_local = True
@@ -352,6 +360,20 @@ class Testlocal(unittest.TestCase,
         unlink_file(ionss_file)
         cmd.extend(['-x', 'D_LOG_FILE=%s' % ionss_file])
 
+        if self.ionss_fault is not None:
+            fi_config = {'fault_config': [{'id': self.ionss_fault,
+                                           'interval': 1,
+                                           'max_faults': 1}]}
+            fi_file = tempfile.NamedTemporaryFile(suffix='.yaml',
+                                                  prefix='ionss_fi_',
+                                                  dir=export_tmp_dir,
+                                                  mode='w',
+                                                  delete=False)
+            self.ionss_fi_file = fi_file.name
+            yaml.dump(fi_config, fi_file.file, default_flow_style=False)
+            fi_file.close()
+            cmd.extend(['-x', 'D_FI_CONFIG=%s' % self.ionss_fi_file])
+
         if self.ionss_valgrind:
             cmd.extend(valgrind)
         if jdata:
@@ -720,6 +742,8 @@ class Testlocal(unittest.TestCase,
         # Finally, remove any temporary files created.
         os.unlink(os.path.join(self.cnss_prefix, 'IONSS.attach_info_tmp'))
         os.unlink(self.ionss_config_file)
+        if self.ionss_fi_file:
+            os.unlink(self.ionss_fi_file)
         os.rmdir(self.cnss_prefix)
         shutil.rmtree(self.export_dir)
 
@@ -1374,6 +1398,38 @@ class Testlocal(unittest.TestCase,
         self.kill_ionss_proc()
         os.fstat(fd)
 
+    def test_failover_imigrate_fail(self):
+        """Test failover when the batched inode migrate fails"""
+
+        # The IONSS is started with a fault injected so that pushing the
+        # results of the first batched inode migrate fails.  The open file
+        # goes offline, but the handle resolved for it on the new server
+        # must be released cleanly, so that a second link to the same inode
+        # can be looked up and used.
+
+        create_file(self.export_dir, 'tfile')
+        os.link(os.path.join(self.export_dir, 'tfile'),
+                os.path.join(self.export_dir, 'tlink'))
+
+        fd = os.open(os.path.join(self.import_dir, 'tfile'), os.O_RDONLY)
+        os.fstat(fd)
+
+        self.kill_ionss_proc()
+
+        try:
+            os.fstat(fd)
+        except OSError as e:
+            self.logger.info("fstat of migrated file returned errno %d '%s'",
+                             e.errno, e.strerror)
+        os.close(fd)
+
+        for i in range(0, 2):
+            print("Loop %d" % i)
+            fd = os.open(os.path.join(self.import_dir, 'tlink'), os.O_RDONLY)
+            print(os.fstat(fd))
+            os.read(fd, 16)
+            os.close(fd)
+
     def ft_stat_helper(self, fsid, outcomes):
         """Helper function for trying stat on projection
 